@@ -34,6 +34,7 @@ set_if_true (BUILD_UNIT_TESTS UNIT_TEST)
 set_if_true (BUILD_PIGLET PIGLET)
 set_if_true (ENABLE_PROFILE PROFILE)
 set_if_true (ENABLE_SHELL BUILD_SHELL)
+set_if_true (ENABLE_POOL_ALLOCATOR POOL_ALLOCATOR)
 set_if_true (BUILD_PIGLET PIGLET)
 set_if_true (STATIC_PIGLETS STATIC_PIGLETS)
 
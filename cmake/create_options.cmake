@@ -21,6 +21,7 @@ option (ENABLE_SHELL "enable shell support" OFF)
 option (ENABLE_COREFILES "Prevent Snort from generating core files" ON)
 option (ENABLE_INTEL_SOFT_CPM "Enable Intel Soft CPM support" OFF)
 option (ENABLE_LARGE_PCAP "Enable support for pcaps larger than 2 GB" OFF)
+option (ENABLE_POOL_ALLOCATOR "Use the size class pool allocator for new and delete" OFF)
 option (ENABLE_ADDRESS_SANITIZER "enable address sanitizer support" OFF)
 option (ENABLE_CODE_COVERAGE "Whether to enable code coverage support" OFF)
 option (BUILD_SHELL "Build the command line shell" OFF)
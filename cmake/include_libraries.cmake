@@ -17,3 +17,6 @@ find_package(DBLATEX QUIET)
 find_package(Ruby QUIET 1.8.7)
 find_package(HS QUIET)
 
+# shm_open is in librt on older glibc
+find_library(RT_LIBRARY rt)
+
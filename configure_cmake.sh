@@ -35,6 +35,7 @@ Optional Features:
     --enable-linux-smp-stats Enable statistics reporting through proc
     --enable-debug-msgs      Enable debug printing options (bugreports and developers only)
     --enable-large-pcap      Enable support for pcaps larger than 2 GB
+    --enable-pool-allocator  Use the size class pool allocator for new and delete
     --enable-address-sanitizer  Enable address sanitizer support
     --enable-code-coverage   Whether to enable code coverage support
     --enable-debug           Enable debugging options (bugreports and developers only)
@@ -224,6 +225,12 @@ while [ $# -ne 0 ]; do
         --enable-large-pcap)
             append_cache_entry ENABLE_LARGE_PCAP    BOOL   true
             ;;
+        --enable-pool-allocator)
+            append_cache_entry ENABLE_POOL_ALLOCATOR    BOOL   true
+            ;;
+        --disable-pool-allocator)
+            append_cache_entry ENABLE_POOL_ALLOCATOR    BOOL   false
+            ;;
         --enable-address-sanitizer)
             append_cache_entry ENABLE_ADDRESS_SANITIZER BOOL    true
             ;;
@@ -54,6 +54,7 @@ typedef struct {
     int stop;
     int eof;
     int dlt;
+    int cksum_good;
 
     unsigned snaplen;
     unsigned idx;
@@ -174,6 +175,7 @@ static int unescape(char c, char* u)
 // $packet -> server
 // $client <addr> <port>
 // $server <addr> <port>
+// $checksum good|none
 static void parse_command(FileImpl* impl, char* s)
 {
     if ( !strncmp(s, "packet -> client", 16) )
@@ -190,6 +192,9 @@ static void parse_command(FileImpl* impl, char* s)
 
     else if ( !strncmp(s, "server ", 7) )
         parse_host(s+7, &impl->cfg.dst_addr, &impl->cfg.dst_port);
+
+    else if ( !strncmp(s, "checksum ", 9) )
+        impl->cksum_good = !strncmp(s+9, "good", 4);
 }
 
 // load quoted string data into buffer up to snaplen
@@ -364,6 +369,12 @@ static void set_pkt_hdr(FileImpl* impl, DAQ_PktHdr_t* phdr, ssize_t len)
     phdr->address_space_id = 0;
     phdr->opaque = 0;
 
+#ifdef DAQ_PKT_FLAG_HW_TCP_CS_GOOD
+    // emulate nic checksum offload
+    if ( impl->cksum_good )
+        phdr->flags |= DAQ_PKT_FLAG_HW_TCP_CS_GOOD;
+#endif
+
     if ( impl->dlt != DLT_USER )
     {
         phdr->priv_ptr = NULL;
@@ -48,9 +48,10 @@ end
 
 -- eval() is required
 -- eval must return a bool (match == true)
-function eval ()
+-- ptr is the current buffer; ffi.C.get_buffer() returns the same
+function eval (ptr)
     -- buf is a luajit cdata
-    local buf = ffi.C.get_buffer()
+    local buf = ffi.cast("const struct SnortBuffer*", ptr)
 
     -- str is a lua string
     local str = ffi.string(buf.data, buf.len)
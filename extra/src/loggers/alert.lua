@@ -16,7 +16,8 @@
 --
 --     lualert =
 --     {
---         args = "num = 1, str = 'bar', cond = true"
+--         args = "num = 1, str = 'bar', cond = true",
+--         batch = 16  -- optional, use alert_batch() if defined
 --     }
 --
 -- the arg string is (in general) optional
@@ -57,6 +58,19 @@ function alert ()
         evt.gid, evt.sid, evt.rev, str))
 end
 
+-- alert_batch() is optional
+-- if present and batch > 1 is configured, it is called instead of
+-- alert() with up to batch events at a time
+function alert_batch (n, ptr)
+    local a = ffi.cast("const struct SnortAlert*", ptr)
+
+    for i = 0, n - 1 do
+        local evt = a[i].event
+        print(string.format('%d:%d:%d %s',
+            evt.gid, evt.sid, evt.rev, ffi.string(evt.msg)))
+    end
+end
+
 -- plugin table is required
 plugin =
 {
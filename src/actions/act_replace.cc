@@ -23,15 +23,26 @@
 #include "config.h"
 #endif
 
+#include <string.h>
+
 #include <string>
 
+#include "main/snort_config.h"
 #include "main/snort_types.h"
 #include "main/snort_debug.h"
+#include "codecs/ip/checksum.h"
 #include "framework/ips_action.h"
 #include "framework/module.h"
+#include "protocols/layer.h"
 #include "protocols/packet.h"
+#include "protocols/tcp.h"
+#include "protocols/udp.h"
 #include "packet_io/active.h"
 
+#ifdef UNIT_TEST
+#include "catch/catch.hpp"
+#endif
+
 #define s_name "rewrite"
 
 #define s_help \
@@ -72,7 +83,49 @@ void Replace_QueueChange(const std::string& s, unsigned off)
     r->offset = off;
 }
 
-static inline void Replace_ApplyChange(Packet* p, Replacement* r)
+// the checksum covering the payload can be adjusted in place (RFC 1624)
+// if it was verified good when decoded, only earlier rewrites have
+// modified the packet, and no outer udp header also covers it.  otherwise
+// encode_update() must recompute it (which also fixes a bad checksum).
+struct L4Cksum
+{
+    uint16_t* sum;
+    const uint8_t* start;
+    bool udp;
+};
+
+static bool Replace_GetCksum(Packet* p, L4Cksum& c)
+{
+    if ( (p->packet_flags & PKT_MODIFIED) and !(p->packet_flags & PKT_CKSUM_CURRENT) )
+        return false;
+
+    if ( p->is_rebuilt() or p->is_cooked() or p->is_fragment() or
+        (p->ptrs.decode_flags & DECODE_ERR_CKSUM_ALL) )
+        return false;
+
+    const udp::UDPHdr* outer_udp = layer::get_outer_udp_lyr(p);
+
+    if ( p->is_tcp() and p->ptrs.tcph and !outer_udp and SnortConfig::tcp_checksums() )
+    {
+        tcp::TCPHdr* h = const_cast<tcp::TCPHdr*>(p->ptrs.tcph);
+        c.sum = &h->th_sum;
+        c.start = (const uint8_t*)h;
+        c.udp = false;
+        return true;
+    }
+    if ( p->is_udp() and p->ptrs.udph and outer_udp == p->ptrs.udph and p->ptrs.udph->uh_chk and
+        SnortConfig::udp_checksums() )
+    {
+        udp::UDPHdr* h = const_cast<udp::UDPHdr*>(p->ptrs.udph);
+        c.sum = &h->uh_chk;
+        c.start = (const uint8_t*)h;
+        c.udp = true;
+        return true;
+    }
+    return false;
+}
+
+static inline void Replace_ApplyChange(Packet* p, Replacement* r, L4Cksum* c)
 {
     uint8_t* start = (uint8_t*)p->data + r->offset;
     const uint8_t* end = p->data + p->dsize;
@@ -83,7 +136,31 @@ static inline void Replace_ApplyChange(Packet* p, Replacement* r)
     else
         len = r->data.size();
 
+    if ( !c )
+    {
+        memcpy(start, r->data.c_str(), len);
+        return;
+    }
+
+    // widen to whole 16 bit words counted from the start of the l4 header
+    const uint8_t* lo = c->start + ((start - c->start) & ~1);
+    const uint8_t* hi = c->start + ((start + len - c->start + 1) & ~1);
+
+    if ( hi > end )
+        hi = end;
+
+    // sum the covering words before and after the copy
+    uint16_t old_sum = checksum::cksum_add((const uint16_t*)lo, hi - lo);
     memcpy(start, r->data.c_str(), len);
+    uint16_t new_sum = checksum::cksum_add((const uint16_t*)lo, hi - lo);
+
+    uint16_t sum = checksum::cksum_update(*c->sum, old_sum, new_sum);
+
+    // zero means no checksum for udp
+    if ( c->udp and !sum )
+        sum = 0xffff;
+
+    *c->sum = sum;
 }
 
 static void Replace_ModifyPacket(Packet* p)
@@ -91,11 +168,20 @@ static void Replace_ModifyPacket(Packet* p)
     if ( num_rpl == 0 )
         return;
 
+    L4Cksum cksum;
+    L4Cksum* c = Replace_GetCksum(p, cksum) ? &cksum : nullptr;
+
     for ( int n = 0; n < num_rpl; n++ )
     {
-        Replace_ApplyChange(p, rpl+n);
+        Replace_ApplyChange(p, rpl+n, c);
     }
     p->packet_flags |= PKT_MODIFIED;
+
+    if ( c )
+        p->packet_flags |= PKT_CKSUM_CURRENT;
+    else
+        p->packet_flags &= ~PKT_CKSUM_CURRENT;
+
     num_rpl = 0;
 }
 
@@ -211,3 +297,116 @@ SO_PUBLIC const BaseApi* snort_plugins[] =
 const BaseApi* act_replace = &rep_api.base;
 #endif
 
+
+//-------------------------------------------------------------------------
+// unit tests
+//-------------------------------------------------------------------------
+
+#ifdef UNIT_TEST
+// rewrite the payload at every offset and length, including past the end,
+// and verify the in place checksum against the pseudoheader
+static void rewrite_and_verify(bool udp)
+{
+    const unsigned hlen = udp ? udp::UDP_HEADER_LEN : tcp::TCP_MIN_HEADER_LEN;
+    const unsigned dlen = 37;
+    uint8_t raw[tcp::TCP_MIN_HEADER_LEN + dlen] = { };
+
+    checksum::Pseudoheader ph;
+    ph.sip = 0x0100000a;
+    ph.dip = 0x0200000a;
+    ph.zero = 0;
+    ph.protocol = udp ? 17 : 6;
+    ph.len = htons(hlen + dlen);
+
+    Packet p;
+    p.data = raw + hlen;
+    p.dsize = dlen;
+
+    L4Cksum c;
+    c.start = raw;
+    c.udp = udp;
+    c.sum = udp ? &((udp::UDPHdr*)raw)->uh_chk : &((tcp::TCPHdr*)raw)->th_sum;
+
+    for ( unsigned off = 0; off < dlen; ++off )
+    {
+        for ( unsigned len = 1; len <= dlen + 2 - off; ++len )
+        {
+            for ( unsigned i = 0; i < sizeof(raw); ++i )
+                raw[i] = (uint8_t)(i * 31 + off);
+
+            if ( !udp )
+                ((tcp::TCPHdr*)raw)->th_offx2 = 0x50;
+
+            *c.sum = 0;
+            *c.sum = udp ? checksum::udp_cksum((uint16_t*)raw, hlen + dlen, &ph) :
+                checksum::tcp_cksum((uint16_t*)raw, hlen + dlen, &ph);
+
+            Replacement r;
+            r.data = std::string(len, (char)(0xf0 ^ len));
+            r.offset = off;
+            Replace_ApplyChange(&p, &r, &c);
+
+            const uint16_t verify = udp ?
+                checksum::udp_cksum((uint16_t*)raw, hlen + dlen, &ph) :
+                checksum::tcp_cksum((uint16_t*)raw, hlen + dlen, &ph);
+            CHECK(verify == 0);
+            CHECK(p.data[off] == (uint8_t)(0xf0 ^ len));
+        }
+    }
+}
+
+TEST_CASE("rewrite tcp checksum", "[act_replace]")
+{
+    rewrite_and_verify(false);
+}
+
+TEST_CASE("rewrite udp checksum", "[act_replace]")
+{
+    rewrite_and_verify(true);
+}
+
+TEST_CASE("rewrite udp checksum to zero", "[act_replace]")
+{
+    // choose the new data so the sum is 0xffff; the computed checksum is
+    // then 0, which udp must send as 0xffff
+    const unsigned dlen = 10;
+    uint8_t raw[udp::UDP_HEADER_LEN + dlen];
+
+    for ( unsigned i = 0; i < sizeof(raw); ++i )
+        raw[i] = (uint8_t)(i * 7 + 1);
+
+    checksum::Pseudoheader ph;
+    ph.sip = 0x0100000a;
+    ph.dip = 0x0200000a;
+    ph.zero = 0;
+    ph.protocol = 17;
+    ph.len = htons(sizeof(raw));
+
+    udp::UDPHdr* h = (udp::UDPHdr*)raw;
+    h->uh_chk = 0;
+    h->uh_chk = checksum::udp_cksum((uint16_t*)raw, sizeof(raw), &ph);
+
+    // sum everything but the last word with the checksum field zeroed
+    uint8_t tmp[sizeof(raw)];
+    memcpy(tmp, raw, sizeof(raw));
+    ((udp::UDPHdr*)tmp)->uh_chk = 0;
+    tmp[sizeof(tmp) - 2] = tmp[sizeof(tmp) - 1] = 0;
+    const uint16_t rest = ~checksum::udp_cksum((uint16_t*)tmp, sizeof(tmp), &ph);
+    const uint16_t word = 0xffff - rest;
+
+    Packet p;
+    p.data = raw + udp::UDP_HEADER_LEN;
+    p.dsize = dlen;
+
+    L4Cksum c { &h->uh_chk, raw, true };
+
+    Replacement r;
+    r.data = std::string((const char*)&word, 2);
+    r.offset = dlen - 2;
+    Replace_ApplyChange(&p, &r, &c);
+
+    CHECK(h->uh_chk == 0xffff);
+    CHECK(checksum::udp_cksum((uint16_t*)raw, sizeof(raw), &ph) == 0);
+}
+#endif
+
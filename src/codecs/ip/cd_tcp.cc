@@ -49,6 +49,7 @@ const PegInfo pegs[]
 {
     { "bad checksum (ip4)", "nonzero tcp over ip checksums" },
     { "bad checksum (ip6)", "nonzero tcp over ipv6 checksums" },
+    { "checksum offloaded", "tcp checksums already verified by the daq" },
     { nullptr, nullptr }
 };
 
@@ -56,6 +57,7 @@ struct Stats
 {
     PegCount bad_ip4_cksum;
     PegCount bad_ip6_cksum;
+    PegCount cksum_offloaded;
 };
 
 static THREAD_LOCAL Stats stats;
@@ -132,6 +134,20 @@ private:
 };
 
 static sfip_var_t* SynToMulticastDstIp = NULL;
+
+// the nic only validates the outermost tcp header so tunneled and
+// rebuilt packets are always checked here
+static inline bool hw_cksum_good(const RawData& raw, const CodecData& codec)
+{
+#ifdef DAQ_PKT_FLAG_HW_TCP_CS_GOOD
+    return (raw.pkth->flags & DAQ_PKT_FLAG_HW_TCP_CS_GOOD) and
+        codec.ip_layer_cnt == 1 and !codec.is_cooked();
+#else
+    UNUSED(raw);
+    UNUSED(codec);
+    return false;
+#endif
+}
 } // namespace
 
 void TcpCodec::get_protocol_ids(std::vector<uint16_t>& v)
@@ -166,7 +182,10 @@ bool TcpCodec::decode(const RawData& raw, CodecData& codec, DecodeData& snort)
     /* Checksum code moved in front of the other decoder alerts.
        If it's a bad checksum (maybe due to encrypted ESP traffic), the other
        alerts could be false positives. */
-    if ( SnortConfig::tcp_checksums() )
+    if ( SnortConfig::tcp_checksums() and hw_cksum_good(raw, codec) )
+        stats.cksum_offloaded++;
+
+    else if ( SnortConfig::tcp_checksums() )
     {
         uint16_t csum;
         PegCount* bad_cksum_cnt;
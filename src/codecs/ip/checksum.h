@@ -24,6 +24,10 @@
 #include <stdlib.h>
 #include <cstddef>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace checksum
 {
 struct Pseudoheader6
@@ -54,6 +58,12 @@ inline uint16_t icmp_cksum(const uint16_t* buf, std::size_t len, const Pseudohea
 inline uint16_t icmp_cksum(const uint16_t* buf, std::size_t len);
 inline uint16_t ip_cksum(const uint16_t* buf, std::size_t len);
 
+//  adjust an existing checksum for a change in the data it covers.
+//  old_sum and new_sum are cksum_add() of the data before and after the
+//  change, which must start on the same 16 bit word boundary relative to
+//  the start of the checksummed data.
+inline uint16_t cksum_update(uint16_t cksum, uint16_t old_sum, uint16_t new_sum);
+
 /*
  *  NOTE: Since multiple dynamic libraries use checksums, the choice
  *          is to either include all of the checksum details in a header,
@@ -87,84 +97,97 @@ struct Psuedoheader6Union
     };
 };
 
-inline uint16_t cksum_add(const uint16_t* buf, std::size_t len, uint32_t cksum)
+#ifdef __SSE2__
+// sum 64 byte blocks as 32 bit lanes of two independent accumulators.
+// each lane gains at most 4 * 0xffff per block so the lanes are folded into
+// the total every 4096 blocks to stay clear of overflow.  the result is the
+// same as summing words in memory order so no byte swapping is needed.
+inline uint64_t cksum_add_blocks(const uint16_t*& sp, std::size_t& len)
 {
-    const uint16_t* sp = buf;
-    std::size_t n, sn;
+    const __m128i mask = _mm_set1_epi32(0xffff);
+    const __m128i* p = reinterpret_cast<const __m128i*>(sp);
+    std::size_t blocks = len / 64;
+    uint64_t sum = 0;
+
+    len &= 63;
 
-    if (len > 1 )
+    while ( blocks )
     {
-        sn = ((len / 2) & 0xF);  // == len/2 % 16
-        n = (((len / 2) + 15) / 16);   // ceiling of (len / 2) / 16
+        std::size_t n = (blocks < 4096) ? blocks : 4096;
+        __m128i a0 = _mm_setzero_si128();
+        __m128i a1 = _mm_setzero_si128();
+        blocks -= n;
 
-        switch (sn)
+        while ( n-- )
         {
-        case 0:
-            sn = 16;
-            cksum += sp[15];
-        case 15:
-            cksum += sp[14];
-        case 14:
-            cksum += sp[13];
-        case 13:
-            cksum += sp[12];
-        case 12:
-            cksum += sp[11];
-        case 11:
-            cksum += sp[10];
-        case 10:
-            cksum += sp[9];
-        case 9:
-            cksum += sp[8];
-        case 8:
-            cksum  += sp[7];
-        case 7:
-            cksum += sp[6];
-        case 6:
-            cksum += sp[5];
-        case 5:
-            cksum += sp[4];
-        case 4:
-            cksum += sp[3];
-        case 3:
-            cksum += sp[2];
-        case 2:
-            cksum += sp[1];
-        case 1:
-            cksum += sp[0];
+            const __m128i v0 = _mm_loadu_si128(p);
+            const __m128i v1 = _mm_loadu_si128(p + 1);
+            const __m128i v2 = _mm_loadu_si128(p + 2);
+            const __m128i v3 = _mm_loadu_si128(p + 3);
+
+            a0 = _mm_add_epi32(a0, _mm_and_si128(v0, mask));
+            a1 = _mm_add_epi32(a1, _mm_srli_epi32(v0, 16));
+            a0 = _mm_add_epi32(a0, _mm_and_si128(v1, mask));
+            a1 = _mm_add_epi32(a1, _mm_srli_epi32(v1, 16));
+            a0 = _mm_add_epi32(a0, _mm_and_si128(v2, mask));
+            a1 = _mm_add_epi32(a1, _mm_srli_epi32(v2, 16));
+            a0 = _mm_add_epi32(a0, _mm_and_si128(v3, mask));
+            a1 = _mm_add_epi32(a1, _mm_srli_epi32(v3, 16));
+            p += 4;
         }
-        sp += sn;
+        // lanes are < 2^31 so a0 + a1 cannot overflow; widen to 64 bits
+        __m128i acc = _mm_add_epi32(a0, a1);
+        acc = _mm_add_epi64(
+            _mm_unpacklo_epi32(acc, _mm_setzero_si128()),
+            _mm_unpackhi_epi32(acc, _mm_setzero_si128()));
+        acc = _mm_add_epi64(acc, _mm_srli_si128(acc, 8));
+        sum += (uint32_t)_mm_cvtsi128_si32(acc);
+        sum += (uint64_t)(uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 4)) << 32;
+    }
+    sp = reinterpret_cast<const uint16_t*>(p);
+    return sum;
+}
+#endif
 
-        /* XXX - unroll loop using Duff's device. */
-        while (--n > 0)
-        {
-            cksum += sp[0];
-            cksum += sp[1];
-            cksum += sp[2];
-            cksum += sp[3];
-            cksum += sp[4];
-            cksum += sp[5];
-            cksum += sp[6];
-            cksum += sp[7];
-            cksum += sp[8];
-            cksum += sp[9];
-            cksum += sp[10];
-            cksum += sp[11];
-            cksum += sp[12];
-            cksum += sp[13];
-            cksum += sp[14];
-            cksum += sp[15];
-            sp += 16;
-        }
+inline uint16_t cksum_add(const uint16_t* buf, std::size_t len, uint32_t cksum)
+{
+    const uint16_t* sp = buf;
+    uint64_t sum = cksum;
+
+#ifdef __SSE2__
+    if ( len >= 64 )
+        sum += cksum_add_blocks(sp, len);
+#endif
+
+    while ( len > 15 )
+    {
+        sum += sp[0];
+        sum += sp[1];
+        sum += sp[2];
+        sum += sp[3];
+        sum += sp[4];
+        sum += sp[5];
+        sum += sp[6];
+        sum += sp[7];
+        sp += 8;
+        len -= 16;
+    }
+
+    while ( len > 1 )
+    {
+        sum += *sp++;
+        len -= 2;
     }
 
     if (len & 1)
-        cksum += (*(unsigned char*)sp);
+        sum += (*(const unsigned char*)sp);
 
-    cksum  = (cksum >> 16) + (cksum & 0x0000ffff);
-    cksum += (cksum >> 16);
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 16) + (sum & 0x0000ffff);
+    sum = (sum >> 16) + (sum & 0x0000ffff);
+    sum += (sum >> 16);
 
-    return (uint16_t)(~cksum);
+    return (uint16_t)(~sum);
 }
 
 inline void add_ipv4_pseudoheader(const Pseudoheader* const ph4,
@@ -340,6 +363,21 @@ inline uint16_t ip_cksum(const uint16_t* buf, std::size_t len)
 
 inline uint16_t cksum_add(const uint16_t* buf, std::size_t len)
 { return detail::cksum_add(buf, len, 0); }
+
+// RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m') where m and m' are the sums of
+// the old and new data.  cksum_add() returns the complemented sum so ~m
+// comes directly from it.
+inline uint16_t cksum_update(uint16_t cksum, uint16_t old_sum, uint16_t new_sum)
+{
+    uint32_t sum = (uint16_t)~cksum;
+    sum += old_sum;
+    sum += (uint16_t)~new_sum;
+
+    sum = (sum >> 16) + (sum & 0x0000ffff);
+    sum += (sum >> 16);
+
+    return (uint16_t)(~sum);
+}
 } // namespace checksum
 
 #endif  /* CODECS_CHECKSUM_H */
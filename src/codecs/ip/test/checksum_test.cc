@@ -0,0 +1,189 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2015-2016 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// checksum_test.cc
+// unit tests for the vectorized checksum and incremental update
+
+#include <CppUTest/CommandLineTestRunner.h>
+#include <CppUTest/TestHarness.h>
+
+#include <string.h>
+
+#include <vector>
+
+#include "codecs/ip/checksum.h"
+
+// straightforward RFC 1071 sum over bytes in memory order
+static uint16_t ref_cksum(const uint8_t* buf, size_t len, uint32_t seed = 0)
+{
+    uint64_t sum = seed;
+
+    while ( len > 1 )
+    {
+        uint16_t w;
+        memcpy(&w, buf, 2);
+        sum += w;
+        buf += 2;
+        len -= 2;
+    }
+    if ( len )
+        sum += *buf;
+
+    while ( sum >> 16 )
+        sum = (sum >> 16) + (sum & 0xffff);
+
+    return (uint16_t)~sum;
+}
+
+static void fill(std::vector<uint8_t>& v, unsigned seed)
+{
+    for ( auto& b : v )
+    {
+        seed = seed * 1103515245 + 12345;
+        b = seed >> 16;
+    }
+}
+
+TEST_GROUP(checksum) { };
+
+TEST(checksum, lengths_and_offsets)
+{
+    std::vector<uint8_t> buf(1024 + 16);
+    fill(buf, 1);
+
+    // odd offsets give unaligned 16 bit loads; the sum is still in memory order
+    for ( size_t off = 0; off < 4; ++off )
+    {
+        for ( size_t len = 0; len <= 1024; ++len )
+        {
+            const uint8_t* p = buf.data() + off;
+            CHECK(checksum::cksum_add((const uint16_t*)p, len) == ref_cksum(p, len));
+        }
+    }
+}
+
+TEST(checksum, long_buffers)
+{
+    // more than 4096 64 byte blocks of 0xff stresses the lane folding
+    for ( size_t len : { 64 * 4096 - 1, 64 * 4096, 64 * 4096 + 65, 64 * 9000 + 3 } )
+    {
+        std::vector<uint8_t> ones(len, 0xff);
+        CHECK(checksum::cksum_add((const uint16_t*)ones.data(), len) ==
+            ref_cksum(ones.data(), len));
+
+        std::vector<uint8_t> buf(len + 1);
+        fill(buf, len);
+        const uint8_t* p = buf.data() + 1;
+        CHECK(checksum::cksum_add((const uint16_t*)p, len) == ref_cksum(p, len));
+    }
+}
+
+TEST(checksum, extreme_results)
+{
+    for ( size_t len : { 2, 20, 64, 130, 1500 } )
+    {
+        // all zeros sums to 0 so the checksum is 0xffff
+        std::vector<uint8_t> zeros(len, 0);
+        CHECK(checksum::cksum_add((const uint16_t*)zeros.data(), len) == 0xffff);
+
+        // all ones sums to 0xffff (negative zero) so the checksum is 0
+        std::vector<uint8_t> ones(len, 0xff);
+        CHECK(checksum::cksum_add((const uint16_t*)ones.data(), len) == 0x0000);
+
+        // a buffer with its own checksum inserted verifies to 0
+        std::vector<uint8_t> buf(len);
+        fill(buf, len);
+        buf[0] = buf[1] = 0;
+        uint16_t sum = checksum::cksum_add((const uint16_t*)buf.data(), len);
+        memcpy(buf.data(), &sum, 2);
+        CHECK(checksum::cksum_add((const uint16_t*)buf.data(), len) == 0);
+    }
+}
+
+TEST(checksum, ip_header)
+{
+    std::vector<uint8_t> buf(60);
+
+    for ( unsigned seed = 0; seed < 1000; ++seed )
+    {
+        fill(buf, seed);
+        const size_t len = 20 + 4 * (seed % 11);
+        CHECK(checksum::ip_cksum((const uint16_t*)buf.data(), len) == ref_cksum(buf.data(), len));
+    }
+}
+
+// rewrite bytes at every alignment after a leading checksum field and fold
+// the change in with cksum_update() the same way act_replace does.  the
+// second word stands in for the pseudoheader, which is never all zero, so
+// the result must equal a full recompute.
+TEST(checksum, incremental_update)
+{
+    std::vector<uint8_t> buf(97);
+
+    for ( unsigned seed = 0; seed < 30000; ++seed )
+    {
+        fill(buf, seed);
+        const size_t len = 5 + seed % 93;
+        const size_t at = 4 + (seed / 3) % (len - 4);
+        const size_t n = 1 + (seed / 7) % (len - at);
+
+        buf[0] = buf[1] = 0;
+        buf[2] = (seed & 1) ? 0xff : 0x00;
+        buf[3] = (seed & 1) ? 0xff : 0x06;
+
+        uint16_t cksum = checksum::cksum_add((const uint16_t*)buf.data(), len);
+        memcpy(buf.data(), &cksum, 2);
+
+        const size_t lo = at & ~1;
+        size_t hi = (at + n + 1) & ~1;
+        if ( hi > len )
+            hi = len;
+
+        const uint16_t* p = (const uint16_t*)(buf.data() + lo);
+        const uint16_t old_sum = checksum::cksum_add(p, hi - lo);
+
+        // zeros and ones drive the sums to their extremes
+        switch ( seed % 3 )
+        {
+        case 0:
+            for ( size_t i = 0; i < n; ++i )
+                buf[at + i] ^= (uint8_t)(seed + i);
+            break;
+        case 1:
+            memset(buf.data() + at, 0, n);
+            break;
+        case 2:
+            memset(buf.data() + at, 0xff, n);
+            break;
+        }
+
+        const uint16_t new_sum = checksum::cksum_add(p, hi - lo);
+        cksum = checksum::cksum_update(cksum, old_sum, new_sum);
+
+        buf[0] = buf[1] = 0;
+        CHECK(cksum == checksum::cksum_add((const uint16_t*)buf.data(), len));
+
+        memcpy(buf.data(), &cksum, 2);
+        CHECK(checksum::cksum_add((const uint16_t*)buf.data(), len) == 0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
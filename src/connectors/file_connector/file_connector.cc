@@ -90,7 +90,7 @@ ConnectorMsgHandle* FileConnector::alloc_message(const uint32_t length, const ui
 void FileConnector::discard_message(ConnectorMsgHandle* msg)
 {
     DebugMessage(DEBUG_CONNECTORS,"FileConnector::discard_message()\n");
-    delete msg;
+    delete (FileConnectorMsgHandle*)msg;
 }
 
 bool FileConnector::transmit_message(ConnectorMsgHandle* msg)
@@ -123,6 +123,8 @@ bool FileConnector::transmit_message(ConnectorMsgHandle* msg)
         file.write( (const char*)fmsg->connector_msg.data, fmsg->connector_msg.length);
     }
 
+    // transmitted messages are consumed as with other connectors
+    delete fmsg;
     return true;
 }
 
@@ -143,6 +145,18 @@ ConnectorMsgHandle* FileConnector::receive_message_binary()
         return nullptr;
     }
 
+    // A length outside the buffer can't be a valid message; skip its
+    // content so the following message can still be read
+    if ( fc_hdr->connector_msg_length < sizeof(SCMsgHdr) or
+        fc_hdr->connector_msg_length > MAXIMUM_SC_MESSAGE_CONTENT + sizeof(SCMsgHdr) )
+    {
+        if ( fc_hdr->connector_msg_length > sizeof(SCMsgHdr) )
+            file.ignore(fc_hdr->connector_msg_length - sizeof(SCMsgHdr));
+
+        delete[] buffer;
+        return nullptr;
+    }
+
     // Now read the SC message content
     file.read((char*)(buffer+sizeof(FileConnectorMsgHdr)+sizeof(SCMsgHdr)),
         (fc_hdr->connector_msg_length - sizeof(SCMsgHdr)));
@@ -64,6 +64,10 @@ FileConnectorModule::~FileConnectorModule()
     DebugMessage(DEBUG_CONNECTORS,"FileConnectorModule::~FileConnectorModule()\n");
     if ( config )
         delete config;
+
+    for ( auto cfg : config_set )
+        delete cfg;
+
     config_set.clear();
 }
 
@@ -119,8 +123,10 @@ bool FileConnectorModule::set(const char* fqn, Value& v, SnortConfig*)
 FileConnectorConfig::FileConnectorConfigSet FileConnectorModule::get_and_clear_config()
 {
     DebugMessage(DEBUG_CONNECTORS,"FileConnectorModule::get_and_clear_config()\n");
+    FileConnectorConfig::FileConnectorConfigSet temp = config_set;
     config = nullptr;
-    return config_set;
+    config_set.clear();
+    return temp;
 }
 
 bool FileConnectorModule::begin(const char* fqn, int idx, SnortConfig*)
@@ -148,8 +154,7 @@ bool FileConnectorModule::end(const char* fqn, int idx, SnortConfig*)
 
     if (idx != 0)
     {
-        config_set.push_back(*config);
-        delete config;
+        config_set.push_back(config);
         config = nullptr;
     }
 
@@ -0,0 +1,463 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2016-2016 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// shm_connector.cc
+
+#include "shm_connector.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "log/messages.h"
+#include "main/snort_debug.h"
+#include "main/thread.h"
+#include "shm_connector_module.h"
+#include "utils/util.h"
+
+// how long to wait for the peer to finish creating the ring
+#define SHM_ATTACH_TRIES 1000
+#define SHM_ATTACH_USEC  1000
+
+static inline uint64_t record_size(uint32_t length)
+{ return sizeof(ShmRecord) + ((length + 7) & ~(uint64_t)7); }
+
+ShmConnectorCommon::ShmConnectorCommon(ShmConnectorConfig::ShmConnectorConfigSet conf)
+{
+    for ( auto cfg : conf )
+        config_set.push_back(cfg);
+}
+
+ShmConnector::ShmConnector(ShmConnectorConfig* cfg)
+{
+    config = cfg;
+    ring = nullptr;
+    data = nullptr;
+    mask = 0;
+    size = 0;
+    map_size = 0;
+    end = (cfg->direction == Connector::CONN_TRANSMIT) ? 0 : 1;
+    rx_pos = 0;
+    memset(&tx_msg.connector_msg, 0, sizeof(tx_msg.connector_msg));
+    memset(&rx_msg.connector_msg, 0, sizeof(rx_msg.connector_msg));
+}
+
+// the last end to detach removes the ring
+ShmConnector::~ShmConnector()
+{
+    if ( !ring )
+        return;
+
+    ring->pid[end].store(0);
+    bool last = !peer_alive();
+
+    munmap(ring, map_size);
+
+    if ( last )
+        shm_unlink(name.c_str());
+}
+
+static bool is_alive(int32_t pid)
+{ return pid > 0 and (!kill(pid, 0) or errno == EPERM); }
+
+bool ShmConnector::peer_alive() const
+{ return is_alive(ring->pid[end ^ 1].load()); }
+
+// either end may create the ring; the other waits for it to be ready.
+// a ring with no live process attached was left by a prior run that
+// didn't exit cleanly so it is removed and created again.
+bool ShmConnector::attach(const std::string& shm_name)
+{
+    name = shm_name;
+
+    MapResult res = map_ring();
+
+    if ( res == RING_STALE )
+    {
+        shm_unlink(name.c_str());
+        res = map_ring();
+    }
+    if ( res == RING_OK )
+        return true;
+
+    if ( res == RING_STALE )
+        ErrorMessage("%s: can't replace stale %s\n", SHM_CONNECTOR_NAME, name.c_str());
+
+    return false;
+}
+
+ShmConnector::MapResult ShmConnector::map_ring()
+{
+    const ShmConnectorConfig* cfg = (const ShmConnectorConfig*)config;
+    const size_t hdr_size = (sizeof(ShmRingHeader) + 4095) & ~(size_t)4095;
+    map_size = hdr_size + cfg->ring_size;
+
+    bool creator = true;
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if ( fd < 0 and errno == EEXIST )
+    {
+        creator = false;
+        fd = shm_open(name.c_str(), O_RDWR, 0600);
+    }
+    if ( fd < 0 )
+    {
+        ErrorMessage("%s: can't open %s: %s\n", SHM_CONNECTOR_NAME,
+            name.c_str(), get_error(errno));
+        return RING_BAD;
+    }
+
+    // map what is there so a mismatched peer can be checked for liveness
+    size_t len = map_size;
+    bool ok = true;
+
+    if ( creator )
+        ok = !ftruncate(fd, map_size);
+    else
+    {
+        struct stat st;
+        unsigned tries = 0;
+
+        while ( (ok = !fstat(fd, &st)) and !st.st_size and ++tries < SHM_ATTACH_TRIES )
+            usleep(SHM_ATTACH_USEC);
+
+        // a creator that died before sizing the ring leaves it empty
+        if ( ok and (size_t)st.st_size < hdr_size )
+        {
+            close(fd);
+            return RING_STALE;
+        }
+        len = st.st_size;
+    }
+
+    void* p = ok ? mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if ( p == MAP_FAILED )
+    {
+        ErrorMessage("%s: can't map %s: %s\n", SHM_CONNECTOR_NAME,
+            name.c_str(), get_error(errno));
+        return RING_BAD;
+    }
+
+    ring = (ShmRingHeader*)p;
+    data = (uint8_t*)p + hdr_size;
+    mask = cfg->ring_size - 1;
+    size = cfg->ring_size;
+
+    // new mappings are zeroed so the positions start out clear
+    if ( creator )
+    {
+        ring->version = SHM_RING_VERSION;
+        ring->size = cfg->ring_size;
+        ring->pid[end].store(getpid());
+        ring->magic.store(SHM_RING_MAGIC, std::memory_order_release);
+    }
+    else
+    {
+        unsigned tries = 0;
+
+        while ( ring->magic.load(std::memory_order_acquire) != SHM_RING_MAGIC and
+            ++tries < SHM_ATTACH_TRIES )
+            usleep(SHM_ATTACH_USEC);
+
+        MapResult res = RING_OK;
+
+        if ( ring->magic.load() != SHM_RING_MAGIC or !peer_alive() )
+            res = RING_STALE;
+
+        else if ( len != map_size or ring->version != SHM_RING_VERSION or
+            ring->size != cfg->ring_size )
+        {
+            ErrorMessage("%s: %s is not a compatible ring\n", SHM_CONNECTOR_NAME,
+                name.c_str());
+            res = RING_BAD;
+        }
+        if ( res != RING_OK )
+        {
+            munmap(ring, len);
+            ring = nullptr;
+            return res;
+        }
+        ring->pid[end].store(getpid());
+    }
+    rx_pos = ring->tail.load(std::memory_order_acquire);
+
+    DebugFormat(DEBUG_CONNECTORS, "ShmConnector::attach(): %s %s\n",
+        name.c_str(), creator ? "created" : "opened");
+
+    return RING_OK;
+}
+
+// messages are built in place; if the ring is full the caller still gets
+// a buffer but the message is dropped on transmit
+ConnectorMsgHandle* ShmConnector::alloc_message(const uint32_t length, const uint8_t** buf)
+{
+    uint64_t need = record_size(length);
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t idx = head & mask;
+    uint64_t pad = (idx + need > size) ? size - idx : 0;
+
+    if ( need > size / 2 or
+        head + pad + need - ring->tail.load(std::memory_order_acquire) > size )
+    {
+        ShmConnectorMsgHandle* h = new ShmConnectorMsgHandle;
+        h->connector_msg.length = length;
+        h->connector_msg.data = new uint8_t[length];
+        h->dropped = true;
+        *buf = h->connector_msg.data;
+        return h;
+    }
+
+    if ( pad )
+    {
+        ShmRecord* r = (ShmRecord*)(data + idx);
+        r->length = 0;
+        r->flags = SHM_RECORD_PAD;
+        head += pad;
+    }
+
+    ShmRecord* r = (ShmRecord*)(data + (head & mask));
+    r->length = length;
+    r->flags = 0;
+
+    tx_msg.connector_msg.length = length;
+    tx_msg.connector_msg.data = (uint8_t*)(r + 1);
+    tx_msg.next = head + need;
+    tx_msg.dropped = false;
+
+    *buf = tx_msg.connector_msg.data;
+    return &tx_msg;
+}
+
+void ShmConnector::discard_message(ConnectorMsgHandle* msg)
+{
+    ShmConnectorMsgHandle* h = (ShmConnectorMsgHandle*)msg;
+
+    if ( h == &rx_msg )
+    {
+        ring->tail.store(h->next, std::memory_order_release);
+        h->connector_msg.data = nullptr;
+    }
+    else if ( h->dropped )
+    {
+        delete[] h->connector_msg.data;
+        delete h;
+    }
+    // unpublished tx messages are simply overwritten
+}
+
+bool ShmConnector::transmit_message(ConnectorMsgHandle* msg)
+{
+    ShmConnectorMsgHandle* h = (ShmConnectorMsgHandle*)msg;
+
+    if ( h->dropped )
+    {
+        shm_connector_stats.dropped++;
+        discard_message(h);
+        return false;
+    }
+
+    // seq_cst so either the reader sees the new head or we see it waiting
+    ring->head.store(h->next);
+    shm_connector_stats.messages++;
+
+    if ( ring->waiting.load() )
+        wake();
+
+    return true;
+}
+
+ConnectorMsgHandle* ShmConnector::receive_message(bool block)
+{
+    // receiving the next message releases the previous one
+    if ( rx_msg.connector_msg.data )
+        discard_message(&rx_msg);
+
+    while ( true )
+    {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+
+        if ( rx_pos == head )
+        {
+            if ( !block )
+                return nullptr;
+
+            wait(rx_pos);
+            continue;
+        }
+
+        // the record comes from the peer so it must fit in what was
+        // published and not cross the end of the ring
+        uint64_t idx = rx_pos & mask;
+        uint64_t avail = head - rx_pos;
+
+        ShmRecord rec;
+        memcpy(&rec, data + idx, sizeof(rec));
+
+        uint64_t need = (rec.flags & SHM_RECORD_PAD) ? size - idx : record_size(rec.length);
+
+        if ( avail > size or need > avail or idx + need > size )
+        {
+            // there is no way to find the next record so drop what is there
+            shm_connector_stats.corrupt++;
+            rx_pos = head;
+            ring->tail.store(head, std::memory_order_release);
+            continue;
+        }
+
+        if ( rec.flags & SHM_RECORD_PAD )
+        {
+            rx_pos += need;
+            continue;
+        }
+
+        rx_msg.connector_msg.length = rec.length;
+        rx_msg.connector_msg.data = data + idx + sizeof(rec);
+        rx_msg.next = rx_pos + need;
+        rx_msg.dropped = false;
+
+        rx_pos = rx_msg.next;
+        shm_connector_stats.messages++;
+
+        return &rx_msg;
+    }
+}
+
+void ShmConnector::wait(uint64_t pos)
+{
+    shm_connector_stats.waits++;
+
+    uint32_t w = ring->wake.load();
+    ring->waiting.store(1);
+
+    if ( ring->head.load() == pos )
+    {
+#ifdef __linux__
+        // the timeout covers a producer that goes away while we sleep
+        struct timespec ts = { 0, 100000000 };
+        syscall(SYS_futex, (uint32_t*)&ring->wake, FUTEX_WAIT, w, &ts, nullptr, 0);
+#else
+        usleep(100);
+#endif
+    }
+    ring->waiting.store(0);
+}
+
+void ShmConnector::wake()
+{
+    ring->wake.fetch_add(1);
+
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t*)&ring->wake, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#endif
+}
+
+//-------------------------------------------------------------------------
+// api stuff
+//-------------------------------------------------------------------------
+
+static Module* mod_ctor()
+{ return new ShmConnectorModule; }
+
+static void mod_dtor(Module* m)
+{ delete m; }
+
+// one ring per packet thread; instance n here pairs with instance n there
+static Connector* shm_connector_tinit(ConnectorConfig* config)
+{
+    ShmConnectorConfig* cfg = (ShmConnectorConfig*)config;
+
+    if ( cfg->direction != Connector::CONN_TRANSMIT and
+        cfg->direction != Connector::CONN_RECEIVE )
+        return nullptr;
+
+    std::string name = "/" SHM_CONNECTOR_NAME "_";
+    name += cfg->name;
+    name += "_";
+    name += std::to_string(get_instance_id());
+
+    ShmConnector* shm_connector = new ShmConnector(cfg);
+
+    if ( !shm_connector->attach(name) )
+    {
+        delete shm_connector;
+        return nullptr;
+    }
+    return shm_connector;
+}
+
+static void shm_connector_tterm(Connector* connector)
+{
+    delete connector;
+}
+
+static ConnectorCommon* shm_connector_ctor(Module* m)
+{
+    ShmConnectorModule* mod = (ShmConnectorModule*)m;
+    return new ShmConnectorCommon(mod->get_and_clear_config());
+}
+
+static void shm_connector_dtor(ConnectorCommon* p)
+{
+    delete p;
+}
+
+const ConnectorApi shm_connector_api =
+{
+    {
+        PT_CONNECTOR,
+        sizeof(ConnectorApi),
+        CONNECTOR_API_VERSION,
+        0,
+        API_RESERVED,
+        API_OPTIONS,
+        SHM_CONNECTOR_NAME,
+        SHM_CONNECTOR_HELP,
+        mod_ctor,
+        mod_dtor
+    },
+    0,
+    nullptr,
+    nullptr,
+    shm_connector_tinit,
+    shm_connector_tterm,
+    shm_connector_ctor,
+    shm_connector_dtor
+};
+
+#ifdef BUILDING_SO
+SO_PUBLIC const BaseApi* snort_plugins[] =
+{
+    &shm_connector_api.base,
+    nullptr
+};
+#else
+const BaseApi* shm_connector = &shm_connector_api.base;
+#endif
+
@@ -0,0 +1,119 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2016-2016 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// shm_connector.h
+
+#ifndef SHM_CONNECTOR_H
+#define SHM_CONNECTOR_H
+
+// single producer, single consumer ring in posix shared memory.  messages
+// are built in place by alloc_message and published by transmit_message;
+// receive_message returns a view into the ring that is released by
+// discard_message.  one message may be outstanding in each direction.
+
+#include <atomic>
+#include <string>
+
+#include "framework/connector.h"
+#include "shm_connector_config.h"
+
+#define SHM_RING_MAGIC   0x53484d52  // SHMR
+#define SHM_RING_VERSION 2
+
+// positions are free running byte counts; index is pos & (size - 1)
+struct ShmRingHeader
+{
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint64_t size;
+    std::atomic<int32_t> pid[2];               // attached transmitter, receiver
+
+    alignas(64) std::atomic<uint64_t> head;    // producer only
+    std::atomic<uint32_t> wake;                // futex word for readers
+    std::atomic<uint32_t> waiting;
+
+    alignas(64) std::atomic<uint64_t> tail;    // consumer only
+};
+
+// records are 8 byte aligned; a pad record fills the end of the ring
+// when the next message doesn't fit there
+struct ShmRecord
+{
+    uint32_t length;
+    uint32_t flags;
+};
+
+#define SHM_RECORD_PAD 0x1
+
+class ShmConnectorMsgHandle : public ConnectorMsgHandle
+{
+public:
+    ConnectorMsg connector_msg;
+    uint64_t next;   // ring position after this message
+    bool dropped;    // ring was full; held on the heap
+};
+
+class ShmConnectorCommon : public ConnectorCommon
+{
+public:
+    ShmConnectorCommon(ShmConnectorConfig::ShmConnectorConfigSet);
+};
+
+class ShmConnector : public Connector
+{
+public:
+    ShmConnector(ShmConnectorConfig*);
+    ~ShmConnector();
+
+    bool attach(const std::string& shm_name);
+
+    ConnectorMsgHandle* alloc_message(const uint32_t, const uint8_t**) override;
+    void discard_message(ConnectorMsgHandle*) override;
+    bool transmit_message(ConnectorMsgHandle*) override;
+    ConnectorMsgHandle* receive_message(bool) override;
+
+    ConnectorMsg* get_connector_msg(ConnectorMsgHandle* handle) override
+    { return &((ShmConnectorMsgHandle*)handle)->connector_msg; }
+
+    Direction get_connector_direction() override
+    { return ((const ShmConnectorConfig*)config)->direction; }
+
+private:
+    enum MapResult { RING_OK, RING_BAD, RING_STALE };
+
+    MapResult map_ring();
+    bool peer_alive() const;
+
+    void wait(uint64_t pos);
+    void wake();
+
+    std::string name;
+    ShmRingHeader* ring;
+    uint8_t* data;
+    uint64_t mask;
+    uint64_t size;      // local copy; the peer could change the header
+    size_t map_size;
+    unsigned end;       // our pid slot
+
+    uint64_t rx_pos;
+    ShmConnectorMsgHandle tx_msg;
+    ShmConnectorMsgHandle rx_msg;
+};
+
+#endif
+
@@ -0,0 +1,134 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2016-2016 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// shm_connector_module.cc
+
+#include "shm_connector_module.h"
+
+#include "main/snort_debug.h"
+#include "profiler/profiler.h"
+
+static const Parameter shm_connector_params[] =
+{
+    { "connector", Parameter::PT_STRING, nullptr, nullptr,
+      "connector name" },
+
+    { "name", Parameter::PT_STRING, nullptr, nullptr,
+      "channel name; both ends of a ring use the same name" },
+
+    { "direction", Parameter::PT_ENUM, "receive | transmit", nullptr,
+      "usage" },
+
+    { "size", Parameter::PT_INT, "4096:1073741824", "1048576",
+      "ring size in bytes, rounded up to a power of 2" },
+
+    { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
+};
+
+static const PegInfo shm_connector_pegs[] =
+{
+    { "messages", "total messages" },
+    { "dropped", "messages dropped because the ring was full" },
+    { "waits", "blocking receives that had to wait" },
+    { "corrupt", "received records that overran the ring; pending messages are dropped" },
+    { nullptr, nullptr }
+};
+
+THREAD_LOCAL ShmConnectorStats shm_connector_stats;
+THREAD_LOCAL ProfileStats shm_connector_perfstats;
+
+//-------------------------------------------------------------------------
+// shm_connector module
+//-------------------------------------------------------------------------
+
+ShmConnectorModule::ShmConnectorModule() :
+    Module(SHM_CONNECTOR_NAME, SHM_CONNECTOR_HELP, shm_connector_params)
+{
+    config = nullptr;
+}
+
+ShmConnectorModule::~ShmConnectorModule()
+{
+    if ( config )
+        delete config;
+
+    for ( auto cfg : config_set )
+        delete cfg;
+}
+
+ProfileStats* ShmConnectorModule::get_profile() const
+{ return &shm_connector_perfstats; }
+
+bool ShmConnectorModule::set(const char*, Value& v, SnortConfig*)
+{
+    if ( v.is("connector") )
+        config->connector_name = v.get_string();
+
+    else if ( v.is("name") )
+        config->name = v.get_string();
+
+    else if ( v.is("direction") )
+        config->direction = v.get_long() ? Connector::CONN_TRANSMIT : Connector::CONN_RECEIVE;
+
+    else if ( v.is("size") )
+    {
+        unsigned n = 4096;
+
+        while ( n < v.get_long() )
+            n <<= 1;
+
+        config->ring_size = n;
+    }
+    else
+        return false;
+
+    return true;
+}
+
+// hand over the compiled list to the caller
+ShmConnectorConfig::ShmConnectorConfigSet ShmConnectorModule::get_and_clear_config()
+{
+    ShmConnectorConfig::ShmConnectorConfigSet temp = config_set;
+    config_set.clear();
+    return temp;
+}
+
+bool ShmConnectorModule::begin(const char*, int, SnortConfig*)
+{
+    if ( !config )
+        config = new ShmConnectorConfig;
+
+    return true;
+}
+
+bool ShmConnectorModule::end(const char*, int idx, SnortConfig*)
+{
+    if ( idx != 0 )
+    {
+        config_set.push_back(config);
+        config = nullptr;
+    }
+    return true;
+}
+
+const PegInfo* ShmConnectorModule::get_pegs() const
+{ return shm_connector_pegs; }
+
+PegCount* ShmConnectorModule::get_counts() const
+{ return (PegCount*)&shm_connector_stats; }
+
@@ -0,0 +1,362 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2016-2016 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// shm_connector_test.cc
+// unit tests for passing messages between processes through the shm ring
+
+#include "connectors/shm_connector/shm_connector.h"
+
+#include <stdarg.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "connectors/shm_connector/shm_connector_module.h"
+
+#include <CppUTest/CommandLineTestRunner.h>
+#include <CppUTest/TestHarness.h>
+
+//-------------------------------------------------------------------------
+// stubs, spies, etc.
+//-------------------------------------------------------------------------
+
+THREAD_LOCAL ShmConnectorStats shm_connector_stats;
+
+void ErrorMessage(const char*, ...) { }
+
+const char* get_error(int err)
+{ return strerror(err); }
+
+unsigned get_instance_id()
+{ return 0; }
+
+ShmConnectorModule::ShmConnectorModule() :
+    Module(SHM_CONNECTOR_NAME, SHM_CONNECTOR_HELP) { }
+ShmConnectorModule::~ShmConnectorModule() { }
+bool ShmConnectorModule::set(const char*, Value&, SnortConfig*) { return true; }
+bool ShmConnectorModule::begin(const char*, int, SnortConfig*) { return true; }
+bool ShmConnectorModule::end(const char*, int, SnortConfig*) { return true; }
+ShmConnectorConfig::ShmConnectorConfigSet ShmConnectorModule::get_and_clear_config()
+{ return config_set; }
+const PegInfo* ShmConnectorModule::get_pegs() const { return nullptr; }
+PegCount* ShmConnectorModule::get_counts() const { return nullptr; }
+ProfileStats* ShmConnectorModule::get_profile() const { return nullptr; }
+
+void Module::init(const char* s, const char* h) { name = s; help = h; }
+Module::Module(const char* s, const char* h) { init(s, h); }
+Module::Module(const char* s, const char* h, const Parameter*, bool) { init(s, h); }
+void Module::show_interval_stats(IndexVec&, FILE*) { }
+void Module::show_stats() { }
+void Module::reset_stats() { }
+void Module::sum_stats() { }
+
+//-------------------------------------------------------------------------
+// helpers
+//-------------------------------------------------------------------------
+
+// sizes vary so records wrap and pad at the end of the small ring
+static uint32_t get_length(unsigned i)
+{ return sizeof(i) + i % 300; }
+
+static void fill(uint8_t* buf, unsigned i)
+{
+    uint32_t len = get_length(i);
+    memcpy(buf, &i, sizeof(i));
+
+    for ( unsigned j = sizeof(i); j < len; ++j )
+        buf[j] = (uint8_t)(i + j);
+}
+
+static bool check(const ConnectorMsg* msg, unsigned i)
+{
+    unsigned seq;
+
+    if ( msg->length != get_length(i) )
+        return false;
+
+    memcpy(&seq, msg->data, sizeof(seq));
+
+    if ( seq != i )
+        return false;
+
+    for ( unsigned j = sizeof(i); j < msg->length; ++j )
+        if ( msg->data[j] != (uint8_t)(i + j) )
+            return false;
+
+    return true;
+}
+
+// the child blocks on an empty ring until the parent starts sending
+static int receive(const std::string& name, unsigned count)
+{
+    ShmConnectorConfig cfg;
+    cfg.direction = Connector::CONN_RECEIVE;
+    cfg.ring_size = 1 << 12;
+
+    ShmConnector rx(&cfg);
+
+    if ( !rx.attach(name) )
+        return 2;
+
+    for ( unsigned i = 0; i < count; ++i )
+    {
+        ConnectorMsgHandle* h = rx.receive_message(true);
+
+        if ( !h or !check(rx.get_connector_msg(h), i) )
+            return 1;
+
+        rx.discard_message(h);
+    }
+
+    // nothing extra was published
+    return rx.receive_message(false) ? 1 : 0;
+}
+
+static bool exists(const std::string& name)
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+
+    if ( fd < 0 )
+        return false;
+
+    close(fd);
+    return true;
+}
+
+// a second mapping of the ring for playing a broken peer
+static ShmRingHeader* map_ring(const std::string& name, size_t ring_size, uint8_t*& data)
+{
+    const size_t hdr_size = (sizeof(ShmRingHeader) + 4095) & ~(size_t)4095;
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+
+    if ( fd < 0 )
+        return nullptr;
+
+    void* p = mmap(nullptr, hdr_size + ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if ( p == MAP_FAILED )
+        return nullptr;
+
+    data = (uint8_t*)p + hdr_size;
+    return (ShmRingHeader*)p;
+}
+
+static bool send(ShmConnector& tx, unsigned i)
+{
+    const uint8_t* buf;
+    ConnectorMsgHandle* h = tx.alloc_message(get_length(i), &buf);
+    fill((uint8_t*)buf, i);
+    return tx.transmit_message(h);
+}
+
+//-------------------------------------------------------------------------
+// tests
+//-------------------------------------------------------------------------
+
+TEST_GROUP(shm_connector)
+{
+    std::string name;
+
+    void setup()
+    {
+        name = "/shm_connector_test_" + std::to_string(getpid());
+        shm_unlink(name.c_str());
+        memset(&shm_connector_stats, 0, sizeof(shm_connector_stats));
+    }
+
+    void teardown()
+    {
+        shm_unlink(name.c_str());
+    }
+};
+
+// one process transmits, retrying when the ring is full, and a forked
+// process receives and checks every message in order
+TEST(shm_connector, two_process_round_trip)
+{
+    const unsigned count = 20000;
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+
+    if ( !pid )
+        _exit(receive(name, count));
+
+    ShmConnectorConfig cfg;
+    cfg.direction = Connector::CONN_TRANSMIT;
+    cfg.ring_size = 1 << 12;
+
+    ShmConnector tx(&cfg);
+    CHECK(tx.attach(name));
+
+    for ( unsigned i = 0; i < count; )
+    {
+        const uint8_t* buf;
+        ConnectorMsgHandle* h = tx.alloc_message(get_length(i), &buf);
+        fill((uint8_t*)buf, i);
+
+        if ( tx.transmit_message(h) )
+            ++i;
+    }
+
+    int status = -1;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status));
+    CHECK(WEXITSTATUS(status) == 0);
+    CHECK(shm_connector_stats.messages == count);
+}
+
+// a peer configured with a different ring size can't attach
+TEST(shm_connector, size_mismatch)
+{
+    ShmConnectorConfig tx_cfg;
+    tx_cfg.direction = Connector::CONN_TRANSMIT;
+    tx_cfg.ring_size = 1 << 12;
+
+    ShmConnectorConfig rx_cfg;
+    rx_cfg.direction = Connector::CONN_RECEIVE;
+    rx_cfg.ring_size = 1 << 13;
+
+    ShmConnector tx(&tx_cfg);
+    CHECK(tx.attach(name));
+
+    ShmConnector rx(&rx_cfg);
+    CHECK(!rx.attach(name));
+}
+
+// records that don't fit what was published are dropped and the
+// receiver picks up with the next good message
+TEST(shm_connector, corrupt_record)
+{
+    ShmConnectorConfig tx_cfg;
+    tx_cfg.direction = Connector::CONN_TRANSMIT;
+    tx_cfg.ring_size = 1 << 12;
+
+    ShmConnectorConfig rx_cfg;
+    rx_cfg.direction = Connector::CONN_RECEIVE;
+    rx_cfg.ring_size = 1 << 12;
+
+    ShmConnector tx(&tx_cfg);
+    CHECK(tx.attach(name));
+
+    ShmConnector rx(&rx_cfg);
+    CHECK(rx.attach(name));
+
+    uint8_t* data;
+    ShmRingHeader* ring = map_ring(name, tx_cfg.ring_size, data);
+    CHECK(ring);
+
+    // length runs past head
+    CHECK(send(tx, 0));
+    ((ShmRecord*)data)->length = 1000;
+    CHECK(!rx.receive_message(false));
+    CHECK(shm_connector_stats.corrupt == 1);
+    CHECK(ring->tail.load() == ring->head.load());
+
+    // length fits what was published but runs off the end of the ring
+    CHECK(send(tx, 1));
+    uint64_t pos = ring->tail.load();
+    CHECK(pos > 8);
+    ring->head.store(pos + rx_cfg.ring_size);
+    ((ShmRecord*)(data + pos))->length = rx_cfg.ring_size - 16;
+    CHECK(!rx.receive_message(false));
+    CHECK(shm_connector_stats.corrupt == 2);
+    ring->head.store(ring->tail.load());
+
+    CHECK(send(tx, 2));
+    ConnectorMsgHandle* h = rx.receive_message(false);
+    CHECK(h);
+    CHECK(check(rx.get_connector_msg(h), 2));
+    rx.discard_message(h);
+
+    // head is more than a ring ahead
+    CHECK(send(tx, 3));
+    ring->head.store(ring->tail.load() + 2 * rx_cfg.ring_size);
+    CHECK(!rx.receive_message(false));
+    CHECK(shm_connector_stats.corrupt == 3);
+
+    munmap(ring, (sizeof(ShmRingHeader) + 4095) / 4096 * 4096 + tx_cfg.ring_size);
+}
+
+// the ring is removed when the last end detaches
+TEST(shm_connector, unlink_on_exit)
+{
+    ShmConnectorConfig tx_cfg;
+    tx_cfg.direction = Connector::CONN_TRANSMIT;
+    tx_cfg.ring_size = 1 << 12;
+
+    ShmConnectorConfig rx_cfg;
+    rx_cfg.direction = Connector::CONN_RECEIVE;
+    rx_cfg.ring_size = 1 << 12;
+
+    ShmConnector* tx = new ShmConnector(&tx_cfg);
+    CHECK(tx->attach(name));
+
+    ShmConnector* rx = new ShmConnector(&rx_cfg);
+    CHECK(rx->attach(name));
+
+    delete tx;
+    CHECK(exists(name));
+
+    delete rx;
+    CHECK(!exists(name));
+}
+
+// a ring left by a process that died attached is replaced, even if the
+// new configuration differs
+TEST(shm_connector, stale_ring)
+{
+    ShmConnectorConfig tx_cfg;
+    tx_cfg.direction = Connector::CONN_TRANSMIT;
+    tx_cfg.ring_size = 1 << 12;
+
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+
+    if ( !pid )
+    {
+        ShmConnector* tx = new ShmConnector(&tx_cfg);
+        _exit(tx->attach(name) and send(*tx, 0) ? 0 : 1);
+    }
+
+    int status = -1;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status));
+    CHECK(WEXITSTATUS(status) == 0);
+    CHECK(exists(name));
+
+    ShmConnectorConfig rx_cfg;
+    rx_cfg.direction = Connector::CONN_RECEIVE;
+    rx_cfg.ring_size = 1 << 13;
+
+    ShmConnector rx(&rx_cfg);
+    CHECK(rx.attach(name));
+
+    // nothing from the old ring is delivered
+    CHECK(!rx.receive_message(false));
+}
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -61,12 +61,6 @@
 #include "protocols/ip.h"
 #include "sfip/sf_ipvar.h"
 
-#define CHECK_SRC_IP         0x01
-#define CHECK_DST_IP         0x02
-#define INVERSE              0x04
-#define CHECK_SRC_PORT       0x08
-#define CHECK_DST_PORT       0x10
-
 THREAD_LOCAL ProfileStats detectPerfStats;
 THREAD_LOCAL ProfileStats eventqPerfStats;
 THREAD_LOCAL ProfileStats rebuiltPacketPerfStats;
@@ -138,6 +132,7 @@ void snort_inspect(Packet* p)
     Profile profile(eventqPerfStats);
     SnortEventqLog(p);
     SnortEventqReset();
+    EventManager::end_packet(p);
 }
 
 void snort_log(Packet* p)
@@ -295,396 +290,99 @@ bool snort_detect(Packet* p)
     }
 }
 
-static int CheckAddrPort(
-    sfip_var_t* rule_addr,
-    PortObject* po,
-    Packet* p,
-    uint32_t flags, int mode)
+// check one side of a bidirectional rule against one side of the packet
+static inline bool CheckAddrPort(
+    sfip_var_t* rule_addr, const PortRange* ports, unsigned num_ports,
+    bool except_addr, bool any_port, bool except_port,
+    const sfip_t* pkt_addr, uint16_t pkt_port, int check_ports)
 {
-    const sfip_t* pkt_addr;          /* packet IP address */
-    u_short pkt_port;                /* packet port */
-    int global_except_addr_flag = 0; /* global exception flag is set */
-    int any_port_flag = 0;           /* any port flag set */
-    int except_port_flag = 0;        /* port exception flag set */
-    int ip_match = 0;                /* flag to indicate addr match made */
-
-    DebugMessage(DEBUG_DETECT, "CheckAddrPort: ");
-    /* set up the packet particulars */
-    if (mode & CHECK_SRC_IP)
-    {
-        pkt_addr = p->ptrs.ip_api.get_src();
-        pkt_port = p->ptrs.sp;
-
-        DebugMessage(DEBUG_DETECT,"SRC ");
-
-        if (mode & INVERSE)
-        {
-            global_except_addr_flag = flags & EXCEPT_DST_IP;
-            any_port_flag = flags & ANY_DST_PORT;
-            except_port_flag = flags & EXCEPT_DST_PORT;
-        }
-        else
-        {
-            global_except_addr_flag = flags & EXCEPT_SRC_IP;
-            any_port_flag = flags & ANY_SRC_PORT;
-            except_port_flag = flags & EXCEPT_SRC_PORT;
-        }
-    }
-    else
-    {
-        pkt_addr = p->ptrs.ip_api.get_dst();
-        pkt_port = p->ptrs.dp;
-
-        DebugMessage(DEBUG_DETECT, "DST ");
-
-        if (mode & INVERSE)
-        {
-            global_except_addr_flag = flags & EXCEPT_SRC_IP;
-            any_port_flag = flags & ANY_SRC_PORT;
-            except_port_flag = flags & EXCEPT_SRC_PORT;
-        }
-        else
-        {
-            global_except_addr_flag = flags & EXCEPT_DST_IP;
-            any_port_flag = flags & ANY_DST_PORT;
-            except_port_flag = flags & EXCEPT_DST_PORT;
-        }
-    }
-
-    DebugFormat(DEBUG_DETECT, "addr %lx, port %d ", pkt_addr, pkt_port);
+    if ( !rule_addr )
+        return false;
 
-    if (!rule_addr)
-        goto bail;
+    if ( (sfvar_ip_in(rule_addr, pkt_addr) != 0) == except_addr )
+        return false;
 
-    if (!(global_except_addr_flag)) /*modeled after Check{Src,Dst}IP function*/
-    {
-        if (sfvar_ip_in(rule_addr, pkt_addr))
-            ip_match = 1;
-    }
-    else
-    {
-        DebugMessage(DEBUG_DETECT, ", global exception flag set");
-        /* global exception flag is up, we can't match on *any*
-         * of the source addresses
-         */
+    if ( any_port or !check_ports )
+        return true;
 
-        if (sfvar_ip_in(rule_addr, pkt_addr))
-            return 0;
+    return PortRangesHavePort(ports, num_ports, pkt_port) != except_port;
+}
 
-        ip_match=1;
-    }
+static bool CheckBidirectional(RuleTreeNode* rtn, Packet* p, int check_ports)
+{
+    uint32_t flags = rtn->flags;
+    const sfip_t* src = p->ptrs.ip_api.get_src();
+    const sfip_t* dst = p->ptrs.ip_api.get_dst();
 
-bail:
-    if (!ip_match)
-    {
-        DebugMessage(DEBUG_DETECT, ", no address match,  "
-            "packet rejected\n");
-        return 0;
-    }
+    DebugMessage(DEBUG_DETECT, "Checking bidirectional rule...\n");
 
-    DebugMessage(DEBUG_DETECT, ", addresses accepted");
+    if ( CheckAddrPort(rtn->sip, rtn->src_ports, rtn->num_src_ports,
+        flags & EXCEPT_SRC_IP, flags & ANY_SRC_PORT, flags & EXCEPT_SRC_PORT,
+        src, p->ptrs.sp, check_ports) and
 
-    /* if the any port flag is up, we're all done (success) */
-    if (any_port_flag)
+        CheckAddrPort(rtn->dip, rtn->dst_ports, rtn->num_dst_ports,
+        flags & EXCEPT_DST_IP, flags & ANY_DST_PORT, flags & EXCEPT_DST_PORT,
+        dst, p->ptrs.dp, check_ports) )
     {
-        DebugMessage(DEBUG_DETECT, ", any port match, "
-            "packet accepted\n");
-        return 1;
+        return true;
     }
 
-    if (!(mode & (CHECK_SRC_PORT | CHECK_DST_PORT)))
-    {
-        return 1;
-    }
+    DebugMessage(DEBUG_DETECT, "   src->dst check failed, checking inverse\n");
 
-    /* check the packet port against the rule port */
-    if ( !PortObjectHasPort(po,pkt_port) )
-    {
-        /* if the exception flag isn't up, fail */
-        if (!except_port_flag)
-        {
-            DebugMessage(DEBUG_DETECT, ", port mismatch,  "
-                "packet rejected\n");
-            return 0;
-        }
-        DebugMessage(DEBUG_DETECT, ", port mismatch exception");
-    }
-    else
-    {
-        /* if the exception flag is up, fail */
-        if (except_port_flag)
-        {
-            DebugMessage(DEBUG_DETECT,
-                ", port match exception,  packet rejected\n");
-            return 0;
-        }
-        DebugMessage(DEBUG_DETECT, ", ports match");
-    }
+    return
+        CheckAddrPort(rtn->dip, rtn->dst_ports, rtn->num_dst_ports,
+        flags & EXCEPT_DST_IP, flags & ANY_DST_PORT, flags & EXCEPT_DST_PORT,
+        src, p->ptrs.sp, check_ports) and
 
-    /* ports and address match */
-    DebugMessage(DEBUG_DETECT, ", packet accepted!\n");
-    return 1;
+        CheckAddrPort(rtn->sip, rtn->src_ports, rtn->num_src_ports,
+        flags & EXCEPT_SRC_IP, flags & ANY_SRC_PORT, flags & EXCEPT_SRC_PORT,
+        dst, p->ptrs.dp, check_ports);
 }
 
-#define CHECK_ADDR_SRC_ARGS(x) (x)->src_portobject
-#define CHECK_ADDR_DST_ARGS(x) (x)->dst_portobject
-
-int CheckBidirectional(Packet* p, RuleTreeNode* rtn_idx,
-    RuleFpList*, int check_ports)
+// the header checks to do are given by the any and except flags
+bool CheckRuleHeader(RuleTreeNode* rtn, Packet* p, int check_ports)
 {
-    DebugMessage(DEBUG_DETECT, "Checking bidirectional rule...\n");
-
-    if (CheckAddrPort(rtn_idx->sip, CHECK_ADDR_SRC_ARGS(rtn_idx), p,
-        rtn_idx->flags, CHECK_SRC_IP | (check_ports ? CHECK_SRC_PORT : 0)))
-    {
-        DebugMessage(DEBUG_DETECT, "   Src->Src check passed\n");
-        if (!CheckAddrPort(rtn_idx->dip, CHECK_ADDR_DST_ARGS(rtn_idx), p,
-            rtn_idx->flags, CHECK_DST_IP | (check_ports ? CHECK_DST_PORT : 0)))
-        {
-            DebugMessage(DEBUG_DETECT,
-                "   Dst->Dst check failed, checking inverse combination\n");
-            if (CheckAddrPort(rtn_idx->dip, CHECK_ADDR_DST_ARGS(rtn_idx), p,
-                rtn_idx->flags, (CHECK_SRC_IP | INVERSE | (check_ports ? CHECK_SRC_PORT : 0))))
-            {
-                DebugMessage(DEBUG_DETECT,
-                    "   Inverse Dst->Src check passed\n");
-                if (!CheckAddrPort(rtn_idx->sip, CHECK_ADDR_SRC_ARGS(rtn_idx), p,
-                    rtn_idx->flags, (CHECK_DST_IP | INVERSE | (check_ports ? CHECK_DST_PORT : 0))))
-                {
-                    DebugMessage(DEBUG_DETECT,
-                        "   Inverse Src->Dst check failed\n");
-                    return 0;
-                }
-                else
-                {
-                    DebugMessage(DEBUG_DETECT, "Inverse addr/port match\n");
-                }
-            }
-            else
-            {
-                DebugMessage(DEBUG_DETECT, "   Inverse Dst->Src check failed,"
-                    " trying next rule\n");
-                return 0;
-            }
-        }
-        else
-        {
-            DebugMessage(DEBUG_DETECT, "dest IP/port match\n");
-        }
-    }
-    else
-    {
-        DebugMessage(DEBUG_DETECT,
-            "   Src->Src check failed, trying inverse test\n");
-        if (CheckAddrPort(rtn_idx->dip, CHECK_ADDR_DST_ARGS(rtn_idx), p,
-            rtn_idx->flags, CHECK_SRC_IP | INVERSE | (check_ports ? CHECK_SRC_PORT : 0)))
-        {
-            DebugMessage(DEBUG_DETECT,
-                "   Dst->Src check passed\n");
+    uint32_t flags = rtn->flags;
 
-            if (!CheckAddrPort(rtn_idx->sip, CHECK_ADDR_SRC_ARGS(rtn_idx), p,
-                rtn_idx->flags, CHECK_DST_IP | INVERSE | (check_ports ? CHECK_DST_PORT : 0)))
-            {
-                DebugMessage(DEBUG_DETECT,
-                    "   Src->Dst check failed\n");
-                return 0;
-            }
-            else
-            {
-                DebugMessage(DEBUG_DETECT,
-                    "Inverse addr/port match\n");
-            }
-        }
-        else
-        {
-            DebugMessage(DEBUG_DETECT,"   Inverse test failed, "
-                "testing next rule...\n");
-            return 0;
-        }
-    }
+    if ( flags & BIDIRECTIONAL )
+        return CheckBidirectional(rtn, p, check_ports);
 
-    DebugMessage(DEBUG_DETECT,"   Bidirectional success!\n");
-    return 1;
-}
-
-/****************************************************************************
- *
- * Function: CheckSrcIp(Packet *, RuleTreeNode *, RuleFpList *)
- *
- * Purpose: Test the source IP and see if it equals the SIP of the packet
- *
- * Arguments: p => ptr to the decoded packet data structure
- *            rtn_idx => ptr to the current rule data struct
- *            fp_list => ptr to the current function pointer node
- *
- * Returns: 0 on failure (no match), 1 on success (match)
- *
- ***************************************************************************/
-int CheckSrcIP(Packet* p, RuleTreeNode* rtn_idx, RuleFpList* fp_list, int check_ports)
-{
-    DebugMessage(DEBUG_DETECT,"CheckSrcIPEqual: ");
-
-    if (!(rtn_idx->flags & EXCEPT_SRC_IP))
+    if ( check_ports )
     {
-        if ( sfvar_ip_in(rtn_idx->sip, p->ptrs.ip_api.get_src()) )
+        if ( !(flags & ANY_DST_PORT) and
+            PortRangesHavePort(rtn->dst_ports, rtn->num_dst_ports, p->ptrs.dp) ==
+            ((flags & EXCEPT_DST_PORT) != 0) )
         {
-            /* the packet matches this test, proceed to the next test */
-            return fp_list->next->RuleHeadFunc(p, rtn_idx, fp_list->next, check_ports);
+            DebugMessage(DEBUG_DETECT, "   DP mismatch!\n");
+            return false;
         }
-    }
-    else
-    {
-        /* global exception flag is up, we can't match on *any*
-         * of the source addresses
-         */
-        DebugMessage(DEBUG_DETECT,"  global exception flag, \n");
-
-        if ( sfvar_ip_in(rtn_idx->sip, p->ptrs.ip_api.get_src()) )
-            return 0;
-
-        return fp_list->next->RuleHeadFunc(p, rtn_idx, fp_list->next, check_ports);
-    }
-
-    DebugMessage(DEBUG_DETECT,"  Mismatch on SIP\n");
-
-    /* return 0 on a failed test */
-    return 0;
-}
-
-/****************************************************************************
- *
- * Function: CheckDstIp(Packet *, RuleTreeNode *, RuleFpList *)
- *
- * Purpose: Test the dest IP and see if it equals the DIP of the packet
- *
- * Arguments: p => ptr to the decoded packet data structure
- *            rtn_idx => ptr to the current rule data struct
- *            fp_list => ptr to the current function pointer node
- *
- * Returns: 0 on failure (no match), 1 on success (match)
- *
- ***************************************************************************/
-int CheckDstIP(Packet* p, RuleTreeNode* rtn_idx, RuleFpList* fp_list, int check_ports)
-{
-    DebugMessage(DEBUG_DETECT, "CheckDstIPEqual: ");
 
-    if (!(rtn_idx->flags & EXCEPT_DST_IP))
-    {
-        if ( sfvar_ip_in(rtn_idx->dip, p->ptrs.ip_api.get_dst()) )
+        if ( !(flags & ANY_SRC_PORT) and
+            PortRangesHavePort(rtn->src_ports, rtn->num_src_ports, p->ptrs.sp) ==
+            ((flags & EXCEPT_SRC_PORT) != 0) )
         {
-            /* the packet matches this test, proceed to the next test */
-            return fp_list->next->RuleHeadFunc(p, rtn_idx, fp_list->next, check_ports);
+            DebugMessage(DEBUG_DETECT, "   SP mismatch!\n");
+            return false;
         }
     }
-    else
-    {
-        /* global exception flag is up, we can't match on *any*
-         * of the source addresses */
-        DebugMessage(DEBUG_DETECT,"  global exception flag, \n");
-
-        if ( sfvar_ip_in(rtn_idx->dip, p->ptrs.ip_api.get_dst()) )
-            return 0;
 
-        return fp_list->next->RuleHeadFunc(p, rtn_idx, fp_list->next, check_ports);
-    }
-
-    return 0;
-}
-
-int CheckSrcPortEqual(Packet* p, RuleTreeNode* rtn_idx,
-    RuleFpList* fp_list, int check_ports)
-{
-    DebugMessage(DEBUG_DETECT,"CheckSrcPortEqual: ");
-
-    /* Check if attributes provided match earlier */
-    if (check_ports == 0)
+    if ( !(flags & ANY_SRC_IP) and
+        (sfvar_ip_in(rtn->sip, p->ptrs.ip_api.get_src()) != 0) ==
+        ((flags & EXCEPT_SRC_IP) != 0) )
     {
-        return fp_list->next->RuleHeadFunc(p, rtn_idx, fp_list->next, check_ports);
-    }
-    if ( PortObjectHasPort(rtn_idx->src_portobject,p->ptrs.sp) )
-    {
-        DebugMessage(DEBUG_DETECT, "  SP match!\n");
-        return fp_list->next->RuleHeadFunc(p, rtn_idx, fp_list->next, check_ports);
-    }
-    else
-    {
-        DebugMessage(DEBUG_DETECT, "   SP mismatch!\n");
-    }
-
-    return 0;
-}
-
-int CheckSrcPortNotEq(Packet* p, RuleTreeNode* rtn_idx,
-    RuleFpList* fp_list, int check_ports)
-{
-    DebugMessage(DEBUG_DETECT,"CheckSrcPortNotEq: ");
-
-    /* Check if attributes provided match earlier */
-    if (check_ports == 0)
-    {
-        return fp_list->next->RuleHeadFunc(p, rtn_idx, fp_list->next, check_ports);
-    }
-    if ( !PortObjectHasPort(rtn_idx->src_portobject,p->ptrs.sp) )
-    {
-        DebugMessage(DEBUG_DETECT, "  !SP match!\n");
-        return fp_list->next->RuleHeadFunc(p, rtn_idx, fp_list->next, check_ports);
-    }
-    else
-    {
-        DebugMessage(DEBUG_DETECT, "  !SP mismatch!\n");
-    }
-
-    return 0;
-}
-
-int CheckDstPortEqual(Packet* p, RuleTreeNode* rtn_idx,
-    RuleFpList* fp_list, int check_ports)
-{
-    DebugMessage(DEBUG_DETECT,"CheckDstPortEqual: ");
-
-    /* Check if attributes provided match earlier */
-    if (check_ports == 0)
-    {
-        return fp_list->next->RuleHeadFunc(p, rtn_idx, fp_list->next, check_ports);
-    }
-    if ( PortObjectHasPort(rtn_idx->dst_portobject,p->ptrs.dp) )
-    {
-        DebugMessage(DEBUG_DETECT, " DP match!\n");
-        return fp_list->next->RuleHeadFunc(p, rtn_idx, fp_list->next, check_ports);
-    }
-    else
-    {
-        DebugMessage(DEBUG_DETECT," DP mismatch!\n");
+        DebugMessage(DEBUG_DETECT, "   SIP mismatch!\n");
+        return false;
     }
-    return 0;
-}
-
-int CheckDstPortNotEq(Packet* p, RuleTreeNode* rtn_idx,
-    RuleFpList* fp_list, int check_ports)
-{
-    DebugMessage(DEBUG_DETECT,"CheckDstPortNotEq: ");
 
-    /* Check if attributes provided match earlier */
-    if (check_ports == 0)
+    if ( !(flags & ANY_DST_IP) and
+        (sfvar_ip_in(rtn->dip, p->ptrs.ip_api.get_dst()) != 0) ==
+        ((flags & EXCEPT_DST_IP) != 0) )
     {
-        return fp_list->next->RuleHeadFunc(p, rtn_idx, fp_list->next, check_ports);
-    }
-    if ( !PortObjectHasPort(rtn_idx->dst_portobject,p->ptrs.dp) )
-    {
-        DebugMessage(DEBUG_DETECT, " !DP match!\n");
-        return fp_list->next->RuleHeadFunc(p, rtn_idx, fp_list->next, check_ports);
-    }
-    else
-    {
-        DebugMessage(DEBUG_DETECT," !DP mismatch!\n");
+        DebugMessage(DEBUG_DETECT, "   DIP mismatch!\n");
+        return false;
     }
 
-    return 0;
-}
-
-int RuleListEnd(Packet*, RuleTreeNode*, RuleFpList*, int)
-{
-    return 1;
+    return true;
 }
 
 int OptListEnd(void*, Cursor&, Packet*)
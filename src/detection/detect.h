@@ -52,17 +52,10 @@ void snort_log(Packet*);
 SO_PUBLIC bool snort_detect(Packet*);
 
 // parsing
-int RuleListEnd(Packet*, RuleTreeNode*, RuleFpList*, int);
 int OptListEnd(void* option_data, class Cursor&, Packet*);
 
 // detection
-int CheckBidirectional(Packet*, RuleTreeNode*, RuleFpList*, int);
-int CheckSrcIP(Packet*, RuleTreeNode*, RuleFpList*, int);
-int CheckDstIP(Packet*, RuleTreeNode*, RuleFpList*, int);
-int CheckSrcPortEqual(Packet*, RuleTreeNode*, RuleFpList*, int);
-int CheckDstPortEqual(Packet*, RuleTreeNode*, RuleFpList*, int);
-int CheckSrcPortNotEq(Packet*, RuleTreeNode*, RuleFpList*, int);
-int CheckDstPortNotEq(Packet*, RuleTreeNode*, RuleFpList*, int);
+bool CheckRuleHeader(RuleTreeNode*, Packet*, int check_ports);
 
 // alerts
 void CallLogFuncs(Packet*, ListHead*, Event*, const char*);
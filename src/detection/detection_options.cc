@@ -462,11 +462,7 @@ int detection_option_node_evaluate(
                     otn->state[get_instance_id()].matches++;
 
                     if ( !eval_data->flowbit_noalert )
-                    {
-                        PatternMatchData* pmd = (PatternMatchData*)eval_data->pmd;
-                        int pattern_size = pmd ? pmd->pattern_size : 0;
-                        fpAddMatch((OTNX_MATCH_DATA*)pomd, pattern_size, otn);
-                    }
+                        fpAddMatch((OTNX_MATCH_DATA*)pomd, otn);
                     result = rval = DETECTION_OPTION_MATCH;
                 }
             }
@@ -715,6 +711,8 @@ struct node_profile_stats
     uint64_t checks;
     uint64_t latency_timeouts;
     uint64_t latency_suspends;
+    hr_duration elapsed_script;
+    uint64_t script_checks;
 };
 
 static void detection_option_node_update_otn_stats(detection_option_tree_node_t* node,
@@ -733,6 +731,13 @@ static void detection_option_node_update_otn_stats(detection_option_tree_node_t*
         node_stats.checks += node->state[i].checks;
     }
 
+    if ( node->option_type != RULE_OPTION_TYPE_LEAF_NODE and
+        ((IpsOption*)node->option_data)->is_script() )
+    {
+        node_stats.elapsed_script = node_stats.elapsed;
+        node_stats.script_checks = node_stats.checks;
+    }
+
     if ( stats )
     {
         local_stats.elapsed = stats->elapsed + node_stats.elapsed;
@@ -746,6 +751,9 @@ static void detection_option_node_update_otn_stats(detection_option_tree_node_t*
 
         local_stats.latency_timeouts = timeouts;
         local_stats.latency_suspends = suspends;
+
+        local_stats.elapsed_script = stats->elapsed_script + node_stats.elapsed_script;
+        local_stats.script_checks = stats->script_checks + node_stats.script_checks;
     }
 
     else
@@ -756,6 +764,8 @@ static void detection_option_node_update_otn_stats(detection_option_tree_node_t*
         local_stats.checks = node_stats.checks;
         local_stats.latency_timeouts = timeouts;
         local_stats.latency_suspends = suspends;
+        local_stats.elapsed_script = node_stats.elapsed_script;
+        local_stats.script_checks = node_stats.script_checks;
     }
 
     if ( node->option_type == RULE_OPTION_TYPE_LEAF_NODE )
@@ -777,6 +787,8 @@ static void detection_option_node_update_otn_stats(detection_option_tree_node_t*
 
         state.latency_timeouts += local_stats.latency_timeouts;
         state.latency_suspends += local_stats.latency_suspends;
+        state.elapsed_script += local_stats.elapsed_script;
+        state.script_checks += local_stats.script_checks;
     }
 
     if ( node->num_children )
@@ -80,6 +80,12 @@
 #include "protocols/icmp4.h"
 #include "search_engines/pat_stats.h"
 
+#ifdef UNIT_TEST
+#include <algorithm>
+#include <vector>
+#include "catch/catch.hpp"
+#endif
+
 THREAD_LOCAL ProfileStats rulePerfStats;
 THREAD_LOCAL ProfileStats ruleRTNEvalPerfStats;
 THREAD_LOCAL ProfileStats ruleOTNEvalPerfStats;
@@ -129,8 +135,6 @@ static inline void InitMatchInfo(OTNX_MATCH_DATA* o)
     for (i = 0; i < o->iMatchInfoArraySize; i++)
     {
         o->matchInfo[i].iMatchCount  = 0;
-        o->matchInfo[i].iMatchIndex  = 0;
-        o->matchInfo[i].iMatchMaxLen = 0;
     }
 }
 
@@ -256,6 +260,68 @@ int fpLogEvent(const RuleTreeNode* rtn, const OptTreeNode* otn, Packet* p)
     return 0;
 }
 
+// true if a should be logged ahead of b; ties are broken on sid so that
+// repeated tests are stable
+static inline bool fpEventBefore(
+    const OptTreeNode* a, const OptTreeNode* b, int order)
+{
+    if ( order == SNORT_EVENTQ_PRIORITY )
+    {
+        if ( a->sigInfo.priority != b->sigInfo.priority )
+            return a->sigInfo.priority < b->sigInfo.priority;
+
+        return a->sigInfo.id < b->sigInfo.id;
+    }
+    if ( a->longestPatternLen != b->longestPatternLen )
+        return a->longestPatternLen > b->longestPatternLen;
+
+    return a->sigInfo.id > b->sigInfo.id;
+}
+
+// insert otn into a queue of at most max matches kept in event_queue order;
+// returns 1 if the queue was already full
+static int fpQueueMatch(MATCH_INFO* pmi, const OptTreeNode* otn, int max, int order)
+{
+    int n = pmi->iMatchCount;
+
+    /* Check that we are not storing the same otn again */
+    for ( int i = 0; i < n; i++ )
+    {
+        if ( pmi->MatchArray[i] == otn )
+            return 0;
+    }
+
+    /*
+    **  If we hit the max number of unique events for any rule type alert,
+    **  log or pass, then this event only goes in if it beats the last one.
+    */
+    int rval = 0;
+
+    if ( n >= max )
+    {
+        pc.match_limit++;
+
+        if ( !max or !fpEventBefore(otn, pmi->MatchArray[max - 1], order) )
+            return 1;
+
+        n = max - 1;
+        rval = 1;
+    }
+
+    /* the queue is short so insert from the tail */
+    int i = n;
+
+    while ( i > 0 and fpEventBefore(otn, pmi->MatchArray[i - 1], order) )
+    {
+        pmi->MatchArray[i] = pmi->MatchArray[i - 1];
+        --i;
+    }
+    pmi->MatchArray[i] = otn;
+    pmi->iMatchCount = n + 1;
+
+    return rval;
+}
+
 /*
 **
 **  NAME
@@ -267,6 +333,11 @@ int fpLogEvent(const RuleTreeNode* rtn, const OptTreeNode* otn, Packet* p)
 **    one.  This function also allows us to change the order of alert,
 **    pass, and log signatures by cacheing them for decision later.
 **
+**    Each queue is kept sorted in event_queue order as matches are added
+**    so fpFinalSelectEvent() can log straight from the front.  Once a
+**    queue is full, a better event displaces the worst one queued and a
+**    worse one is dropped, so the queue always holds the top max_queue_events.
+**
 **    IMPORTANT NOTE:
 **    fpAddMatch must be called even when the queue has been maxed
 **    out.  This is because there are three different queues (alert,
@@ -276,21 +347,16 @@ int fpLogEvent(const RuleTreeNode* rtn, const OptTreeNode* otn, Packet* p)
 **
 **  FORMAL INPUTS
 **    OTNX_MATCH_DATA    * - the omd to add the event to.
-**    int pLen             - length of pattern that matched, 0 for no content
 **    OptTreeNode        * - the otn to add.
 **
 **  FORMAL OUTPUTS
 **    int - 1 max_events variable hit, 0 successful.
 **
 */
-int fpAddMatch(OTNX_MATCH_DATA* omd_local, int pLen, const OptTreeNode* otn)
+int fpAddMatch(OTNX_MATCH_DATA* omd_local, const OptTreeNode* otn)
 {
-    MATCH_INFO* pmi;
-    int evalIndex;
-    int i;
     RuleTreeNode* rtn = getRuntimeRtnFromOtn(otn);
-
-    evalIndex = rtn->listhead->ruleListNode->evalIndex;
+    int evalIndex = rtn->listhead->ruleListNode->evalIndex;
 
     /* bounds check index */
     if ( evalIndex >= omd_local->iMatchInfoArraySize )
@@ -298,57 +364,13 @@ int fpAddMatch(OTNX_MATCH_DATA* omd_local, int pLen, const OptTreeNode* otn)
         pc.match_limit++;
         return 1;
     }
-    pmi = &omd_local->matchInfo[evalIndex];
-
-    /*
-    **  If we hit the max number of unique events for any rule type alert,
-    **  log or pass, then we don't add it to the list.
-    */
-    if ( pmi->iMatchCount >= (int)snort_conf->fast_pattern_config->get_max_queue_events() ||
-        pmi->iMatchCount >= MAX_EVENT_MATCH)
-    {
-        pc.match_limit++;
-        return 1;
-    }
-
-    /* Check that we are not storing the same otn again */
-    for ( i=0; i< pmi->iMatchCount; i++ )
-    {
-        if ( pmi->MatchArray[ i  ] == otn )
-        {
-            //LogMessage("fpAddMatch: storing the same otn...\n");
-            return 0;
-        }
-    }
-
-    /*
-    **  Add the event to the appropriate list
-    */
-    pmi->MatchArray[ pmi->iMatchCount ] = otn;
-
-    /*
-    **  This means that we are adding a NC rule
-    **  and we only set the index to this rule
-    **  if there is no content rules in the
-    **  same array.
-    */
-    if (pLen > 0)
-    {
-        /*
-        **  Event Comparison Function
-        **  Here the largest content match is the
-        **  priority
-        */
-        if ( pmi->iMatchMaxLen < pLen )
-        {
-            pmi->iMatchMaxLen = pLen;
-            pmi->iMatchIndex  = pmi->iMatchCount;
-        }
-    }
+    int max = (int)snort_conf->fast_pattern_config->get_max_queue_events();
 
-    pmi->iMatchCount++;
+    if ( max > MAX_EVENT_MATCH )
+        max = MAX_EVENT_MATCH;
 
-    return 0;
+    return fpQueueMatch(&omd_local->matchInfo[evalIndex], otn, max,
+        snort_conf->event_queue_config->order);
 }
 
 /*
@@ -381,7 +403,7 @@ int fpEvalRTN(RuleTreeNode* rtn, Packet* p, int check_ports)
 
     DebugFormat(DEBUG_DETECT, "[*] Rule Head %p\n", rtn);
 
-    if (!rtn->rule_func->RuleHeadFunc(p, rtn, rtn->rule_func, check_ports))
+    if ( !CheckRuleHeader(rtn, p, check_ports) )
     {
         DebugMessage(DEBUG_DETECT,
             "   => Header check failed, checking next node\n");
@@ -529,60 +551,6 @@ static int rule_tree_match(
     return 0;
 }
 
-static int sortOrderByPriority(const void* e1, const void* e2)
-{
-    OptTreeNode* otn1;
-    OptTreeNode* otn2;
-
-    if (!e1 || !e2)
-        return 0;
-
-    otn1 = *(OptTreeNode**)e1;
-    otn2 = *(OptTreeNode**)e2;
-
-    if ( otn1->sigInfo.priority < otn2->sigInfo.priority )
-        return -1;
-
-    if ( otn1->sigInfo.priority > otn2->sigInfo.priority )
-        return +1;
-
-    /* This improves stability of repeated tests */
-    if ( otn1->sigInfo.id < otn2->sigInfo.id )
-        return -1;
-
-    if ( otn1->sigInfo.id > otn2->sigInfo.id )
-        return +1;
-
-    return 0;
-}
-
-static int sortOrderByContentLength(const void* e1, const void* e2)
-{
-    OptTreeNode* otn1;
-    OptTreeNode* otn2;
-
-    if (!e1 || !e2)
-        return 0;
-
-    otn1 = *(OptTreeNode**)e1;
-    otn2 = *(OptTreeNode**)e2;
-
-    if (otn1->longestPatternLen < otn2->longestPatternLen)
-        return +1;
-
-    if (otn1->longestPatternLen > otn2->longestPatternLen)
-        return -1;
-
-    /* This improves stability of repeated tests */
-    if ( otn1->sigInfo.id < otn2->sigInfo.id )
-        return +1;
-
-    if ( otn1->sigInfo.id > otn2->sigInfo.id )
-        return -1;
-
-    return 0;
-}
-
 /*
 **
 **  NAME
@@ -717,7 +685,6 @@ static inline int fpFinalSelectEvent(OTNX_MATCH_DATA* o, Packet* p)
 {
     int i;
     int j;
-    int k;
     const OptTreeNode* otn;
     int tcnt = 0;
     EventQueueConfig* eq = snort_conf->event_queue_config;
@@ -730,93 +697,57 @@ static inline int fpFinalSelectEvent(OTNX_MATCH_DATA* o, Packet* p)
         if (!SnortConfig::process_all_events() && (tcnt > 0))
             return 1;
 
-        if (o->matchInfo[i].iMatchCount)
+        /*
+         * The queues are already in priority or content length order;
+         * see fpAddMatch().  That order does NOT take precedence over
+         * 'alert drop pass ...' ordering.  If order is 'drop alert', and
+         * we log 3 for drop alerts do not get logged.  IF order is 'alert
+         * drop', and we log 3 for alert, than no drops are logged.
+         */
+        /* Process each event in the action (alert,drop,log,...) groups */
+        for (j=0; j < o->matchInfo[i].iMatchCount; j++)
         {
-            /*
-             * We must always sort so if we que 8 and log 3 and they are
-             * all from the same action group we want them sorted so we get
-             * the highest 3 in priority, priority and lenght sort do NOT
-             * take precedence over 'alert drop pass ...' ordering.  If
-             * order is 'drop alert', and we log 3 for drop alertsdo not
-             * get logged.  IF order is 'alert drop', and we log 3 for
-             * alert, than no drops are logged.  So, there should be a
-             * built in drop/sdrop/reject comes before alert/pass/log as
-             * part of the natural ordering....Jan '06..
-             */
-            /* Sort the rules in this action group */
-            if (eq->order == SNORT_EVENTQ_PRIORITY)
+            otn = o->matchInfo[i].MatchArray[j];
+            rtn = getRtnFromOtn(otn);
+
+            if (rtn && pass_action(rtn->type))
             {
-                qsort(o->matchInfo[i].MatchArray, o->matchInfo[i].iMatchCount,
-                    sizeof(void*), sortOrderByPriority);
+                /* Already acted on rules, so just don't act on anymore */
+                if ( tcnt > 0 )
+                    return 1;
             }
-            else if (eq->order == SNORT_EVENTQ_CONTENT_LEN)
+
+            if ( !fpSessionAlerted(p, otn) )
             {
-                qsort(o->matchInfo[i].MatchArray, o->matchInfo[i].iMatchCount,
-                    sizeof(void*), sortOrderByContentLength);
+                /*
+                **  QueueEvent
+                */
+                if ( SnortEventqAdd(otn) )
+                    pc.queue_limit++;
+
+                tcnt++;
             }
             else
+                pc.alert_limit++;
+
+            /* Only count it if we're going to log it */
+            if (tcnt <= eq->log_events)
             {
-                FatalError("fpdetect: Order function for event queue is invalid.\n");
+                if ( p->flow )
+                    fpAddSessionAlert(p, otn);
             }
 
-            /* Process each event in the action (alert,drop,log,...) groups */
-            for (j=0; j < o->matchInfo[i].iMatchCount; j++)
+            if (tcnt >= eq->max_events)
             {
-                otn = o->matchInfo[i].MatchArray[j];
-                rtn = getRtnFromOtn(otn);
-
-                if (otn && rtn && pass_action(rtn->type))
-                {
-                    /* Already acted on rules, so just don't act on anymore */
-                    if ( tcnt > 0 )
-                        return 1;
-                }
-
-                /*
-                **  Loop here so we don't log the same event
-                **  multiple times.
-                */
-                for (k = 0; k < j; k++)
-                {
-                    if (o->matchInfo[i].MatchArray[k] == otn)
-                    {
-                        otn = nullptr;
-                        break;
-                    }
-                }
-
-                if ( otn && !fpSessionAlerted(p, otn) )
-                {
-                    /*
-                    **  QueueEvent
-                    */
-                    if ( SnortEventqAdd(otn) )
-                        pc.queue_limit++;
-
-                    tcnt++;
-                }
-                else
-                    pc.alert_limit++;
-
-                /* Only count it if we're going to log it */
-                if (tcnt <= eq->log_events)
-                {
-                    if ( p->flow )
-                        fpAddSessionAlert(p, otn);
-                }
-
-                if (tcnt >= eq->max_events)
-                {
-                    pc.queue_limit++;
-                    return 1;
-                }
+                pc.queue_limit++;
+                return 1;
+            }
 
-                /* only log/count one pass */
-                if ( otn && rtn && pass_action(rtn->type))
-                {
-                    p->packet_flags |= PKT_PASS_RULE;
-                    return 1;
-                }
+            /* only log/count one pass */
+            if ( rtn && pass_action(rtn->type))
+            {
+                p->packet_flags |= PKT_PASS_RULE;
+                return 1;
             }
         }
     }
@@ -1384,3 +1315,165 @@ OptTreeNode* GetOTN(uint32_t gid, uint32_t sid)
     return otn;
 }
 
+
+#ifdef UNIT_TEST
+// the queues must hold what the old code logged: all unique matches
+// qsorted with these comparators and then cut to max_queue_events
+static int sortOrderByPriority(const void* e1, const void* e2)
+{
+    const OptTreeNode* otn1 = *(const OptTreeNode* const*)e1;
+    const OptTreeNode* otn2 = *(const OptTreeNode* const*)e2;
+
+    if ( otn1->sigInfo.priority < otn2->sigInfo.priority )
+        return -1;
+
+    if ( otn1->sigInfo.priority > otn2->sigInfo.priority )
+        return +1;
+
+    if ( otn1->sigInfo.id < otn2->sigInfo.id )
+        return -1;
+
+    if ( otn1->sigInfo.id > otn2->sigInfo.id )
+        return +1;
+
+    return 0;
+}
+
+static int sortOrderByContentLength(const void* e1, const void* e2)
+{
+    const OptTreeNode* otn1 = *(const OptTreeNode* const*)e1;
+    const OptTreeNode* otn2 = *(const OptTreeNode* const*)e2;
+
+    if ( otn1->longestPatternLen < otn2->longestPatternLen )
+        return +1;
+
+    if ( otn1->longestPatternLen > otn2->longestPatternLen )
+        return -1;
+
+    if ( otn1->sigInfo.id < otn2->sigInfo.id )
+        return +1;
+
+    if ( otn1->sigInfo.id > otn2->sigInfo.id )
+        return -1;
+
+    return 0;
+}
+
+// with unique ids the order is exact; otherwise qsort may order equal keys
+// either way so only the sort keys are compared
+static void check_queue(
+    std::vector<OptTreeNode>& otns, unsigned seed, int max, int order, bool unique)
+{
+    MATCH_INFO mi;
+    mi.iMatchCount = 0;
+
+    std::vector<const OptTreeNode*> added;
+
+    for ( unsigned n = 0; n < 3 * otns.size(); ++n )
+    {
+        seed = seed * 1103515245 + 12345;
+        const OptTreeNode* otn = &otns[(seed >> 16) % otns.size()];
+
+        // matches already queued are ignored; others report a full queue
+        const bool queued =
+            std::find(mi.MatchArray, mi.MatchArray + mi.iMatchCount, otn) !=
+            mi.MatchArray + mi.iMatchCount;
+        const int full = (mi.iMatchCount >= max) ? 1 : 0;
+
+        CHECK(fpQueueMatch(&mi, otn, max, order) == (queued ? 0 : full));
+
+        if ( std::find(added.begin(), added.end(), otn) == added.end() )
+            added.push_back(otn);
+    }
+
+    std::vector<const OptTreeNode*> ref = added;
+    qsort(ref.data(), ref.size(), sizeof(ref[0]),
+        order == SNORT_EVENTQ_PRIORITY ? sortOrderByPriority : sortOrderByContentLength);
+
+    if ( (int)ref.size() > max )
+        ref.resize(max);
+
+    REQUIRE(mi.iMatchCount == (int)ref.size());
+
+    for ( int i = 0; i < mi.iMatchCount; ++i )
+    {
+        const OptTreeNode* a = mi.MatchArray[i];
+        const OptTreeNode* b = ref[i];
+
+        if ( unique )
+            CHECK(a == b);
+        else
+        {
+            CHECK(a->sigInfo.id == b->sigInfo.id);
+            CHECK(a->sigInfo.priority == b->sigInfo.priority);
+            CHECK(a->longestPatternLen == b->longestPatternLen);
+        }
+    }
+}
+
+// otns are value initialized by the vector
+static void make_otns(std::vector<OptTreeNode>& otns, unsigned seed, bool unique)
+{
+    for ( unsigned i = 0; i < otns.size(); ++i )
+    {
+        seed = seed * 1103515245 + 12345;
+        otns[i].sigInfo.generator = 1;
+        otns[i].sigInfo.id = unique ? i + 1 : 1 + (seed >> 16) % 4;
+        otns[i].sigInfo.priority = 1 + (seed >> 20) % 3;
+        otns[i].longestPatternLen = (seed >> 24) % 4;
+    }
+}
+
+TEST_CASE("match queue order and truncation", "[fp_detect]")
+{
+    for ( int order : { SNORT_EVENTQ_PRIORITY, SNORT_EVENTQ_CONTENT_LEN } )
+    {
+        for ( bool unique : { true, false } )
+        {
+            for ( unsigned seed = 0; seed < 500; ++seed )
+            {
+                std::vector<OptTreeNode> otns(1 + seed % 30);
+                make_otns(otns, seed, unique);
+
+                for ( int max : { 0, 1, 3, 5, 8, 20, MAX_EVENT_MATCH } )
+                    check_queue(otns, seed, max, order, unique);
+            }
+        }
+    }
+}
+
+TEST_CASE("match queue ties", "[fp_detect]")
+{
+    // equal priority breaks on the lower sid, equal length on the higher sid
+    std::vector<OptTreeNode> otns(4);
+    make_otns(otns, 0, true);
+
+    for ( auto& otn : otns )
+    {
+        otn.sigInfo.priority = 2;
+        otn.longestPatternLen = 5;
+    }
+
+    MATCH_INFO mi;
+    mi.iMatchCount = 0;
+
+    for ( int i : { 2, 0, 3, 1 } )
+        fpQueueMatch(&mi, &otns[i], 3, SNORT_EVENTQ_PRIORITY);
+
+    REQUIRE(mi.iMatchCount == 3);
+    CHECK(mi.MatchArray[0]->sigInfo.id == 1);
+    CHECK(mi.MatchArray[1]->sigInfo.id == 2);
+    CHECK(mi.MatchArray[2]->sigInfo.id == 3);
+
+    mi.iMatchCount = 0;
+
+    for ( int i : { 2, 0, 3, 1 } )
+        fpQueueMatch(&mi, &otns[i], 3, SNORT_EVENTQ_CONTENT_LEN);
+
+    REQUIRE(mi.iMatchCount == 3);
+    CHECK(mi.MatchArray[0]->sigInfo.id == 4);
+    CHECK(mi.MatchArray[1]->sigInfo.id == 3);
+    CHECK(mi.MatchArray[2]->sigInfo.id == 2);
+}
+#endif
+
@@ -67,15 +67,12 @@ int fpEvalRTN(RuleTreeNode* rtn, Packet* p, int check_ports);
 /*
 **  MATCH_INFO
 **  The events that are matched get held in this structure,
-**  and iMatchIndex gets set to the event that holds the
-**  highest priority.
+**  best first per the event_queue order.
 */
 struct MATCH_INFO
 {
     const OptTreeNode* MatchArray[MAX_EVENT_MATCH];
     int iMatchCount;
-    int iMatchIndex;
-    int iMatchMaxLen;
 };
 
 /*
@@ -104,7 +101,7 @@ struct OTNX_MATCH_DATA
 void otnx_match_data_init(int);
 void otnx_match_data_term();
 
-int fpAddMatch(OTNX_MATCH_DATA* omd_local, int pLen, const OptTreeNode* otn);
+int fpAddMatch(OTNX_MATCH_DATA* omd_local, const OptTreeNode* otn);
 OptTreeNode* GetOTN(uint32_t gid, uint32_t sid);
 
 /* counter for number of times we evaluate rules.  Used to
@@ -36,13 +36,16 @@
 #include "log/log.h"
 #include "parser/parser.h"
 #include "events/event.h"
-#include "hash/sfxhash.h"
+#include "filters/filter_table.h"
+#include "flow/flow.h"
 #include "sfip/sfip_t.h"
 #include "sfip/sf_ip.h"
 
-/*  D E F I N E S  **************************************************/
-#define MAX_TAG_NODES   256
+#ifdef UNIT_TEST
+#include "catch/catch.hpp"
+#endif
 
+/*  D E F I N E S  **************************************************/
 /* by default we'll set a 5 minute timeout if we see no activity
  * on a tag with a 'count' metric so that we prune dead sessions
  * periodically since we're not doing TCP state tracking
@@ -54,7 +57,7 @@
 #define TAG_LOG_PKT         1
 
 /*  D A T A   S T R U C T U R E S  **********************************/
-/**Key used for identifying a session or host.
+/**Key used for identifying a session.
  */
 struct tTagFlowKey
 {
@@ -70,9 +73,6 @@ struct tTagFlowKey
  */
 struct TagNode
 {
-    /**key identifying a session or host. */
-    tTagFlowKey key;
-
     /** number of packets/seconds/bytes to tag for */
     int seconds;
     int packets;
@@ -99,215 +99,145 @@ struct TagNode
 };
 
 /*  G L O B A L S  **************************************************/
-static THREAD_LOCAL SFXHASH* host_tag_cache_ptr = nullptr;
-
-// FIXIT-M utilize Flow instead of separate cache
-static THREAD_LOCAL SFXHASH* ssn_tag_cache_ptr = nullptr;
+// host tags are keyed by address alone; session tags are kept here
+// only for packets without a flow
+static THREAD_LOCAL FilterTable* host_tag_cache = nullptr;
+static THREAD_LOCAL FilterTable* ssn_tag_cache = nullptr;
 
 static THREAD_LOCAL uint32_t last_prune_time = 0;
-static THREAD_LOCAL uint32_t tag_alloc_faults = 0;
-static THREAD_LOCAL uint32_t tag_memory_usage = 0;
 
 static THREAD_LOCAL bool s_exclusive = false;
 static THREAD_LOCAL unsigned s_sessions = 0;
 
+// number of flows with a session tag
+static THREAD_LOCAL unsigned s_flow_tags = 0;
+
 // TBD when tags leverage sessions, tag nodes can be freed at end
 // of session.  then we can configure this to allow multiple
 // (consecutive) sessions to be captured.
 static const unsigned s_max_sessions = 1;
 
-/*  P R O T O T Y P E S  ********************************************/
-static TagNode* TagAlloc(SFXHASH*);
-static void TagFree(SFXHASH*, TagNode*);
-static int TagFreeSessionNodeFunc(void* key, void* data);
-static int TagFreeHostNodeFunc(void* key, void* data);
-static int PruneTagCache(uint32_t, int);
-static int PruneTime(SFXHASH* tree, uint32_t thetime);
-static void TagSession(Packet*, TagData*, uint32_t, uint16_t, void*);
-static void TagHost(Packet*, TagData*, uint32_t, uint16_t, void*);
-static void AddTagNode(Packet*, TagData*, int, uint32_t, uint16_t, void*);
-static inline void SwapTag(TagNode*);
-
-/**Calculated memory needed per node insertion into respective cache. Its includes
- * memory needed for allocating TagNode, SFXHASH_NODE, and key size.
- *
- * @param hash - pointer to SFXHASH that should point to either ssn_tag_cache_ptr
- * or host_tag_cache_ptr.
- *
- * @returns number of bytes needed
- */
-static inline unsigned int memory_per_node(
-    SFXHASH* hash
-    )
+// session tags live with the flow so checking them is just a lookup of
+// the flow's data; they are freed along with the flow.
+class TagFlowData : public FlowData
 {
-    if (hash == ssn_tag_cache_ptr)
+public:
+    TagFlowData() : FlowData(flow_id)
     {
-        return sizeof(tTagFlowKey)+sizeof(SFXHASH_NODE)+sizeof(TagNode);
+        memset(&node, 0, sizeof(node));
+        ++s_flow_tags;
     }
-    else if (hash == host_tag_cache_ptr)
-    {
-        return sizeof(sfip_t)+sizeof(SFXHASH_NODE)+sizeof(TagNode);
-    }
-
-    return 0;
-}
-
-/** Allocate a TagNode
- *
- * Alocates a TagNode while guaranteeing that total memory usage remains within TAG_MEMCAP.
- * Least used nodes may be deleted from ssn_tag_cache and host_tag_cache to make space if
- * the limit is being exceeded.
- *
- * @param hash - pointer to SFXHASH that should point to either ssn_tag_cache_ptr
- * or host_tag_cache_ptr.
- *
- * @returns a pointer to new TagNode or NULL if memory couldn't * be allocated
- */
-static TagNode* TagAlloc(
-    SFXHASH* hash
-    )
-{
-    TagNode* tag_node = NULL;
 
-    if (tag_memory_usage + memory_per_node(hash) > TAG_MEMCAP)
+    ~TagFlowData()
     {
-        /* aggressively prune */
-        struct timeval tv;
-        struct timezone tz;
-        int pruned_nodes = 0;
-
-        tag_alloc_faults++;
-
-        gettimeofday(&tv, &tz);
-
-        pruned_nodes = PruneTagCache((uint32_t)tv.tv_sec, 0);
-
-        if (pruned_nodes == 0)
-        {
-            /* if we can't prune due to time, just try to nuke
-             * 5 not so recently used nodes */
-            pruned_nodes = PruneTagCache(0, 5);
-
-            /* unlikely to happen since memcap has been reached */
-            if (pruned_nodes == 0)
-                return NULL;
-        }
+        if ( node.metric & TAG_METRIC_SESSION )
+            s_exclusive = false;
+        --s_flow_tags;
     }
 
-    tag_node = (TagNode*)calloc(1, sizeof(TagNode));
+    static void init()
+    { flow_id = FlowData::get_flow_id(); }
 
-    if (tag_node != NULL)
-        tag_memory_usage += memory_per_node(hash);
+public:
+    static unsigned flow_id;
+    TagNode node;
+};
 
-    return tag_node;
-}
+unsigned TagFlowData::flow_id = 0;
+
+/*  P R O T O T Y P E S  ********************************************/
+static void TagSession(Packet*, TagData*, uint32_t, uint16_t, void*);
+static void TagHost(Packet*, TagData*, uint32_t, uint16_t, void*);
+static void AddTagNode(Packet*, TagData*, int, uint32_t, uint16_t, void*);
 
-/**Frees allocated TagNode.
+/**Frees a TagNode held in a tag cache.
  *
- * @param hash - pointer to SFXHASH that should point to either ssn_tag_cache_ptr
- * or host_tag_cache_ptr.
+ * @param cache - ssn_tag_cache or host_tag_cache
  * @param node - pointer to node to be freed
  */
-static void TagFree(
-    SFXHASH* hash,
-    TagNode* node
-    )
+static void TagFree(FilterTable* cache, TagNode* node)
 {
-    if (node == NULL)
-        return;
-
     if ( node->metric & TAG_METRIC_SESSION )
         s_exclusive = false;
 
-    free((void*)node);
-    tag_memory_usage -= memory_per_node(hash);
+    cache->remove(node);
 }
 
-/**Callback from session tag cache to free user data.
- * @param key - pointer to key to session tag
- * @param data - pointer to user data, to be freed.
- * @returns 0
+/**Reset all data structures and free all memory.
  */
-static int TagFreeSessionNodeFunc(void*, void* data)
+void TagCacheReset(void)
 {
-    TagFree(ssn_tag_cache_ptr, (TagNode*)data);
-    return 0;
+    if ( ssn_tag_cache )
+        ssn_tag_cache->clear();
+
+    if ( host_tag_cache )
+        host_tag_cache->clear();
 }
 
-/**Callback from host tag cache to free user data.
- * @param key - pointer to key to session tag
- * @param data - pointer to user data, to be freed.
- * @returns 0
+/**Set a session key from the packet, optionally reversed.
  */
-static int TagFreeHostNodeFunc(void*, void* data)
+static inline void SetSessionKey(tTagFlowKey& key, const Packet* p, bool swap)
 {
-    TagFree(host_tag_cache_ptr, (TagNode*)data);
-    return 0;
+    memset(&key, 0, sizeof(key));
+
+    if ( swap )
+    {
+        sfip_copy(key.sip, p->ptrs.ip_api.get_dst());
+        sfip_copy(key.dip, p->ptrs.ip_api.get_src());
+        key.sp = p->ptrs.dp;
+        key.dp = p->ptrs.sp;
+    }
+    else
+    {
+        sfip_copy(key.sip, p->ptrs.ip_api.get_src());
+        sfip_copy(key.dip, p->ptrs.ip_api.get_dst());
+        key.sp = p->ptrs.sp;
+        key.dp = p->ptrs.dp;
+    }
 }
 
-/**Reset all data structures and free all memory.
+/**Set a host key from the packet source or destination.
  */
-void TagCacheReset(void)
+static inline void SetHostKey(sfip_t& key, const Packet* p, bool dst)
 {
-    sfxhash_make_empty(ssn_tag_cache_ptr);
-    sfxhash_make_empty(host_tag_cache_ptr);
+    memset(&key, 0, sizeof(key));
+
+    if ( dst )
+        sfip_copy(key, p->ptrs.ip_api.get_dst());
+    else
+        sfip_copy(key, p->ptrs.ip_api.get_src());
 }
 
-/**
- * swap the sips and dips, dp's and sp's
- *
- * @param np TagNode ptr
- */
-static inline void SwapTag(TagNode* np)
+void InitTagFlow(void)
 {
-    sfip_t tip;
-    uint16_t tport;
-
-    tip = np->key.sip;
-    np->key.sip = np->key.dip;
-    np->key.dip = tip;
+    TagFlowData::init();
+}
 
-    tport = np->key.sp;
-    np->key.sp = np->key.dp;
-    np->key.dp = tport;
+// the tables are created on first use since few rules tag
+static FilterTable* get_ssn_cache()
+{
+    if ( !ssn_tag_cache )
+        ssn_tag_cache = new FilterTable(TAG_MEMCAP / 2, sizeof(tTagFlowKey), sizeof(TagNode));
+    return ssn_tag_cache;
 }
 
-void InitTag(void)
+static FilterTable* get_host_cache()
 {
-    unsigned int hashTableSize = TAG_MEMCAP/sizeof(TagNode);
-
-    ssn_tag_cache_ptr = sfxhash_new(
-        hashTableSize,                      /* number of hash buckets */
-        sizeof(tTagFlowKey),             /* size of the key we're going to use */
-        0,                                  /* size of the storage node */
-        0,                                  /* disable memcap*/
-        0,                                  /* use auto node recovery */
-        NULL,                               /* anr free function */
-        TagFreeSessionNodeFunc,             /* user free function */
-        0);                                 /* recycle node flag */
-
-    host_tag_cache_ptr = sfxhash_new(
-        hashTableSize,               /* number of hash buckets */
-        sizeof(sfip_t),            /* size of the key we're going to use */
-        0,                           /* size of the storage node */
-        0,                           /* disable memcap*/
-        0,                           /* use auto node recovery */
-        NULL,                        /* anr free function */
-        TagFreeHostNodeFunc,         /* user free function */
-        0);                          /* recycle node flag */
+    if ( !host_tag_cache )
+        host_tag_cache = new FilterTable(TAG_MEMCAP / 2, sizeof(sfip_t), sizeof(TagNode));
+    return host_tag_cache;
 }
 
+static inline unsigned get_count(const FilterTable* cache)
+{ return cache ? cache->get_count() : 0; }
+
 void CleanupTag(void)
 {
-    if (ssn_tag_cache_ptr)
-    {
-        sfxhash_delete(ssn_tag_cache_ptr);
-    }
+    delete ssn_tag_cache;
+    ssn_tag_cache = nullptr;
 
-    if (host_tag_cache_ptr)
-    {
-        sfxhash_delete(host_tag_cache_ptr);
-    }
+    delete host_tag_cache;
+    host_tag_cache = nullptr;
 }
 
 static void TagSession(Packet* p, TagData* tag, uint32_t time, uint16_t event_id, void* log_list)
@@ -342,9 +272,8 @@ static void TagHost(Packet* p, TagData* tag, uint32_t time, uint16_t event_id, v
 static void AddTagNode(Packet* p, TagData* tag, int mode, uint32_t now,
     uint16_t event_id, void* log_list)
 {
-    TagNode* idx;  /* index pointer */
-    TagNode* returned;
-    SFXHASH* tag_cache_ptr = NULL;
+    TagNode* node;
+    bool added = false;
 
     DebugMessage(DEBUG_FLOW, "Adding new Tag Head\n");
 
@@ -359,112 +288,150 @@ static void AddTagNode(Packet* p, TagData* tag, int mode, uint32_t now,
         s_exclusive = true;
         ++s_sessions;
     }
-    if (mode == TAG_SESSION)
+    if ( mode == TAG_SESSION and p->flow )
     {
         DebugMessage(DEBUG_FLOW,"Session Tag!\n");
-        tag_cache_ptr = ssn_tag_cache_ptr;
+        TagFlowData* fd = (TagFlowData*)p->flow->get_application_data(TagFlowData::flow_id);
+
+        if ( !fd )
+        {
+            fd = new TagFlowData;
+            p->flow->set_application_data(fd);
+            added = true;
+        }
+        node = &fd->node;
+    }
+    else if ( mode == TAG_SESSION )
+    {
+        DebugMessage(DEBUG_FLOW,"Session Tag!\n");
+
+        /* check for duplicates in either direction */
+        FilterTable* cache = get_ssn_cache();
+        tTagFlowKey key;
+        SetSessionKey(key, p, true);
+
+        if ( !(node = (TagNode*)cache->find(&key)) )
+        {
+            SetSessionKey(key, p, false);
+
+            if ( !(node = (TagNode*)cache->get(&key, now, added)) )
+                return;
+        }
+        cache->set_expiry(node, now + TAG_PRUNE_QUANTUM);
     }
     else
     {
         DebugMessage(DEBUG_FLOW,"Host Tag!\n");
-        tag_cache_ptr = host_tag_cache_ptr;
+
+        /* check for duplicates in either direction */
+        FilterTable* cache = get_host_cache();
+        sfip_t key;
+        SetHostKey(key, p, mode != TAG_HOST_DST);
+
+        if ( !(node = (TagNode*)cache->find(&key)) )
+        {
+            /* if we're supposed to be tagging the other side, swap it
+               around -- Lawrence Reed */
+            SetHostKey(key, p, mode == TAG_HOST_DST);
+
+            if ( !(node = (TagNode*)cache->get(&key, now, added)) )
+                return;
+        }
+        cache->set_expiry(node, now + TAG_PRUNE_QUANTUM);
     }
-    idx = TagAlloc(tag_cache_ptr);
 
-    /* If a TagNode couldn't be allocated, just write an error message
-     * and return - won't be able to track this one. */
-    if (idx == NULL)
+    if ( !added )
     {
-        ErrorMessage("AddTagNode(): Unable to allocate %u bytes of memory for new TagNode\n",
-            (unsigned)sizeof(TagNode));
+        DebugMessage(DEBUG_FLOW,"Existing Tag found!\n");
+
+        if ( tag->tag_metric & TAG_METRIC_SECONDS )
+            node->seconds = now + tag->tag_seconds;
+
         return;
     }
 
-    sfip_copy(idx->key.sip, p->ptrs.ip_api.get_src());
-    sfip_copy(idx->key.dip, p->ptrs.ip_api.get_dst());
-    idx->key.sp = p->ptrs.sp;
-    idx->key.dp = p->ptrs.dp;
-    idx->metric = tag->tag_metric;
-    idx->last_access = now;
-    idx->event_id = event_id;
-    idx->event_time.tv_sec = p->pkth->ts.tv_sec;
-    idx->event_time.tv_usec = p->pkth->ts.tv_usec;
-    idx->mode = mode;
-    idx->pkt_count = 0;
-    idx->log_list = log_list;
-
-    if (idx->metric & TAG_METRIC_SECONDS)
+    DebugMessage(DEBUG_FLOW,"Inserting a New Tag!\n");
+
+    node->metric = tag->tag_metric;
+    node->last_access = now;
+    node->event_id = event_id;
+    node->event_time.tv_sec = p->pkth->ts.tv_sec;
+    node->event_time.tv_usec = p->pkth->ts.tv_usec;
+    node->mode = mode;
+    node->pkt_count = 0;
+    node->log_list = log_list;
+
+    if (node->metric & TAG_METRIC_SECONDS)
     {
         /* set the expiration time for this tag */
-        idx->seconds = now + tag->tag_seconds;
+        node->seconds = now + tag->tag_seconds;
     }
 
-    if (idx->metric & TAG_METRIC_BYTES)
+    if (node->metric & TAG_METRIC_BYTES)
     {
         /* set the expiration time for this tag */
-        idx->bytes = tag->tag_bytes;
+        node->bytes = tag->tag_bytes;
     }
 
-    if (idx->metric & TAG_METRIC_PACKETS)
+    if (node->metric & TAG_METRIC_PACKETS)
     {
         /* set the expiration time for this tag */
-        idx->packets = tag->tag_packets;
+        node->packets = tag->tag_packets;
     }
+}
 
-    /* check for duplicates */
-    returned = (TagNode*)sfxhash_find(tag_cache_ptr, idx);
+/**Find the tag for a packet without a flow tag.
+ */
+static TagNode* FindTagNode(Packet* p, FilterTable*& cache)
+{
+    TagNode* node;
 
-    if (returned == NULL)
+    if ( get_count(ssn_tag_cache) )
     {
-        DebugMessage(DEBUG_FLOW,"Looking the other way!!\n");
-        SwapTag(idx);
-        returned = (TagNode*)sfxhash_find(tag_cache_ptr, idx);
-        SwapTag(idx);
-    }
+        tTagFlowKey key;
+        cache = ssn_tag_cache;
 
-    if (returned == NULL)
-    {
-        DebugMessage(DEBUG_FLOW,"Inserting a New Tag!\n");
+        DebugMessage(DEBUG_FLOW, "[*] Checking session tag list (forward)...\n");
+        SetSessionKey(key, p, false);
 
-        /* if we're supposed to be tagging the other side, swap it
-           around -- Lawrence Reed */
-        if (mode == TAG_HOST_DST)
-        {
-            SwapTag(idx);
-        }
+        if ( (node = (TagNode*)cache->find(&key)) )
+            return node;
 
-        if (sfxhash_add(tag_cache_ptr, idx, idx) != SFXHASH_OK)
-        {
-            DebugMessage(DEBUG_FLOW,
-                "sfxhash_add failed, that's going to "
-                "make life difficult\n");
-            TagFree(tag_cache_ptr, idx);
-            return;
-        }
+        DebugMessage(DEBUG_FLOW, "   Checking session tag list (reverse)...\n");
+        SetSessionKey(key, p, true);
+
+        if ( (node = (TagNode*)cache->find(&key)) )
+            return node;
     }
-    else
+
+    if ( get_count(host_tag_cache) )
     {
-        DebugMessage(DEBUG_FLOW,"Existing Tag found!\n");
+        sfip_t key;
+        cache = host_tag_cache;
 
-        if (idx->metric & TAG_METRIC_SECONDS)
-            returned->seconds = idx->seconds;
-        else
-            returned->seconds += idx->seconds;
+        DebugMessage(DEBUG_FLOW, "   Checking host tag list...\n");
+        SetHostKey(key, p, true);
 
-        /* get rid of the new tag since we are using an existing one */
-        TagFree(tag_cache_ptr, idx);
+        if ( (node = (TagNode*)cache->find(&key)) )
+            return node;
+
+        SetHostKey(key, p, false);
+
+        if ( (node = (TagNode*)cache->find(&key)) )
+            return node;
     }
+    return nullptr;
 }
 
 int CheckTagList(Packet* p, Event* event, void** log_list)
 {
-    TagNode idx;
-    TagNode* returned = NULL;
-    SFXHASH* taglist = NULL;
+    TagFlowData* fd = nullptr;
+    TagNode* returned = nullptr;
+    FilterTable* taglist = nullptr;
     char create_event = 1;
 
     /* check for active tags */
-    if (!sfxhash_count(host_tag_cache_ptr) && !sfxhash_count(ssn_tag_cache_ptr))
+    if ( !s_flow_tags and !get_count(host_tag_cache) and !get_count(ssn_tag_cache) )
     {
         return 0;
     }
@@ -475,65 +442,28 @@ int CheckTagList(Packet* p, Event* event, void** log_list)
         return 0;
     }
 
-    DebugFormat(DEBUG_FLOW,"Host Tags Active: %d   Session Tags Active: %d\n",
-        sfxhash_count(host_tag_cache_ptr), sfxhash_count(ssn_tag_cache_ptr));
-
-    DebugMessage(DEBUG_FLOW, "[*] Checking session tag list (forward)...\n");
+    DebugFormat(DEBUG_FLOW,"Host Tags Active: %u   Session Tags Active: %u\n",
+        get_count(host_tag_cache), get_count(ssn_tag_cache) + s_flow_tags);
 
-    sfip_copy(idx.key.sip, p->ptrs.ip_api.get_src());
-    sfip_copy(idx.key.dip, p->ptrs.ip_api.get_dst());
-    idx.key.sp = p->ptrs.sp;
-    idx.key.dp = p->ptrs.dp;
-
-    /* check for session tags... */
-    returned = (TagNode*)sfxhash_find(ssn_tag_cache_ptr, &idx);
-
-    if (returned == NULL)
+    if ( s_flow_tags and p->flow )
     {
-        sfip_copy(idx.key.dip, p->ptrs.ip_api.get_src());
-        sfip_copy(idx.key.sip, p->ptrs.ip_api.get_dst());
-        idx.key.dp = p->ptrs.sp;
-        idx.key.sp = p->ptrs.dp;
-
-        DebugMessage(DEBUG_FLOW, "   Checking session tag list (reverse)...\n");
-        returned = (TagNode*)sfxhash_find(ssn_tag_cache_ptr, &idx);
+        fd = (TagFlowData*)p->flow->get_application_data(TagFlowData::flow_id);
 
-        if (returned == NULL)
+        if ( fd )
         {
-            DebugMessage(DEBUG_FLOW, "   Checking host tag list "
-                "(forward)...\n");
-
-            returned = (TagNode*)sfxhash_find(host_tag_cache_ptr, &idx);
-
-            if (returned == NULL)
+            if ( fd->node.last_access + TAG_PRUNE_QUANTUM < (uint32_t)p->pkth->ts.tv_sec )
             {
-                /*
-                **  Only switch sip, because that's all we check for
-                **  the host tags.
-                */
-                sfip_copy(idx.key.sip, p->ptrs.ip_api.get_src());
-
-                returned = (TagNode*)sfxhash_find(host_tag_cache_ptr, &idx);
-            }
-
-            if (returned != NULL)
-            {
-                DebugMessage(DEBUG_FLOW,"   [*!*] Found host node\n");
-                taglist = host_tag_cache_ptr;
+                p->flow->free_application_data(fd);
+                fd = nullptr;
             }
+            else
+                returned = &fd->node;
         }
-        else
-        {
-            DebugMessage(DEBUG_FLOW,"   [*!*] Found session node\n");
-            taglist = ssn_tag_cache_ptr;
-        }
-    }
-    else
-    {
-        DebugMessage(DEBUG_FLOW,"   [*!*] Found session node\n");
-        taglist = ssn_tag_cache_ptr;
     }
 
+    if ( !returned )
+        returned = FindTagNode(p, taglist);
+
     if (returned != NULL)
     {
         DebugMessage(DEBUG_FLOW, "    ! Found tag node !\n");
@@ -541,6 +471,9 @@ int CheckTagList(Packet* p, Event* event, void** log_list)
         returned->last_access = p->pkth->ts.tv_sec;
         returned->pkt_count++;
 
+        if ( taglist )
+            taglist->set_expiry(returned, returned->last_access + TAG_PRUNE_QUANTUM);
+
         if ( returned->metric & TAG_METRIC_SECONDS )
         {
             if (p->pkth->ts.tv_sec > returned->seconds)
@@ -599,10 +532,10 @@ int CheckTagList(Packet* p, Event* event, void** log_list)
             DebugMessage(DEBUG_FLOW,
                 "    Prune condition met for tag, removing from list\n");
 
-            if (sfxhash_remove(taglist, returned) != SFXHASH_OK)
-            {
-                LogMessage("WARNING: failed to remove tagNode from hash.\n");
-            }
+            if ( taglist )
+                TagFree(taglist, returned);
+            else
+                p->flow->free_application_data(fd);
         }
     }
 
@@ -610,7 +543,13 @@ int CheckTagList(Packet* p, Event* event, void** log_list)
     {
         DebugMessage(DEBUG_FLOW,
             "Exceeded Prune Quantum, pruning tag trees\n");
-        PruneTagCache(p->pkth->ts.tv_sec, 0);
+
+        if ( ssn_tag_cache )
+            ssn_tag_cache->prune(p->pkth->ts.tv_sec);
+
+        if ( host_tag_cache )
+            host_tag_cache->prune(p->pkth->ts.tv_sec);
+
         last_prune_time = p->pkth->ts.tv_sec;
     }
 
@@ -620,75 +559,6 @@ int CheckTagList(Packet* p, Event* event, void** log_list)
     return 0;
 }
 
-static int PruneTagCache(uint32_t thetime, int mustdie)
-{
-    int pruned = 0;
-
-    if (mustdie == 0)
-    {
-        if (sfxhash_count(ssn_tag_cache_ptr) != 0)
-        {
-            pruned = PruneTime(ssn_tag_cache_ptr, thetime);
-        }
-
-        if (sfxhash_count(host_tag_cache_ptr) != 0)
-        {
-            pruned += PruneTime(host_tag_cache_ptr, thetime);
-        }
-    }
-    else
-    {
-        TagNode* lru_node = NULL;
-
-        while (pruned < mustdie &&
-            (sfxhash_count(ssn_tag_cache_ptr) > 0 || sfxhash_count(host_tag_cache_ptr) > 0))
-        {
-            if ((lru_node = (TagNode*)sfxhash_lru(ssn_tag_cache_ptr)) != NULL)
-            {
-                if (sfxhash_remove(ssn_tag_cache_ptr, lru_node) != SFXHASH_OK)
-                {
-                    LogMessage("WARNING: failed to remove tagNode from hash.\n");
-                }
-                pruned++;
-            }
-            if ((lru_node = (TagNode*)sfxhash_lru(host_tag_cache_ptr)) != NULL)
-            {
-                if (sfxhash_remove(host_tag_cache_ptr, lru_node) != SFXHASH_OK)
-                {
-                    LogMessage("WARNING: failed to remove tagNode from hash.\n");
-                }
-                pruned++;
-            }
-        }
-    }
-
-    return pruned;
-}
-
-static int PruneTime(SFXHASH* tree, uint32_t thetime)
-{
-    int pruned = 0;
-    TagNode* lru_node = NULL;
-
-    while ((lru_node = (TagNode*)sfxhash_lru(tree)) != NULL)
-    {
-        if ((lru_node->last_access + TAG_PRUNE_QUANTUM) < thetime)
-        {
-            if (sfxhash_remove(tree, lru_node) != SFXHASH_OK)
-            {
-                LogMessage("WARNING: failed to remove tagNode from hash.\n");
-            }
-            pruned++;
-        }
-        else
-        {
-            break;
-        }
-    }
-
-    return pruned;
-}
-
 void SetTags(Packet* p, const OptTreeNode* otn, uint16_t event_id)
 {
     DebugMessage(DEBUG_FLOW, "Setting tags\n");
@@ -728,3 +598,113 @@ void SetTags(Packet* p, const OptTreeNode* otn, uint16_t event_id)
     }
 }
 
+
+#ifdef UNIT_TEST
+struct TagTestPacket
+{
+    Packet pkt;
+    DAQ_PktHdr_t hdr;
+    uint8_t ip[20];
+
+    TagTestPacket(uint8_t src, uint8_t dst, Flow* flow = nullptr)
+    {
+        static const uint8_t ip4[20] =
+        { 0x45, 0, 0, 20, 0, 0, 0, 0, 64, 6, 0, 0, 10, 0, 0, 0, 10, 0, 0, 0 };
+
+        memcpy(ip, ip4, sizeof(ip));
+        ip[15] = src;
+        ip[19] = dst;
+
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.caplen = hdr.pktlen = 60;
+
+        pkt.reset();
+        pkt.pkth = &hdr;
+        pkt.flow = flow;
+        pkt.ptrs.ip_api.set(ip);
+        pkt.ptrs.sp = 1234;
+        pkt.ptrs.dp = 80;
+    }
+
+    Packet* at(time_t sec)
+    {
+        hdr.ts.tv_sec = sec;
+        return &pkt;
+    }
+};
+
+TEST_CASE("session tag with flow", "[tag]")
+{
+    if ( !TagFlowData::flow_id )
+        InitTagFlow();
+
+    CleanupTag();
+
+    Flow flow;
+    TagTestPacket tp(1, 2, &flow);
+    TagData tag = { TAG_SESSION, 0, 2, 0, TAG_METRIC_PACKETS, 0 };
+
+    AddTagNode(tp.at(100), &tag, TAG_SESSION, 100, 7, nullptr);
+
+    // the tag lives with the flow and the tables are not needed
+    CHECK(flow.get_application_data(TagFlowData::flow_id));
+    CHECK(s_flow_tags == 1);
+    CHECK(!ssn_tag_cache);
+    CHECK(!host_tag_cache);
+
+    Event event;
+    void* log_list;
+
+    CHECK(CheckTagList(tp.at(101), &event, &log_list) == 1);
+    CHECK(event.sig_info->generator == GENERATOR_TAG);
+    CHECK(event.ref_time.tv_sec == 100);
+
+    // the last tagged packet frees the flow data
+    CHECK(CheckTagList(tp.at(102), &event, &log_list) == 1);
+    CHECK(!flow.get_application_data(TagFlowData::flow_id));
+    CHECK(s_flow_tags == 0);
+
+    CHECK(CheckTagList(tp.at(103), &event, &log_list) == 0);
+    CHECK(!ssn_tag_cache);
+    CHECK(!host_tag_cache);
+}
+
+TEST_CASE("host tag batched prune", "[tag]")
+{
+    CleanupTag();
+    last_prune_time = 0;
+
+    TagTestPacket tp1(1, 2), tp2(3, 4), tp3(5, 6);
+    TagData tag = { TAG_HOST, 0, 100, 0, TAG_METRIC_PACKETS, TAG_HOST_SRC };
+
+    Event event;
+    void* log_list;
+
+    AddTagNode(tp2.at(990), &tag, TAG_HOST_SRC, 990, 1, nullptr);
+    AddTagNode(tp1.at(1000), &tag, TAG_HOST_SRC, 1000, 2, nullptr);
+
+    REQUIRE(host_tag_cache);
+    CHECK(!ssn_tag_cache);
+    CHECK(host_tag_cache->get_count() == 2);
+
+    // 1st check prunes nothing; hits extend the tag
+    CHECK(CheckTagList(tp1.at(1000), &event, &log_list) == 1);
+    CHECK(last_prune_time == 1000);
+    CHECK(CheckTagList(tp1.at(1200), &event, &log_list) == 1);
+    CHECK(host_tag_cache->get_count() == 2);
+
+    // tp2's tag expired at 1290 but waits for the next quantum
+    CHECK(CheckTagList(tp3.at(1295), &event, &log_list) == 0);
+    CHECK(host_tag_cache->get_count() == 2);
+    CHECK(last_prune_time == 1000);
+
+    CHECK(CheckTagList(tp3.at(1301), &event, &log_list) == 0);
+    CHECK(host_tag_cache->get_count() == 1);
+    CHECK(last_prune_time == 1301);
+
+    CHECK(CheckTagList(tp2.at(1302), &event, &log_list) == 0);
+    CHECK(CheckTagList(tp1.at(1302), &event, &log_list) == 1);
+
+    CleanupTag();
+}
+#endif
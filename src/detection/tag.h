@@ -23,9 +23,8 @@
 
 // rule option tag causes logging of some number of subsequent packets
 // following an alert.  this module is use by the tag option to implement
-// that functionality.  uses its own hash table.
-//
-// FIXIT-L convert tags to use flow instead of hash table.
+// that functionality.  session tags are stored with the flow; host tags
+// (and session tags on packets without a flow) use a fixed size table.
 
 #include <cstdint>
 
@@ -54,7 +53,7 @@ struct TagData
     int tag_direction;  /* source or dest, used for host tagging */
 };
 
-void InitTag(void);
+void InitTagFlow(void);
 void CleanupTag(void);
 int CheckTagList(Packet*, Event*, void**);
 void SetTags(Packet*, const OptTreeNode*, uint16_t);
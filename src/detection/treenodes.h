@@ -36,6 +36,7 @@ class IpsOption;
 struct Packet;
 struct RuleTreeNode;
 struct PortObject;
+struct PortRange;
 struct OutputSet;
 struct TagData;
 struct sfip_var_t;
@@ -69,6 +70,10 @@ struct OtnState
     uint64_t latency_timeouts = 0;
     uint64_t latency_suspends = 0;
 
+    // time in script options like luajit
+    hr_duration elapsed_script = 0_ticks;
+    uint64_t script_checks = 0;
+
     operator bool() const
     { return elapsed > 0_ticks || checks > 0; }
 };
@@ -122,33 +127,22 @@ struct OptTreeNode
     char generated;
 };
 
-/* function pointer list for rule head nodes */
-// FIXIT-L use bit mask to determine what header checks to do
-// cheaper than traversing a list and uses much less memory
-struct RuleFpList
-{
-    /* context data for this test */
-    void* context;
-
-    /* rule check function pointer */
-    int (* RuleHeadFunc)(Packet*, RuleTreeNode*, RuleFpList*, int);
-
-    /* pointer to the next rule function node */
-    RuleFpList* next;
-};
-
 // one of these per rule per policy
 // represents head part of rule
 struct RuleTreeNode
 {
-    RuleFpList* rule_func; /* match functions.. (Bidirectional etc.. ) */
-
     sfip_var_t* sip;
     sfip_var_t* dip;
 
     PortObject* src_portobject;
     PortObject* dst_portobject;
 
+    /* flattened port objects checked by CheckRuleHeader() */
+    PortRange* src_ports;
+    PortRange* dst_ports;
+    unsigned num_src_ports;
+    unsigned num_dst_ports;
+
     struct ListHead* listhead;
 
     int proto;
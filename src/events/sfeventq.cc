@@ -56,6 +56,12 @@
 #include <stdlib.h>
 #include "utils/util.h"
 
+#ifdef UNIT_TEST
+#include <algorithm>
+#include <vector>
+#include "catch/catch.hpp"
+#endif
+
 /*
 **  NAME
 **    sfeventq_new::
@@ -80,7 +86,7 @@ SF_EVENTQ* sfeventq_new(int max_nodes, int log_nodes, int event_size)
     eq = (SF_EVENTQ*)SnortAlloc(sizeof(SF_EVENTQ));
 
     /* Initialize the memory for the nodes that we are going to use. */
-    eq->node_mem = (SF_EVENTQ_NODE*)SnortAlloc(sizeof(SF_EVENTQ_NODE) * max_nodes);
+    eq->node_mem = (void**)SnortAlloc(sizeof(void*) * max_nodes);
     eq->event_mem = (char*)SnortAlloc(event_size * (max_nodes + 1));
 
     eq->max_nodes = max_nodes;
@@ -143,7 +149,6 @@ void* sfeventq_event_alloc(SF_EVENTQ* eq)
 */
 void sfeventq_reset(SF_EVENTQ* eq)
 {
-    eq->head = NULL;
     eq->cur_nodes = 0;
     eq->cur_events = 0;
     eq->reserve_event = (char*)(&eq->event_mem[eq->max_nodes * eq->event_size]);
@@ -180,46 +185,13 @@ void sfeventq_free(SF_EVENTQ* eq)
     free(eq);
 }
 
-/*
-**  NAME
-**    get_eventq_node::
-*/
-/**
-**  This function returns a ptr to the node to use.  We allocate the last
-**  event node if we have exhausted the event queue.  Before we allocate
-**  the last node, we determine if the incoming event has a higher
-**  priority than the last node.  If it does, we allocate the node, otherwise
-**  we drop it because it is lower priority.
-**
-**  If the last node is allocated, we have to point the reserve_event to
-**  the allocated event memory, since the reserved_event memory was used
-**  for the incoming event.
-**
-**  @return SF_EVENTQ_NODE *
-**
-**  @retval NULL resource exhaustion and event is lower priority than last node
-**  @retval !NULL ptr to node memory.
-*/
-static SF_EVENTQ_NODE* get_eventq_node(SF_EVENTQ* eq, void*)
-{
-    if (eq->cur_nodes >= eq->max_nodes)
-        return NULL;
-
-    /*
-    **  We grab the next node from the node memory.
-    */
-    return &eq->node_mem[eq->cur_nodes++];
-}
-
 /*
 **  NAME
 **    sfeventq_add:
 */
 /**
-**  Add this event to the queue using the supplied ordering
-**  function.  If the queue is exhausted, then we compare the
-**  event to be added with the last event, and decide whether
-**  it is a higher priority than the last node.
+**  Add this event to the end of the queue.  The caller is expected to
+**  add events in the order they should be logged.
 **
 **  @return integer
 **
@@ -228,42 +200,16 @@ static SF_EVENTQ_NODE* get_eventq_node(SF_EVENTQ* eq, void*)
 */
 int sfeventq_add(SF_EVENTQ* eq, void* event)
 {
-    SF_EVENTQ_NODE* node;
-
     if (!event)
         return -1;
 
     /*
-    **  If get_eventq_node() returns NULL, this means that
-    **  we have exhausted the eventq and the incoming event
-    **  is lower in priority then the last ranked event.
-    **  So we just drop it.
+    **  We have exhausted the eventq so we just drop it.
     */
-    node = get_eventq_node(eq, event);
-    if (!node)
+    if (eq->cur_nodes >= eq->max_nodes)
         return -1;
 
-    node->event = event;
-    node->next  = NULL;
-    node->prev  = NULL;
-
-    /*
-    **  This is the first node
-    */
-    if (eq->cur_nodes == 1)
-    {
-        eq->head = eq->last = node;
-        return 0;
-    }
-
-    /*
-    **  This means we are the last node.
-    */
-    node->prev = eq->last;
-
-    eq->last->next = node;
-    eq->last = node;
-
+    eq->node_mem[eq->cur_nodes++] = event;
     return 0;
 }
 
@@ -283,24 +229,18 @@ int sfeventq_add(SF_EVENTQ* eq, void* event)
 */
 int sfeventq_action(SF_EVENTQ* eq, int (* action_func)(void*, void*), void* user)
 {
-    SF_EVENTQ_NODE* node;
-    int logged = 0;
-
     if (action_func == NULL)
         return -1;
 
-    if (eq->head == NULL)
+    if (eq->cur_nodes == 0)
         return 0;
 
-    for (node = eq->head; node != NULL; node = node->next)
-    {
-        if (logged >= eq->log_nodes)
-            return 1;
+    int n = (eq->cur_nodes < eq->log_nodes) ? eq->cur_nodes : eq->log_nodes;
 
-        if (action_func(node->event, user))
+    for (int i = 0; i < n; i++)
+    {
+        if (action_func(eq->node_mem[i], user))
             return -1;
-
-        logged++;
     }
 
     return 1;
@@ -413,3 +353,89 @@ int main(int argc, char** argv)
 
 #endif
 
+#ifdef UNIT_TEST
+// events are logged in the order added, up to log_nodes, and events past
+// max_nodes are dropped; this is what the old linked list did
+static int log_event(void* event, void* user)
+{
+    ((std::vector<int>*)user)->push_back(*(int*)event);
+    return 0;
+}
+
+static int fail_event(void* event, void* user)
+{
+    std::vector<int>* v = (std::vector<int>*)user;
+    v->push_back(*(int*)event);
+    return v->size() == 2;
+}
+
+TEST_CASE("sfeventq bad args", "[sfeventq]")
+{
+    CHECK(sfeventq_new(0, 1, 4) == nullptr);
+    CHECK(sfeventq_new(1, 0, 4) == nullptr);
+    CHECK(sfeventq_new(1, 1, 0) == nullptr);
+}
+
+TEST_CASE("sfeventq order and truncation", "[sfeventq]")
+{
+    for ( int max = 1; max <= 9; ++max )
+    {
+        for ( int log = 1; log <= max; ++log )
+        {
+            SF_EVENTQ* eq = sfeventq_new(max, log, sizeof(int));
+
+            for ( int add = 0; add <= max + 2; ++add )
+            {
+                for ( int i = 0; i < add; ++i )
+                {
+                    int* e = (int*)sfeventq_event_alloc(eq);
+
+                    // one reserve event is available after max_nodes
+                    if ( i > max )
+                    {
+                        CHECK(e == nullptr);
+                        continue;
+                    }
+                    REQUIRE(e != nullptr);
+
+                    // ties are kept in the order added
+                    *e = i / 2;
+                    CHECK(sfeventq_add(eq, e) == (i < max ? 0 : -1));
+                }
+
+                std::vector<int> logged;
+                CHECK(sfeventq_action(eq, log_event, &logged) == (add ? 1 : 0));
+
+                const int n = std::min(std::min(add, max), log);
+                REQUIRE((int)logged.size() == n);
+
+                for ( int i = 0; i < n; ++i )
+                    CHECK(logged[i] == i / 2);
+
+                sfeventq_reset(eq);
+            }
+            sfeventq_free(eq);
+        }
+    }
+}
+
+TEST_CASE("sfeventq action failure", "[sfeventq]")
+{
+    SF_EVENTQ* eq = sfeventq_new(5, 5, sizeof(int));
+
+    for ( int i = 0; i < 4; ++i )
+    {
+        int* e = (int*)sfeventq_event_alloc(eq);
+        *e = i;
+        sfeventq_add(eq, e);
+    }
+    std::vector<int> logged;
+    CHECK(sfeventq_action(eq, fail_event, &logged) == -1);
+    CHECK(logged.size() == 2);
+    CHECK(sfeventq_action(eq, nullptr, &logged) == -1);
+    CHECK(sfeventq_add(eq, nullptr) == -1);
+
+    sfeventq_free(eq);
+}
+#endif
+
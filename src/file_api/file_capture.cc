@@ -31,12 +31,21 @@
 #endif
 
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <errno.h>
 #include <string.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "file_stats.h"
 
 #include "main/snort_config.h"
@@ -46,6 +55,104 @@
 FileMemPool* file_mempool = nullptr;
 File_Capture_Stats file_capture_stats;
 
+//--------------------------------------------------------------------------
+// file writer
+// packet threads queue reserved block chains; a single writer thread
+// stores them and releases the blocks back to the mempool.  the mempool
+// supports only one releasing thread at a time and packet threads still
+// release inline (queue full, no sha, release_file()) so all releases
+// are serialized with release_mutex.
+//--------------------------------------------------------------------------
+
+struct FileStoreRequest
+{
+    std::string name;
+    FileCaptureBlock* head;
+};
+
+class FileWriter
+{
+public:
+    FileWriter(unsigned);
+    ~FileWriter();
+
+    // returns false if the queue is full
+    bool put(const std::string&, FileCaptureBlock*);
+
+private:
+    void run();
+
+private:
+    std::deque<FileStoreRequest> queue;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cond;
+    std::thread* writer;
+    unsigned max_queued;
+    bool done = false;
+};
+
+static FileWriter* file_writer = nullptr;
+static std::mutex release_mutex;
+
+FileWriter::FileWriter(unsigned max)
+{
+    max_queued = max;
+    writer = new std::thread(&FileWriter::run, this);
+}
+
+// drains the queue before returning
+FileWriter::~FileWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        done = true;
+    }
+    queue_cond.notify_one();
+    writer->join();
+    delete writer;
+}
+
+bool FileWriter::put(const std::string& name, FileCaptureBlock* head)
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+
+        if ( queue.size() >= max_queued )
+            return false;
+
+        queue.push_back({ name, head });
+
+        if ( file_capture_stats.files_store_queue_max < queue.size() )
+            file_capture_stats.files_store_queue_max = queue.size();
+    }
+    queue_cond.notify_one();
+    return true;
+}
+
+void FileWriter::run()
+{
+    std::deque<FileStoreRequest> batch;
+    std::unique_lock<std::mutex> lock(queue_mutex);
+
+    while ( true )
+    {
+        queue_cond.wait(lock, [this]{ return done or !queue.empty(); });
+
+        if ( queue.empty() )
+            break;
+
+        // take everything queued so producers only wait on the swap
+        batch.swap(queue);
+        lock.unlock();
+
+        for ( auto& req : batch )
+            FileCapture::save_blocks(req.name, req.head);
+
+        batch.clear();
+        lock.lock();
+    }
+}
+
 FileCapture::FileCapture()
 {
     reserved = 0;
@@ -94,6 +201,12 @@ void FileCapture::init_mempool(int64_t max_file_mem, int64_t block_len)
     }
 }
 
+void FileCapture::init_writer(unsigned queue_size)
+{
+    if ( queue_size and !file_writer )
+        file_writer = new FileWriter(queue_size);
+}
+
 /*
  * Stop file capture, memory resource will be released if not reserved
  *
@@ -420,103 +533,144 @@ uint64_t FileCapture::capture_size() const
 void FileCapture::release_file()
 {
     reserved = false;
+    release_blocks(head);
+}
 
+void FileCapture::release_blocks(FileCaptureBlock* fileblock)
+{
+    std::lock_guard<std::mutex> lock(release_mutex);
     file_capture_stats.files_released_total++;
-    FileCaptureBlock* fileblock = head;
 
     while (fileblock)
     {
+        // the block may be reused as soon as it is released
+        FileCaptureBlock* next = fileblock->next;
+
         if (file_mempool_release(file_mempool, fileblock) != FILE_MEM_SUCCESS)
             file_capture_stats.file_buffers_release_errors++;
-        fileblock = fileblock->next;
+        fileblock = next;
         file_capture_stats.file_buffers_released_total++;
     }
 }
 
 /*
- * writing file to the disk.
+ * writing file blocks to the disk, gathering up to max_iov blocks per
+ * system call directly from the mempool.
  *
  * In the case of interrupt errors, the write is retried, but only for a
  * finite number of times.
  */
-void FileCapture::write_file(uint8_t* buf, size_t buf_len, FILE* fh)
+static bool write_blocks(int fd, struct iovec* iov, unsigned n)
 {
     int max_retries = 3;
-    size_t bytes_written = 0;
-    int err;
 
-    /* Nothing to write or nothing to write to */
-    if ((buf == nullptr) || (fh == nullptr))
-        return;
-
-    /* writing several times */
-    do
+    while (n)
     {
-        size_t bytes_left = buf_len - bytes_written;
+        ssize_t len = writev(fd, iov, n);
+
+        if (len < 0)
+        {
+            int err = errno;
+
+            if (((err == EINTR) || (err == EAGAIN)) && (--max_retries > 0))
+                continue;
 
-        bytes_written += fwrite(buf + bytes_written, 1, bytes_left, fh);
+            ErrorMessage("File inspect: disk writing error - %s!\n", get_error(err));
+            return false;
+        }
 
-        err = ferror(fh);
-        if (err && (err != EINTR) && (err != EAGAIN))
+        /* skip over what was written */
+        while (n && ((size_t)len >= iov->iov_len))
         {
-            break;
+            len -= iov->iov_len;
+            ++iov;
+            --n;
         }
 
-        max_retries--;
+        if (n)
+        {
+            iov->iov_base = (uint8_t*)iov->iov_base + len;
+            iov->iov_len -= len;
+        }
     }
-    while ((max_retries > 0) && (bytes_written < buf_len));
 
-    if (bytes_written < buf_len)
-    {
-        ErrorMessage("File inspect: disk writing error - %s!\n", get_error(err));
-    }
+    return true;
 }
 
-// Store files on local disk
-void FileCapture::store_file(FileContext* file)
+bool FileCapture::write_file(FileCaptureBlock* block, int fd)
 {
-    uint8_t* sha = file->get_file_sig_sha256();
-    if (!sha)
-        return;
+    const unsigned max_iov = 64;
+    struct iovec iov[max_iov];
 
-    std::string file_name = file->sha_to_string(sha);
+    while (block)
+    {
+        unsigned n = 0;
 
-    std::string file_full_name;
-    get_instance_file(file_full_name, file_name.c_str());
+        for ( ; block && (n < max_iov); block = block->next, ++n)
+        {
+            iov[n].iov_base = (uint8_t*)block + sizeof(*block);
+            iov[n].iov_len = block->length;
+        }
+
+        if (!write_blocks(fd, iov, n))
+            return false;
+    }
 
+    return true;
+}
+
+// Write the block chain to the named file and release it
+void FileCapture::save_blocks(const std::string& file_full_name, FileCaptureBlock* head)
+{
     /*Check whether the file exists*/
     struct stat buffer;
-    if (stat (file_full_name.c_str(), &buffer) == 0)
+
+    if (stat (file_full_name.c_str(), &buffer) != 0)
     {
-        return;
+        int fd = open(file_full_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if ((fd < 0) || !write_file(head, fd))
+            file_capture_stats.files_store_errors++;
+        else
+            file_capture_stats.files_stored++;
+
+        if (fd >= 0)
+            close(fd);
     }
 
-    FILE* fh = fopen(file_full_name.c_str(), "w");
-    if (!fh )
+    release_blocks(head);
+}
+
+// Store files on local disk
+void FileCapture::store_file(FileContext* file)
+{
+    // the blocks belong to the store request from here on
+    FileCaptureBlock* blocks = head;
+    head = last = current_block = nullptr;
+
+    uint8_t* sha = file->get_file_sig_sha256();
+    if (!sha)
     {
+        release_blocks(blocks);
         return;
     }
 
-    // Check the file buffer
-    uint8_t* buff = nullptr;
-    int size = 0;
-    void* file_mem;
+    std::string file_name = file->sha_to_string(sha);
 
-    do
+    std::string file_full_name;
+    get_instance_file(file_full_name, file_name.c_str());
+
+    if (file_writer)
     {
-        file_mem = get_file_data(&buff, &size);
-        // Get file from file buffer
-        if (!buff || !size )
+        if (file_writer->put(file_full_name, blocks))
         {
-            //file_inspect_stats.file_read_failures++;
+            file_capture_stats.files_store_queued++;
             return;
         }
-
-        write_file(buff, size, fh);
+        file_capture_stats.files_store_queue_full++;
     }
-    while (file_mem);
 
-    fclose(fh);
+    save_blocks(file_full_name, blocks);
 }
 
 /*Log file capture mempool usage*/
@@ -541,6 +695,13 @@ void FileCapture::print_mem_usage(void)
  */
 void FileCapture::exit(void)
 {
+    // the writer still needs the mempool for release
+    if (file_writer)
+    {
+        delete file_writer;
+        file_writer = nullptr;
+    }
+
     if (file_mempool_destroy(file_mempool) == 0)
     {
         free(file_mempool);
@@ -30,6 +30,13 @@
 //     data will stay in the mempool.
 // 3) Then file data can be read through file_capture_read()
 // 4) Finally, fila data must be released from mempool file_capture_release()
+//
+// Files stored to disk with store_file() are handed to a writer thread
+// when one was started with init_writer(); the writer releases the file
+// memory once it is written so packet threads never block on disk i/o.
+
+#include <atomic>
+#include <string>
 
 #include "file_api.h"
 #include "file_lib.h"
@@ -50,6 +57,10 @@ public:
     // this must be called during snort init
     static void init_mempool(int64_t max_file_mem, int64_t block_size);
 
+    // start the file store thread; files are written synchronously if
+    // queue_size is 0 or if the thread can't keep up
+    static void init_writer(unsigned queue_size);
+
     // Capture file data to local buffer
     // This is the main function call to enable file capture
     FileCaptureState process_buffer(const uint8_t* file_data, int data_size,
@@ -73,7 +84,8 @@ public:
     //   the size of file
     uint64_t capture_size() const;
 
-    // Store files on local disk
+    // Store reserved file on local disk; the file is released after it
+    // is written so release_file() must not be called after this
     void store_file(FileContext *file);
 
     // Release the file that is reserved in memory, this function might be
@@ -92,7 +104,10 @@ private:
     inline FileCaptureBlock* create_file_buffer(FileMemPool* file_mempool);
     inline FileCaptureState save_to_file_buffer(FileMemPool* file_mempool,
          const uint8_t* file_data, int data_size, int64_t max_size);
-    void write_file(uint8_t *buf, size_t buf_len, FILE *fh);
+    static bool write_file(FileCaptureBlock*, int fd);
+    static void save_blocks(const std::string&, FileCaptureBlock*);
+    static void release_blocks(FileCaptureBlock*);
+    friend class FileWriter;
 
     bool reserved;
     uint64_t file_size; /*file_size*/
@@ -104,10 +119,11 @@ private:
     FileCaptureState capture_state;
 };
 
+// counters updated by the writer thread are atomic
 typedef struct _File_Capture_Stats
 {
     uint64_t files_buffered_total;
-    uint64_t files_released_total;
+    std::atomic<uint64_t> files_released_total;
     uint64_t files_freed_total;
     uint64_t files_captured_total;
     uint64_t file_memcap_failures_total;
@@ -120,9 +136,14 @@ typedef struct _File_Capture_Stats
     uint64_t file_buffers_used_max;   /* maximum buffers used simultaneously*/
     uint64_t file_buffers_allocated_total;
     uint64_t file_buffers_freed_total;
-    uint64_t file_buffers_released_total;
+    std::atomic<uint64_t> file_buffers_released_total;
     uint64_t file_buffers_free_errors;
-    uint64_t file_buffers_release_errors;
+    std::atomic<uint64_t> file_buffers_release_errors;
+    uint64_t files_store_queued;      /* handed to the writer thread */
+    uint64_t files_store_queue_full;  /* written inline due to backpressure */
+    uint64_t files_store_queue_max;   /* maximum files queued simultaneously */
+    std::atomic<uint64_t> files_stored;
+    std::atomic<uint64_t> files_store_errors;
 } File_Capture_Stats;
 
 extern File_Capture_Stats file_capture_stats;
@@ -82,6 +82,11 @@ void FileConfig::process_file_rule(FileMagicRule &rule)
     fileIdentifier.insert_file_rule(rule);
 }
 
+void FileConfig::compile_file_rules()
+{
+    fileIdentifier.compile();
+}
+
 void FileConfig::process_file_policy_rule(FileRule &rule)
 {
     filePolicy.insert_file_rule(rule);
@@ -43,6 +43,7 @@
 #include "file_config.h"
 
 #include "main/snort_types.h"
+#include "memory/memory_cap.h"
 #include "stream/stream_api.h"
 #include "packet_io/active.h"
 
@@ -152,6 +153,8 @@ void FileFlows::finish_signature_lookup(FileContext* context)
 bool FileFlows::file_process(FileContext* context, const uint8_t* file_data,
     int data_size, FilePosition position)
 {
+    memory::BudgetContext budget(memory::BUDGET_FILE);
+
     if ( FileConfig::trace_stream )
     {
         FileContext::print_file_data(stdout, file_data, data_size,
@@ -239,6 +242,7 @@ bool FileFlows::file_process(FileContext* context, const uint8_t* file_data,
 bool FileFlows::file_process(const uint8_t* file_data, int data_size,
     FilePosition position, bool upload, size_t file_index)
 {
+    memory::BudgetContext budget(memory::BUDGET_FILE);
     FileContext* context;
     FileDirection direction = upload ? FILE_UPLOAD:FILE_DOWNLOAD;
     /* if both disabled, return immediately*/
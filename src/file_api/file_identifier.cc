@@ -32,6 +32,8 @@
 #include <sys/types.h>
 
 #include <algorithm>
+#include <map>
+#include <unordered_map>
 
 #include "main/snort_types.h"
 #include "main/snort_debug.h"
@@ -330,9 +332,97 @@ void FileIdentifier::insert_file_rule(FileMagicRule& rule)
     update_trie(identifier_root, node);
 }
 
+/*
+ * Compute the alphabet equivalence classes: two bytes belong to the same
+ * class if every trie node moves to the same next node on either byte.
+ */
+void FileIdentifier::compile_byte_classes(const std::vector<IdentifierNode*>& nodes)
+{
+    uint8_t classes[MAX_BRANCH] = { };
+    unsigned count = 1;
+
+    for (auto node : nodes)
+    {
+        /*refine the current partition by this node's transitions*/
+        std::map<std::pair<unsigned, IdentifierNode*>, unsigned> split;
+
+        for (int i = 0; i < MAX_BRANCH; i++)
+        {
+            auto key = std::make_pair((unsigned)classes[i], node->next[i]);
+            auto it = split.find(key);
+
+            if (it == split.end())
+                it = split.insert(std::make_pair(key, (unsigned)split.size())).first;
+
+            classes[i] = it->second;
+        }
+        count = split.size();
+    }
+
+    memcpy(byte_class, classes, sizeof(byte_class));
+    num_classes = count;
+}
+
+/*
+ * Flatten the tries into a state table. Shared nodes map to a single
+ * state so the table has one row per distinct node.
+ */
+void FileIdentifier::compile()
+{
+    std::vector<IdentifierNode*> nodes;
+    std::unordered_map<IdentifierNode*, uint32_t> state_ids;
+
+    id_states.clear();
+    id_transitions.clear();
+
+    if (identifier_root)
+    {
+        state_ids[identifier_root] = 1;
+        nodes.push_back(identifier_root);
+    }
+
+    /*breadth first so the states near the root are adjacent*/
+    for (unsigned n = 0; n < nodes.size(); n++)
+    {
+        for (int i = 0; i < MAX_BRANCH; i++)
+        {
+            IdentifierNode* next = nodes[n]->next[i];
+
+            if (next && (state_ids.find(next) == state_ids.end()))
+            {
+                nodes.push_back(next);
+                state_ids[next] = nodes.size();
+            }
+        }
+    }
+
+    compile_byte_classes(nodes);
+
+    id_states.resize(nodes.size() + 1);
+    id_transitions.assign(id_states.size() * num_classes, 0);
+
+    for (unsigned n = 0; n < nodes.size(); n++)
+    {
+        IdentifierNode* node = nodes[n];
+        uint32_t* row = &id_transitions[(n + 1) * num_classes];
+
+        id_states[n + 1].offset = node->offset;
+        id_states[n + 1].type_id = node->type_id;
+
+        for (int i = 0; i < MAX_BRANCH; i++)
+        {
+            if (node->next[i])
+                row[byte_class[i]] = state_ids[node->next[i]];
+        }
+    }
+
+    table_memory = id_states.size() * sizeof(IdentifierState) +
+        id_transitions.size() * sizeof(uint32_t);
+}
+
 /*
  * This is the main function to find file type
- * Find file type is to traverse the tries.
+ * Find file type is to walk the compiled tries.
  * Context is saved to continue file type identification as data becomes available
  */
 uint32_t FileIdentifier::find_file_type_id(const uint8_t* buf, int len, uint64_t file_offset,
@@ -345,25 +435,28 @@ uint32_t FileIdentifier::find_file_type_id(const uint8_t* buf, int len, uint64_t
     if ( !buf || len <= 0 )
         return SNORT_FILE_TYPE_CONTINUE;
 
-    if (!(*context))
-        *context = (void*)(identifier_root);
+    /*the context holds the state to resume from; root is state 1*/
+    uint32_t state = (uint32_t)(uintptr_t)(*context);
 
-    IdentifierNode* current = (IdentifierNode*)(*context);
+    if (!state && (id_states.size() > 1))
+        state = 1;
 
     uint64_t end = file_offset + len;
 
-    while (current &&  (current->offset >= file_offset))
+    while (state && (id_states[state].offset >= file_offset))
     {
+        const IdentifierState& current = id_states[state];
+
         /*Found file id, save and continue*/
-        if (current->type_id)
+        if (current.type_id)
         {
-            file_type_id = current->type_id;
+            file_type_id = current.type_id;
         }
 
-        if ( current->offset >= end )
+        if ( current.offset >= end )
         {
             /* Save current state */
-            *context = current;
+            *context = (void*)(uintptr_t)state;
             if (file_type_id)
                 return file_type_id;
             else
@@ -371,7 +464,8 @@ uint32_t FileIdentifier::find_file_type_id(const uint8_t* buf, int len, uint64_t
         }
 
         /*Move to the next level*/
-        current = current->next[buf[current->offset - file_offset ]];
+        state = id_transitions[state * num_classes +
+            byte_class[buf[current.offset - file_offset]]];
     }
 
     /*Either end of magics or passed the current offset*/
@@ -421,6 +515,7 @@ TEST_CASE ("FileIdRulePDF", "[FileMagic]")
     FileIdentifier rc;
 
     rc.insert_file_rule(rule);
+    rc.compile();
 
     const char* data = "PDF";
 
@@ -430,6 +525,31 @@ TEST_CASE ("FileIdRulePDF", "[FileMagic]")
 
 }
 
+TEST_CASE ("FileIdRecompileMemory", "[FileMagic]")
+{
+    FileMagicData magic;
+
+    magic.content = "PDF";
+    magic.offset = 0;
+
+    FileMagicRule rule;
+
+    rule.type = "pdf";
+    rule.file_magics.push_back(magic);
+    rule.id = 1;
+
+    FileIdentifier rc;
+
+    rc.insert_file_rule(rule);
+    rc.compile();
+
+    uint32_t used = rc.memory_usage();
+    CHECK(used > 0);
+
+    rc.compile();
+    CHECK(rc.memory_usage() == used);
+}
+
 TEST_CASE ("FileIdRuleUnknow", "[FileMagic]")
 {
     FileMagicData magic;
@@ -446,6 +566,7 @@ TEST_CASE ("FileIdRuleUnknow", "[FileMagic]")
     FileIdentifier rc;
 
     rc.insert_file_rule(rule);
+    rc.compile();
 
     const char* data = "DDF";
 
@@ -482,6 +603,7 @@ TEST_CASE ("FileIdRuleEXE", "[FileMagic]")
     rule.id = 3;
 
     rc.insert_file_rule(rule);
+    rc.compile();
 
     const char* data = "PDFooo";
     void *context = NULL;
@@ -515,6 +637,7 @@ TEST_CASE ("FileIdRulePDFEXE", "[FileMagic]")
     rule.id = 3;
 
     rc.insert_file_rule(rule);
+    rc.compile();
 
     const char* data = "PDFEXE";
     void *context = NULL;
@@ -549,10 +672,59 @@ TEST_CASE ("FileIdRuleFirst", "[FileMagic]")
     rule.id = 3;
 
     rc.insert_file_rule(rule);
+    rc.compile();
 
     const char* data = "PDF";
     void *context = NULL;
 
     CHECK(rc.find_file_type_id((const uint8_t *)data, strlen(data), 0, &context) == 1);
 }
+TEST_CASE ("FileIdRuleOffsetGap", "[FileMagic]")
+{
+    FileMagicData magic;
+
+    magic.content = "PK";
+    magic.offset = 0;
+
+    FileMagicRule rule;
+
+    rule.type = "zip";
+    rule.file_magics.push_back(magic);
+    rule.id = 1;
+
+    FileIdentifier rc;
+    rc.insert_file_rule(rule);
+
+    magic.clear();
+    magic.content = "MZ";
+    magic.offset = 0;
+
+    rule.clear();
+    rule.type = "exe";
+    rule.file_magics.push_back(magic);
+
+    magic.clear();
+    magic.content = "PE";
+    magic.offset = 6;
+    rule.file_magics.push_back(magic);
+    rule.id = 2;
+
+    rc.insert_file_rule(rule);
+    rc.compile();
+
+    // the second magic is in the next segment
+    const char* data = "MZxxxx";
+    void *context = NULL;
+
+    CHECK(rc.find_file_type_id((const uint8_t *)data, strlen(data), 0, &context) ==
+        SNORT_FILE_TYPE_CONTINUE);
+    CHECK(context != NULL);
+
+    data = "PE";
+    CHECK(rc.find_file_type_id((const uint8_t *)data, strlen(data), 6, &context) == 2);
+
+    data = "PKzip";
+    context = NULL;
+    CHECK(rc.find_file_type_id((const uint8_t *)data, strlen(data), 0, &context) == 1);
+}
 #endif
@@ -25,8 +25,13 @@
 // File type identification is based on file magic. To improve the detection
 // performance, a trie is created to scan file data once. Currently, only the
 // most specific file type is returned.
+//
+// Once all rules are inserted the trie is compiled into a dense state table
+// with an equivalence class alphabet; each state carries the file offset it
+// examines so identification is a single table walk over the file data.
 
 #include <list>
+#include <vector>
 #include "file_lib.h"
 #include "hash/sfghash.h"
 
@@ -84,12 +89,20 @@ struct IDMemoryBlock
 
 typedef std::list<IDMemoryBlock >  IDMemoryBlocks;
 
+struct IdentifierState
+{
+    uint32_t offset;   /* file offset examined by this state */
+    uint32_t type_id;  /* file type matched on entering this state */
+};
+
 class FileIdentifier
 {
 public:
     ~FileIdentifier();
-    uint32_t memory_usage(void) {return memory_used;}
+    uint32_t memory_usage(void) {return memory_used + table_memory;}
     void insert_file_rule(FileMagicRule& rule);
+    // must be called after the last rule is inserted
+    void compile(void);
     uint32_t find_file_type_id(const uint8_t* buf, int len, uint64_t offset, void** context);
     FileMagicRule* get_rule_from_id(uint32_t);
 private:
@@ -101,6 +114,7 @@ private:
     bool update_next(IdentifierNode* start, IdentifierNode** next_ptr, IdentifierNode* append);
     IdentifierNode* create_trie_from_magic(FileMagicRule& rule, uint32_t type_id);
     void update_trie(IdentifierNode* start, IdentifierNode* append);
+    void compile_byte_classes(const std::vector<IdentifierNode*>& nodes);
 
     /*properties*/
     IdentifierNode* identifier_root = nullptr; /*Root of magic tries*/
@@ -108,6 +122,13 @@ private:
     SFGHASH* identifier_merge_hash = nullptr;
     FileMagicRule file_magic_rules[FILE_ID_MAX + 1];
     IDMemoryBlocks idMemoryBlocks;
+
+    /*compiled tries; state 0 is the dead state and state 1 is the root*/
+    std::vector<IdentifierState> id_states;
+    std::vector<uint32_t> id_transitions; /*id_states.size() * num_classes*/
+    uint8_t byte_class[MAX_BRANCH] = { };
+    unsigned num_classes = 1;
+    uint32_t table_memory = 0; /*replaced on each compile*/
 };
 
 #endif
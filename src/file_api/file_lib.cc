@@ -37,6 +37,7 @@
 #include "file_identifier.h"
 #include "file_config.h"
 #include "hash/hashes.h"
+#include "hash/sha256_hw.h"
 #include "utils/util.h"
 #include "file_api/file_capture.h"
 
@@ -187,7 +188,7 @@ FileContext::FileContext ()
 FileContext::~FileContext ()
 {
     if (file_signature_context)
-        free(file_signature_context);
+        delete file_signature_context;
     if(file_capture)
         stop_file_capture();
 }
@@ -282,31 +283,35 @@ void FileContext::process_file_signature_sha256(const uint8_t* file_data, int si
     switch (position)
     {
     case SNORT_FILE_START:
-        file_signature_context = SnortAlloc(sizeof(SHA256_CTX));
-        SHA256_Init((SHA256_CTX*)file_signature_context);
-        SHA256_Update((SHA256_CTX*)file_signature_context, file_data, data_size);
+        if (!file_signature_context)
+            file_signature_context = new Sha256;
+        else
+            file_signature_context->init();
+        file_signature_context->update(file_data, data_size);
         break;
     case SNORT_FILE_MIDDLE:
         if (!file_signature_context)
-            file_signature_context = SnortAlloc(sizeof(SHA256_CTX));
-        SHA256_Update((SHA256_CTX*)file_signature_context, file_data, data_size);
+            file_signature_context = new Sha256;
+        file_signature_context->update(file_data, data_size);
         break;
     case SNORT_FILE_END:
         if (!file_signature_context)
-            file_signature_context = SnortAlloc(sizeof(SHA256_CTX));
-        if (processed_bytes == 0)
-            SHA256_Init((SHA256_CTX*)file_signature_context);
-        SHA256_Update((SHA256_CTX*)file_signature_context, file_data, data_size);
+            file_signature_context = new Sha256;
+        else if (processed_bytes == 0)
+            file_signature_context->init();
+        file_signature_context->update(file_data, data_size);
         sha256 = new uint8_t[SHA256_HASH_SIZE];
-        SHA256_Final(sha256, (SHA256_CTX*)file_signature_context);
+        file_signature_context->final(sha256);
         file_state.sig_state = FILE_SIG_DONE;
         break;
     case SNORT_FILE_FULL:
-        file_signature_context = SnortAlloc(sizeof (SHA256_CTX));
-        SHA256_Init((SHA256_CTX*)file_signature_context);
-        SHA256_Update((SHA256_CTX*)file_signature_context, file_data, data_size);
+        if (!file_signature_context)
+            file_signature_context = new Sha256;
+        else
+            file_signature_context->init();
+        file_signature_context->update(file_data, data_size);
         sha256 = new uint8_t[SHA256_HASH_SIZE];
-        SHA256_Final(sha256, (SHA256_CTX*)file_signature_context);
+        file_signature_context->final(sha256);
         file_state.sig_state = FILE_SIG_DONE;
         break;
     default:
@@ -35,6 +35,7 @@
 
 class FileCapture;
 class FileConfig;
+class Sha256;
 
 class FileInfo
 {
@@ -104,7 +105,7 @@ private:
     bool file_capture_enabled = false;
     uint64_t processed_bytes = 0;
     void* file_type_context;
-    void* file_signature_context;
+    Sha256* file_signature_context;
     FileConfig* file_config;
     FileCapture *file_capture;
     FileState file_state = {FILE_CAPTURE_SUCCESS, FILE_SIG_PROCESSING};
@@ -191,7 +191,6 @@ FileVerdict FilePolicy::signature_lookup(Flow* flow, FileContext* file )
             if (capture->reserve_file(file) == FILE_CAPTURE_SUCCESS)
             {
                 capture->store_file(file);
-                capture->release_file();
             }
         }
     }
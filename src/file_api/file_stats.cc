@@ -259,7 +259,7 @@ void print_file_stats()
     LogMessage("Total files buffered:              " FMTu64(
             "-10") " \n", file_capture_stats.files_buffered_total);
     LogMessage("Total files released:              " FMTu64(
-            "-10") " \n", file_capture_stats.files_released_total);
+            "-10") " \n", file_capture_stats.files_released_total.load());
     LogMessage("Total files freed:                 " FMTu64(
             "-10") " \n", file_capture_stats.files_freed_total);
     LogMessage("Total files captured:              " FMTu64(
@@ -271,13 +271,13 @@ void print_file_stats()
     LogMessage("Total buffers freed:               " FMTu64(
             "-10") " \n", file_capture_stats.file_buffers_freed_total);
     LogMessage("Total buffers released:            " FMTu64(
-            "-10") " \n", file_capture_stats.file_buffers_released_total);
+            "-10") " \n", file_capture_stats.file_buffers_released_total.load());
     LogMessage("Maximum file buffers used:         " FMTu64(
             "-10") " \n", file_capture_stats.file_buffers_used_max);
     LogMessage("Total buffers free errors:         " FMTu64(
             "-10") " \n", file_capture_stats.file_buffers_free_errors);
     LogMessage("Total buffers release errors:      " FMTu64(
-            "-10") " \n", file_capture_stats.file_buffers_release_errors);
+            "-10") " \n", file_capture_stats.file_buffers_release_errors.load());
     LogMessage("Total memcap failures:             " FMTu64(
             "-10") " \n", file_capture_stats.file_memcap_failures_total);
     LogMessage("Total memcap failures at reserve:  " FMTu64(
@@ -290,6 +290,16 @@ void print_file_stats()
             "-10") " \n", file_capture_stats.file_size_max);
     LogMessage("Total capture max before reserve:  " FMTu64(
             "-10") " \n", file_capture_stats.file_size_exceeded);
+    LogMessage("Total files queued for storage:    " FMTu64(
+            "-10") " \n", file_capture_stats.files_store_queued);
+    LogMessage("Total files stored inline (full):  " FMTu64(
+            "-10") " \n", file_capture_stats.files_store_queue_full);
+    LogMessage("Maximum files queued for storage:  " FMTu64(
+            "-10") " \n", file_capture_stats.files_store_queue_max);
+    LogMessage("Total files stored:                " FMTu64(
+            "-10") " \n", file_capture_stats.files_stored.load());
+    LogMessage("Total file store errors:           " FMTu64(
+            "-10") " \n", file_capture_stats.files_store_errors.load());
     LogMessage("Total file signature max:          " FMTu64(
             "-10") " \n", file_stats.files_sig_depth);
 
@@ -28,7 +28,7 @@
 #include "filters/sfthd.h"
 #include "main/thread.h"
 
-static THREAD_LOCAL SFXHASH* detection_filter_hash = NULL;
+static THREAD_LOCAL FilterTable* detection_filter_hash = NULL;
 
 DetectionFilterConfig* DetectionFilterConfigNew(void)
 {
@@ -70,7 +70,7 @@ void detection_filter_reset_active(void)
     if (detection_filter_hash == NULL)
         return;
 
-    sfxhash_make_empty(detection_filter_hash);
+    detection_filter_hash->clear();
 }
 
 void* detection_filter_create(DetectionFilterConfig* df_config, THDX_STRUCT* thdx)
@@ -95,9 +95,6 @@ void detection_filter_init(DetectionFilterConfig* df_config)
     if ( !detection_filter_hash )
     {
         detection_filter_hash = sfthd_local_new(df_config->memcap);
-
-        if ( !detection_filter_hash )
-            FatalError("can't allocate detection filter cache\n");
     }
 }
 
@@ -106,7 +103,7 @@ void detection_filter_term()
     if ( !detection_filter_hash )
         return;
 
-    sfxhash_delete(detection_filter_hash);
+    delete detection_filter_hash;
     detection_filter_hash = NULL;
 }
 
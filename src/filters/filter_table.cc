@@ -0,0 +1,469 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2016-2016 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+#include "filter_table.h"
+
+#include <string.h>
+
+#include "hash/sfhashfcn.h"
+#include "utils/stats.h"
+#include "utils/util.h"
+
+#ifdef UNIT_TEST
+#include "catch/catch.hpp"
+#endif
+
+constexpr time_t FilterTable::never;
+
+// entries per bucket.  each key may live in either of 2 buckets which
+// keeps buckets from overflowing long before the table is full.
+static const unsigned max_ways = 4;
+
+static inline size_t align8(size_t n)
+{ return (n + 7) & ~(size_t)7; }
+
+// keys are a few words of ids and addresses so hash a word at a time
+static inline unsigned hash_key(const uint8_t* d, size_t n, unsigned h)
+{
+    while ( n >= 4 )
+    {
+        uint32_t w;
+        memcpy(&w, d, 4);
+        h = (h ^ w) * 0x9e3779b1;
+        h ^= h >> 15;
+        d += 4;
+        n -= 4;
+    }
+    while ( n-- )
+        h = (h ^ *d++) * 0x9e3779b1;
+
+    return h ^ (h >> 16);
+}
+
+// lru ticks wrap so compare by distance
+static inline bool older(uint32_t a, uint32_t b)
+{ return (int32_t)(a - b) < 0; }
+
+FilterTable::FilterTable(size_t memcap, size_t ksz, size_t dsz)
+{
+    key_size = ksz;
+    data_size = dsz;
+    data_offset = align8(key_size);
+    slot_size = align8(data_offset + data_size);
+
+    size_t n = memcap / (slot_size + sizeof(Meta));
+
+    ways = (n < max_ways) ? (unsigned)n : max_ways;
+    rows = ways ? (unsigned)(n / ways) : 0;
+
+    // a memcap too small for even one entry disables tracking
+    if ( rows )
+    {
+        // align so each bucket's metadata is a single cache line
+        meta_mem = SnortAlloc(rows * ways * sizeof(Meta) + 63);
+        meta = (Meta*)(((uintptr_t)meta_mem + 63) & ~(uintptr_t)63);
+        mem = (uint8_t*)SnortAlloc(rows * ways * slot_size);
+    }
+    else
+    {
+        meta_mem = nullptr;
+        meta = nullptr;
+        mem = nullptr;
+    }
+
+    // same seeding as the other hash tables
+    SFHASHFCN* hf = sfhashfcn_new(rows ? rows : 1);
+    seed = hf->seed ^ hf->hardener;
+    sfhashfcn_free(hf);
+
+    count = 0;
+    last = 0;
+    tick = 0;
+}
+
+FilterTable::~FilterTable()
+{
+    free(meta_mem);
+    free(mem);
+}
+
+void FilterTable::clear()
+{
+    if ( meta )
+        memset(meta, 0, rows * ways * sizeof(Meta));
+    count = 0;
+    tick = 0;
+}
+
+// tag 0 marks a free slot
+static inline uint32_t get_tag(unsigned hash)
+{ return hash | 1; }
+
+unsigned FilterTable::lookup(const void* key, uint32_t tag, const unsigned* row, unsigned& empty)
+{
+    for ( unsigned r = 0; r < 2; ++r )
+    {
+        unsigned base = row[r] * ways;
+
+        for ( unsigned i = base; i < base + ways; ++i )
+        {
+            if ( meta[i].tag == tag )
+            {
+                if ( !memcmp(get_key(i), key, key_size) )
+                {
+                    meta[i].used = ++tick;
+                    last = i;
+                    return i;
+                }
+            }
+            else if ( !meta[i].tag and empty == ~0u )
+                empty = i;
+        }
+    }
+    return ~0u;
+}
+
+void FilterTable::get_rows(unsigned hash, unsigned* row)
+{
+    // multiply and shift instead of modulo to avoid dividing
+    uint32_t alt = hash * 0x85ebca6b ^ hash >> 13;
+    row[0] = ((uint64_t)hash * rows) >> 32;
+    row[1] = ((uint64_t)alt * rows) >> 32;
+}
+
+void* FilterTable::find(const void* key)
+{
+    if ( !count )
+        return nullptr;
+
+    unsigned hash = hash_key((const uint8_t*)key, key_size, seed);
+    unsigned row[2];
+    get_rows(hash, row);
+
+    unsigned empty = ~0u;
+    unsigned idx = lookup(key, get_tag(hash), row, empty);
+
+    return (idx == ~0u) ? nullptr : get_data(idx);
+}
+
+void* FilterTable::get(const void* key, time_t now, bool& added)
+{
+    if ( !rows )
+        return nullptr;
+
+    unsigned hash = hash_key((const uint8_t*)key, key_size, seed);
+    uint32_t tag = get_tag(hash);
+
+    unsigned row[2];
+    get_rows(hash, row);
+
+    unsigned empty = ~0u;
+    unsigned idx = lookup(key, tag, row, empty);
+
+    if ( idx != ~0u )
+    {
+        added = false;
+        return get_data(idx);
+    }
+
+    idx = empty;
+
+    if ( idx == ~0u )
+    {
+        // both buckets are full; reuse an expired entry if possible
+        // otherwise prune the least recently used
+        unsigned expired = ~0u;
+        unsigned lru = row[0] * ways;
+        uint32_t oldest = meta[lru].used;
+
+        for ( unsigned r = 0; r < 2 and expired == ~0u; ++r )
+        {
+            unsigned base = row[r] * ways;
+
+            for ( unsigned i = base; i < base + ways; ++i )
+            {
+                if ( now > meta[i].expires )
+                {
+                    expired = i;
+                    break;
+                }
+                // ages are random so select without branching
+                bool o = older(meta[i].used, oldest);
+                lru = o ? i : lru;
+                oldest = o ? meta[i].used : oldest;
+            }
+        }
+        if ( expired != ~0u )
+        {
+            idx = expired;
+            pc.filter_expires++;
+        }
+        else
+        {
+            idx = lru;
+            pc.filter_prunes++;
+        }
+    }
+    else
+        ++count;
+
+    last = idx;
+
+    Meta& m = meta[idx];
+    m.tag = tag;
+    m.used = ++tick;
+    m.expires = never;
+
+    memcpy(get_key(idx), key, key_size);
+    memset(get_data(idx), 0, data_size);
+
+    added = true;
+    return get_data(idx);
+}
+
+void FilterTable::set_expiry(void* data, time_t t)
+{
+    meta[get_index(data)].expires = t;
+}
+
+void FilterTable::remove(void* data)
+{
+    meta[get_index(data)].tag = 0;
+    --count;
+}
+
+unsigned FilterTable::prune(time_t now)
+{
+    unsigned pruned = 0;
+
+    for ( unsigned i = 0; i < rows * ways and count; ++i )
+    {
+        if ( meta[i].tag and now > meta[i].expires )
+        {
+            meta[i].tag = 0;
+            --count;
+            ++pruned;
+        }
+    }
+    return pruned;
+}
+
+#ifdef UNIT_TEST
+struct TestKey
+{
+    unsigned id;
+    uint32_t addr[4];
+};
+
+struct TestData
+{
+    unsigned count;
+    time_t start;
+};
+
+static TestKey make_key(unsigned id)
+{
+    TestKey k;
+    memset(&k, 0, sizeof(k));
+    k.id = id;
+    k.addr[0] = id * 7;
+    return k;
+}
+
+// smallest memcap holding n entries
+static size_t memcap_for(unsigned n)
+{
+    size_t m = 0;
+
+    while ( FilterTable(m, sizeof(TestKey), sizeof(TestData)).get_capacity() < 1 )
+        m += 8;
+
+    return m * n;
+}
+
+TEST_CASE("filter table hit and miss", "[filter_table]")
+{
+    FilterTable t(64 * 1024, sizeof(TestKey), sizeof(TestData));
+    TestKey k1 = make_key(1), k2 = make_key(2);
+    bool added;
+
+    CHECK(t.find(&k1) == nullptr);
+
+    TestData* d = (TestData*)t.get(&k1, 1, added);
+    REQUIRE(d);
+    CHECK(added);
+    CHECK(d->count == 0);
+    CHECK(t.get_count() == 1);
+    d->count = 5;
+
+    CHECK(t.get(&k1, 1, added) == d);
+    CHECK(!added);
+    CHECK(t.find(&k1) == d);
+    CHECK(d->count == 5);
+
+    CHECK(t.find(&k2) == nullptr);
+    TestData* d2 = (TestData*)t.get(&k2, 1, added);
+    CHECK(added);
+    CHECK(d2 != d);
+    CHECK(t.get_count() == 2);
+
+    t.clear();
+    CHECK(t.get_count() == 0);
+    CHECK(t.find(&k1) == nullptr);
+}
+
+TEST_CASE("filter table fill", "[filter_table]")
+{
+    FilterTable t(64 * 1024, sizeof(TestKey), sizeof(TestData));
+    unsigned n = t.get_capacity();
+    PegCount prunes = pc.filter_prunes;
+    bool added;
+
+    for ( unsigned i = 0; i < n; ++i )
+    {
+        TestKey k = make_key(i);
+        TestData* d = (TestData*)t.get(&k, 1, added);
+        REQUIRE(d);
+        CHECK(added);
+        d->count = i;
+    }
+    prunes = pc.filter_prunes - prunes;
+    CHECK(t.get_count() + prunes == n);
+
+    // every key is either still there with its data or was pruned
+    unsigned missing = 0;
+
+    for ( unsigned i = 0; i < n; ++i )
+    {
+        TestKey k = make_key(i);
+        TestData* d = (TestData*)t.find(&k);
+
+        if ( d )
+            CHECK(d->count == i);
+        else
+            ++missing;
+    }
+    CHECK(missing == prunes);
+
+    // two choices of bucket keep most entries in use
+    CHECK(t.get_count() > n / 2);
+}
+
+TEST_CASE("filter table reuses expired before lru", "[filter_table]")
+{
+    // a single bucket so every key competes for the same slots
+    FilterTable t(memcap_for(4), sizeof(TestKey), sizeof(TestData));
+    REQUIRE(t.get_capacity() == 4);
+
+    TestKey k[6];
+    TestData* d[6];
+    bool added;
+
+    for ( unsigned i = 0; i < 4; ++i )
+    {
+        k[i] = make_key(i + 1);
+        d[i] = (TestData*)t.get(k + i, 1, added);
+        REQUIRE(d[i]);
+    }
+    t.set_expiry(d[2], 10);
+
+    // k[0] is now the most recent so k[1] is the lru
+    CHECK(t.get(k, 5, added) == d[0]);
+
+    PegCount expires = pc.filter_expires;
+    PegCount prunes = pc.filter_prunes;
+
+    // nothing has expired yet
+    k[4] = make_key(5);
+    d[4] = (TestData*)t.get(k + 4, 5, added);
+    CHECK(added);
+    CHECK(d[4] == d[1]);
+    CHECK(pc.filter_prunes == prunes + 1);
+    CHECK(t.find(k + 1) == nullptr);
+
+    // k[2] has expired and goes before the lru, now k[3]
+    k[5] = make_key(6);
+    d[5] = (TestData*)t.get(k + 5, 20, added);
+    CHECK(added);
+    CHECK(d[5] == d[2]);
+    CHECK(pc.filter_expires == expires + 1);
+    CHECK(t.find(k + 2) == nullptr);
+    CHECK(t.find(k + 3) == d[3]);
+    CHECK(t.get_count() == 4);
+}
+
+TEST_CASE("filter table prune", "[filter_table]")
+{
+    FilterTable t(64 * 1024, sizeof(TestKey), sizeof(TestData));
+    TestKey k1 = make_key(1), k2 = make_key(2), k3 = make_key(3);
+    bool added;
+
+    t.set_expiry(t.get(&k1, 1, added), 5);
+    t.set_expiry(t.get(&k2, 1, added), 10);
+    t.get(&k3, 1, added);
+
+    CHECK(t.prune(5) == 0);
+    CHECK(t.prune(7) == 1);
+    CHECK(t.get_count() == 2);
+    CHECK(t.find(&k1) == nullptr);
+    CHECK(t.find(&k2) != nullptr);
+
+    CHECK(t.prune(1000) == 1);
+    CHECK(t.get_count() == 1);
+    CHECK(t.find(&k3) != nullptr);
+}
+
+TEST_CASE("filter table remove", "[filter_table]")
+{
+    FilterTable t(64 * 1024, sizeof(TestKey), sizeof(TestData));
+    TestKey k1 = make_key(1), k2 = make_key(2);
+    bool added;
+
+    TestData* d1 = (TestData*)t.get(&k1, 1, added);
+    TestData* d2 = (TestData*)t.get(&k2, 1, added);
+    d1->count = d2->count = 3;
+
+    t.remove(d1);
+    CHECK(t.get_count() == 1);
+    CHECK(t.find(&k1) == nullptr);
+    CHECK(t.find(&k2) == d2);
+
+    d1 = (TestData*)t.get(&k1, 1, added);
+    CHECK(added);
+    CHECK(d1->count == 0);
+    CHECK(t.get_count() == 2);
+}
+
+TEST_CASE("filter table memcap too small", "[filter_table]")
+{
+    size_t m = memcap_for(1);
+    TestKey k = make_key(1);
+    bool added;
+
+    FilterTable none(m - 1, sizeof(TestKey), sizeof(TestData));
+    CHECK(none.get_capacity() == 0);
+    CHECK(none.get(&k, 1, added) == nullptr);
+    CHECK(none.find(&k) == nullptr);
+    CHECK(none.prune(1) == 0);
+
+    FilterTable one(m, sizeof(TestKey), sizeof(TestData));
+    CHECK(one.get_capacity() == 1);
+    CHECK(one.get(&k, 1, added) != nullptr);
+    CHECK(added);
+}
+#endif
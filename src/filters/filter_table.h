@@ -0,0 +1,114 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2016-2016 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+#ifndef FILTER_TABLE_H
+#define FILTER_TABLE_H
+
+// fixed size tracking table for event_filter, rate_filter, and
+// detection_filter.  all entries are allocated up front in small set
+// associative buckets so tracking an event never allocates.  each entry
+// carries an expiration time set by the user.  when both of a key's
+// buckets are full an expired entry is reused first; otherwise the least
+// recently used entry is pruned.  the tag, lru tick, and expiration of a
+// bucket share one cache line so lookups and victim selection only touch
+// the keys and data of matching entries.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <limits>
+
+class FilterTable
+{
+public:
+    FilterTable(size_t memcap, size_t key_size, size_t data_size);
+    ~FilterTable();
+
+    // returns the data for key, adding a zeroed entry if not found.
+    // added is set true if the entry is new.  returns nullptr only if
+    // the memcap is too small for a single entry.
+    void* get(const void* key, time_t now, bool& added);
+
+    // returns the data for key or nullptr if not found
+    void* find(const void* key);
+
+    // the entry holding data may be reused for another key after t
+    void set_expiry(void* data, time_t t);
+
+    // free the entry holding data
+    void remove(void* data);
+
+    // free all entries expired as of now; returns the number freed
+    unsigned prune(time_t now);
+
+    void clear();
+
+    unsigned get_capacity() const
+    { return rows * ways; }
+
+    unsigned get_count() const
+    { return count; }
+
+    static constexpr time_t never = std::numeric_limits<time_t>::max();
+
+private:
+    struct Meta
+    {
+        uint32_t tag;       // key hash, 0 if free
+        uint32_t used;      // lru tick
+        time_t expires;
+    };
+
+    uint8_t* get_key(unsigned i) const
+    { return mem + i * slot_size; }
+
+    uint8_t* get_data(unsigned i) const
+    { return mem + i * slot_size + data_offset; }
+
+    // data is almost always from the last get so skip the divide
+    unsigned get_index(const void* data) const
+    {
+        if ( data == get_data(last) )
+            return last;
+        return ((const uint8_t*)data - data_offset - mem) / slot_size;
+    }
+
+    void get_rows(unsigned hash, unsigned* row);
+    unsigned lookup(const void* key, uint32_t tag, const unsigned* row, unsigned& empty);
+
+private:
+    Meta* meta;         // per slot, cache line aligned
+    void* meta_mem;
+    uint8_t* mem;       // per slot key and data
+
+    size_t key_size;
+    size_t data_size;
+    size_t data_offset;
+    size_t slot_size;
+
+    unsigned rows;
+    unsigned ways;
+    unsigned seed;
+    unsigned count;
+    unsigned last;
+
+    uint32_t tick;
+};
+
+#endif
+
@@ -37,7 +37,9 @@
 #include "utils/util.h"
 #include "utils/sflsq.h"
 #include "hash/sfghash.h"
-#include "hash/sfxhash.h"
+#include "filters/filter_table.h"
+#include "main/thread.h"
+#include "main/thread_config.h"
 #include "sfip/sf_ipvar.h"
 
 // Number of hash rows for gid 1 (rules)
@@ -68,9 +70,10 @@ typedef struct
 } tSFRFTrackingNodeKey;
 
 /* Tracking node for rate_filter. One node is created on fly, in tracking
- * hash for each threshold configure (identified by Tid) and source or
+ * table for each threshold configure (identified by Tid) and source or
  * destination IP address.  For rule based tracking, IP is cleared in the
- * created node. Nodes are deleted when hash performs ANR on hash.
+ * created node. Nodes are reused once they expire or pruned when the
+ * table is full.
  */
 typedef struct
 {
@@ -95,7 +98,7 @@ typedef struct
     time_t revertTime;
 } tSFRFTrackingNode;
 
-SFXHASH* rf_hash = NULL;
+static THREAD_LOCAL FilterTable* rf_hash = nullptr;
 
 // private methods ...
 static int _checkThreshold(
@@ -116,6 +119,12 @@ static tSFRFTrackingNode* _getSFRFTrackingNode(
     time_t curTime
     );
 
+static void _setExpiry(
+    tSFRFConfigNode*,
+    tSFRFTrackingNode*,
+    time_t curTime
+    );
+
 static void _updateDependentThresholds(
     RateFilterConfig* config,
     unsigned gid,
@@ -134,29 +143,10 @@ static void _updateDependentThresholds(
  * @param nbytes maximum memory to use for thresholding objects, in bytes.
  * @return  pointer to newly created tSFRFContext
 */
-#define SFRF_BYTES (sizeof(tSFRFTrackingNodeKey) + sizeof(tSFRFTrackingNode))
-
 static void SFRF_New(unsigned nbytes)
 {
-    int nrows;
-
-    /* Calc max ip nodes for this memory */
-    if ( nbytes < SFRF_BYTES )
-    {
-        nbytes = SFRF_BYTES;
-    }
-    nrows = nbytes / (SFRF_BYTES);
-
-    /* Create global hash table for all of the IP Nodes */
-    rf_hash = sfxhash_new(
-        nrows,  /* try one node per row - for speed */
-        sizeof(tSFRFTrackingNodeKey), /* keys size */
-        sizeof(tSFRFTrackingNode),     /* data size */
-        nbytes,                  /* memcap **/
-        1,         /* ANR flag - true ?- Automatic Node Recovery=ANR */
-        0,         /* ANR callback - none */
-        0,         /* user freemem callback - none */
-        1);       /* Recycle nodes ?*/
+    rf_hash = new FilterTable(
+        nbytes, sizeof(tSFRFTrackingNodeKey), sizeof(tSFRFTrackingNode));
 }
 
 void SFRF_Delete(void)
@@ -164,14 +154,14 @@ void SFRF_Delete(void)
     if ( !rf_hash )
         return;
 
-    sfxhash_delete(rf_hash);
-    rf_hash = NULL;
+    delete rf_hash;
+    rf_hash = nullptr;
 }
 
 void SFRF_Flush(void)
 {
     if ( rf_hash )
-        sfxhash_make_empty(rf_hash);
+        rf_hash->clear();
 }
 
 static void SFRF_ConfigNodeFree(void* item)
@@ -227,15 +217,6 @@ int SFRF_ConfigAdd(
 
     PolicyId policy_id = get_network_policy()->policy_id;
 
-    // Auto init - memcap must be set 1st, which is not really a problem
-    if ( rf_hash == NULL )
-    {
-        SFRF_New(rf_config->memcap);
-
-        if ( rf_hash == NULL )
-            return -1;
-    }
-
     if ((rf_config == NULL) || (cfgNode == NULL))
         return -1;
 
@@ -428,6 +409,8 @@ static int SFRF_TestObject(
         if ( cfgNode->newAction == RULE_TYPE__DROP )
             dynNode->count--;
 
+    _setExpiry(cfgNode, dynNode, curTime);
+
 #ifdef SFRF_DEBUG
     printf("--SFRF_DEBUG: %d-%d-%d: %d Packet IP %s, op: %d, count %d, action %d\n",
         cfgNode->tid, cfgNode->gid,
@@ -485,6 +468,10 @@ int SFRF_TestThreshold(
     if ( gid >= SFRF_MAX_GENID )
         return status; /* bogus gid */
 
+    // tracking is per packet thread so each gets a share of the memcap
+    if ( !rf_hash )
+        SFRF_New(config->memcap / ThreadConfig::get_instance_max());
+
     // Some events (like 'TCP connection closed' raised by preprocessor may
     // not have any configured threshold but may impact thresholds for other
     // events (like 'TCP connection opened'
@@ -804,7 +791,7 @@ static tSFRFTrackingNode* _getSFRFTrackingNode(
 {
     tSFRFTrackingNode* dynNode = NULL;
     tSFRFTrackingNodeKey key;
-    SFXHASH_NODE* hnode = NULL;
+    bool added;
 
     /* Setup key */
     key.ip = *(ip);
@@ -814,24 +801,44 @@ static tSFRFTrackingNode* _getSFRFTrackingNode(
     /*
      * Check for any Permanent sid objects for this gid or add this one ...
      */
-    hnode = sfxhash_get_node(rf_hash, (void*)&key);
-    if ( hnode && hnode->data )
-    {
-        dynNode = (tSFRFTrackingNode*)hnode->data;
+    dynNode = (tSFRFTrackingNode*)rf_hash->get(&key, curTime, added);
 
-        if ( dynNode->filterState == FS_NEW )
-        {
-            // first time initialization
-            dynNode->tstart = curTime;
+    if ( dynNode && dynNode->filterState == FS_NEW )
+    {
+        // first time initialization
+        dynNode->tstart = curTime;
 #ifdef SFRF_OVER_RATE
-            dynNode->tlast = curTime;
+        dynNode->tlast = curTime;
 #endif
-            dynNode->filterState = FS_OFF;
-        }
+        dynNode->filterState = FS_OFF;
     }
     return dynNode;
 }
 
+// once the sampling period and any revert timeout have passed, the node
+// is no different from a new one
+static void _setExpiry(
+    tSFRFConfigNode* cfgNode,
+    tSFRFTrackingNode* dynNode,
+    time_t curTime
+    )
+{
+    time_t expires = curTime + cfgNode->seconds;
+
+    if ( !cfgNode->seconds )
+        expires = FilterTable::never;  // total count
+
+    else if ( dynNode->filterState == FS_ON )
+    {
+        if ( !cfgNode->timeout )
+            expires = FilterTable::never;
+
+        else if ( dynNode->revertTime + (time_t)cfgNode->timeout > expires )
+            expires = dynNode->revertTime + cfgNode->timeout;
+    }
+    rf_hash->set_expiry(dynNode, expires);
+}
+
 #ifdef UNIT_TEST
 // FIXIT-L see sfip/sf_ip.cc
 #include "sfrf_test.cc"
@@ -43,7 +43,6 @@
 #include "sfip/sf_ipvar.h"
 #include "utils/sflsq.h"
 #include "hash/sfghash.h"
-#include "hash/sfxhash.h"
 #include "utils/util.h"
 #include "utils/dyn_array.h"
 
@@ -53,29 +52,6 @@
 // This disables adding and testing of Threshold objects
 //#define CRIPPLE
 
-SFXHASH* sfthd_new_hash(unsigned nbytes, size_t key, size_t data)
-{
-    size_t size = key + data;
-    int nrows;
-
-    /* Calc max ip nodes for this memory */
-    if ( nbytes < size )
-    {
-        nbytes = size;
-    }
-    nrows = nbytes / (size);
-
-    return sfxhash_new(
-        nrows,  /* try one node per row - for speed */
-        key,    /* keys size */
-        data,   /* data size */
-        nbytes, /* memcap **/
-        1,      /* ANR flag - true ?- Automatic Node Recovery=ANR */
-        0,      /* ANR callback - none */
-        0,      /* user freemem callback - none */
-        1);     /* Recycle nodes ?*/
-}
-
 /*!
   Create a threshold table, initialize the threshold system,
   and optionally limit it's memory usage.
@@ -87,34 +63,14 @@ SFXHASH* sfthd_new_hash(unsigned nbytes, size_t key, size_t data)
   @retval !0 valid THD_STRUCT
 */
 
-SFXHASH* sfthd_local_new(unsigned bytes)
+FilterTable* sfthd_local_new(unsigned bytes)
 {
-    SFXHASH* local_hash =
-        sfthd_new_hash(bytes,
-        sizeof(THD_IP_NODE_KEY),
-        sizeof(THD_IP_NODE));
-
-#ifdef THD_DEBUG
-    if (local_hash == NULL)
-        printf("Could not allocate the sfxhash table\n");
-#endif
-
-    return local_hash;
+    return new FilterTable(bytes, sizeof(THD_IP_NODE_KEY), sizeof(THD_IP_NODE));
 }
 
-SFXHASH* sfthd_global_new(unsigned bytes)
+FilterTable* sfthd_global_new(unsigned bytes)
 {
-    SFXHASH* global_hash =
-        sfthd_new_hash(bytes,
-        sizeof(THD_IP_GNODE_KEY),
-        sizeof(THD_IP_NODE));
-
-#ifdef THD_DEBUG
-    if (global_hash == NULL)
-        printf("Could not allocate the sfxhash table\n");
-#endif
-
-    return global_hash;
+    return new FilterTable(bytes, sizeof(THD_IP_GNODE_KEY), sizeof(THD_IP_NODE));
 }
 
 THD_STRUCT* sfthd_new(unsigned lbytes, unsigned gbytes)
@@ -130,7 +86,7 @@ THD_STRUCT* sfthd_new(unsigned lbytes, unsigned gbytes)
     if ( !thd->ip_nodes )
     {
 #ifdef THD_DEBUG
-        printf("Could not allocate the sfxhash table\n");
+        printf("Could not allocate the filter table\n");
 #endif
         free(thd);
         return NULL;
@@ -144,9 +100,9 @@ THD_STRUCT* sfthd_new(unsigned lbytes, unsigned gbytes)
     if ( !thd->ip_gnodes )
     {
 #ifdef THD_DEBUG
-        printf("Could not allocate the sfxhash table\n");
+        printf("Could not allocate the filter table\n");
 #endif
-        sfxhash_delete(thd->ip_nodes);
+        delete thd->ip_nodes;
         free(thd);
         return NULL;
     }
@@ -243,11 +199,8 @@ void sfthd_free(THD_STRUCT* thd)
         return;
 
 #ifndef CRIPPLE
-    if (thd->ip_nodes != NULL)
-        sfxhash_delete(thd->ip_nodes);
-
-    if (thd->ip_gnodes != NULL)
-        sfxhash_delete(thd->ip_gnodes);
+    delete thd->ip_nodes;
+    delete thd->ip_gnodes;
 #endif
 
     free(thd);
@@ -682,7 +635,7 @@ static char* printIP(unsigned u)
 
 #endif
 
-int sfthd_test_rule(SFXHASH* rule_hash, THD_NODE* sfthd_node,
+int sfthd_test_rule(FilterTable* rule_hash, THD_NODE* sfthd_node,
     const sfip_t* sip, const sfip_t* dip, long curtime)
 {
     int status;
@@ -880,7 +833,7 @@ static inline int sfthd_test_non_suppress(
  *
  */
 int sfthd_test_local(
-    SFXHASH* local_hash,
+    FilterTable* local_hash,
     THD_NODE* sfthd_node,
     const sfip_t* sip,
     const sfip_t* dip,
@@ -888,7 +841,6 @@ int sfthd_test_local(
 {
     THD_IP_NODE_KEY key;
     THD_IP_NODE data,* sfthd_ip_node;
-    int status=0;
     const sfip_t* ip;
 
     PolicyId policy_id = get_network_policy()->policy_id;
@@ -939,34 +891,38 @@ int sfthd_test_local(
     key.ip = *ip;
     key.thd_id = sfthd_node->thd_id;
 
-    /* Set up a new data element */
-    data.count  = 1;
-    data.prev   = 0;
-    data.tstart = data.tlast = curtime; /* Event time */
-
     /*
      * Check for any Permanent sig_id objects for this gen_id  or add this one ...
      */
-    status = sfxhash_add(local_hash, (void*)&key, &data);
-    if (status == SFXHASH_INTABLE)
-    {
-        /* Already in the table */
-        sfthd_ip_node = (THD_IP_NODE*)local_hash->cnode->data;
+    bool added;
+    THD_IP_NODE* node = (THD_IP_NODE*)local_hash->get(&key, curtime, added);
 
-        /* Increment the event count */
-        sfthd_ip_node->count++;
-    }
-    else if (status != SFXHASH_OK)
-    {
-        /* hash error */
+    if ( !node )
         return 1; /*  check the next threshold object */
+
+    if ( added )
+    {
+        node->count  = 1;
+        node->prev   = 0;
+        node->tstart = node->tlast = curtime; /* Event time */
+
+        /* Was not in the table - it was added - work with a copy of the data */
+        data = *node;
+        sfthd_ip_node = &data;
     }
     else
     {
-        /* Was not in the table - it was added - work with our copy of the data */
-        sfthd_ip_node = &data;
+        /* Already in the table */
+        sfthd_ip_node = node;
+
+        /* Increment the event count */
+        sfthd_ip_node->count++;
     }
 
+    /* tstart and tlast are at most curtime so after this the node is no
+     * different from a new one */
+    local_hash->set_expiry(node, curtime + sfthd_node->seconds);
+
     return sfthd_test_non_suppress(sfthd_node, sfthd_ip_node, curtime);
 }
 
@@ -974,7 +930,7 @@ int sfthd_test_local(
  *   Test a global thresholding object
  */
 static inline int sfthd_test_global(
-    SFXHASH* global_hash,
+    FilterTable* global_hash,
     THD_NODE* sfthd_node,
     unsigned sig_id,     /* from current event */
     const sfip_t* sip,        /* " */
@@ -984,7 +940,6 @@ static inline int sfthd_test_global(
     THD_IP_GNODE_KEY key;
     THD_IP_NODE data;
     THD_IP_NODE* sfthd_ip_node;
-    int status=0;
     const sfip_t* ip;
 
     PolicyId policy_id = get_network_policy()->policy_id;
@@ -1032,32 +987,38 @@ static inline int sfthd_test_global(
     key.sig_id = sig_id;
     key.policyId = policy_id;
 
-    /* Set up a new data element */
-    data.count  = 1;
-    data.prev  = 0;
-    data.tstart = data.tlast = curtime; /* Event time */
+    /*
+     * Check for any Permanent sig_id objects for this gen_id  or add this one ...
+     */
+    bool added;
+    THD_IP_NODE* node = (THD_IP_NODE*)global_hash->get(&key, curtime, added);
 
-    /* Check for any Permanent sig_id objects for this gen_id  or add this one ...  */
-    status = sfxhash_add(global_hash, (void*)&key, &data);
-    if (status == SFXHASH_INTABLE)
-    {
-        /* Already in the table */
-        sfthd_ip_node = (THD_IP_NODE*)global_hash->cnode->data;
+    if ( !node )
+        return 1; /*  check the next threshold object */
 
-        /* Increment the event count */
-        sfthd_ip_node->count++;
-    }
-    else if (status != SFXHASH_OK)
+    if ( added )
     {
-        /* hash error */
-        return 1; /*  check the next threshold object */
+        node->count  = 1;
+        node->prev   = 0;
+        node->tstart = node->tlast = curtime; /* Event time */
+
+        /* Was not in the table - it was added - work with a copy of the data */
+        data = *node;
+        sfthd_ip_node = &data;
     }
     else
     {
-        /* Was not in the table - it was added - work with our copy of the data */
-        sfthd_ip_node = &data;
+        /* Already in the table */
+        sfthd_ip_node = node;
+
+        /* Increment the event count */
+        sfthd_ip_node->count++;
     }
 
+    /* tstart and tlast are at most curtime so after this the node is no
+     * different from a new one */
+    global_hash->set_expiry(node, curtime + sfthd_node->seconds);
+
     return sfthd_test_non_suppress(sfthd_node, sfthd_ip_node, curtime);
 }
 
@@ -29,9 +29,9 @@
 
 #include "utils/sflsq.h"
 #include "hash/sfghash.h"
-#include "hash/sfxhash.h"
 #include "main/policy.h"
 #include "sfip/sfip_t.h"
+#include "filters/filter_table.h"
 
 /*!
     Max GEN_ID value - Set this to the Max Used by Snort, this is used for the
@@ -183,8 +183,8 @@ typedef struct
  */
 struct THD_STRUCT
 {
-    SFXHASH* ip_nodes;   /* Global hash of active IP's key=THD_IP_NODE_KEY, data=THD_IP_NODE */
-    SFXHASH* ip_gnodes;  /* Global hash of active IP's key=THD_IP_GNODE_KEY, data=THD_IP_GNODE */
+    FilterTable* ip_nodes;   /* Global table of active IP's key=THD_IP_NODE_KEY, data=THD_IP_NODE */
+    FilterTable* ip_gnodes;  /* Global table of active IP's key=THD_IP_GNODE_KEY, data=THD_IP_GNODE */
 };
 
 struct ThresholdObjects
@@ -210,13 +210,13 @@ struct ThresholdObjects
 // lbytes = local threshold memcap
 // gbytes = global threshold memcap (0 to disable global)
 THD_STRUCT* sfthd_new(unsigned lbytes, unsigned gbytes);
-SFXHASH* sfthd_local_new(unsigned bytes);
-SFXHASH* sfthd_global_new(unsigned bytes);
+FilterTable* sfthd_local_new(unsigned bytes);
+FilterTable* sfthd_global_new(unsigned bytes);
 void sfthd_free(THD_STRUCT*);
 ThresholdObjects* sfthd_objs_new(void);
 void sfthd_objs_free(ThresholdObjects*);
 
-int sfthd_test_rule(SFXHASH* rule_hash, THD_NODE* sfthd_node,
+int sfthd_test_rule(FilterTable* rule_hash, THD_NODE* sfthd_node,
     const sfip_t* sip, const sfip_t* dip, long curtime);
 
 void* sfthd_create_rule_threshold(
@@ -253,10 +253,8 @@ int sfthd_test_threshold(
     const sfip_t* dip,
     long curtime);
 
-SFXHASH* sfthd_new_hash(unsigned, size_t, size_t);
-
 int sfthd_test_local(
-    SFXHASH* local_hash,
+    FilterTable* local_hash,
     THD_NODE* sfthd_node,
     const sfip_t* sip,
     const sfip_t* dip,
@@ -90,7 +90,7 @@ typedef struct
 
 static THD_STRUCT* pThd = NULL;
 static ThresholdObjects* pThdObjs = NULL;
-static SFXHASH* dThd = NULL;
+static FilterTable* dThd = NULL;
 
 //---------------------------------------------------------------
 
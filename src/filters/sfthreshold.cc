@@ -46,11 +46,12 @@
 #include "sfthd.h"
 #include "main/analyzer.h"
 #include "main/snort_config.h"
+#include "main/thread_config.h"
 #include "utils/util.h"
 #include "parser/parser.h"
 
 /* Data */
-THD_STRUCT* thd_runtime = NULL;
+static THREAD_LOCAL THD_STRUCT* thd_runtime = NULL;
 
 static THREAD_LOCAL int thd_checked = 0; // per packet
 static THREAD_LOCAL int thd_answer = 0;  // per packet
@@ -278,14 +279,6 @@ int sfthreshold_create(
     if (!thd_config->enabled)
         return 0;
 
-    /* Auto init - memcap must be set 1st, which is not really a problem */
-    if (thd_runtime == NULL)
-    {
-        thd_runtime = sfthd_new(thd_config->memcap, thd_config->memcap);
-        if (thd_runtime == NULL)
-            return -1;
-    }
-
     /* print_thdx( thdx ); */
 
     /* Add the object to the table - */
@@ -324,6 +317,13 @@ int sfthreshold_test(
 
     if (!thd_checked)
     {
+        // tracking is per packet thread so each gets a share of the memcap
+        if (thd_runtime == NULL)
+        {
+            unsigned memcap = snort_conf->threshold_config->memcap /
+                ThreadConfig::get_instance_max();
+            thd_runtime = sfthd_new(memcap, memcap);
+        }
         thd_checked = 1;
         thd_answer = sfthd_test_threshold(snort_conf->threshold_config->thd_objs,
             thd_runtime, gen_id, sig_id, sip, dip, curtime);
@@ -349,9 +349,9 @@ void sfthreshold_reset_active(void)
         return;
 
     if (thd_runtime->ip_nodes != NULL)
-        sfxhash_make_empty(thd_runtime->ip_nodes);
+        thd_runtime->ip_nodes->clear();
 
     if (thd_runtime->ip_gnodes != NULL)
-        sfxhash_make_empty(thd_runtime->ip_gnodes);
+        thd_runtime->ip_gnodes->clear();
 }
 
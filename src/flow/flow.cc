@@ -59,7 +59,9 @@ void Flow::init(PktType proto)
     protocol = proto;
 
     // FIXIT-M getFlowbitSizeInBytes() should be attribute of ??? (or eliminate)
-    bitop = new BitOp(getFlowbitSizeInBytes());
+    // flows installed by ha are initialized before the session is created
+    if ( !bitop )
+        bitop = new BitOp(getFlowbitSizeInBytes());
 }
 
 void Flow::term()
@@ -69,6 +71,13 @@ void Flow::term()
 
     free_application_data();
 
+    if ( more_data )
+    {
+        delete[] more_data;
+        more_data = nullptr;
+        more_size = 0;
+    }
+
     if ( ssn_client )
         ssn_client->rem_ref();
 
@@ -118,7 +127,7 @@ void Flow::reset(bool do_cleanup)
     if ( data )
         clear_data();
 
-    constexpr size_t offset = offsetof(Flow, appDataList);
+    constexpr size_t offset = offsetof(Flow, flow_data);
     // FIXIT-L need a struct to zero here to make future proof
     memset((uint8_t*)this+offset, 0, sizeof(Flow)-offset);
 
@@ -161,55 +170,55 @@ void Flow::clear(bool freeAppData)
         clear_gadget();
 }
 
-int Flow::set_application_data(FlowData* fd)
+FlowData** Flow::get_slot(unsigned id)
 {
-    FlowData* appData = get_application_data(fd->get_id());
-    assert(appData != fd);
+    assert(id > 0);
 
-    if (appData)
-        free_application_data(appData);
+    if ( id <= FLOW_DATA_INLINE )
+        return flow_data + id - 1;
 
-    fd->prev = nullptr;
-    fd->next = appDataList;
+    id -= FLOW_DATA_INLINE + 1;
 
-    if ( appDataList )
-        appDataList->prev = fd;
+    if ( id >= more_size )
+    {
+        // size for all ids known now; more may be added on reload
+        unsigned n = FlowData::get_max_flow_id();
+        n = (n > FLOW_DATA_INLINE) ? n - FLOW_DATA_INLINE : 0;
 
-    appDataList = fd;
-    return 0;
+        if ( n <= id )
+            n = id + 1;
+
+        FlowData** tmp = new FlowData*[n]();
+
+        if ( more_data )
+        {
+            memcpy(tmp, more_data, more_size * sizeof(*more_data));
+            delete[] more_data;
+        }
+        more_data = tmp;
+        more_size = n;
+    }
+    return more_data + id;
 }
 
-FlowData* Flow::get_application_data(unsigned id)
+int Flow::set_application_data(FlowData* fd)
 {
-    FlowData* appData = appDataList;
+    FlowData** slot = get_slot(fd->get_id());
+    assert(*slot != fd);
 
-    while (appData)
-    {
-        if (appData->get_id() == id)
-            return appData;
+    if ( *slot )
+        delete *slot;
 
-        appData = appData->next;
-    }
-    return nullptr;
+    *slot = fd;
+    return 0;
 }
 
 void Flow::free_application_data(FlowData* fd)
 {
-    if ( fd == appDataList )
-    {
-        appDataList = fd->next;
-        if ( appDataList )
-            appDataList->prev = nullptr;
-    }
-    else if ( !fd->next )
-    {
-        fd->prev->next = nullptr;
-    }
-    else
-    {
-        fd->prev->next = fd->next;
-        fd->next->prev = fd->prev;
-    }
+    FlowData** slot = get_slot(fd->get_id());
+    assert(*slot == fd);
+
+    *slot = nullptr;
     delete fd;
 }
 
@@ -223,29 +232,38 @@ void Flow::free_application_data(uint32_t proto)
 
 void Flow::free_application_data()
 {
-    FlowData* appData = appDataList;
+    for ( unsigned i = 0; i < FLOW_DATA_INLINE; ++i )
+    {
+        if ( flow_data[i] )
+        {
+            delete flow_data[i];
+            flow_data[i] = nullptr;
+        }
+    }
 
-    while (appData)
+    for ( unsigned i = 0; i < more_size; ++i )
     {
-        FlowData* tmp = appData;
-        appData = appData->next;
-        delete tmp;
+        if ( more_data[i] )
+        {
+            delete more_data[i];
+            more_data[i] = nullptr;
+        }
     }
-    appDataList = nullptr;
 }
 
 void Flow::call_handlers(Packet* p, bool eof)
 {
-    FlowData* appData = appDataList;
-
-    while (appData)
+    for ( unsigned i = 0; i < FLOW_DATA_INLINE + more_size; ++i )
     {
+        FlowData* fd = (i < FLOW_DATA_INLINE) ? flow_data[i] : more_data[i - FLOW_DATA_INLINE];
+
+        if ( !fd )
+            continue;
+
         if ( eof )
-            appData->handle_eof(p);
+            fd->handle_eof(p);
         else
-            appData->handle_retransmit(p);
-
-        appData = appData->next;
+            fd->handle_retransmit(p);
     }
 }
 
@@ -397,3 +415,36 @@ void Flow::set_ttl(Packet* p, bool client)
     }
 }
 
+#ifdef UNIT_TEST
+
+#include "catch/catch.hpp"
+
+TEST_CASE("flow data lookup", "[flow]")
+{
+    Flow* flow = new Flow;
+    unsigned id = FLOW_DATA_INLINE + 2;
+    FlowData* fd = new FlowData(id);
+    flow->set_application_data(fd);
+
+    SECTION("id 0")
+    {
+        CHECK(flow->get_application_data(0) == nullptr);
+    }
+    SECTION("past overflow")
+    {
+        CHECK(flow->get_application_data(id) == fd);
+        CHECK(flow->get_application_data(id + 1000) == nullptr);
+    }
+    SECTION("reuse keeps overflow slots")
+    {
+        FlowData** more = flow->more_data;
+        flow->free_application_data();
+        CHECK(flow->more_data == more);
+        CHECK(flow->get_application_data(id) == nullptr);
+    }
+    flow->free_application_data();
+    flow->term();
+    delete flow;
+}
+
+#endif
@@ -24,8 +24,8 @@
 // Flow is the object that captures all the data we know about a session,
 // including IP for defragmentation and TCP for desegmentation.  For all
 // protocols, it used to track connection status bindings, and inspector
-// state.  Inspector state is stored in FlowData, and Flow manages a list
-// of FlowData items.
+// state.  Inspector state is stored in FlowData, and Flow manages a table
+// of FlowData items indexed by id.
 
 #include <assert.h>
 
@@ -84,6 +84,11 @@
 #define STREAM_STATE_IGNORE            0x1000
 #define STREAM_STATE_NO_PICKUP         0x2000
 
+// FlowData ids are assigned as inspectors are configured so they are small
+// and dense.  this many are stored inline in the flow; any others go in an
+// array allocated on first use.
+#define FLOW_DATA_INLINE 4
+
 struct Packet;
 
 typedef void (* StreamAppDataFree)(void*);
@@ -100,11 +105,15 @@ public:
     static unsigned get_flow_id()
     { return ++flow_id; }
 
+    static unsigned get_max_flow_id()
+    { return flow_id; }
+
     virtual void handle_expected(Packet*) { }
     virtual void handle_retransmit(Packet*) { }
     virtual void handle_eof(Packet*) { }
 
 public:  // FIXIT-L privatize
+    // used by ExpectCache to chain data for expected flows
     FlowData* next;
     FlowData* prev;
 
@@ -148,7 +157,6 @@ public:
     void clear(bool freeAppData = true);
 
     int set_application_data(FlowData*);
-    FlowData* get_application_data(uint32_t proto);
     void free_application_data(uint32_t proto);
     void free_application_data(FlowData*);
     void free_application_data();
@@ -275,6 +283,20 @@ public:
         disable_inspect = true;
     }
 
+    // id 0 is never assigned; ips options pass it when their inspector
+    // isn't configured
+    FlowData* get_application_data(uint32_t id)
+    {
+        if ( !id )
+            return nullptr;
+
+        if ( id <= FLOW_DATA_INLINE )
+            return flow_data[id - 1];
+
+        id -= FLOW_DATA_INLINE + 1;
+        return (id < more_size) ? more_data[id] : nullptr;
+    }
+
     bool is_inspection_disabled()
     {
         return disable_inspect;
@@ -294,8 +316,12 @@ public:  // FIXIT-M privatize if possible
     Inspector* ssn_server;
     long last_data_seen;
 
+    // overflow slots are kept across reuse; only the entries are cleared
+    FlowData** more_data;
+    unsigned more_size;
+
     // everything from here down is zeroed
-    FlowData* appDataList;
+    FlowData* flow_data[FLOW_DATA_INLINE];
     Inspector* clouseau;  // service identifier
     Inspector* gadget;    // service handler
     Inspector* data;
@@ -304,6 +330,7 @@ public:  // FIXIT-M privatize if possible
     unsigned policy_id;
 
     FlowState flow_state;
+    uint32_t ha_digest;  // last state synced to the peer
 
     // FIXIT-L can client and server ip and port be removed from flow?
     sfip_t client_ip; // FIXIT-L family and bits should be changed to uint16_t
@@ -325,9 +352,13 @@ public:  // FIXIT-M privatize if possible
 
     uint8_t  response_count;
     bool disable_inspect;
+    uint8_t ha_state;  // HAFlowSync
 
 public:
     LwState ssn_state;
+
+private:
+    FlowData** get_slot(unsigned id);
 };
 
 #endif
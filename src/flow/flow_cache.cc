@@ -24,6 +24,7 @@
 #include "config.h"
 #endif
 
+#include "flow/ha.h"
 #include "hash/zhash.h"
 #include "helpers/flag_context.h"
 #include "ips_options/ips_flowbits.h"
@@ -152,6 +153,7 @@ Flow* FlowCache::get(const FlowKey* key)
 
 int FlowCache::release(Flow* flow, PruneReason reason, bool do_cleanup)
 {
+    HighAvailabilityManager::process_deletion(flow);
     flow->reset(do_cleanup);
     prune_stats.update(reason);
     return remove(flow);
@@ -459,6 +459,7 @@ static void init_roles(Packet* p, Flow* flow)
 
 unsigned FlowControl::process(Flow* flow, Packet* p)
 {
+    memory::BudgetContext budget(memory::BUDGET_FLOW);
     unsigned news = 0;
 
     p->flow = flow;
@@ -494,10 +495,13 @@ unsigned FlowControl::process(Flow* flow, Packet* p)
         break;
 
     case Flow::INSPECT:
+    {
         assert(flow->ssn_client);
         assert(flow->ssn_server);
+        memory::BudgetContext stream_budget(memory::BUDGET_STREAM);
         flow->session->process(p);
         break;
+    }
 
     case Flow::ALLOW:
         if ( news )
@@ -16,24 +16,122 @@
 // 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 //--------------------------------------------------------------------------
 // ha.cc author Ed Borgoyn <eborgoyn@cisco.com>
-
 #include "ha.h"
 
 #include <assert.h>
+#include <string.h>
 #include <functional>
+#include <vector>
 
 #include "flow.h"
+#include "flow_control.h"
 #include "main/snort_debug.h"
 #include "packet_io/sfdaq.h"
 #include "side_channel/side_channel.h"
+#include "stream/stream.h"
+#include "target_based/snort_protocols.h"
 
+// records are batched until the message fills, a new second starts, or
+// the thread terminates
 static THREAD_LOCAL HighAvailability* ha;
 
+// clients are registered during configuration and indexed by id
+static std::vector<HighAvailabilityClient*> s_clients;
+
+//-------------------------------------------------------------------------
+// encoding
+//-------------------------------------------------------------------------
+
+// service is left to the caller to avoid a name lookup per packet
+static void get_state(const Flow* flow, HAFlowState& hs)
+{
+    memset(&hs, 0, sizeof(hs));
+
+    hs.session_flags = flow->ssn_state.session_flags;
+    hs.policy_id = flow->policy_id;
+    hs.ipprotocol = flow->ssn_state.ipprotocol;
+    hs.application_protocol = flow->ssn_state.application_protocol;
+    hs.ssn_policy = flow->ssn_policy;
+    hs.session_state = flow->session_state;
+    hs.client_port = flow->client_port;
+    hs.server_port = flow->server_port;
+    hs.flow_state = (uint8_t)flow->flow_state;
+    hs.direction = flow->ssn_state.direction;
+    hs.ignore_direction = flow->ssn_state.ignore_direction;
+    hs.client_ip = flow->client_ip;
+    hs.server_ip = flow->server_ip;
+}
+
+static void set_state(Flow* flow, const HAFlowState& hs)
+{
+    flow->ssn_state.session_flags = hs.session_flags;
+    flow->ssn_state.ipprotocol = hs.ipprotocol;
+    flow->ssn_state.application_protocol = hs.application_protocol;
+    flow->ssn_state.direction = hs.direction;
+    flow->ssn_state.ignore_direction = hs.ignore_direction;
+
+    flow->policy_id = hs.policy_id;
+    flow->ssn_policy = hs.ssn_policy;
+    flow->session_state = hs.session_state;
+
+    flow->client_ip = hs.client_ip;
+    flow->server_ip = hs.server_ip;
+    flow->client_port = hs.client_port;
+    flow->server_port = hs.server_port;
+
+    flow->service = hs.service > 0 ? get_protocol_name(hs.service) : nullptr;
+
+    // verdicts carry over as is; inspected flows are rebound by the
+    // binder on the first packet seen here
+    switch ( hs.flow_state )
+    {
+    case Flow::BLOCK:
+    case Flow::RESET:
+    case Flow::ALLOW:
+        flow->set_state((Flow::FlowState)hs.flow_state);
+        break;
+    default:
+        flow->set_state(Flow::SETUP);
+    }
+}
+
+// only used to detect changes so mixing a word at a time is plenty
+static uint32_t get_digest(const HAFlowState& hs, const char* service)
+{
+    const uint8_t* s = (const uint8_t*)&hs;
+    uint64_t h = (uint64_t)(uintptr_t)service;
+    unsigned i;
+
+    for ( i = 0; i + sizeof(h) <= sizeof(hs); i += sizeof(h) )
+    {
+        uint64_t w;
+        memcpy(&w, s + i, sizeof(w));
+        h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+    }
+    for ( ; i < sizeof(hs); ++i )
+        h = (h ^ s[i]) * 0x9e3779b97f4a7c15ull;
+
+    uint32_t d = (uint32_t)(h >> 32);
+
+    // 0 is reserved for never synced
+    return d ? d : 1;
+}
+
+//-------------------------------------------------------------------------
+// HighAvailability
+//-------------------------------------------------------------------------
+
 HighAvailability::HighAvailability()
 {
     using namespace std::placeholders;
     DebugMessage(DEBUG_HA,"HighAvailability::HighAvailability()\n");
 
+    buf = nullptr;
+    used = 0;
+    count = 0;
+    receiving = false;
+    last_flush = 0;
+
     sc = SideChannelManager::get_side_channel( (SCPort)1);
 
     // If we don't have a side channel, move-on and don't perform ha processing.
@@ -42,6 +140,9 @@ HighAvailability::HighAvailability()
 
     sc->set_default_port(1);
     sc->register_receive_handler(std::bind(&HighAvailability::receive_handler, this, _1));
+
+    if ( sc->connector_transmit )
+        buf = new uint8_t[HA_MAX_MESSAGE];
 }
 
 HighAvailability::~HighAvailability()
@@ -52,36 +153,290 @@ HighAvailability::~HighAvailability()
     if ( !sc )
         return;
 
+    flush();
+
     sc->unregister_receive_handler();
     delete sc;
+    delete[] buf;
+}
+
+void HighAvailability::flush()
+{
+    if ( !count )
+        return;
+
+    HAMessageHeader* hdr = (HAMessageHeader*)buf;
+    hdr->version = HA_MESSAGE_VERSION;
+    hdr->count = count;
+    hdr->length = used;
+
+    SCMessage* msg = sc->alloc_transmit_message(used);
+    memcpy(msg->content, buf, used);
+    sc->transmit_message(msg);
+    delete msg;
+
+    DebugFormat(DEBUG_HA, "HighAvailability::flush: %u records, %u bytes\n",
+        count, used);
+
+    used = 0;
+    count = 0;
+}
+
+bool HighAvailability::reserve(uint16_t len)
+{
+    if ( !used )
+        used = sizeof(HAMessageHeader);
+
+    if ( used + len > HA_MAX_MESSAGE or count == UINT8_MAX )
+    {
+        flush();
+        used = sizeof(HAMessageHeader);
+    }
+    return used + len <= HA_MAX_MESSAGE;
+}
+
+void HighAvailability::add_update(Flow* flow, HAFlowState& hs)
+{
+    // stage the record since client lengths aren't known up front
+    uint8_t tmp[HA_MAX_MESSAGE - sizeof(HAMessageHeader)];
+
+    HARecordHeader* rec = (HARecordHeader*)tmp;
+    rec->event = HA_UPDATE;
+    rec->clients = 0;
+    rec->key = *flow->key;
+
+    hs.service = flow->service ? FindProtocolReference(flow->service) : 0;
+
+    uint16_t len = sizeof(*rec);
+    memcpy(tmp + len, &hs, sizeof(hs));
+    len += sizeof(hs);
+
+    for ( auto* c : s_clients )
+    {
+        if ( !c )
+            continue;
+
+        uint16_t avail = sizeof(tmp) - len;
+
+        if ( avail <= sizeof(HAClientHeader) )
+            break;
+
+        avail -= sizeof(HAClientHeader);
+        HAClientHeader* ch = (HAClientHeader*)(tmp + len);
+
+        uint8_t n = c->encode(flow, (uint8_t*)(ch + 1),
+            avail < UINT8_MAX ? avail : UINT8_MAX);
+
+        if ( !n )
+            continue;
+
+        ch->id = c->get_id();
+        ch->length = n;
+        len += sizeof(*ch) + n;
+        rec->clients++;
+    }
+    rec->length = len;
+
+    if ( !reserve(len) )
+        return;
+
+    memcpy(buf + used, tmp, len);
+    used += len;
+    count++;
+}
+
+void HighAvailability::add_delete(Flow* flow)
+{
+    if ( !reserve(sizeof(HARecordHeader)) )
+        return;
+
+    HARecordHeader* rec = (HARecordHeader*)(buf + used);
+    rec->event = HA_DELETE;
+    rec->clients = 0;
+    rec->length = sizeof(*rec);
+    rec->key = *flow->key;
+
+    used += sizeof(*rec);
+    count++;
+}
+
+//-------------------------------------------------------------------------
+// decoding
+//-------------------------------------------------------------------------
+
+void HighAvailability::update_flow(
+    const FlowKey* key, unsigned clients, const uint8_t* data, uint16_t len)
+{
+    if ( len < sizeof(HAFlowState) )
+        return;
+
+    Flow* flow = flow_con->find_flow(key);
+
+    // never clobber a flow we are processing
+    if ( flow and flow->ha_state != HA_STANDBY )
+        return;
+
+    if ( !flow )
+    {
+        if ( !(flow = flow_con->new_flow(key)) )
+            return;
+
+        flow->init((PktType)key->protocol);
+        flow->ha_state = HA_STANDBY;
+    }
+
+    // the digest stays clear so the first packet here announces the flow
+    HAFlowState hs;
+    memcpy(&hs, data, sizeof(hs));
+    set_state(flow, hs);
+
+    data += sizeof(hs);
+    len -= sizeof(hs);
+
+    for ( unsigned i = 0; i < clients; ++i )
+    {
+        if ( len < sizeof(HAClientHeader) )
+            break;
+
+        HAClientHeader ch;
+        memcpy(&ch, data, sizeof(ch));
+        data += sizeof(ch);
+        len -= sizeof(ch);
+
+        if ( ch.length > len )
+            break;
+
+        if ( ch.id < s_clients.size() and s_clients[ch.id] )
+            s_clients[ch.id]->decode(flow, data, ch.length);
+
+        data += ch.length;
+        len -= ch.length;
+    }
+}
+
+void HighAvailability::delete_flow(const FlowKey* key)
+{
+    Flow* flow = flow_con->find_flow(key);
+
+    if ( !flow )
+        return;
+
+    // don't echo the deletion back
+    flow->ha_state = HA_NONE;
+    flow_con->delete_flow(key);
+}
+
+void HighAvailability::consume(const uint8_t* data, uint32_t len)
+{
+    HAMessageHeader hdr;
+
+    if ( len < sizeof(hdr) )
+        return;
+
+    memcpy(&hdr, data, sizeof(hdr));
+
+    if ( hdr.version != HA_MESSAGE_VERSION or hdr.length > len or
+        hdr.length < sizeof(hdr) or hdr.length > HA_MAX_MESSAGE )
+        return;
+
+    data += sizeof(hdr);
+    len = hdr.length - sizeof(hdr);
+
+    for ( unsigned i = 0; i < hdr.count; ++i )
+    {
+        HARecordHeader rec;
+
+        if ( len < sizeof(rec) )
+            break;
+
+        memcpy(&rec, data, sizeof(rec));
+
+        if ( rec.length < sizeof(rec) or rec.length > len )
+            break;
+
+        FlowKey key = rec.key;
+
+        if ( rec.event == HA_UPDATE )
+            update_flow(&key, rec.clients, data + sizeof(rec), rec.length - sizeof(rec));
+
+        else if ( rec.event == HA_DELETE )
+            delete_flow(&key);
+
+        data += rec.length;
+        len -= rec.length;
+    }
 }
 
 void HighAvailability::receive_handler(SCMessage* msg)
 {
     assert(msg);
 
-    DebugFormat(DEBUG_HA,"HighAvailability::receive_handler: port: %d, length: %d\n",
-        msg->hdr->port, msg->content_length);
+    DebugFormat(DEBUG_HA,"HighAvailability::receive_handler: length: %d\n",
+        msg->content_length);
+
+    if ( flow_con and msg->hdr )
+    {
+        receiving = true;
+        consume(msg->content, msg->content_length);
+        receiving = false;
+    }
+
     if ( msg->sc )
         msg->sc->discard_message(msg);
+
+    delete msg;
 }
 
-void HighAvailability::process(Flow*, const DAQ_PktHdr_t* pkthdr)
+//-------------------------------------------------------------------------
+// per packet
+//-------------------------------------------------------------------------
+
+void HighAvailability::process(Flow* flow, const DAQ_PktHdr_t* pkthdr)
 {
     DebugMessage(DEBUG_HA,"HighAvailability::process()\n");
 
-    const uint32_t msg_len = 21; // up to 20 digits + trailing null
-
     if ( !sc )
         return;
 
-    SCMessage* msg = sc->alloc_transmit_message(msg_len);
-    snprintf((char*)msg->content, msg_len, "%20" PRIu64, (uint64_t)pkthdr->ts.tv_sec);
-    sc->transmit_message(msg);
+    if ( sc->connector_receive )
+        sc->process(4);
+
+    if ( !buf )
+        return;
+
+    // nothing worth syncing until the flow is bound
+    if ( flow and flow->flow_state != Flow::SETUP )
+    {
+        HAFlowState hs;
+        get_state(flow, hs);
+        uint32_t digest = get_digest(hs, flow->service);
+
+        if ( digest != flow->ha_digest )
+        {
+            add_update(flow, hs);
+            flow->ha_digest = digest;
+        }
+        flow->ha_state = HA_ACTIVE;
+    }
+
+    if ( count and pkthdr->ts.tv_sec != last_flush )
+        flush();
+
+    last_flush = pkthdr->ts.tv_sec;
+}
 
-    sc->process(4);
+void HighAvailability::process_deletion(Flow* flow)
+{
+    if ( !buf or receiving or flow->ha_state != HA_ACTIVE )
+        return;
+
+    add_delete(flow);
 }
 
+//-------------------------------------------------------------------------
+// HighAvailabilityManager
+//-------------------------------------------------------------------------
+
 void HighAvailabilityManager::thread_init()
 {
     DebugMessage(DEBUG_HA,"HighAvailabilityManager::thread_init()\n");
@@ -92,6 +447,7 @@ void HighAvailabilityManager::thread_term()
 {
     DebugMessage(DEBUG_HA,"HighAvailabilityManager::thread_term()\n");
     delete ha;
+    ha = nullptr;
 }
 
 void HighAvailabilityManager::process(Flow* flow, const DAQ_PktHdr_t* pkthdr)
@@ -99,3 +455,33 @@ void HighAvailabilityManager::process(Flow* flow, const DAQ_PktHdr_t* pkthdr)
     ha->process(flow,pkthdr);
 }
 
+void HighAvailabilityManager::process_deletion(Flow* flow)
+{
+    if ( ha )
+        ha->process_deletion(flow);
+}
+
+bool HighAvailabilityManager::register_client(HighAvailabilityClient* client)
+{
+    uint8_t id = client->get_id();
+
+    if ( id < s_clients.size() and s_clients[id] )
+    {
+        delete client;
+        return false;
+    }
+    if ( id >= s_clients.size() )
+        s_clients.resize(id + 1, nullptr);
+
+    s_clients[id] = client;
+    return true;
+}
+
+void HighAvailabilityManager::term()
+{
+    for ( auto* c : s_clients )
+        delete c;
+
+    s_clients.clear();
+}
+
@@ -27,6 +27,92 @@
 #include "side_channel/side_channel.h"
 
 //-------------------------------------------------------------------------
+// flow state is synced to the peer as batches of records:
+//
+//     HAMessageHeader { HARecordHeader [HAFlowState {HAClientHeader data}] }
+//
+// update records carry the core flow state followed by one section per
+// registered client; delete records carry only the header.  all fields
+// are in host order; peers must run the same version on the same arch.
+//-------------------------------------------------------------------------
+
+#define HA_MESSAGE_VERSION 1
+#define HA_MAX_MESSAGE MAXIMUM_SC_MESSAGE_CONTENT
+
+enum HAEvent : uint8_t
+{
+    HA_UPDATE = 1,
+    HA_DELETE
+};
+
+// Flow::ha_state
+enum HAFlowSync : uint8_t
+{
+    HA_NONE,     // never synced
+    HA_ACTIVE,   // processed here and sent to the peer
+    HA_STANDBY   // installed from the peer and not yet seen here
+};
+
+struct __attribute__((__packed__)) HAMessageHeader
+{
+    uint8_t version;
+    uint8_t count;      // records in message
+    uint16_t length;    // bytes in message including this header
+};
+
+struct __attribute__((__packed__)) HARecordHeader
+{
+    uint8_t event;      // HAEvent
+    uint8_t clients;    // client sections following the flow state
+    uint16_t length;    // bytes in record including this header
+    FlowKey key;
+};
+
+struct __attribute__((__packed__)) HAFlowState
+{
+    uint32_t session_flags;
+    uint32_t policy_id;
+    int16_t ipprotocol;
+    int16_t application_protocol;
+    int16_t service;    // protocol reference or 0 if none
+    uint16_t ssn_policy;
+    uint16_t session_state;
+    uint16_t client_port;
+    uint16_t server_port;
+    uint8_t flow_state;
+    int8_t direction;
+    int8_t ignore_direction;
+    sfip_t client_ip;
+    sfip_t server_ip;
+};
+
+struct __attribute__((__packed__)) HAClientHeader
+{
+    uint8_t id;
+    uint8_t length;     // bytes of client data following this header
+};
+
+// inspectors extend update records by registering a client.  encode
+// appends client state for the flow and returns the length used or 0 if
+// there is nothing to send; decode restores it on the peer.  client
+// state is sent along with core state changes.
+class SO_PUBLIC HighAvailabilityClient
+{
+public:
+    virtual ~HighAvailabilityClient() { }
+
+    virtual uint8_t encode(Flow*, uint8_t* buf, uint8_t max) = 0;
+    virtual bool decode(Flow*, const uint8_t* buf, uint8_t len) = 0;
+
+    uint8_t get_id() const
+    { return id; }
+
+protected:
+    HighAvailabilityClient(uint8_t i) : id(i) { }
+
+private:
+    uint8_t id;
+};
 
 class HighAvailability
 {
@@ -35,10 +121,25 @@ public:
     ~HighAvailability();
 
     void process(Flow*, const DAQ_PktHdr_t*);
+    void process_deletion(Flow*);
+    void flush();
 
 private:
     void receive_handler(SCMessage*);
+    void consume(const uint8_t*, uint32_t);
+    void update_flow(const FlowKey*, unsigned clients, const uint8_t*, uint16_t);
+    void delete_flow(const FlowKey*);
+
+    bool reserve(uint16_t);
+    void add_update(Flow*, HAFlowState&);
+    void add_delete(Flow*);
+
     SideChannel* sc;
+    uint8_t* buf;
+    uint16_t used;
+    uint8_t count;
+    bool receiving;
+    time_t last_flush;
 };
 
 class HighAvailabilityManager
@@ -47,6 +148,12 @@ public:
     static void thread_init();
     static void thread_term();
     static void process(Flow*, const DAQ_PktHdr_t*);
+    static void process_deletion(Flow*);
+
+    // main thread, during configuration; takes ownership
+    static bool register_client(HighAvailabilityClient*);
+    static void term();
+
 private:
     HighAvailabilityManager() = delete;
 };
@@ -21,26 +21,43 @@
 #ifndef MEMCAP_H
 #define MEMCAP_H
 
-// this memcap is just a basic tracker to compare a current total against a
-// limit.  this will be updated when memory management is implemented.
+// this memcap is a basic tracker to compare a current total against a
+// limit.  the memory is also charged to a budget so that the thread cap
+// accounts for it and the budget limit applies here too.
 
 #include <stdint.h>
 
+#include "memory/memory_cap.h"
+
 class Memcap
 {
 public:
-    Memcap(uint64_t u = 0) { cap = u; use = 0; }
+    Memcap(uint64_t u = 0) { cap = u; use = 0; budget = memory::BUDGET_OTHER; }
 
     void set_cap(uint64_t c) { cap = c; }
     uint64_t get_cap() { return cap; }
-    bool at_max() { return cap and use >= cap; }
-    void alloc(uint64_t sz) { use += sz; }
-    void dealloc(uint64_t sz) { if ( use >= sz) use -= sz; }
+    void set_budget(memory::Budget b) { budget = b; }
+
+    bool at_max()
+    { return (cap and use >= cap) or memory::MemoryCap::at_max(budget); }
+
+    void alloc(uint64_t sz)
+    { use += sz; memory::MemoryCap::charge(budget, sz); }
+
+    void dealloc(uint64_t sz)
+    {
+        if ( use >= sz )
+        {
+            use -= sz;
+            memory::MemoryCap::release(budget, sz);
+        }
+    }
     uint64_t used() { return use; }
 
 private:
     uint64_t cap;
     uint64_t use;
+    memory::Budget budget;
 };
 
 #endif
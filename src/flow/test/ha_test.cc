@@ -0,0 +1,382 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2016-2016 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// ha_test.cc
+// unit tests for syncing flow state through the file connector
+
+#include "flow/ha.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <map>
+#include <string>
+
+#include "connectors/file_connector/file_connector.h"
+#include "connectors/file_connector/file_connector_module.h"
+#include "flow/flow_control.h"
+#include "managers/connector_manager.h"
+#include "target_based/snort_protocols.h"
+
+#include <CppUTest/CommandLineTestRunner.h>
+#include <CppUTest/TestHarness.h>
+
+//-------------------------------------------------------------------------
+// stubs, spies, etc.
+//-------------------------------------------------------------------------
+
+extern const BaseApi* file_connector;
+
+THREAD_LOCAL FlowControl* flow_con = nullptr;
+
+static std::string s_file;
+static Connector* s_connector = nullptr;
+static std::map<std::string, Flow*> s_flows;
+
+static std::string get_key(const FlowKey* key)
+{ return std::string((const char*)key, sizeof(*key)); }
+
+// transmit and receive use the same file
+const char* get_instance_file(std::string& file, const char*)
+{
+    file = s_file;
+    return file.c_str();
+}
+
+FileConnectorModule::FileConnectorModule() :
+    Module(FILE_CONNECTOR_NAME, FILE_CONNECTOR_HELP) { }
+FileConnectorModule::~FileConnectorModule() { }
+bool FileConnectorModule::set(const char*, Value&, SnortConfig*) { return true; }
+bool FileConnectorModule::begin(const char*, int, SnortConfig*) { return true; }
+bool FileConnectorModule::end(const char*, int, SnortConfig*) { return true; }
+FileConnectorConfig::FileConnectorConfigSet FileConnectorModule::get_and_clear_config()
+{ return config_set; }
+const PegInfo* FileConnectorModule::get_pegs() const { return nullptr; }
+PegCount* FileConnectorModule::get_counts() const { return nullptr; }
+ProfileStats* FileConnectorModule::get_profile() const { return nullptr; }
+
+void Module::init(const char* s, const char* h) { name = s; help = h; }
+Module::Module(const char* s, const char* h) { init(s, h); }
+Module::Module(const char* s, const char* h, const Parameter*, bool) { init(s, h); }
+void Module::show_interval_stats(IndexVec&, FILE*) { }
+void Module::show_stats() { }
+void Module::reset_stats() { }
+void Module::sum_stats() { }
+
+void ConnectorManager::thread_init() { }
+void ConnectorManager::thread_term() { }
+Connector* ConnectorManager::get_connector(const std::string) { return s_connector; }
+
+Flow::Flow() { memset(this, 0, sizeof(*this)); }
+Flow::~Flow() { delete key; }
+void Flow::init(PktType type) { protocol = type; }
+
+Flow* FlowControl::find_flow(const FlowKey* key)
+{
+    auto it = s_flows.find(get_key(key));
+    return it == s_flows.end() ? nullptr : it->second;
+}
+
+Flow* FlowControl::new_flow(const FlowKey* key)
+{
+    Flow* flow = new Flow;
+    flow->key = new FlowKey(*key);
+    s_flows[get_key(key)] = flow;
+    return flow;
+}
+
+void FlowControl::delete_flow(const FlowKey* key)
+{
+    auto it = s_flows.find(get_key(key));
+    delete it->second;
+    s_flows.erase(it);
+}
+
+int16_t FindProtocolReference(const char* s)
+{ return strcmp(s, "http") ? 0 : 7; }
+
+const char* get_protocol_name(uint16_t id)
+{ return id == 7 ? "http" : nullptr; }
+
+//-------------------------------------------------------------------------
+// helpers
+//-------------------------------------------------------------------------
+
+static const ConnectorApi* get_api()
+{ return (const ConnectorApi*)file_connector; }
+
+static void start(FileConnectorConfig& cfg, Connector::Direction dir)
+{
+    cfg.name = "ha";
+    cfg.direction = dir;
+    s_connector = get_api()->tinit(&cfg);
+
+    PortBitSet ports;
+    ports.set(1);
+    SCConnectors conns = { "ha" };
+
+    SideChannelManager::pre_config_init();
+    SideChannelManager::instantiate(&conns, &ports);
+    SideChannelManager::thread_init();
+    HighAvailabilityManager::thread_init();
+}
+
+static void stop()
+{
+    HighAvailabilityManager::thread_term();
+    get_api()->tterm(s_connector);
+    delete s_connector;
+    s_connector = nullptr;
+    SideChannelManager::thread_term();
+}
+
+static void set_key(FlowKey& key, unsigned i)
+{
+    memset(&key, 0, sizeof(key));
+    key.ip_l[3] = i + 1;
+    key.ip_h[3] = 0xff;
+    key.port_l = 1000 + i;
+    key.port_h = 80;
+    key.protocol = 6;
+    key.version = 4;
+}
+
+static void init_flow(Flow& flow, FlowKey& key, unsigned i)
+{
+    set_key(key, i);
+    flow.key = &key;
+    flow.flow_state = Flow::ALLOW;
+    flow.ssn_state.session_flags = 0x3;
+    flow.client_port = 1000 + i;
+    flow.server_port = 80;
+    flow.service = "http";
+}
+
+// process messages from the peer until there are no more
+static void receive()
+{
+    FileConnectorConfig cfg;
+    start(cfg, Connector::CONN_RECEIVE);
+
+    DAQ_PktHdr_t pkth;
+    memset(&pkth, 0, sizeof(pkth));
+
+    for ( unsigned i = 0; i < 16; ++i )
+        HighAvailabilityManager::process(nullptr, &pkth);
+
+    stop();
+}
+
+// write a side channel message to the file as the file connector would
+static void write_message(std::ofstream& out, const uint8_t* data, uint32_t len, uint32_t claim)
+{
+    FileConnectorMsgHdr fch(claim + sizeof(SCMsgHdr));
+    SCMsgHdr sch;
+    memset(&sch, 0, sizeof(sch));
+    sch.port = 1;
+
+    out.write((const char*)&fch, sizeof(fch));
+    out.write((const char*)&sch, sizeof(sch));
+    out.write((const char*)data, len);
+}
+
+static uint16_t put_update(uint8_t* buf, unsigned i, uint16_t claim = 0)
+{
+    Flow flow;
+    FlowKey key;
+    init_flow(flow, key, i);
+
+    HARecordHeader rec;
+    rec.event = HA_UPDATE;
+    rec.clients = 0;
+    rec.length = claim ? claim : sizeof(rec) + sizeof(HAFlowState);
+    rec.key = key;
+
+    HAFlowState hs;
+    memset(&hs, 0, sizeof(hs));
+    hs.flow_state = Flow::ALLOW;
+    hs.client_port = 1000 + i;
+
+    memcpy(buf, &rec, sizeof(rec));
+    memcpy(buf + sizeof(rec), &hs, sizeof(hs));
+
+    flow.key = nullptr;
+    return sizeof(rec) + sizeof(hs);
+}
+
+static uint16_t put_message(uint8_t* buf, uint16_t len)
+{
+    HAMessageHeader hdr;
+    hdr.version = HA_MESSAGE_VERSION;
+    hdr.count = 1;
+    hdr.length = sizeof(hdr) + len;
+    memcpy(buf, &hdr, sizeof(hdr));
+    return hdr.length;
+}
+
+static bool have_flow(unsigned i)
+{
+    FlowKey key;
+    set_key(key, i);
+    return flow_con->find_flow(&key) != nullptr;
+}
+
+//-------------------------------------------------------------------------
+// tests
+//-------------------------------------------------------------------------
+
+TEST_GROUP(high_availability)
+{
+    void setup()
+    {
+        char tmp[] = "/tmp/ha_test_XXXXXX";
+        int fd = mkstemp(tmp);
+        CHECK(fd >= 0);
+        close(fd);
+        s_file = tmp;
+
+        // FlowControl methods are stubbed and never touch the object
+        flow_con = (FlowControl*)&s_flows;
+    }
+
+    void teardown()
+    {
+        for ( auto& f : s_flows )
+            delete f.second;
+
+        s_flows.clear();
+        flow_con = nullptr;
+
+        SideChannelManager::pre_config_init();
+        unlink(s_file.c_str());
+    }
+};
+
+// encode flows, write them through the file connector, decode them back
+TEST(high_availability, round_trip)
+{
+    const unsigned num = 40;
+    Flow flows[num];
+    FlowKey keys[num];
+
+    FileConnectorConfig cfg;
+    start(cfg, Connector::CONN_TRANSMIT);
+
+    DAQ_PktHdr_t pkth;
+    memset(&pkth, 0, sizeof(pkth));
+    pkth.ts.tv_sec = 1;
+
+    for ( unsigned i = 0; i < num; ++i )
+    {
+        init_flow(flows[i], keys[i], i);
+
+        if ( i == 5 )
+            flows[i].flow_state = Flow::BLOCK;
+
+        HighAvailabilityManager::process(&flows[i], &pkth);
+    }
+    HighAvailabilityManager::process_deletion(&flows[7]);
+    stop();
+
+    for ( auto& f : flows )
+        f.key = nullptr;
+
+    receive();
+
+    CHECK(s_flows.size() == num - 1);
+
+    for ( unsigned i = 0; i < num; ++i )
+    {
+        FlowKey key;
+        set_key(key, i);
+        Flow* f = flow_con->find_flow(&key);
+
+        if ( i == 7 )
+        {
+            CHECK(!f);
+            continue;
+        }
+        CHECK(f);
+        CHECK(f->ha_state == HA_STANDBY);
+        CHECK(f->client_port == 1000 + i);
+        CHECK(f->server_port == 80);
+        CHECK(f->ssn_state.session_flags == 0x3);
+        CHECK(f->flow_state == (i == 5 ? Flow::BLOCK : Flow::ALLOW));
+        STRCMP_EQUAL("http", f->service);
+    }
+}
+
+// a record claiming more than the message holds is dropped along with
+// the rest of its message
+TEST(high_availability, truncated_record)
+{
+    uint8_t buf[HA_MAX_MESSAGE];
+    std::ofstream out(s_file, std::ios::binary);
+
+    uint16_t len = put_update(buf + sizeof(HAMessageHeader), 1, 200);
+    len = put_message(buf, len);
+    write_message(out, buf, len, len);
+
+    len = put_update(buf + sizeof(HAMessageHeader), 2);
+    len = put_message(buf, len);
+    write_message(out, buf, len, len);
+
+    // last message is cut short in the file
+    len = put_update(buf + sizeof(HAMessageHeader), 3);
+    len = put_message(buf, len);
+    write_message(out, buf, len - 4, len);
+    out.close();
+
+    receive();
+
+    CHECK(!have_flow(1));
+    CHECK(have_flow(2));
+    CHECK(!have_flow(3));
+    CHECK(s_flows.size() == 1);
+}
+
+// messages larger than HA_MAX_MESSAGE are skipped without overrunning
+// the receive buffer
+TEST(high_availability, oversized_message)
+{
+    uint8_t buf[2 * HA_MAX_MESSAGE];
+    memset(buf, 0, sizeof(buf));
+    std::ofstream out(s_file, std::ios::binary);
+
+    uint16_t len = put_update(buf + sizeof(HAMessageHeader), 1);
+    put_message(buf, len);
+    write_message(out, buf, sizeof(buf), sizeof(buf));
+
+    len = put_update(buf + sizeof(HAMessageHeader), 2);
+    len = put_message(buf, len);
+    write_message(out, buf, len, len);
+    out.close();
+
+    receive();
+
+    CHECK(!have_flow(1));
+    CHECK(have_flow(2));
+    CHECK(s_flows.size() == 1);
+}
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
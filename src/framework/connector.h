@@ -30,7 +30,7 @@
 #include "framework/base_api.h"
 
 // this is the current version of the api
-#define CONNECTOR_API_VERSION ((BASE_API_VERSION << 16) | 0)
+#define CONNECTOR_API_VERSION ((BASE_API_VERSION << 16) | 1)
 
 //-------------------------------------------------------------------------
 // api for class
@@ -81,7 +81,11 @@ protected:
 class ConnectorConfig
 {
 public:
-    typedef std::vector<ConnectorConfig> ConfigSet;
+    // plugins derive their own config so the set holds pointers
+    typedef std::vector<ConnectorConfig*> ConfigSet;
+
+    virtual ~ConnectorConfig() { }
+
     Connector::Direction direction;
     std::string connector_name;
     std::string name;
@@ -90,6 +94,12 @@ public:
 class SO_PUBLIC ConnectorCommon
 {
 public:
+    virtual ~ConnectorCommon()
+    {
+        for ( auto cfg : config_set )
+            delete cfg;
+    }
+
     ConnectorConfig::ConfigSet config_set;
 };
 
@@ -30,7 +30,7 @@
 struct Packet;
 
 // this is the current version of the api
-#define IPSAPI_VERSION ((BASE_API_VERSION << 16) | 0)
+#define IPSAPI_VERSION ((BASE_API_VERSION << 16) | 1)
 
 //-------------------------------------------------------------------------
 // api for class
@@ -68,6 +68,7 @@ public:
     virtual bool fp_research() { return false; }
     virtual int eval(class Cursor&, Packet*) { return true; }
     virtual bool retry() { return false; }
+    virtual bool is_script() { return false; }  // for rule profiling
     virtual void action(Packet*) { }
 
     option_type_t get_type() const { return type; }
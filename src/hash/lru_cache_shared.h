@@ -23,6 +23,11 @@
 
 // LruCacheShared -- Implements a thread-safe unordered map where the
 // least-recently-used (LRU) entries are removed once a fixed size is hit.
+//
+// The cache may be split into shards selected by key hash, each with its
+// own lock, LRU list, and share of the max size, so that threads working
+// on different keys don't serialize on one lock.  With a single shard
+// (the default) LRU order is exact; otherwise it is kept per shard.
 
 #include <list>
 #include <vector>
@@ -56,23 +61,43 @@ public:
     LruCacheShared(const LruCacheShared& arg) = delete;
     LruCacheShared& operator=(const LruCacheShared& arg) = delete;
 
-    LruCacheShared(const size_t initial_size) :
-        max_size(initial_size),
-        current_size(0)
+    //  The shard count is capped at initial_size so that every shard can
+    //  hold at least one entry.
+    LruCacheShared(const size_t initial_size, const unsigned num_shards = 1) :
+        shards(get_num_shards(initial_size, num_shards))
     {
+        for ( unsigned i = 0; i < shards.size(); i++ )
+            shards[i].max_size = get_shard_max(initial_size, i);
     }
 
     //  Get current number of elements in the LruCache.
     size_t size(void)
     {
-        std::lock_guard<std::mutex> cache_lock(cache_mutex);
-        return current_size;
+        size_t n = 0;
+
+        for ( auto& shard : shards )
+        {
+            std::lock_guard<std::mutex> cache_lock(shard.cache_mutex);
+            n += shard.current_size;
+        }
+        return n;
     }
 
     size_t get_max_size(void)
     {
-        std::lock_guard<std::mutex> cache_lock(cache_mutex);
-        return max_size;
+        size_t n = 0;
+
+        for ( auto& shard : shards )
+        {
+            std::lock_guard<std::mutex> cache_lock(shard.cache_mutex);
+            n += shard.max_size;
+        }
+        return n;
+    }
+
+    unsigned get_num_shards(void) const
+    {
+        return shards.size();
     }
 
     //  Modify the maximum number of entries allowed in the cache.
@@ -87,6 +112,11 @@ public:
     //  Returns true and copies data if the key is found.
     bool find(const Key& key, Data& data, bool update=true);
 
+    //  Find Data for each of count keys, taking each shard lock once.
+    //  Sets found[i] and copies data[i] for each key found.
+    //  Returns the number of keys found.
+    size_t find(const Key* keys, size_t count, Data* data, bool* found, bool update=true);
+
     //  Remove entry associated with Key.
     //  Returns true if entry existed, false otherwise.
     bool remove(const Key& key);
@@ -100,7 +130,7 @@ public:
     void clear(void);
 
     //  Return all data from the LruCache in order (most recently used to
-    //  least).
+    //  least) for each shard.
     std::vector<std::pair<Key, Data> > get_all_data(void);
 
     const PegInfo* get_pegs() const
@@ -108,10 +138,8 @@ public:
         return lru_cache_shared_peg_names;
     }
 
-    PegCount* get_counts() const
-    {
-        return (PegCount*)&stats;
-    }
+    //  Sums the shard counts.
+    PegCount* get_counts() const;
 
 private:
     using LruList = std::list<std::pair<Key, Data> >;
@@ -119,19 +147,59 @@ private:
     using LruMap  = std::unordered_map<Key, LruListIter, Hash>;
     using LruMapIter = typename LruMap::iterator;
 
-    size_t max_size;   // Once max_size elements are in the cache, start to
-                       // remove the least-recently-used elements.
+    struct Shard
+    {
+        size_t max_size = 0;  // Once max_size elements are in the shard,
+                              // start to remove the least-recently-used
+                              // elements.
+
+        //  NOTE: std::list::size() is O(n) (it recounts the list every time)
+        //        so instead we keep track of the current size manually.
+        size_t current_size = 0;  // Number of entries currently in the shard.
 
-    //  NOTE: std::list::size() is O(n) (it recounts the list every time)
-    //        so instead we keep track of the current size manually.
-    size_t current_size;    // Number of entries currently in the cache.
+        std::mutex cache_mutex;
+        LruList list;  //  Contains key/data pairs. Maintains LRU order with
+                       //  least recently used at the end.
+        LruMap map;    //  Maps key to list iterator for fast lookup.
 
-    std::mutex cache_mutex;
-    LruList list;  //  Contains key/data pairs. Maintains LRU order with
-                   //  least recently used at the end.
-    LruMap map;    //  Maps key to list iterator for fast lookup.
+        struct LruCacheSharedStats stats;
+    };
+
+    static unsigned get_num_shards(size_t max_size, unsigned num_shards)
+    {
+        if ( max_size < num_shards )
+            num_shards = max_size;
 
-    struct LruCacheSharedStats stats;
+        return num_shards ? num_shards : 1;
+    }
+
+    //  Each shard gets at least one entry, so after set_max_size() to
+    //  less than the shard count the total max is the shard count.
+    size_t get_shard_max(size_t max_size, unsigned i) const
+    {
+        size_t n = max_size / shards.size() + (i < max_size % shards.size() ? 1 : 0);
+        return n ? n : 1;
+    }
+
+    unsigned get_shard_index(const Key& key) const
+    {
+        if ( shards.size() == 1 )
+            return 0;
+
+        //  Mix the key hash so that shards don't track the map's buckets.
+        uint64_t h = hash(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h % shards.size();
+    }
+
+    bool find(Shard&, const Key& key, Data& data, bool update);
+
+    std::vector<Shard> shards;
+    Hash hash;
+
+    mutable struct LruCacheSharedStats stats;
 };
 
 template<typename Key, typename Data, typename Hash>
@@ -142,19 +210,24 @@ bool LruCacheShared<Key, Data, Hash>::set_max_size(size_t newsize)
     if (newsize <= 0)
         return false;   //  Not allowed to set size to zero.
 
-    std::lock_guard<std::mutex> cache_lock(cache_mutex);
-
-    //  Remove the oldest entries if we have to reduce cache size.
-    list_iter=list.end();
-    while (current_size > newsize)
+    for ( unsigned i = 0; i < shards.size(); i++ )
     {
-        list_iter--;
-        current_size--;
-        map.erase(list_iter->first);
-        list.erase(list_iter);
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> cache_lock(shard.cache_mutex);
+        size_t shard_size = get_shard_max(newsize, i);
+
+        //  Remove the oldest entries if we have to reduce cache size.
+        while (shard.current_size > shard_size)
+        {
+            list_iter = shard.list.end();
+            list_iter--;
+            shard.current_size--;
+            shard.map.erase(list_iter->first);
+            shard.list.erase(list_iter);
+        }
+
+        shard.max_size = shard_size;
     }
-
-    max_size = newsize;
     return true;
 }
 
@@ -162,54 +235,55 @@ template<typename Key, typename Data, typename Hash>
 void LruCacheShared<Key, Data, Hash>::insert(const Key& key, const Data& data)
 {
     LruMapIter map_iter;
-    std::lock_guard<std::mutex> cache_lock(cache_mutex);
+    Shard& shard = shards[get_shard_index(key)];
+    std::lock_guard<std::mutex> cache_lock(shard.cache_mutex);
 
     //  If key already exists, remove it.
-    map_iter = map.find(key);
-    if (map_iter != map.end())
+    map_iter = shard.map.find(key);
+    if (map_iter != shard.map.end())
     {
-        current_size--;
-        list.erase(map_iter->second);
-        map.erase(map_iter);
-        stats.replaces++;
+        shard.current_size--;
+        shard.list.erase(map_iter->second);
+        shard.map.erase(map_iter);
+        shard.stats.replaces++;
     }
     else
     {
-        stats.adds++;
+        shard.stats.adds++;
     }
 
     //  Add key/data pair to front of list.
-    list.push_front(std::make_pair(key, data));
+    shard.list.push_front(std::make_pair(key, data));
 
     //  Add list iterator for the new entry to map.
-    map[key] = list.begin();
+    shard.map[key] = shard.list.begin();
 
     //  If we've exceeded the configured size, remove the oldest entry.
-    if (current_size >= max_size)
+    if (shard.current_size >= shard.max_size)
     {
         LruListIter list_iter;
-        list_iter = list.end();
+        list_iter = shard.list.end();
         list_iter--;
-        map.erase(list_iter->first);
-        list.erase(list_iter);
-        stats.prunes++;
+        shard.map.erase(list_iter->first);
+        shard.list.erase(list_iter);
+        shard.stats.prunes++;
     }
     else
     {
-        current_size++;
+        shard.current_size++;
     }
 }
 
 template<typename Key, typename Data, typename Hash>
-bool LruCacheShared<Key, Data, Hash>::find(const Key& key, Data& data, bool update)
+bool LruCacheShared<Key, Data, Hash>::find(
+    Shard& shard, const Key& key, Data& data, bool update)
 {
     LruMapIter map_iter;
-    std::lock_guard<std::mutex> cache_lock(cache_mutex);
 
-    map_iter = map.find(key);
-    if (map_iter == map.end())
+    map_iter = shard.map.find(key);
+    if (map_iter == shard.map.end())
     {
-        stats.find_misses++;
+        shard.stats.find_misses++;
         return false;   //  Key is not in LruCache.
     }
 
@@ -217,26 +291,74 @@ bool LruCacheShared<Key, Data, Hash>::find(const Key& key, Data& data, bool upda
 
     //  If needed, move entry to front of LruList
     if (update)
-        list.splice(list.begin(), list, map_iter->second);
+        shard.list.splice(shard.list.begin(), shard.list, map_iter->second);
 
-    stats.find_hits++;
+    shard.stats.find_hits++;
     return true;
 }
 
+template<typename Key, typename Data, typename Hash>
+bool LruCacheShared<Key, Data, Hash>::find(const Key& key, Data& data, bool update)
+{
+    Shard& shard = shards[get_shard_index(key)];
+    std::lock_guard<std::mutex> cache_lock(shard.cache_mutex);
+    return find(shard, key, data, update);
+}
+
+template<typename Key, typename Data, typename Hash>
+size_t LruCacheShared<Key, Data, Hash>::find(
+    const Key* keys, size_t count, Data* data, bool* found, bool update)
+{
+    std::vector<unsigned> index(count);
+    std::vector<bool> done(count);
+    size_t hits = 0;
+
+    for ( size_t i = 0; i < count; i++ )
+    {
+        index[i] = get_shard_index(keys[i]);
+        found[i] = false;
+    }
+
+    //  Visit each shard used by the batch once, in order of first use.
+    for ( size_t i = 0; i < count; i++ )
+    {
+        if ( done[i] )
+            continue;
+
+        Shard& shard = shards[index[i]];
+        std::lock_guard<std::mutex> cache_lock(shard.cache_mutex);
+
+        for ( size_t j = i; j < count; j++ )
+        {
+            if ( done[j] or index[j] != index[i] )
+                continue;
+
+            if ( find(shard, keys[j], data[j], update) )
+            {
+                found[j] = true;
+                hits++;
+            }
+            done[j] = true;
+        }
+    }
+    return hits;
+}
+
 template<typename Key, typename Data, typename Hash>
 bool LruCacheShared<Key, Data, Hash>::remove(const Key& key)
 {
     LruMapIter map_iter;
-    std::lock_guard<std::mutex> cache_lock(cache_mutex);
+    Shard& shard = shards[get_shard_index(key)];
+    std::lock_guard<std::mutex> cache_lock(shard.cache_mutex);
 
-    map_iter = map.find(key);
-    if (map_iter == map.end())
+    map_iter = shard.map.find(key);
+    if (map_iter == shard.map.end())
         return false;   //  Key is not in LruCache.
 
-    current_size--;
-    list.erase(map_iter->second);
-    map.erase(map_iter);
-    stats.removes++;
+    shard.current_size--;
+    shard.list.erase(map_iter->second);
+    shard.map.erase(map_iter);
+    shard.stats.removes++;
     return(true);
 }
 
@@ -244,18 +366,19 @@ template<typename Key, typename Data, typename Hash>
 bool LruCacheShared<Key, Data, Hash>::remove(const Key& key, Data& data)
 {
     LruMapIter map_iter;
-    std::lock_guard<std::mutex> cache_lock(cache_mutex);
+    Shard& shard = shards[get_shard_index(key)];
+    std::lock_guard<std::mutex> cache_lock(shard.cache_mutex);
 
-    map_iter = map.find(key);
-    if (map_iter == map.end())
+    map_iter = shard.map.find(key);
+    if (map_iter == shard.map.end())
         return false;   //  Key is not in LruCache.
 
     data = map_iter->second->second;
 
-    current_size--;
-    list.erase(map_iter->second);
-    map.erase(map_iter);
-    stats.removes++;
+    shard.current_size--;
+    shard.list.erase(map_iter->second);
+    shard.map.erase(map_iter);
+    shard.stats.removes++;
     return(true);
 }
 
@@ -263,33 +386,62 @@ template<typename Key, typename Data, typename Hash>
 void LruCacheShared<Key, Data, Hash>::clear(void)
 {
     LruMapIter map_iter;
-    std::lock_guard<std::mutex> cache_lock(cache_mutex);
 
-    for (map_iter = map.begin(); map_iter != map.end(); /* No incr */)
+    for ( auto& shard : shards )
     {
-        list.erase(map_iter->second);
+        std::lock_guard<std::mutex> cache_lock(shard.cache_mutex);
 
-        //  erase returns next iterator after erased element.
-        map_iter = map.erase(map_iter);
-    }
+        for (map_iter = shard.map.begin(); map_iter != shard.map.end(); /* No incr */)
+        {
+            shard.list.erase(map_iter->second);
 
-    current_size = 0;
-    stats.clears++;
+            //  erase returns next iterator after erased element.
+            map_iter = shard.map.erase(map_iter);
+        }
+
+        shard.current_size = 0;
+
+        if ( &shard == &shards[0] )
+            shard.stats.clears++;
+    }
 }
 
 template<typename Key, typename Data, typename Hash>
 std::vector<std::pair<Key, Data> > LruCacheShared<Key, Data, Hash>::get_all_data(void)
 {
     std::vector<std::pair<Key, Data> > vec;
-    std::lock_guard<std::mutex> cache_lock(cache_mutex);
 
-    for (auto& entry : list )
+    for ( auto& shard : shards )
     {
-        vec.push_back(entry);
+        std::lock_guard<std::mutex> cache_lock(shard.cache_mutex);
+
+        for (auto& entry : shard.list )
+        {
+            vec.push_back(entry);
+        }
     }
 
     return vec;
 }
 
+template<typename Key, typename Data, typename Hash>
+PegCount* LruCacheShared<Key, Data, Hash>::get_counts() const
+{
+    const unsigned num_pegs = sizeof(stats) / sizeof(PegCount);
+    PegCount* sum = (PegCount*)&stats;
+
+    for ( unsigned i = 0; i < num_pegs; i++ )
+        sum[i] = 0;
+
+    for ( auto& shard : shards )
+    {
+        const PegCount* counts = (const PegCount*)&shard.stats;
+
+        for ( unsigned i = 0; i < num_pegs; i++ )
+            sum[i] += counts[i];
+    }
+    return sum;
+}
+
 #endif
 
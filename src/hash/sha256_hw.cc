@@ -0,0 +1,263 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2016-2016 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+#include "sha256_hw.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA256_HW_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+//--------------------------------------------------------------------------
+// cpu detection
+//--------------------------------------------------------------------------
+
+static bool check_cpu()
+{
+#ifdef SHA256_HW_X86
+    unsigned a, b, c, d;
+
+    // sse4.1 is needed for the shuffles / blends
+    if ( !__get_cpuid(1, &a, &b, &c, &d) or !(c & bit_SSE4_1) )
+        return false;
+
+    if ( __get_cpuid_max(0, nullptr) < 7 )
+        return false;
+
+    __cpuid_count(7, 0, a, b, c, d);
+    return (b & (1u << 29)) != 0;  // CPUID.(EAX=7,ECX=0):EBX.SHA[bit 29]
+#else
+    return false;
+#endif
+}
+
+// function static so it is safely set once regardless of which
+// thread gets here first
+bool Sha256::accelerated()
+{
+    static const bool hw = check_cpu();
+    return hw;
+}
+
+//--------------------------------------------------------------------------
+// SHA-NI block transform
+//--------------------------------------------------------------------------
+
+#ifdef SHA256_HW_X86
+
+alignas(16) static const uint32_t K[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define SHA256_HW_TARGET __attribute__((target("sha,sse4.1")))
+
+// 4 rounds using message words m (already byte swapped); k is the index
+// of the first round constant
+#define ROUNDS4(m, k) \
+    msg = _mm_add_epi32(m, _mm_load_si128((const __m128i*)(K + (k)))); \
+    s1 = _mm_sha256rnds2_epu32(s1, s0, msg); \
+    msg = _mm_shuffle_epi32(msg, 0x0E); \
+    s0 = _mm_sha256rnds2_epu32(s0, s1, msg)
+
+// extend the message schedule: m0 += sigma terms of m1..m3
+#define SCHEDULE(m0, m1, m2, m3) \
+    m0 = _mm_sha256msg1_epu32(m0, m1); \
+    m0 = _mm_add_epi32(m0, _mm_alignr_epi8(m3, m2, 4)); \
+    m0 = _mm_sha256msg2_epu32(m0, m3)
+
+SHA256_HW_TARGET
+void sha256_hw_blocks(uint32_t state[8], const uint8_t* data, size_t nblocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // state is a b c d e f g h; rnds2 wants abef / cdgh
+    __m128i t = _mm_loadu_si128((const __m128i*)&state[0]);      // d c b a
+    __m128i s1 = _mm_loadu_si128((const __m128i*)&state[4]);     // h g f e
+
+    t = _mm_shuffle_epi32(t, 0xB1);                              // c d a b
+    s1 = _mm_shuffle_epi32(s1, 0x1B);                            // e f g h
+    __m128i s0 = _mm_alignr_epi8(t, s1, 8);                      // a b e f
+    s1 = _mm_blend_epi16(s1, t, 0xF0);                           // c d g h
+
+    while ( nblocks-- )
+    {
+        const __m128i save0 = s0;
+        const __m128i save1 = s1;
+        __m128i msg;
+
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data +  0)), bswap);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), bswap);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), bswap);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), bswap);
+
+        ROUNDS4(m0, 0);
+        ROUNDS4(m1, 4);
+        ROUNDS4(m2, 8);
+        ROUNDS4(m3, 12);
+
+        for ( unsigned k = 16; k < 64; k += 16 )
+        {
+            SCHEDULE(m0, m1, m2, m3);
+            ROUNDS4(m0, k);
+            SCHEDULE(m1, m2, m3, m0);
+            ROUNDS4(m1, k + 4);
+            SCHEDULE(m2, m3, m0, m1);
+            ROUNDS4(m2, k + 8);
+            SCHEDULE(m3, m0, m1, m2);
+            ROUNDS4(m3, k + 12);
+        }
+
+        s0 = _mm_add_epi32(s0, save0);
+        s1 = _mm_add_epi32(s1, save1);
+        data += 64;
+    }
+
+    // back to a b c d e f g h
+    t = _mm_shuffle_epi32(s0, 0x1B);                             // f e b a
+    s1 = _mm_shuffle_epi32(s1, 0xB1);                            // d c h g
+    s0 = _mm_blend_epi16(t, s1, 0xF0);                           // d c b a
+    s1 = _mm_alignr_epi8(s1, t, 8);                              // h g f e
+
+    _mm_storeu_si128((__m128i*)&state[0], s0);
+    _mm_storeu_si128((__m128i*)&state[4], s1);
+}
+
+#else
+
+void sha256_hw_blocks(uint32_t*, const uint8_t*, size_t)
+{ }
+
+#endif
+
+//--------------------------------------------------------------------------
+// Sha256 methods
+//--------------------------------------------------------------------------
+
+static const uint32_t sha256_iv[8] =
+{
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+void Sha256::init()
+{
+    if ( !accelerated() )
+    {
+        SHA256_Init(&sw);
+        return;
+    }
+    memcpy(hw.state, sha256_iv, sizeof(hw.state));
+    hw.bytes = 0;
+}
+
+void Sha256::update(const uint8_t* data, size_t len)
+{
+    if ( accelerated() )
+        hw_update(data, len);
+    else
+        SHA256_Update(&sw, data, len);
+}
+
+void Sha256::final(uint8_t* digest)
+{
+    if ( accelerated() )
+        hw_final(digest);
+    else
+        SHA256_Final(digest, &sw);
+}
+
+void Sha256::hw_update(const uint8_t* data, size_t len)
+{
+    unsigned used = hw.bytes % sizeof(hw.buf);
+    hw.bytes += len;
+
+    if ( used )
+    {
+        unsigned n = sizeof(hw.buf) - used;
+
+        if ( len < n )
+        {
+            memcpy(hw.buf + used, data, len);
+            return;
+        }
+        memcpy(hw.buf + used, data, n);
+        sha256_hw_blocks(hw.state, hw.buf, 1);
+        data += n;
+        len -= n;
+    }
+
+    // hash full blocks directly from the caller's buffer
+    if ( size_t nblocks = len / sizeof(hw.buf) )
+    {
+        sha256_hw_blocks(hw.state, data, nblocks);
+        data += nblocks * sizeof(hw.buf);
+        len -= nblocks * sizeof(hw.buf);
+    }
+
+    if ( len )
+        memcpy(hw.buf, data, len);
+}
+
+void Sha256::hw_final(uint8_t* digest)
+{
+    unsigned used = hw.bytes % sizeof(hw.buf);
+    uint64_t bits = hw.bytes << 3;
+
+    hw.buf[used++] = 0x80;
+
+    if ( used > sizeof(hw.buf) - 8 )
+    {
+        memset(hw.buf + used, 0, sizeof(hw.buf) - used);
+        sha256_hw_blocks(hw.state, hw.buf, 1);
+        used = 0;
+    }
+    memset(hw.buf + used, 0, sizeof(hw.buf) - 8 - used);
+
+    for ( int i = 0; i < 8; ++i )
+        hw.buf[63 - i] = (uint8_t)(bits >> (8 * i));
+
+    sha256_hw_blocks(hw.state, hw.buf, 1);
+
+    for ( int i = 0; i < 8; ++i )
+    {
+        digest[4*i]   = (uint8_t)(hw.state[i] >> 24);
+        digest[4*i+1] = (uint8_t)(hw.state[i] >> 16);
+        digest[4*i+2] = (uint8_t)(hw.state[i] >> 8);
+        digest[4*i+3] = (uint8_t)(hw.state[i]);
+    }
+}
+
@@ -0,0 +1,67 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2016-2016 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+#ifndef SHA256_HW_H
+#define SHA256_HW_H
+
+// streaming SHA-256 that uses the x86 SHA extensions (SHA-NI) when the
+// cpu has them and falls back to the portable / openssl implementation
+// otherwise.  the choice is made once per process.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hash/hashes.h"
+#include "main/snort_types.h"
+
+class SO_PUBLIC Sha256
+{
+public:
+    Sha256()
+    { init(); }
+
+    void init();
+    void update(const uint8_t*, size_t);
+    void final(uint8_t* digest);  // SHA256_HASH_SIZE bytes
+
+    // true if the hardware path is in use
+    static bool accelerated();
+
+private:
+    void hw_update(const uint8_t*, size_t);
+    void hw_final(uint8_t*);
+
+private:
+    union
+    {
+        struct
+        {
+            uint32_t state[8];
+            uint64_t bytes;
+            uint8_t buf[64];
+        } hw;
+        SHA256_CTX sw;
+    };
+};
+
+// process nblocks 64 byte blocks into state; callers must check
+// Sha256::accelerated() first
+void sha256_hw_blocks(uint32_t state[8], const uint8_t* data, size_t nblocks);
+
+#endif
+
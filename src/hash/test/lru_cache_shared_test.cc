@@ -24,14 +24,12 @@
 #include <CppUTest/CommandLineTestRunner.h>
 #include <CppUTest/TestHarness.h>
 
-#include <chrono>
-#include <iostream>
 #include <functional>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 #include <string.h>
 
-#include "time/stopwatch.h"
-
 TEST_GROUP(lru_cache_shared)
 {
 };
@@ -208,6 +206,151 @@ TEST(lru_cache_shared, stats_test)
     CHECK(!strcmp(pegs[6].name, "lru cache clears"));
 }
 
+//  Test that a sharded cache splits the max size across shards and
+//  keeps each shard within its share.
+TEST(lru_cache_shared, shard_test)
+{
+    std::string data;
+    LruCacheShared<int, std::string, std::hash<int> > lru_cache(10, 4);
+
+    CHECK(4 == lru_cache.get_num_shards());
+    CHECK(10 == lru_cache.get_max_size());
+
+    for (int i = 0; i < 100; i++)
+    {
+        lru_cache.insert(i, std::to_string(i));
+        CHECK(lru_cache.size() <= 10);
+    }
+
+    CHECK(10 == lru_cache.size());
+
+    //  Most recent key is always kept.
+    CHECK(true == lru_cache.find(99, data));
+    CHECK("99" == data);
+
+    auto vec = lru_cache.get_all_data();
+    CHECK(10 == vec.size());
+
+    for (auto& entry : vec)
+        CHECK(entry.second == std::to_string(entry.first));
+
+    CHECK(true == lru_cache.set_max_size(4));
+    CHECK(4 == lru_cache.get_max_size());
+    CHECK(4 == lru_cache.size());
+
+    PegCount* stats = lru_cache.get_counts();
+    CHECK(stats[0] == 100);  //  adds
+    CHECK(stats[2] == 90);   //  prunes
+
+    lru_cache.clear();
+    CHECK(0 == lru_cache.size());
+    stats = lru_cache.get_counts();
+    CHECK(stats[6] == 1);    //  clears
+}
+
+//  Test that no shard is left without room when the size is smaller
+//  than the shard count.
+TEST(lru_cache_shared, small_shard_test)
+{
+    std::string data;
+    LruCacheShared<int, std::string, std::hash<int> > lru_cache(3, 8);
+
+    CHECK(3 == lru_cache.get_num_shards());
+    CHECK(3 == lru_cache.get_max_size());
+
+    for (int i = 0; i < 20; i++)
+    {
+        lru_cache.insert(i, std::to_string(i));
+        CHECK(true == lru_cache.find(i, data));
+        CHECK(lru_cache.size() <= 3);
+    }
+
+    LruCacheShared<int, std::string, std::hash<int> > big_cache(16, 8);
+    CHECK(8 == big_cache.get_num_shards());
+    CHECK(true == big_cache.set_max_size(2));
+    CHECK(8 == big_cache.get_max_size());
+
+    for (int i = 0; i < 20; i++)
+    {
+        big_cache.insert(i, std::to_string(i));
+        CHECK(true == big_cache.find(i, data));
+    }
+    CHECK(big_cache.size() <= 8);
+}
+
+//  Test batched find across shards.
+TEST(lru_cache_shared, batch_find_test)
+{
+    LruCacheShared<int, std::string, std::hash<int> > lru_cache(100, 8);
+
+    for (int i = 0; i < 50; i++)
+        lru_cache.insert(i, std::to_string(i));
+
+    int keys[100];
+    std::string data[100];
+    bool found[100];
+
+    for (int i = 0; i < 100; i++)
+        keys[i] = 99 - i;
+
+    CHECK(50 == lru_cache.find(keys, 100, data, found));
+
+    for (int i = 0; i < 100; i++)
+    {
+        CHECK(found[i] == (keys[i] < 50));
+
+        if ( found[i] )
+            CHECK(data[i] == std::to_string(keys[i]));
+    }
+
+    PegCount* stats = lru_cache.get_counts();
+    CHECK(stats[3] == 50);   //  find hits
+    CHECK(stats[4] == 50);   //  find misses
+}
+
+//  Run threads looking up and adding hosts in one shared cache, with and
+//  without shards, and check that no operation is lost.
+static void contention_run(unsigned num_shards, unsigned num_threads)
+{
+    const unsigned ops = 20000;
+    const unsigned keys = 4096;
+
+    //  Room for every key so no shard has to prune.
+    LruCacheShared<int, int, std::hash<int> > lru_cache(2 * keys, num_shards);
+    std::vector<std::thread> threads;
+
+    for (unsigned t = 0; t < num_threads; t++)
+    {
+        threads.emplace_back([&lru_cache, t, ops, keys]()
+        {
+            unsigned k = t * 7919;
+            int data;
+
+            for (unsigned i = 0; i < ops; i++)
+            {
+                k = (k * 1103515245 + 12345) % keys;
+
+                if ( !lru_cache.find(k, data) )
+                    lru_cache.insert(k, k);
+            }
+        });
+    }
+    for (auto& th : threads)
+        th.join();
+
+    PegCount* stats = lru_cache.get_counts();
+    CHECK(stats[3] + stats[4] == ops * num_threads);
+    CHECK(stats[0] + stats[1] == stats[4]);
+    CHECK(lru_cache.size() <= keys);
+}
+
+TEST(lru_cache_shared, contention_test)
+{
+    for (unsigned shards : { 1, 32 })
+        for (unsigned threads = 1; threads <= 32; threads *= 2)
+            contention_run(shards, threads);
+}
+
 int main(int argc, char** argv)
 {
     return CommandLineTestRunner::RunAllTests(argc, argv);
@@ -0,0 +1,98 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2016-2016 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// sha256_hw_test.cc
+// unit tests for Sha256 class
+
+#include "hash/sha256_hw.h"
+
+#include <CppUTest/CommandLineTestRunner.h>
+#include <CppUTest/TestHarness.h>
+
+#include <vector>
+#include <string.h>
+
+TEST_GROUP(sha256_hw)
+{
+};
+
+//  Test the FIPS 180-2 vectors.
+TEST(sha256_hw, known_answer_test)
+{
+    static const uint8_t abc[SHA256_HASH_SIZE] =
+    {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+        0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+        0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+    };
+    static const uint8_t two_block[SHA256_HASH_SIZE] =
+    {
+        0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8,
+        0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+        0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67,
+        0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1
+    };
+    uint8_t digest[SHA256_HASH_SIZE];
+
+    Sha256 s;
+    s.update((const uint8_t*)"abc", 3);
+    s.final(digest);
+    CHECK(!memcmp(digest, abc, sizeof(digest)));
+
+    const char* msg = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    s.init();
+    s.update((const uint8_t*)msg, strlen(msg));
+    s.final(digest);
+    CHECK(!memcmp(digest, two_block, sizeof(digest)));
+}
+
+//  Test that arbitrary segmentation gives the same result as the
+//  one-shot sha256() for lengths around the block and padding edges.
+TEST(sha256_hw, segmented_update_test)
+{
+    std::vector<uint8_t> data(1024);
+
+    for ( unsigned i = 0; i < data.size(); ++i )
+        data[i] = (uint8_t)(i * 31 + 7);
+
+    for ( unsigned len = 0; len < data.size(); ++len )
+    {
+        uint8_t expected[SHA256_HASH_SIZE], actual[SHA256_HASH_SIZE];
+        sha256(data.data(), len, expected);
+
+        Sha256 s;
+        unsigned off = 0, seg = 1;
+
+        while ( off < len )
+        {
+            unsigned n = (seg < len - off) ? seg : len - off;
+            s.update(data.data() + off, n);
+            off += n;
+            seg = (seg * 7 + 3) % 97;
+        }
+        s.final(actual);
+        CHECK(!memcmp(expected, actual, sizeof(actual)));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
+
@@ -84,6 +84,18 @@ bool init_chunk(
     return false;
 }
 
+int ref_chunk_func(lua_State* L, const char* func)
+{
+    lua_getglobal(L, func);
+
+    if ( !lua_isfunction(L, -1) )
+    {
+        lua_pop(L, 1);
+        return LUA_NOREF;
+    }
+    return luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
 #ifdef UNIT_TEST
 TEST_CASE( "chunk initialization", "[chunk]" )
 {
@@ -152,5 +164,40 @@ TEST_CASE( "chunk initialization", "[chunk]" )
         }
     }
 }
-#endif
+TEST_CASE( "chunk function refs", "[chunk]" )
+{
+    Lua::State lua(true);
+
+    string test_chunk = "function eval() return true end";
+    string test_args_table = "args = { }";
+    const char* test_name = "test_ips_luajit";
 
+    REQUIRE( init_chunk(lua, test_chunk, test_name, test_args_table) );
+
+    SECTION( "defined function" )
+    {
+        int ref = ref_chunk_func(lua, "eval");
+        REQUIRE( ref != LUA_NOREF );
+
+        lua_rawgeti(lua, LUA_REGISTRYINDEX, ref);
+        CHECK( lua_isfunction(lua, -1) );
+        CHECK( !lua_pcall(lua, 0, 1, 0) );
+        CHECK( lua_toboolean(lua, -1) );
+        lua_pop(lua, 1);
+    }
+
+    SECTION( "undefined function" )
+    {
+        int top = lua_gettop(lua);
+        CHECK( ref_chunk_func(lua, "alert") == LUA_NOREF );
+        CHECK( lua_gettop(lua) == top );
+    }
+
+    SECTION( "global is not a function" )
+    {
+        string test_not_a_function_chunk = "eval = 1";
+        REQUIRE( init_chunk(lua, test_not_a_function_chunk, test_name, test_args_table) );
+        CHECK( ref_chunk_func(lua, "eval") == LUA_NOREF );
+    }
+}
+#endif
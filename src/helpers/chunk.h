@@ -27,5 +27,8 @@
 // FIXIT-M: Merge with helpers/lua
 bool init_chunk(struct lua_State*, std::string& chunk, const char* name, std::string& args);
 
+// registry ref to global function or LUA_NOREF if not defined
+int ref_chunk_func(struct lua_State*, const char* func);
+
 #endif
 
@@ -25,8 +25,11 @@
 
 #define LRU_CACHE_INITIAL_SIZE 65535
 
+// lock shards; enough that packet threads rarely collide
+#define LRU_CACHE_SHARDS 32
+
 LruCacheShared<HostIpKey, std::shared_ptr<HostTracker>, HashHostIpKey>
-    host_cache(LRU_CACHE_INITIAL_SIZE);
+    host_cache(LRU_CACHE_INITIAL_SIZE, LRU_CACHE_SHARDS);
 
 void host_cache_add_host_tracker(HostTracker* ht)
 {
@@ -25,6 +25,7 @@
 // configuration or dynamic discovery).  It provides a thread-safe API to
 // set/get the host data.
 
+#include <atomic>
 #include <mutex>
 #include <memory>
 #include <cstring>
@@ -85,9 +86,10 @@ private:
     //  FIXIT-H - Do we need to use a host_id instead of sfip_t as in sfrna?
     sfip_t ip_addr;
 
-    //  Policies to apply to this host.
-    Policy stream_policy = 0;
-    Policy frag_policy = 0;
+    //  Policies to apply to this host.  These are read for every new
+    //  flow so they are atomic rather than taking the lock.
+    std::atomic<Policy> stream_policy { 0 };
+    std::atomic<Policy> frag_policy { 0 };
 
     std::list<HostApplicationEntry> services;
     std::list<HostApplicationEntry> clients;
@@ -112,25 +114,21 @@ public:
 
     Policy get_stream_policy(void)
     {
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
         return stream_policy;
     }
 
     void set_stream_policy(const Policy& policy)
     {
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
         stream_policy = policy;
     }
 
     Policy get_frag_policy(void)
     {
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
         return frag_policy;
     }
 
     void set_frag_policy(const Policy& policy)
     {
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
         frag_policy = policy;
     }
 
@@ -122,11 +122,15 @@ public:
 
     int eval(Cursor&, Packet*) override;
 
+    bool is_script() override
+    { return true; }
+
 private:
     void init(const char*, const char*);
 
     std::string config;
     std::vector<Lua::State> states;
+    std::vector<int> refs;
 };
 
 LuaJitOption::LuaJitOption(
@@ -143,7 +147,18 @@ LuaJitOption::LuaJitOption(
     for ( unsigned i = 0; i < max; ++i )
     {
         states.emplace_back(true);
-        init_chunk(states[i], chunk, name, config);
+
+        if ( !init_chunk(states[i], chunk, name, config) )
+            return;
+
+        // look up eval once here instead of by name on each call
+        refs.push_back(ref_chunk_func(states[i], opt_eval));
+
+        if ( refs[i] == LUA_NOREF )
+        {
+            ParseError("%s luajit %s() not defined", name, opt_eval);
+            return;
+        }
     }
 }
 
@@ -178,14 +193,18 @@ int LuaJitOption::eval(Cursor& c, Packet*)
 
     cursor = &c;
 
-    lua_State* L = states[get_instance_id()];
+    unsigned idx = get_instance_id();
+    lua_State* L = states[idx];
 
     {
-        Lua::ManageStack ms(L, 1);
+        Lua::ManageStack ms(L, 2);
 
-        lua_getglobal(L, opt_eval);
+        // eval is called with the buffer so scripts can ffi.cast it
+        // instead of calling back through get_buffer()
+        lua_rawgeti(L, LUA_REGISTRYINDEX, refs[idx]);
+        lua_pushlightuserdata(L, (void*)get_buffer());
 
-        if ( lua_pcall(L, 0, 1, 0) )
+        if ( lua_pcall(L, 1, 1, 0) )
         {
             const char* err = lua_tostring(L, -1);
             ErrorMessage("%s\n", err);
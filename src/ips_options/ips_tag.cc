@@ -156,6 +156,11 @@ static void mod_dtor(Module* m)
     delete m;
 }
 
+static void tag_init(SnortConfig*)
+{
+    InitTagFlow();
+}
+
 static IpsOption* tag_ctor(Module* p, OptTreeNode* otn)
 {
     TagModule* m = (TagModule*)p;
@@ -179,7 +184,7 @@ static const IpsApi tag_api =
     },
     OPT_TYPE_META,
     1, PROTO_BIT__NONE,
-    nullptr,
+    tag_init,
     nullptr,
     nullptr,
     nullptr,
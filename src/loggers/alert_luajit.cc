@@ -41,6 +41,10 @@
 #include "profiler/profiler.h"
 #include "utils/stats.h"
 
+#ifdef UNIT_TEST
+#include "catch/catch.hpp"
+#endif
+
 static THREAD_LOCAL ProfileStats luaLogPerfStats;
 
 static THREAD_LOCAL Event* event;
@@ -49,47 +53,61 @@ static THREAD_LOCAL SnortEvent lua_event;
 static THREAD_LOCAL Packet* packet;
 static THREAD_LOCAL SnortPacket lua_packet;
 
-SO_PUBLIC const SnortEvent* get_event()
-{
-    assert(event);
+static THREAD_LOCAL const SnortAlert* lua_alerts;
 
-    lua_event.gid = event->sig_info->generator;
-    lua_event.sid = event->sig_info->id;
-    lua_event.rev = event->sig_info->rev;
+static void set_event(SnortEvent& se, const Event* e)
+{
+    se.gid = e->sig_info->generator;
+    se.sid = e->sig_info->id;
+    se.rev = e->sig_info->rev;
 
-    lua_event.event_id = event->event_id;
-    lua_event.event_ref = event->event_reference;
+    se.event_id = e->event_id;
+    se.event_ref = e->event_reference;
 
-    if ( event->sig_info->message )
-        lua_event.msg = event->sig_info->message;
+    if ( e->sig_info->message )
+        se.msg = e->sig_info->message;
     else
-        lua_event.msg = "";
-
-    lua_event.svc = event->sig_info->num_services ? event->sig_info->services[1].service : "n/a";
+        se.msg = "";
 
-    return &lua_event;
+    se.svc = e->sig_info->num_services ? e->sig_info->services[1].service : "n/a";
 }
 
-SO_PUBLIC const SnortPacket* get_packet()
+static void set_packet(SnortPacket& sp, Packet* p)
 {
-    assert(packet);
-
-    switch ( packet->type() )
+    switch ( p->type() )
     {
-    case PktType::IP: lua_packet.type = "IP"; break;
-    case PktType::TCP: lua_packet.type = "TCP"; break;
-    case PktType::UDP: lua_packet.type = "UDP"; break;
-    case PktType::ICMP: lua_packet.type = "ICMP"; break;
-    default: lua_packet.type = "OTHER";
+    case PktType::IP: sp.type = "IP"; break;
+    case PktType::TCP: sp.type = "TCP"; break;
+    case PktType::UDP: sp.type = "UDP"; break;
+    case PktType::ICMP: sp.type = "ICMP"; break;
+    default: sp.type = "OTHER";
     }
 
-    lua_packet.num = pc.total_from_daq;
-    lua_packet.sp = packet->ptrs.sp;
-    lua_packet.dp = packet->ptrs.dp;
+    sp.num = pc.total_from_daq;
+    sp.sp = p->ptrs.sp;
+    sp.dp = p->ptrs.dp;
+}
+
+SO_PUBLIC const SnortEvent* get_event()
+{
+    assert(event);
+    set_event(lua_event, event);
+    return &lua_event;
+}
 
+SO_PUBLIC const SnortPacket* get_packet()
+{
+    assert(packet);
+    set_packet(lua_packet, packet);
     return &lua_packet;
 }
 
+SO_PUBLIC const SnortAlert* get_alerts()
+{
+    assert(lua_alerts);
+    return lua_alerts;
+}
+
 //-------------------------------------------------------------------------
 // module stuff
 //-------------------------------------------------------------------------
@@ -99,6 +117,15 @@ static const Parameter s_params[] =
     { "args", Parameter::PT_STRING, nullptr, nullptr,
       "luajit logger arguments" },
 
+    { "batch", Parameter::PT_INT, "1:1024", "1",
+      "number of events passed to alert_batch() per call if defined; a partial "
+      "batch is delivered at the end of the packet that makes it batch_time old, "
+      "or when the packet thread exits" },
+
+    { "batch_time", Parameter::PT_INT, "0:60", "1",
+      "max seconds of packet time an event waits in a partial batch; "
+      "0 delivers at the end of each packet" },
+
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
@@ -114,12 +141,25 @@ public:
     bool begin(const char*, int, SnortConfig*) override
     {
         args.clear();
+        batch = 1;
+        batch_time = 1;
         return true;
     }
 
     bool set(const char*, Value& v, SnortConfig*) override
     {
-        args = v.get_string();
+        if ( v.is("args") )
+            args = v.get_string();
+
+        else if ( v.is("batch") )
+            batch = v.get_long();
+
+        else if ( v.is("batch_time") )
+            batch_time = v.get_long();
+
+        else
+            return false;
+
         return true;
     }
 
@@ -128,6 +168,8 @@ public:
 
 public:
     std::string args;
+    unsigned batch = 1;
+    unsigned batch_time = 1;
 };
 
 //-------------------------------------------------------------------------
@@ -140,13 +182,28 @@ public:
     LuaJitLogger(const char* name, std::string& chunk, class LuaLogModule*);
     ~LuaJitLogger();
 
+    void close() override;
     void alert(Packet*, const char*, Event*) override;
+    void end_packet(Packet*) override;
 
     static const struct LogApi* get_api();
 
-private:
+protected:
+    void flush(unsigned idx);
+
+    struct Instance
+    {
+        int alert_ref = LUA_NOREF;
+        int batch_ref = LUA_NOREF;
+        std::vector<SnortAlert> pending;
+        time_t first = 0;  // packet time of oldest pending alert
+    };
+
     std::string config;
     std::vector<Lua::State> states;
+    std::vector<Instance> instances;
+    unsigned batch;
+    unsigned batch_time;
 };
 
 LuaJitLogger::LuaJitLogger(const char* name, std::string& chunk, LuaLogModule* mod)
@@ -156,7 +213,11 @@ LuaJitLogger::LuaJitLogger(const char* name, std::string& chunk, LuaLogModule* m
     config += mod->args;
     config += "}";
 
+    batch = mod->batch;
+    batch_time = mod->batch_time;
+
     unsigned max = ThreadConfig::get_instance_max();
+    instances.resize(max);
 
     // FIXIT-L might make more sense to have one instance
     // with one lua state in each thread instead of one
@@ -165,25 +226,121 @@ LuaJitLogger::LuaJitLogger(const char* name, std::string& chunk, LuaLogModule* m
     for ( unsigned i = 0; i < max; i++ )
     {
         states.emplace_back(true);
-        init_chunk(states[i], chunk, name, config);
+
+        if ( !init_chunk(states[i], chunk, name, config) )
+            return;
+
+        Instance& inst = instances[i];
+
+        // look up functions once here instead of by name on each alert
+        if ( batch > 1 )
+            inst.batch_ref = ref_chunk_func(states[i], "alert_batch");
+
+        if ( inst.batch_ref != LUA_NOREF )
+            inst.pending.reserve(batch);
+
+        else if ( (inst.alert_ref = ref_chunk_func(states[i], "alert")) == LUA_NOREF )
+        {
+            ParseError("%s luajit alert() not defined", name);
+            return;
+        }
     }
 }
 
+// loggers are global and only deleted by EventManager::release_plugins()
+// at shutdown; packet threads are gone by then but each state was only used
+// by its own thread so deliver anything close() didn't get here
 LuaJitLogger::~LuaJitLogger()
-{ }
+{
+    for ( unsigned idx = 0; idx < instances.size(); ++idx )
+    {
+        if ( !instances[idx].pending.empty() )
+            flush(idx);
+    }
+}
+
+void LuaJitLogger::close()
+{
+    unsigned idx = get_instance_id();
+
+    if ( idx < instances.size() and !instances[idx].pending.empty() )
+        flush(idx);
+}
+
+void LuaJitLogger::end_packet(Packet* p)
+{
+    if ( batch <= 1 )
+        return;
+
+    unsigned idx = get_instance_id();
+    Instance& inst = instances[idx];
+
+    if ( inst.pending.empty() )
+        return;
+
+    if ( p->pkth->ts.tv_sec - inst.first >= (time_t)batch_time )
+    {
+        Profile profile(luaLogPerfStats);
+        flush(idx);
+    }
+}
+
+// alert_batch(n) is called with the number of alerts and a pointer to
+// them so scripts can ffi.cast it instead of calling back to get_alerts()
+void LuaJitLogger::flush(unsigned idx)
+{
+    Instance& inst = instances[idx];
+    lua_State* L = states[idx];
+
+    Lua::ManageStack ms(L, 3);
+
+    lua_alerts = inst.pending.data();
+    lua_rawgeti(L, LUA_REGISTRYINDEX, inst.batch_ref);
+    lua_pushinteger(L, inst.pending.size());
+    lua_pushlightuserdata(L, (void*)lua_alerts);
+
+    if ( lua_pcall(L, 2, 1, 0) )
+    {
+        const char* err = lua_tostring(L, -1);
+        ErrorMessage("%s\n", err);
+    }
+    inst.pending.clear();
+    lua_alerts = nullptr;
+}
 
 void LuaJitLogger::alert(Packet* p, const char*, Event* e)
 {
     Profile profile(luaLogPerfStats);
 
+    unsigned idx = get_instance_id();
+    Instance& inst = instances[idx];
+
+    if ( inst.batch_ref != LUA_NOREF )
+    {
+        if ( inst.pending.empty() )
+            inst.first = p->pkth->ts.tv_sec;
+
+        inst.pending.emplace_back();
+        SnortAlert& a = inst.pending.back();
+
+        set_event(a.event, e);
+        set_packet(a.packet, p);
+
+        if ( inst.pending.size() >= batch )
+            flush(idx);
+
+        return;
+    }
+
     packet = p;
     event = e;
 
-    lua_State* L = states[get_instance_id()];
+    lua_State* L = states[idx];
 
     Lua::ManageStack ms(L, 1);
 
-    lua_getglobal(L, "alert");
+    lua_rawgeti(L, LUA_REGISTRYINDEX, inst.alert_ref);
+
     if ( lua_pcall(L, 0, 1, 0) )
     {
         const char* err = lua_tostring(L, -1);
@@ -244,3 +401,116 @@ static const LogApi log_lua_api =
 
 const LogApi* log_luajit = &log_lua_api;
 
+
+//-------------------------------------------------------------------------
+// unit tests
+//-------------------------------------------------------------------------
+
+#ifdef UNIT_TEST
+class BatchLogger : public LuaJitLogger
+{
+public:
+    BatchLogger(std::string& chunk, LuaLogModule* mod) :
+        LuaJitLogger(mod->get_name(), chunk, mod) { }
+
+    int get(const char* key)
+    {
+        lua_State* L = states[0];
+        lua_getglobal(L, key);
+        int n = lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        return n;
+    }
+};
+
+static std::string batch_chunk =
+    "calls = 0\n"
+    "total = 0\n"
+    "function alert_batch(n, alerts)\n"
+    "    calls = calls + 1\n"
+    "    total = total + n\n"
+    "    last = n\n"
+    "end\n";
+
+TEST_CASE("luajit alert batch", "[luajit]")
+{
+    LuaLogModule mod("test_alert_luajit");
+    mod.batch = 3;
+    mod.batch_time = 2;
+
+    BatchLogger log(batch_chunk, &mod);
+
+    SigInfo si = { };
+    si.generator = 1;
+    si.id = 1000;
+
+    Event ev = { };
+    ev.sig_info = &si;
+
+    DAQ_PktHdr_t h = { };
+    h.ts.tv_sec = 100;
+
+    Packet p;
+    p.ptrs.set_pkt_type(PktType::TCP);
+    p.pkth = &h;
+
+    SECTION("full batches")
+    {
+        for ( unsigned i = 0; i < 7; ++i )
+        {
+            log.alert(&p, nullptr, &ev);
+            log.end_packet(&p);
+        }
+        CHECK(log.get("calls") == 2);
+        CHECK(log.get("last") == 3);
+        CHECK(log.get("total") == 6);
+
+        log.close();
+        CHECK(log.get("calls") == 3);
+        CHECK(log.get("last") == 1);
+    }
+
+    SECTION("partial batch")
+    {
+        log.alert(&p, nullptr, &ev);
+        log.end_packet(&p);
+        CHECK(log.get("calls") == 0);
+
+        h.ts.tv_sec = 101;
+        log.alert(&p, nullptr, &ev);
+        log.end_packet(&p);
+        CHECK(log.get("calls") == 0);
+
+        // aged from the oldest pending event
+        h.ts.tv_sec = 102;
+        log.end_packet(&p);
+        CHECK(log.get("calls") == 1);
+        CHECK(log.get("last") == 2);
+
+        log.alert(&p, nullptr, &ev);
+        h.ts.tv_sec = 103;
+        log.end_packet(&p);
+        CHECK(log.get("calls") == 1);
+
+        h.ts.tv_sec = 104;
+        log.end_packet(&p);
+        CHECK(log.get("calls") == 2);
+        CHECK(log.get("last") == 1);
+        CHECK(log.get("total") == 3);
+    }
+
+    SECTION("no batch_time")
+    {
+        mod.batch_time = 0;
+        BatchLogger now(batch_chunk, &mod);
+
+        now.alert(&p, nullptr, &ev);
+        now.alert(&p, nullptr, &ev);
+        CHECK(now.get("calls") == 0);
+
+        now.end_packet(&p);
+        CHECK(now.get("calls") == 1);
+        CHECK(now.get("last") == 2);
+    }
+}
+#endif
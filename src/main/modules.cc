@@ -609,13 +609,13 @@ static const Parameter alerts_params[] =
       "set available memory for filters" },
 
     { "event_filter_memcap", Parameter::PT_INT, "0:", "1048576",
-      "set available memory for filters" },
+      "set available memory for filters; divided evenly among packet threads" },
 
     { "order", Parameter::PT_STRING, nullptr, "pass drop alert log",
       "change the order of rule action application" },
 
     { "rate_filter_memcap", Parameter::PT_INT, "0:", "1048576",
-      "set available memory for filters" },
+      "set available memory for filters; divided evenly among packet threads" },
 
     { "reference_net", Parameter::PT_STRING, nullptr, nullptr,
       "set the CIDR for homenet "
@@ -1428,6 +1428,9 @@ static const Parameter file_id_params[] =
     { "capture_block_size", Parameter::PT_INT, "8:", "32768",
       "file capture block size in bytes" },
 
+    { "capture_queue_size", Parameter::PT_INT, "0:", "64",
+      "max files waiting to be stored by the writer thread (0 to store inline)" },
+
     { "enable_type", Parameter::PT_BOOL, nullptr, "false",
       "enable type ID" },
 
@@ -1508,6 +1511,9 @@ bool FileIdModule::set(const char*, Value& v, SnortConfig* sc)
     else if ( v.is("capture_block_size") )
         fc.capture_block_size = v.get_long();
 
+    else if ( v.is("capture_queue_size") )
+        fc.capture_queue_size = v.get_long();
+
     else if ( v.is("enable_type") )
     {
         if ( v.get_bool() )
@@ -1630,7 +1636,13 @@ bool FileIdModule::end(const char* fqn, int idx, SnortConfig* sc)
     FileConfig& fc = sc->file_config;
 
     if (!idx)
+    {
+        // all magics are in, build the type id tables
+        if ( !strcmp(fqn, "file_id.file_rules") )
+            fc.compile_file_rules();
+
         return true;
+    }
 
     if ( !strcmp(fqn, "file_id.file_rules") )
     {
@@ -1755,7 +1767,7 @@ static const Parameter event_filter_params[] =
 };
 
 #define event_filter_help \
-    "configure thresholding of events"
+    "configure thresholding of events; each packet thread counts separately"
 
 class EventFilterModule : public Module
 {
@@ -1853,7 +1865,8 @@ static const Parameter rate_filter_params[] =
 };
 
 #define rate_filter_help \
-    "configure rate filters (which change rule actions)"
+    "configure rate filters (which change rule actions); " \
+    "each packet thread counts separately"
 
 class RateFilterModule : public Module
 {
@@ -430,6 +430,7 @@ void Snort::term()
         snort_conf = NULL;
     }
     CleanupProtoNames();
+    HighAvailabilityManager::term();
     ModuleManager::term();
     PluginManager::release_plugins();
 }
@@ -640,8 +641,6 @@ void Snort::thread_init(const char* intf)
 
     SnortEventqNew(snort_conf->event_queue_config);
 
-    InitTag();
-
     EventTrace_Init();
     detection_filter_init(snort_conf->detection_filter_config);
 
@@ -667,8 +666,8 @@ void Snort::thread_term()
     IpsManager::clear_options();
     EventManager::close_outputs();
     CodecManager::thread_term();
+    HighAvailabilityManager::thread_term();  // flushes to side channel
     SideChannelManager::thread_term();
-    HighAvailabilityManager::thread_term();
 
     if ( s_packet )
     {
@@ -685,6 +684,8 @@ void Snort::thread_term()
 
     otnx_match_data_term();
     detection_filter_term();
+    sfthreshold_free();
+    RateFilter_Cleanup();
     EventTrace_Term();
     CleanupTag();
 
@@ -765,8 +766,12 @@ static DAQ_Verdict update_verdict(DAQ_Verdict verdict, int& inject)
     }
     else if ( s_packet->packet_flags & PKT_MODIFIED )
     {
-        // this packet was normalized and/or has replacements
-        PacketManager::encode_update(s_packet);
+        // this packet was normalized and/or has replacements; rewrites
+        // of an otherwise unmodified packet have already fixed the
+        // checksums so encoding can be skipped
+        if ( !(s_packet->packet_flags & PKT_CKSUM_CURRENT) )
+            PacketManager::encode_update(s_packet);
+
         verdict = DAQ_VERDICT_REPLACE;
     }
     else if ( s_packet->packet_flags & PKT_RESIZED )
@@ -241,6 +241,12 @@ void EventManager::close_outputs()
         p->close();
 }
 
+void EventManager::end_packet(Packet* pkt)
+{
+    for ( auto p : s_loggers.outputs )
+        p->end_packet(pkt);
+}
+
 void EventManager::call_alerters(
     OutputSet* idx, Packet* pkt, const char* message, Event* event)
 {
@@ -83,6 +83,7 @@ public:
 
     static void open_outputs();
     static void close_outputs();
+    static void end_packet(Packet*);
 
     static void call_alerters(OutputSet*, Packet*, const char* message, Event*);
     static void call_loggers(OutputSet*, Packet*, const char* message, Event*);
@@ -60,4 +60,14 @@ struct SnortPacket
 extern "C"
 const struct SnortPacket* get_packet();
 
+// alert_batch(n) gets n of these from the logger
+struct SnortAlert
+{
+    struct SnortEvent event;
+    struct SnortPacket packet;
+};
+
+extern "C"
+const struct SnortAlert* get_alerts();
+
 #endif
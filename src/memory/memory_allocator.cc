@@ -18,9 +18,29 @@
 
 // memory_allocator.cc author Joel Cornett <jocornet@cisco.com>
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "memory_allocator.h"
 
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <cassert>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include "main/thread.h"
+
+#ifdef UNIT_TEST
+#include <set>
+#include <thread>
+#include <vector>
+#include "catch/catch.hpp"
+#endif
 
 namespace memory
 {
@@ -29,7 +49,568 @@ namespace memory
 void* MemoryAllocator::allocate(size_t n)
 { return malloc(n); }
 
-void MemoryAllocator::deallocate(void* p)
+void MemoryAllocator::deallocate(void* p, size_t)
 { free(p); }
 
+// -----------------------------------------------------------------------------
+// size classes
+// -----------------------------------------------------------------------------
+
+// 32 to 256 in steps of 16, then 4 classes per power of 2 up to max_size
+static constexpr unsigned num_classes = 43;
+
+static inline unsigned size_class(size_t n)
+{
+    assert(n <= PoolAllocator::max_size);
+
+    if ( n <= 32 )
+        return 0;
+
+    if ( n <= 256 )
+        return ((n - 1) >> 4) - 1;
+
+    unsigned lg = 63 - __builtin_clzll(n - 1);
+    return 15 + (lg - 8) * 4 + (((n - 1) >> (lg - 2)) - 4);
+}
+
+static inline size_t class_size(unsigned c)
+{
+    if ( c < 15 )
+        return (c + 2) << 4;
+
+    c -= 15;
+    return size_t(c % 4 + 5) << (c / 4 + 6);
+}
+
+// number of blocks moved to or from the central pool at a time
+static inline unsigned batch_size(unsigned c)
+{
+    size_t n = 16384 / class_size(c);
+    return n < 4 ? 4 : (n > 64 ? 64 : n);
+}
+
+// -----------------------------------------------------------------------------
+// arenas and spans
+// -----------------------------------------------------------------------------
+
+// arenas are split into spans that hold blocks of one class.  an empty span
+// goes back to a common list for reuse by any class; past keep_spans its
+// pages are given back to the os.  arenas themselves are never unmapped.
+static constexpr size_t arena_size = 2 * 1024 * 1024;
+static constexpr size_t span_size = 256 * 1024;
+static constexpr size_t page_size = 4096;
+static constexpr unsigned keep_spans = arena_size / span_size;
+
+struct FreeBlock
+{
+    FreeBlock* next;
+};
+
+// the header is in the first page so it survives release
+struct Span
+{
+    Span* prev;
+    Span* next;
+
+    FreeBlock* free;  // blocks returned to the span
+    char* unused;     // blocks never handed out
+    unsigned live;    // blocks out of the span
+    bool released;
+};
+
+// the first block is 64 byte aligned
+static constexpr size_t span_header = 64;
+static_assert(sizeof(Span) <= span_header, "span header too big");
+
+static inline Span* get_span(void* p)
+{ return (Span*)((uintptr_t)p & ~(uintptr_t)(span_size - 1)); }
+
+static inline bool is_full(const Span* s, size_t sz)
+{ return !s->free and (char*)s + span_size - s->unused < (ptrdiff_t)sz; }
+
+static char* new_arena()
+{
+    // over allocate so the arena can be aligned for a huge page
+    size_t len = 2 * arena_size;
+    void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if ( p == MAP_FAILED )
+        return nullptr;
+
+    uintptr_t base = (uintptr_t)p;
+    uintptr_t start = (base + arena_size - 1) & ~(uintptr_t)(arena_size - 1);
+
+    if ( start > base )
+        munmap(p, start - base);
+
+    if ( base + len > start + arena_size )
+        munmap((void*)(start + arena_size), base + len - start - arena_size);
+
+#ifdef MADV_HUGEPAGE
+    madvise((void*)start, arena_size, MADV_HUGEPAGE);
+#endif
+
+    return (char*)start;
+}
+
+struct SpanPool
+{
+    std::mutex lock;
+    Span* free = nullptr;   // singly linked through next
+    unsigned resident = 0;  // free spans not released
+    char* arena_next = nullptr;
+    char* arena_end = nullptr;
+};
+
+static SpanPool spans;
+
+static Span* new_span()
+{
+    std::lock_guard<std::mutex> hold(spans.lock);
+    Span* s = spans.free;
+
+    if ( s )
+    {
+        spans.free = s->next;
+
+        if ( !s->released )
+            --spans.resident;
+    }
+    else
+    {
+        if ( spans.arena_next == spans.arena_end )
+        {
+            spans.arena_next = new_arena();
+
+            if ( !spans.arena_next )
+            {
+                spans.arena_end = nullptr;
+                return nullptr;
+            }
+            spans.arena_end = spans.arena_next + arena_size;
+        }
+        s = (Span*)spans.arena_next;
+        spans.arena_next += span_size;
+    }
+
+    s->prev = s->next = nullptr;
+    s->free = nullptr;
+    s->unused = (char*)s + span_header;
+    s->live = 0;
+    s->released = false;
+    return s;
+}
+
+static void free_span(Span* s)
+{
+    std::lock_guard<std::mutex> hold(spans.lock);
+
+    if ( spans.resident < keep_spans )
+        ++spans.resident;
+
+    else
+    {
+        madvise((char*)s + page_size, span_size - page_size, MADV_DONTNEED);
+        s->released = true;
+    }
+
+    s->next = spans.free;
+    spans.free = s;
+}
+
+// -----------------------------------------------------------------------------
+// free lists
+// -----------------------------------------------------------------------------
+
+// the central list for each class holds the spans with blocks available
+struct CentralList
+{
+    std::mutex lock;
+    Span* partial;
+};
+
+struct FreeList
+{
+    FreeBlock* head;
+    unsigned count;
+};
+
+static CentralList central[num_classes];
+
+static THREAD_LOCAL FreeList cache[num_classes];
+static THREAD_LOCAL bool cache_off = false;
+static THREAD_LOCAL bool cache_hooked = false;
+
+// a thread's lists are returned when it exits so callers don't have to;
+// key destructors don't run for the main thread, which doesn't need them
+static pthread_key_t exit_key;
+
+static void thread_exit(void*)
+{ PoolAllocator::thread_term(); }
+
+static void hook_exit()
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, []() { pthread_key_create(&exit_key, thread_exit); });
+    pthread_setspecific(exit_key, &exit_key);
+    cache_hooked = true;
+}
+
+static void link(CentralList& cl, Span* s)
+{
+    s->prev = nullptr;
+    s->next = cl.partial;
+
+    if ( cl.partial )
+        cl.partial->prev = s;
+
+    cl.partial = s;
+}
+
+static void unlink(CentralList& cl, Span* s)
+{
+    if ( s->prev )
+        s->prev->next = s->next;
+    else
+        cl.partial = s->next;
+
+    if ( s->next )
+        s->next->prev = s->prev;
+}
+
+// caller holds the class lock
+static void put_block(unsigned c, FreeBlock* b)
+{
+    size_t sz = class_size(c);
+    Span* s = get_span(b);
+    bool was_full = is_full(s, sz);
+
+    b->next = s->free;
+    s->free = b;
+
+    if ( was_full )
+        link(central[c], s);
+
+    if ( --s->live == 0 )
+    {
+        unlink(central[c], s);
+        free_span(s);
+    }
+}
+
+static void put_list(unsigned c, FreeBlock* b)
+{
+    std::lock_guard<std::mutex> hold(central[c].lock);
+
+    while ( b )
+    {
+        FreeBlock* next = b->next;
+        put_block(c, b);
+        b = next;
+    }
+}
+
+// take up to a batch from the central list for this thread
+static void* refill(unsigned c)
+{
+    CentralList& cl = central[c];
+    size_t sz = class_size(c);
+
+    // nothing is kept after thread term
+    unsigned n = cache_off ? 1 : batch_size(c);
+
+    FreeBlock* head = nullptr;
+    unsigned count = 0;
+
+    if ( !cache_hooked )
+        hook_exit();
+
+    std::lock_guard<std::mutex> hold(cl.lock);
+
+    while ( count < n )
+    {
+        Span* s = cl.partial;
+
+        if ( !s )
+        {
+            if ( !(s = new_span()) )
+                break;
+
+            link(cl, s);
+        }
+
+        FreeBlock* b;
+
+        if ( s->free )
+        {
+            b = s->free;
+            s->free = b->next;
+        }
+        else
+        {
+            b = (FreeBlock*)s->unused;
+            s->unused += sz;
+        }
+
+        ++s->live;
+        b->next = head;
+        head = b;
+        ++count;
+
+        if ( is_full(s, sz) )
+            unlink(cl, s);
+    }
+
+    if ( !head )
+        return nullptr;
+
+    cache[c].head = head->next;
+    cache[c].count = count - 1;
+    return head;
+}
+
+// keep one batch and return the rest
+static void drain(unsigned c)
+{
+    FreeList& fl = cache[c];
+    unsigned n = batch_size(c);
+
+    FreeBlock* head = fl.head;
+    FreeBlock* tail = head;
+
+    for ( unsigned i = 1; i < n; ++i )
+        tail = tail->next;
+
+    fl.head = tail->next;
+    fl.count -= n;
+    tail->next = nullptr;
+
+    put_list(c, head);
+}
+
+// -----------------------------------------------------------------------------
+// pool allocator
+// -----------------------------------------------------------------------------
+
+void* PoolAllocator::allocate(size_t n)
+{
+    if ( n > max_size )
+        return MemoryAllocator::allocate(n);
+
+    unsigned c = size_class(n);
+    FreeList& fl = cache[c];
+
+    if ( FreeBlock* b = fl.head )
+    {
+        fl.head = b->next;
+        --fl.count;
+        return b;
+    }
+    return refill(c);
+}
+
+void PoolAllocator::deallocate(void* p, size_t n)
+{
+    if ( n > max_size )
+        return MemoryAllocator::deallocate(p, n);
+
+    unsigned c = size_class(n);
+    FreeBlock* b = (FreeBlock*)p;
+
+    if ( cache_off )
+    {
+        b->next = nullptr;
+        put_list(c, b);
+        return;
+    }
+
+    FreeList& fl = cache[c];
+    b->next = fl.head;
+    fl.head = b;
+
+    if ( ++fl.count > 2 * batch_size(c) )
+        drain(c);
+}
+
+void PoolAllocator::thread_term()
+{
+    for ( unsigned c = 0; c < num_classes; ++c )
+    {
+        if ( cache[c].head )
+            put_list(c, cache[c].head);
+
+        cache[c].head = nullptr;
+        cache[c].count = 0;
+    }
+    // anything freed after this goes straight back to the central pool
+    cache_off = true;
+}
+
 } // namespace memory
+
+// -----------------------------------------------------------------------------
+// unit tests
+// -----------------------------------------------------------------------------
+
+#ifdef UNIT_TEST
+
+TEST_CASE( "pool allocator size classes", "[memory]" )
+{
+    using namespace memory;
+
+    CHECK( class_size(size_class(1)) == 32 );
+    CHECK( class_size(size_class(33)) == 48 );
+    CHECK( class_size(size_class(256)) == 256 );
+    CHECK( class_size(size_class(257)) == 320 );
+    CHECK( class_size(size_class(513)) == 640 );
+    CHECK( size_class(PoolAllocator::max_size) == num_classes - 1 );
+
+    for ( size_t n = 1; n <= PoolAllocator::max_size; ++n )
+    {
+        unsigned c = size_class(n);
+        REQUIRE( class_size(c) >= n );
+        REQUIRE( (class_size(c) & 15) == 0 );
+
+        if ( c )
+            REQUIRE( class_size(c - 1) < n );
+    }
+}
+
+TEST_CASE( "pool allocator reuse", "[memory]" )
+{
+    using namespace memory;
+
+    SECTION( "free list" )
+    {
+        void* p = PoolAllocator::allocate(100);
+        REQUIRE( p );
+        CHECK( ((uintptr_t)p & 15) == 0 );
+
+        PoolAllocator::deallocate(p, 100);
+        CHECK( PoolAllocator::allocate(112) == p );
+        PoolAllocator::deallocate(p, 112);
+    }
+
+    SECTION( "large" )
+    {
+        size_t n = PoolAllocator::max_size + 1;
+        void* p = PoolAllocator::allocate(n);
+        REQUIRE( p );
+        PoolAllocator::deallocate(p, n);
+    }
+
+    SECTION( "central pool" )
+    {
+        const size_t n = 4000;
+        std::vector<void*> v;
+
+        for ( unsigned i = 0; i < 1000; ++i )
+        {
+            v.push_back(PoolAllocator::allocate(n));
+            REQUIRE( v.back() );
+            memset(v.back(), 0xa5, n);
+        }
+
+        // freed on another thread and reused here
+        std::thread t([&v, n]()
+        {
+            for ( auto p : v )
+                PoolAllocator::deallocate(p, n);
+            PoolAllocator::thread_term();
+        });
+        t.join();
+
+        // the spans are reused though not necessarily in the same order
+        std::set<Span*> old;
+
+        for ( auto p : v )
+            old.insert(get_span(p));
+
+        unsigned reused = 0;
+        v.clear();
+
+        for ( unsigned i = 0; i < 1000; ++i )
+        {
+            v.push_back(PoolAllocator::allocate(n));
+            REQUIRE( v.back() );
+
+            if ( old.count(get_span(v.back())) )
+                ++reused;
+        }
+        CHECK( reused == v.size() );
+
+        for ( auto p : v )
+            PoolAllocator::deallocate(p, n);
+    }
+}
+
+TEST_CASE( "pool allocator spans", "[memory]" )
+{
+    using namespace memory;
+
+    // sizes not cached by this thread in other tests
+    const size_t n = 5000;
+    const unsigned num = 2000;
+    std::set<Span*> used;
+
+    std::thread a([&used, n, num]()
+    {
+        std::vector<void*> v;
+
+        for ( unsigned i = 0; i < num; ++i )
+        {
+            v.push_back(PoolAllocator::allocate(n));
+            REQUIRE( v.back() );
+            memset(v.back(), 0xa5, n);
+            used.insert(get_span(v.back()));
+        }
+        // the rest is returned when the thread exits
+        for ( auto p : v )
+            PoolAllocator::deallocate(p, n);
+    });
+    a.join();
+
+    // all spans are empty; all but a few are given back
+    unsigned released = 0;
+
+    for ( auto s : used )
+    {
+        CHECK( s->live == 0 );
+
+        if ( s->released )
+        {
+            CHECK( ((char*)s)[span_size - 1] == 0 );
+            ++released;
+        }
+    }
+    CHECK( used.size() >= num * n / span_size );
+    CHECK( released + keep_spans >= used.size() );
+    CHECK( spans.resident <= keep_spans );
+
+    // and reused by another class
+    unsigned reused = 0;
+
+    std::thread b([&used, &reused, num]()
+    {
+        const size_t m = 3000;
+        std::vector<void*> v;
+
+        for ( unsigned i = 0; i < num; ++i )
+        {
+            v.push_back(PoolAllocator::allocate(m));
+            REQUIRE( v.back() );
+
+            if ( used.count(get_span(v.back())) )
+                ++reused;
+        }
+        for ( auto p : v )
+            PoolAllocator::deallocate(p, m);
+
+        PoolAllocator::thread_term();
+    });
+    b.join();
+
+    CHECK( reused == num );
+}
+
+#endif
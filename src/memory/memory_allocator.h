@@ -26,10 +26,30 @@
 namespace memory
 {
 
+// allocators are passed the size on deallocate so they don't need to keep
+// it in a header of their own; it comes from the manager's metadata
+
 struct MemoryAllocator
 {
     static void* allocate(size_t);
-    static void deallocate(void*);
+    static void deallocate(void*, size_t);
+};
+
+// size class allocator with per thread free lists; batches move between
+// threads through a central pool and blocks are carved from spans of huge
+// page arenas.  empty spans are reused by any class and idle ones are given
+// back to the os.  sizes above max_size use MemoryAllocator.  used for new
+// and delete when built with POOL_ALLOCATOR.
+struct PoolAllocator
+{
+    static void* allocate(size_t);
+    static void deallocate(void*, size_t);
+
+    // return this thread's cached blocks to the central pool; done
+    // automatically when a thread that allocated exits
+    static void thread_term();
+
+    static constexpr size_t max_size = 32768;
 };
 
 } // namespace memory
@@ -24,8 +24,12 @@
 #include "config.h"
 #endif
 
+#include <atomic>
 #include <cassert>
+#include <cstdlib>
+#include <new>
 
+#include "framework/counts.h"
 #include "log/messages.h"
 #include "main/snort_config.h"
 #include "main/snort_debug.h"
@@ -37,6 +41,7 @@
 #include "prune_handler.h"
 
 #ifdef UNIT_TEST
+#include <thread>
 #include "catch/catch.hpp"
 #endif
 
@@ -46,10 +51,13 @@ namespace memory
 namespace
 {
 
+// only the owning thread charges and reads a tracker; frees from other
+// threads are credited atomically
 struct Tracker
 {
     size_t allocated = 0;
     size_t deallocated = 0;
+    std::atomic<size_t> remote { 0 };
 
     void allocate(size_t n)
     { allocated += n; }
@@ -57,16 +65,60 @@ struct Tracker
     void deallocate(size_t n)
     { deallocated += n; }
 
+    void deallocate_remote(size_t n)
+    { remote.fetch_add(n, std::memory_order_relaxed); }
+
     size_t used() const
     {
-        assert(allocated >= deallocated);
-        return allocated - deallocated;
+        size_t freed = deallocated + remote.load(std::memory_order_relaxed);
+        assert(allocated >= freed);
+        return allocated - freed;
     }
+};
+
+// usage of one packet thread
+struct Account
+{
+    Tracker total;
+    Tracker budgets[BUDGET_MAX];
+};
+
+struct MemoryCounts
+{
+    PegCount in_use;
+    PegCount max_in_use;
+    PegCount budget_in_use[BUDGET_MAX];
+    PegCount reclaims;
+    PegCount failures;
+};
+
+// indexed by packet thread instance + 1 and never released so that a
+// late free on any thread can credit the thread that was charged
+Account* s_accounts = nullptr;
+unsigned s_num_accounts = 0;
 
-    constexpr Tracker() = default;
+THREAD_LOCAL Account* s_account = nullptr;
+THREAD_LOCAL uint16_t s_owner = 0;
+THREAD_LOCAL MemoryCounts s_counts;
+
+// hard and soft limits per budget; set before the threads start
+size_t s_budget_cap[BUDGET_MAX];
+size_t s_budget_soft[BUDGET_MAX];
+bool s_have_budgets = false;
+
+// stream sessions go with their flows.  file capture uses a shared
+// mempool and the host cache is shared across threads, so neither has a
+// per-thread reclaimer yet.
+Reclaimer s_reclaimers[BUDGET_MAX] =
+{
+    nullptr,        // other
+    prune_handler,  // flow
+    prune_handler,  // stream
+    nullptr,        // file
+    nullptr         // cache
 };
 
-THREAD_LOCAL Tracker s_tracker;
+static_assert(BUDGET_MAX == 5, "update s_reclaimers");
 
 // -----------------------------------------------------------------------------
 // helpers
@@ -108,6 +160,63 @@ inline bool free_space(size_t requested, size_t cap, Tracker& trk, Handler& hand
     return true;
 }
 
+// budgets over their soft limit give back first so one subsystem can't
+// hoard the thread cap; then everyone in priority order
+template<typename OverSoft, typename Reclaim>
+inline bool reclaim(unsigned num, OverSoft over_soft, Reclaim* reclaimers)
+{
+    for ( unsigned i = 0; i < num; ++i )
+    {
+        if ( reclaimers[i] and over_soft(i) and reclaimers[i]() )
+            return true;
+    }
+    for ( unsigned i = 0; i < num; ++i )
+    {
+        if ( reclaimers[i] and reclaimers[i]() )
+            return true;
+    }
+    return false;
+}
+
+// non-packet threads aren't charged
+inline Account* get_account()
+{
+    if ( !s_account and s_accounts and is_packet_thread() )
+    {
+        unsigned i = get_instance_id() + 1;
+
+        if ( i < s_num_accounts )
+        {
+            s_owner = i;
+            s_account = s_accounts + i;
+        }
+    }
+    return s_account;
+}
+
+inline void credit(Account& a, Budget b, size_t n, bool remote)
+{
+    if ( remote )
+    {
+        a.total.deallocate_remote(n);
+        a.budgets[b].deallocate_remote(n);
+    }
+    else
+    {
+        a.total.deallocate(n);
+        a.budgets[b].deallocate(n);
+    }
+}
+
+inline bool over_soft(unsigned b)
+{ return s_budget_soft[b] and s_account->budgets[b].used() >= s_budget_soft[b]; }
+
+void reclaim_handler()
+{
+    if ( memory::reclaim(BUDGET_MAX, over_soft, s_reclaimers) )
+        s_counts.reclaims++;
+}
+
 inline size_t calculate_threshold(size_t cap, size_t threshold)
 { return cap * threshold / 100; }
 
@@ -120,6 +229,8 @@ inline size_t calculate_threshold(size_t cap, size_t threshold)
 size_t MemoryCap::thread_cap = 0;
 size_t MemoryCap::preemptive_threshold = 0;
 
+THREAD_LOCAL Budget MemoryCap::budget = BUDGET_OTHER;
+
 // -----------------------------------------------------------------------------
 // public interface
 // -----------------------------------------------------------------------------
@@ -132,34 +243,123 @@ bool MemoryCap::free_space(size_t n)
     if ( !thread_cap )
         return true;
 
+    Account* a = get_account();
+
+    if ( !a )
+        return true;
+
     const auto& config = *snort_conf->memory;
-    return memory::free_space(n, thread_cap, s_tracker, prune_handler) || config.soft;
+
+    // the budget in scope must fit under its own hard limit and the thread cap
+    bool ok = !s_budget_cap[budget] or
+        memory::free_space(n, s_budget_cap[budget], a->budgets[budget], reclaim_handler);
+
+    ok = ok and memory::free_space(n, thread_cap, a->total, reclaim_handler);
+
+    if ( !ok )
+        s_counts.failures++;
+
+    return ok || config.soft;
 }
 
-void MemoryCap::update_allocations(size_t n)
+Charge MemoryCap::update_allocations(size_t n)
 {
-    s_tracker.allocate(n);
+    Charge c;
     mp_active_context.update_allocs(n);
+
+    Account* a = get_account();
+
+    if ( !a )
+        return c;
+
+    a->total.allocate(n);
+    a->budgets[budget].allocate(n);
+
+    if ( a->total.used() > s_counts.max_in_use )
+        s_counts.max_in_use = a->total.used();
+
+    c.budget = budget;
+    c.owner = s_owner;
+    return c;
 }
 
-void MemoryCap::update_deallocations(size_t n)
+void MemoryCap::update_deallocations(size_t n, Charge c)
 {
-    s_tracker.deallocate(n);
     mp_active_context.update_deallocs(n);
+
+    if ( c.owner and c.owner < s_num_accounts )
+        credit(s_accounts[c.owner], c.budget, n, c.owner != s_owner);
 }
 
 bool MemoryCap::over_threshold()
 {
-    if ( !preemptive_threshold )
+    if ( !get_account() )
         return false;
 
-    return s_tracker.used() >= preemptive_threshold;
+    if ( preemptive_threshold and s_account->total.used() >= preemptive_threshold )
+        return true;
+
+    if ( s_have_budgets )
+    {
+        for ( unsigned b = 0; b < BUDGET_MAX; ++b )
+        {
+            if ( over_soft(b) )
+                return true;
+        }
+    }
+    return false;
+}
+
+void MemoryCap::charge(Budget b, size_t n)
+{
+    if ( Account* a = get_account() )
+    {
+        a->total.allocate(n);
+        a->budgets[b].allocate(n);
+    }
+}
+
+void MemoryCap::release(Budget b, size_t n)
+{
+    if ( Account* a = get_account() )
+        credit(*a, b, n, false);
+}
+
+bool MemoryCap::at_max(Budget b)
+{
+    return s_budget_cap[b] and get_account() and
+        s_account->budgets[b].used() >= s_budget_cap[b];
+}
+
+void MemoryCap::set_reclaimer(Budget b, Reclaimer r)
+{ s_reclaimers[b] = r; }
+
+size_t MemoryCap::get_used(Budget b)
+{
+    if ( !get_account() )
+        return 0;
+
+    return b < BUDGET_MAX ? s_account->budgets[b].used() : s_account->total.used();
 }
 
 void MemoryCap::calculate(unsigned num_threads)
 {
     const MemoryConfig& config = *snort_conf->memory;
 
+    // made once before any packet thread starts.  the allocation can't
+    // come from new here.
+    if ( !s_accounts )
+    {
+        s_num_accounts = num_threads + 1;
+        s_accounts = (Account*)calloc(s_num_accounts, sizeof(Account));
+
+        if ( !s_accounts )
+            FatalError("can't allocate memory accounts");
+
+        for ( unsigned i = 0; i < s_num_accounts; ++i )
+            new (s_accounts + i) Account;
+    }
+
     if ( !config.cap )
         return;
 
@@ -180,6 +380,53 @@ void MemoryCap::calculate(unsigned num_threads)
         DebugFormat(DEBUG_MEMORY,
             "per-thread pre-emptive action threshold set to %zu\n", preemptive_threshold);
     }
+
+    for ( unsigned b = 0; b < BUDGET_MAX; ++b )
+    {
+        if ( !config.share[b] )
+            continue;
+
+        // shares may overcommit; the thread cap still applies
+        s_budget_cap[b] = memory::calculate_threshold(thread_cap, config.share[b]);
+        s_budget_soft[b] = config.threshold ?
+            memory::calculate_threshold(s_budget_cap[b], config.threshold) : s_budget_cap[b];
+
+        s_have_budgets = true;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// stats
+// -----------------------------------------------------------------------------
+
+const PegInfo* MemoryCap::get_pegs()
+{
+    static const PegInfo pegs[] =
+    {
+        { "in_use", "bytes currently allocated by this thread" },
+        { "max_in_use", "maximum bytes allocated by this thread" },
+        { "other_in_use", "bytes in use outside of any budget" },
+        { "flow_in_use", "bytes in use by flow setup and tracking" },
+        { "stream_in_use", "bytes in use by stream sessions" },
+        { "file_in_use", "bytes in use by file processing" },
+        { "cache_in_use", "bytes in use by shared caches" },
+        { "reclaims", "times memory was reclaimed to make room" },
+        { "failures", "allocations that exceeded a cap" },
+        { nullptr, nullptr }
+    };
+    return pegs;
+}
+
+PegCount* MemoryCap::get_counts()
+{
+    if ( get_account() )
+    {
+        s_counts.in_use = s_account->total.used();
+
+        for ( unsigned b = 0; b < BUDGET_MAX; ++b )
+            s_counts.budget_in_use[b] = s_account->budgets[b].used();
+    }
+    return (PegCount*)&s_counts;
 }
 
 } // namespace memory
@@ -267,4 +514,112 @@ TEST_CASE( "memory cap free space", "[memory]" )
     }
 }
 
+namespace t_memory_cap
+{
+
+static unsigned s_calls[3];
+static bool s_frees[3];
+
+template<unsigned N>
+static bool reclaimer()
+{ ++s_calls[N]; return s_frees[N]; }
+
+static bool s_over[3];
+
+static bool over(unsigned i)
+{ return s_over[i]; }
+
+} // namespace t_memory_cap
+
+TEST_CASE( "memory cap reclaim order", "[memory]" )
+{
+    using namespace t_memory_cap;
+
+    memory::Reclaimer reclaimers[3] = { reclaimer<0>, reclaimer<1>, reclaimer<2> };
+
+    for ( unsigned i = 0; i < 3; ++i )
+    {
+        s_calls[i] = 0;
+        s_frees[i] = true;
+        s_over[i] = false;
+    }
+
+    SECTION( "priority order when no budget is over" )
+    {
+        CHECK( memory::reclaim(3, over, reclaimers) );
+        CHECK( s_calls[0] == 1 );
+        CHECK( s_calls[1] == 0 );
+    }
+
+    SECTION( "budget over its soft limit goes first" )
+    {
+        s_over[2] = true;
+
+        CHECK( memory::reclaim(3, over, reclaimers) );
+        CHECK( s_calls[0] == 0 );
+        CHECK( s_calls[2] == 1 );
+    }
+
+    SECTION( "falls back when the hoarder can't free anything" )
+    {
+        s_over[2] = true;
+        s_frees[2] = false;
+        s_frees[0] = false;
+
+        CHECK( memory::reclaim(3, over, reclaimers) );
+        CHECK( s_calls[2] == 1 );
+        CHECK( s_calls[0] == 1 );
+        CHECK( s_calls[1] == 1 );
+    }
+
+    SECTION( "nothing to reclaim" )
+    {
+        memory::Reclaimer none[3] = { };
+        CHECK_FALSE( memory::reclaim(3, over, none) );
+    }
+}
+
+TEST_CASE( "memory cap reclaimers", "[memory]" )
+{
+    CHECK( memory::s_reclaimers[memory::BUDGET_FLOW] );
+    CHECK( memory::s_reclaimers[memory::BUDGET_STREAM] );
+    CHECK_FALSE( memory::s_reclaimers[memory::BUDGET_FILE] );
+    CHECK_FALSE( memory::s_reclaimers[memory::BUDGET_CACHE] );
+}
+
+TEST_CASE( "memory cap credits the charged thread", "[memory]" )
+{
+    memory::Account accounts[3];
+    memory::s_accounts = accounts;
+    memory::s_num_accounts = 3;
+
+    memory::Charge charge;
+
+    std::thread charger([&charge]()
+    {
+        set_thread_type(STHREAD_TYPE_PACKET);
+        set_instance_id(1);
+
+        memory::BudgetContext context(memory::BUDGET_CACHE);
+        charge = memory::MemoryCap::update_allocations(64);
+        memory::MemoryCap::update_allocations(16);
+    });
+    charger.join();
+
+    CHECK( charge.owner == 2 );
+    CHECK( charge.budget == memory::BUDGET_CACHE );
+    CHECK( accounts[2].budgets[memory::BUDGET_CACHE].used() == 80 );
+
+    // this thread isn't charged but the free still credits the charger
+    memory::MemoryCap::update_deallocations(64, charge);
+
+    CHECK( accounts[2].budgets[memory::BUDGET_CACHE].used() == 16 );
+    CHECK( accounts[2].total.used() == 16 );
+    CHECK( accounts[0].total.used() == 0 );
+    CHECK( accounts[1].total.used() == 0 );
+
+    memory::s_accounts = nullptr;
+    memory::s_num_accounts = 0;
+}
+
 #endif
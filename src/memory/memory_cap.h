@@ -22,25 +22,80 @@
 #define MEMORY_CAP_H
 
 #include <cstddef>
+#include <cstdint>
+
+#include "framework/counts.h"
+#include "main/thread.h"
 
 namespace memory
 {
 
+// subsystem budgets carved out of the per-thread cap.  allocations are
+// charged to the budget in scope when they are made; reclaimers are tried
+// in this order.
+enum Budget : uint8_t
+{
+    BUDGET_OTHER,
+    BUDGET_FLOW,
+    BUDGET_STREAM,
+    BUDGET_FILE,
+    BUDGET_CACHE,
+    BUDGET_MAX
+};
+
+// returns true if anything was freed
+typedef bool (* Reclaimer)();
+
+// kept with each allocation so the free credits the same packet thread
+// and budget, whichever thread does it
+struct Charge
+{
+    Budget budget = BUDGET_OTHER;
+    uint16_t owner = 0;  // packet thread instance + 1; 0 if not charged
+};
+
 class MemoryCap
 {
 public:
     static bool free_space(size_t);
-    static void update_allocations(size_t);
-    static void update_deallocations(size_t);
+    static Charge update_allocations(size_t);
+    static void update_deallocations(size_t, Charge = Charge());
 
     static bool over_threshold();
 
     // call from main thread before thread spawn
     static void calculate(unsigned num_threads);
+    static void set_reclaimer(Budget, Reclaimer);
+
+    static Budget set_budget(Budget b)
+    { Budget tmp = budget; budget = b; return tmp; }
+
+    // for memory allocated outside of new / delete
+    static void charge(Budget, size_t);
+    static void release(Budget, size_t);
+    static bool at_max(Budget);
+
+    static size_t get_used(Budget);
+
+    static const PegInfo* get_pegs();
+    static PegCount* get_counts();
 
 private:
     static size_t thread_cap;
     static size_t preemptive_threshold;
+
+    static THREAD_LOCAL Budget budget;
+};
+
+// charge allocations in scope to a budget
+class BudgetContext
+{
+public:
+    BudgetContext(Budget b) : saved(MemoryCap::set_budget(b)) { }
+    ~BudgetContext() { MemoryCap::set_budget(saved); }
+
+private:
+    Budget saved;
 };
 
 } // namespace memory
@@ -23,12 +23,17 @@
 
 #include <cstddef>
 
+#include "memory_cap.h"
+
 struct MemoryConfig
 {
     size_t cap = 0;
     bool soft = false;
     size_t threshold = 0;
 
+    // percent of the thread cap per budget, 0 for no separate limit
+    unsigned share[memory::BUDGET_MAX] = { };
+
     constexpr MemoryConfig() = default;
 };
 
@@ -44,7 +44,9 @@ namespace memory
 
 struct Metadata
 {
-    size_t sanity;
+    uint32_t sanity;
+    // thread and budget charged for this allocation
+    Charge charge;
     // number of requested bytes
     size_t payload_size;
 
@@ -62,7 +64,7 @@ struct Metadata
 
     static Metadata* extract(void*);
 
-    static size_t SANITY_CHECK_VALUE;
+    static uint32_t SANITY_CHECK_VALUE;
 };
 
 inline size_t Metadata::total_size() const
@@ -108,7 +110,7 @@ Metadata* Metadata::extract(void* p)
     return meta;
 }
 
-size_t Metadata::SANITY_CHECK_VALUE = 0xabcdef;
+uint32_t Metadata::SANITY_CHECK_VALUE = 0xabcdef;
 
 // -----------------------------------------------------------------------------
 // the meat
@@ -132,7 +134,13 @@ private:
     bool& flag;
 };
 
-template<typename Allocator = MemoryAllocator, typename Cap = MemoryCap>
+#ifdef POOL_ALLOCATOR
+using DefaultAllocator = PoolAllocator;
+#else
+using DefaultAllocator = MemoryAllocator;
+#endif
+
+template<typename Allocator = DefaultAllocator, typename Cap = MemoryCap>
 struct Interface
 {
     static void* allocate(size_t);
@@ -155,7 +163,7 @@ void* Interface<Allocator, Cap>::allocate(size_t n)
     if ( !meta )
         return nullptr;
 
-    Cap::update_allocations(meta->total_size());
+    meta->charge = Cap::update_allocations(meta->total_size());
     return meta->payload_offset();
 }
 
@@ -168,8 +176,9 @@ void Interface<Allocator, Cap>::deallocate(void* p)
     auto meta = Metadata::extract(p);
     assert(meta);
 
-    Cap::update_deallocations(meta->total_size());
-    Allocator::deallocate(meta);
+    size_t n = meta->total_size();
+    Cap::update_deallocations(n, meta->charge);
+    Allocator::deallocate(meta, n);
 }
 
 template<typename Allocator, typename Cap>
@@ -227,8 +236,8 @@ struct AllocatorSpy
     static void* allocate(size_t n)
     { allocate_called = true; allocate_arg = n; return pool; }
 
-    static void deallocate(void* p)
-    { deallocate_called = true; deallocate_arg = p; }
+    static void deallocate(void* p, size_t n)
+    { deallocate_called = true; deallocate_arg = p; deallocate_size = n; }
 
     static void reset()
     {
@@ -237,6 +246,7 @@ struct AllocatorSpy
         allocate_arg = 0;
         deallocate_called = false;
         deallocate_arg = nullptr;
+        deallocate_size = 0;
     }
 
     static void* pool;
@@ -244,6 +254,7 @@ struct AllocatorSpy
     static size_t allocate_arg;
     static bool deallocate_called;
     static void* deallocate_arg;
+    static size_t deallocate_size;
 };
 
 void* AllocatorSpy::pool = nullptr;
@@ -251,6 +262,7 @@ bool AllocatorSpy::allocate_called = false;
 size_t AllocatorSpy::allocate_arg = 0;
 bool AllocatorSpy::deallocate_called = false;
 void* AllocatorSpy::deallocate_arg = nullptr;
+size_t AllocatorSpy::deallocate_size = 0;
 
 struct CapSpy
 {
@@ -261,14 +273,21 @@ struct CapSpy
         return free_space_result;
     }
 
-    static void update_allocations(size_t n)
+    static memory::Charge update_allocations(size_t n)
     {
         update_allocations_called = true;
         update_allocations_arg = n;
+
+        memory::Charge c;
+        c.budget = memory::BUDGET_FLOW;
+        c.owner = 2;
+        return c;
     }
 
-    static void update_deallocations(size_t n)
+    static void update_deallocations(size_t n, memory::Charge c)
     {
+        update_deallocations_budget = c.budget;
+        update_deallocations_owner = c.owner;
         update_deallocations_called = true;
         update_deallocations_arg = n;
     }
@@ -284,6 +303,8 @@ struct CapSpy
 
         update_deallocations_called = false;
         update_deallocations_arg = 0;
+        update_deallocations_budget = memory::BUDGET_OTHER;
+        update_deallocations_owner = 0;
     }
 
     static bool free_space_called;
@@ -295,6 +316,8 @@ struct CapSpy
 
     static bool update_deallocations_called;
     static size_t update_deallocations_arg;
+    static memory::Budget update_deallocations_budget;
+    static uint16_t update_deallocations_owner;
 };
 
 bool CapSpy::free_space_called = false;
@@ -306,6 +329,8 @@ size_t CapSpy::update_allocations_arg = 0;
 
 bool CapSpy::update_deallocations_called = false;
 size_t CapSpy::update_deallocations_arg = 0;
+memory::Budget CapSpy::update_deallocations_budget = memory::BUDGET_OTHER;
+uint16_t CapSpy::update_deallocations_owner = 0;
 
 } // namespace t_memory
 
@@ -403,6 +428,9 @@ TEST_CASE( "memory manager interface", "[memory]" )
 
             CHECK( CapSpy::update_allocations_called );
             CHECK( CapSpy::update_allocations_arg == memory::Metadata::calculate_total_size(n) );
+
+            CHECK( memory::Metadata::extract(p)->charge.budget == memory::BUDGET_FLOW );
+            CHECK( memory::Metadata::extract(p)->charge.owner == 2 );
         }
     }
 
@@ -420,6 +448,8 @@ TEST_CASE( "memory manager interface", "[memory]" )
         {
             auto meta_pool = reinterpret_cast<memory::Metadata*>(pool);
             meta_pool[0] = memory::Metadata(n);
+            meta_pool[0].charge.budget = memory::BUDGET_STREAM;
+            meta_pool[0].charge.owner = 3;
 
             auto p = meta_pool[0].payload_offset();
 
@@ -427,8 +457,11 @@ TEST_CASE( "memory manager interface", "[memory]" )
 
             CHECK( AllocatorSpy::deallocate_called );
             CHECK( AllocatorSpy::deallocate_arg == (void*)pool );
+            CHECK( AllocatorSpy::deallocate_size == memory::Metadata::calculate_total_size(n) );
             CHECK( CapSpy::update_deallocations_called );
             CHECK( CapSpy::update_deallocations_arg == memory::Metadata::calculate_total_size(n) );
+            CHECK( CapSpy::update_deallocations_budget == memory::BUDGET_STREAM );
+            CHECK( CapSpy::update_deallocations_owner == 3 );
         }
     }
 }
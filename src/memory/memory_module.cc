@@ -21,6 +21,7 @@
 #include "memory_module.h"
 
 #include "main/snort_config.h"
+#include "memory_cap.h"
 #include "memory_config.h"
 
 // -----------------------------------------------------------------------------
@@ -43,6 +44,18 @@ static const Parameter s_params[] =
         "set the per-packet-thread threshold for preemptive cleanup actions "
         "(percent, 0 to disable)" },
 
+    { "flow_share", Parameter::PT_INT, "0:100", "0",
+        "percent of the thread cap for flow tracking (0 for no separate limit)" },
+
+    { "stream_share", Parameter::PT_INT, "0:100", "0",
+        "percent of the thread cap for stream sessions (0 for no separate limit)" },
+
+    { "file_share", Parameter::PT_INT, "0:100", "0",
+        "percent of the thread cap for file processing (0 for no separate limit)" },
+
+    { "cache_share", Parameter::PT_INT, "0:100", "0",
+        "percent of the thread cap for shared caches (0 for no separate limit)" },
+
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
@@ -65,8 +78,26 @@ bool MemoryModule::set(const char*, Value& v, SnortConfig* sc)
     else if ( v.is("threshold") )
         sc->memory->threshold = v.get_long();
 
+    else if ( v.is("flow_share") )
+        sc->memory->share[memory::BUDGET_FLOW] = v.get_long();
+
+    else if ( v.is("stream_share") )
+        sc->memory->share[memory::BUDGET_STREAM] = v.get_long();
+
+    else if ( v.is("file_share") )
+        sc->memory->share[memory::BUDGET_FILE] = v.get_long();
+
+    else if ( v.is("cache_share") )
+        sc->memory->share[memory::BUDGET_CACHE] = v.get_long();
+
     else
         return false;
 
     return true;
 }
+
+const PegInfo* MemoryModule::get_pegs() const
+{ return memory::MemoryCap::get_pegs(); }
+
+PegCount* MemoryModule::get_counts() const
+{ return memory::MemoryCap::get_counts(); }
@@ -29,6 +29,9 @@ public:
     MemoryModule();
 
     bool set(const char*, Value&, SnortConfig*) override;
+
+    const PegInfo* get_pegs() const override;
+    PegCount* get_counts() const override;
 };
 
 #endif
@@ -27,11 +27,13 @@
 namespace memory
 {
 
-void prune_handler()
+bool prune_handler()
 {
     // assert(flow_con);
     if ( flow_con )
-        flow_con->prune_one(PruneReason::MEMCAP, false);
+        return flow_con->prune_one(PruneReason::MEMCAP, false);
+
+    return false;
 }
 
 } // namespace memory
@@ -21,10 +21,20 @@
 #include <mime/decode_base.h>
 #include "decode_qp.h"
 
+#include <string.h>
+#include <algorithm>
+
 #include "utils/snort_bounds.h"
 #include "utils/util.h"
 #include "utils/util_unfold.h"
 
+#ifdef UNIT_TEST
+#include "catch/catch.hpp"
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 void QPDecode::reset_decode_state()
 {
@@ -92,8 +102,64 @@ QPDecode::~QPDecode()
 
 }
 
-int sf_qpdecode(char* src, uint32_t slen, char* dst, uint32_t dlen, uint32_t* bytes_read,
-    uint32_t* bytes_copied)
+/* bytes that are copied through unchanged: printable ASCII other than '=',
+ * tab, CR and LF */
+static inline bool qp_plain(char ch)
+{
+    return ((ch >= 0x20) && (ch <= 0x7e) && (ch != '=')) ||
+        (ch == '\t') || (ch == '\r') || (ch == '\n');
+}
+
+/* Return the length of the leading run of plain bytes in src */
+static inline uint32_t qp_plain_run(const char* src, uint32_t len, bool simd)
+{
+    uint32_t run = 0;
+
+#if defined(__SSE2__)
+    const __m128i lo = _mm_set1_epi8(0x1f);
+    const __m128i hi = _mm_set1_epi8(0x7f);
+    const __m128i eq = _mm_set1_epi8('=');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+
+    while ( simd and (len - run >= 16) )
+    {
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + run));
+
+        /* signed compares also reject bytes >= 0x80 */
+        __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(c, lo), _mm_cmplt_epi8(c, hi));
+        ok = _mm_andnot_si128(_mm_cmpeq_epi8(c, eq), ok);
+        ok = _mm_or_si128(ok, _mm_or_si128(_mm_cmpeq_epi8(c, tab),
+            _mm_or_si128(_mm_cmpeq_epi8(c, cr), _mm_cmpeq_epi8(c, lf))));
+
+        unsigned mask = _mm_movemask_epi8(ok);
+
+        if ( mask != 0xFFFF )
+            return run + __builtin_ctz(~mask);
+
+        run += 16;
+    }
+#else
+    UNUSED(simd);
+#endif
+
+    while ( (run < len) && qp_plain(src[run]) )
+        run++;
+
+    return run;
+}
+
+static inline char qp_hex_value(char ch)
+{
+    if ( ch <= '9' )
+        return ch - '0';
+
+    return (ch | 0x20) - 'a' + 10;
+}
+
+static int qpdecode(char* src, uint32_t slen, char* dst, uint32_t dlen, uint32_t* bytes_read,
+    uint32_t* bytes_copied, bool simd)
 {
     char ch;
 
@@ -105,6 +171,18 @@ int sf_qpdecode(char* src, uint32_t slen, char* dst, uint32_t dlen, uint32_t* by
 
     while ( (*bytes_read < slen) && (*bytes_copied < dlen))
     {
+        /* copy runs of literal text in bulk */
+        uint32_t run = qp_plain_run(src + *bytes_read,
+            std::min(slen - *bytes_read, dlen - *bytes_copied), simd);
+
+        if ( run )
+        {
+            memcpy(dst + *bytes_copied, src + *bytes_read, run);
+            *bytes_read += run;
+            *bytes_copied += run;
+            continue;
+        }
+
         ch = src[*bytes_read];
         *bytes_read += 1;
         if ( ch == '=' )
@@ -127,16 +205,8 @@ int sf_qpdecode(char* src, uint32_t slen, char* dst, uint32_t dlen, uint32_t* by
                     }
                     if (isxdigit((int)ch1) && isxdigit((int)ch2))
                     {
-                        char hexBuf[3];
-                        char* eptr;
-                        hexBuf[0] = ch1;
-                        hexBuf[1] = ch2;
-                        hexBuf[2] = '\0';
-                        dst[*bytes_copied]= (char)strtoul(hexBuf, &eptr, 16);
-                        if ((*eptr != '\0'))
-                        {
-                            return -1;
-                        }
+                        dst[*bytes_copied] = (char)((qp_hex_value(ch1) << 4) |
+                            qp_hex_value(ch2));
                         *bytes_read += 2;
                         *bytes_copied +=1;
                         continue;
@@ -166,3 +236,97 @@ int sf_qpdecode(char* src, uint32_t slen, char* dst, uint32_t dlen, uint32_t* by
 
     return 0;
 }
+
+int sf_qpdecode(char* src, uint32_t slen, char* dst, uint32_t dlen, uint32_t* bytes_read,
+    uint32_t* bytes_copied)
+{
+    return qpdecode(src, slen, dst, dlen, bytes_read, bytes_copied, true);
+}
+
+#ifdef UNIT_TEST
+// decode with and without the vector path and require identical results
+static void qp_check(const char* in, uint32_t len, uint32_t out_size)
+{
+    char scalar[256], vector[256];
+    uint32_t read_scalar = 0, read_vector = 0, n_scalar = 0, n_vector = 0;
+
+    memset(scalar, 0xAA, sizeof(scalar));
+    memset(vector, 0xAA, sizeof(vector));
+
+    int r_scalar = qpdecode((char*)in, len, scalar, out_size, &read_scalar, &n_scalar, false);
+    int r_vector = qpdecode((char*)in, len, vector, out_size, &read_vector, &n_vector, true);
+
+    CHECK(r_scalar == r_vector);
+    CHECK(read_scalar == read_vector);
+    REQUIRE(n_scalar == n_vector);
+    CHECK(!memcmp(scalar, vector, n_scalar));
+}
+
+static void qp_fill(char* buf, unsigned len)
+{
+    for ( unsigned i = 0; i < len; ++i )
+        buf[i] = 'a' + (i % 26);
+}
+
+TEST_CASE("qp known answer", "[qp]")
+{
+    char in[] = "caf=C3=A9 soft=\r\nbreak=\nhere=3d";
+    char out[64];
+    uint32_t read, n;
+
+    REQUIRE(!sf_qpdecode(in, sizeof(in) - 1, out, sizeof(out), &read, &n));
+    CHECK(read == sizeof(in) - 1);
+    REQUIRE(n == 20);
+    CHECK(!memcmp(out, "caf\xC3\xA9 softbreakhere=", n));
+}
+
+TEST_CASE("qp tail lengths", "[qp]")
+{
+    char in[64];
+    qp_fill(in, sizeof(in));
+
+    for ( uint32_t len = 1; len <= sizeof(in); ++len )
+    {
+        qp_check(in, len, 256);
+        qp_check(in, len, len / 2 + 1);
+    }
+}
+
+TEST_CASE("qp special bytes", "[qp]")
+{
+    const char special[] = { '=', '\t', '\r', '\n', 0x01, 0x1f, 0x7f, (char)0x80, (char)0xff };
+
+    for ( auto c : special )
+    {
+        for ( unsigned pos = 0; pos < 48; ++pos )
+        {
+            char in[48];
+            qp_fill(in, sizeof(in));
+            in[pos] = c;
+            qp_check(in, sizeof(in), 256);
+        }
+    }
+}
+
+TEST_CASE("qp escapes across the block boundary", "[qp]")
+{
+    const char* seqs[] = { "=\n", "=\r\n", "=41", "=4g", "=", "==" };
+
+    for ( auto seq : seqs )
+    {
+        unsigned n = strlen(seq);
+
+        // start the sequence before, on and after the 16 and 32 byte edges
+        for ( unsigned pos = 12; pos < 36; ++pos )
+        {
+            char in[48];
+            qp_fill(in, sizeof(in));
+            memcpy(in + pos, seq, n);
+            qp_check(in, sizeof(in), 256);
+
+            // and with the sequence at the very end of the input
+            qp_check(in, pos + n, 256);
+        }
+    }
+}
+#endif
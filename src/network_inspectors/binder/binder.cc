@@ -17,9 +17,12 @@
 //--------------------------------------------------------------------------
 // binder.cc author Russ Combs <rucombs@cisco.com>
 
+#include <map>
 #include <vector>
 using namespace std;
 
+#include <string.h>
+
 #include "binding.h"
 #include "bind_module.h"
 #include "flow/flow.h"
@@ -179,6 +182,266 @@ bool Binding::check_all(const Flow* flow) const
     return true;
 }
 
+//-------------------------------------------------------------------------
+// binding table
+// compiles the bindings into one bit per binding for each value of each
+// discrete dimension so that the candidate bindings for a flow are the
+// AND of a few lookups.  candidates are visited in binding order and only
+// the address check is done per binding.
+//-------------------------------------------------------------------------
+
+class BindingTable
+{
+public:
+    void compile(const vector<Binding*>&);
+
+    // calls f(index) for each binding matching everything but addresses,
+    // in order, until f returns true
+    template <typename F>
+    void match(const Flow*, F f) const;
+
+private:
+    typedef vector<uint64_t> Bits;
+
+    void set(Bits& b, unsigned i) const
+    { b[i / 64] |= (uint64_t)1 << (i % 64); }
+
+    uint16_t add_class(vector<uint64_t>& classes, map<Bits, uint16_t>& ids, const Bits&);
+
+    template <typename All, typename Test>
+    void compile_dim(const vector<Binding*>&, unsigned domain, All, Test,
+        vector<uint16_t>& index, vector<uint64_t>& classes);
+
+    const uint64_t* get(const vector<uint64_t>& classes, uint16_t i) const
+    { return &classes[i * words]; }
+
+    const uint64_t* get_policy(unsigned id) const;
+
+private:
+    unsigned words = 0;
+
+    vector<uint16_t> port_index;    // server port -> class
+    vector<uint64_t> port_classes;
+    vector<uint16_t> vlan_index;    // vlan tag -> class
+    vector<uint64_t> vlan_classes;
+    vector<uint16_t> iface_index;   // interface -> class
+    vector<uint64_t> iface_classes;
+
+    Bits proto_bits[8];             // PktType bit -> bindings
+
+    Bits any_policy;                // bindings for all policies
+    map<unsigned, Bits> policy_bits;
+
+    Bits no_service;                // bindings without a service
+    vector<pair<string, Bits>> service_bits;
+    Bits none;
+};
+
+uint16_t BindingTable::add_class(
+    vector<uint64_t>& classes, map<Bits, uint16_t>& ids, const Bits& b)
+{
+    auto it = ids.find(b);
+
+    if ( it != ids.end() )
+        return it->second;
+
+    uint16_t id = ids.size();
+    ids[b] = id;
+    classes.insert(classes.end(), b.begin(), b.end());
+    return id;
+}
+
+// bindings that accept every value share a wildcard set; the rest are
+// tested per value and identical sets are stored once
+template <typename All, typename Test>
+void BindingTable::compile_dim(
+    const vector<Binding*>& bindings, unsigned domain, All all, Test test,
+    vector<uint16_t>& index, vector<uint64_t>& classes)
+{
+    Bits any(words);
+    vector<unsigned> specific;
+
+    for ( unsigned i = 0; i < bindings.size(); ++i )
+    {
+        if ( all(bindings[i]) )
+            set(any, i);
+        else
+            specific.push_back(i);
+    }
+
+    map<Bits, uint16_t> ids;
+    index.resize(domain);
+    classes.clear();
+
+    for ( unsigned v = 0; v < domain; ++v )
+    {
+        Bits b = any;
+
+        for ( auto i : specific )
+            if ( test(bindings[i], v) )
+                set(b, i);
+
+        index[v] = add_class(classes, ids, b);
+    }
+}
+
+void BindingTable::compile(const vector<Binding*>& bindings)
+{
+    words = (bindings.size() + 63) / 64;
+    none.assign(words, 0);
+
+    compile_dim(bindings, 65536,
+        [](const Binding* pb) { return pb->when.ports.all(); },
+        [](const Binding* pb, unsigned v) { return pb->when.ports.test(v); },
+        port_index, port_classes);
+
+    compile_dim(bindings, 4096,
+        [](const Binding* pb) { return pb->when.vlans.all(); },
+        [](const Binding* pb, unsigned v) { return pb->when.vlans.test(v); },
+        vlan_index, vlan_classes);
+
+    compile_dim(bindings, 256,
+        [](const Binding* pb) { return pb->when.ifaces.all(); },
+        [](const Binding* pb, unsigned v) { return pb->when.ifaces.test(v); },
+        iface_index, iface_classes);
+
+    for ( auto& b : proto_bits )
+        b.assign(words, 0);
+
+    any_policy.assign(words, 0);
+    no_service.assign(words, 0);
+    policy_bits.clear();
+    service_bits.clear();
+
+    for ( unsigned i = 0; i < bindings.size(); ++i )
+    {
+        const BindWhen& when = bindings[i]->when;
+
+        for ( unsigned bit = 0; bit < 8; ++bit )
+            if ( when.protos & (1u << bit) )
+                set(proto_bits[bit], i);
+
+        if ( !when.id )
+            set(any_policy, i);
+
+        if ( when.svc.empty() )
+        {
+            set(no_service, i);
+            continue;
+        }
+        auto it = service_bits.begin();
+
+        while ( it != service_bits.end() and it->first != when.svc )
+            ++it;
+
+        if ( it == service_bits.end() )
+        {
+            service_bits.push_back(make_pair(when.svc, none));
+            it = service_bits.end() - 1;
+        }
+        set(it->second, i);
+    }
+
+    for ( unsigned i = 0; i < bindings.size(); ++i )
+    {
+        unsigned id = bindings[i]->when.id;
+
+        if ( !id )
+            continue;
+
+        auto it = policy_bits.find(id);
+
+        if ( it == policy_bits.end() )
+            it = policy_bits.insert(make_pair(id, any_policy)).first;
+
+        set(it->second, i);
+    }
+}
+
+const uint64_t* BindingTable::get_policy(unsigned id) const
+{
+    if ( id )
+    {
+        auto it = policy_bits.find(id);
+
+        if ( it != policy_bits.end() )
+            return it->second.data();
+    }
+    return any_policy.data();
+}
+
+template <typename F>
+void BindingTable::match(const Flow* flow, F f) const
+{
+    if ( !words )
+        return;
+
+    const uint64_t* port = get(port_classes, port_index[flow->server_port]);
+
+    unsigned v = flow->key->vlan_tag;
+    const uint64_t* vlan = v < vlan_index.size() ? get(vlan_classes, vlan_index[v]) : none.data();
+
+    int i = flow->iface_in < 0 ? 0 : flow->iface_in;
+    const uint64_t* in = (unsigned)i < iface_index.size() ?
+        get(iface_classes, iface_index[i]) : none.data();
+
+    i = flow->iface_out < 0 ? 0 : flow->iface_out;
+    const uint64_t* out = (unsigned)i < iface_index.size() ?
+        get(iface_classes, iface_index[i]) : none.data();
+
+    unsigned policy_id = flow->policy_id;
+    const uint64_t* policy = get_policy(policy_id);
+
+    const uint64_t* svc = none.data();
+
+    if ( !flow->service )
+        svc = no_service.data();
+
+    else
+    {
+        for ( auto& sb : service_bits )
+        {
+            if ( sb.first == flow->service )
+            {
+                svc = sb.second.data();
+                break;
+            }
+        }
+    }
+
+    const unsigned protos = (unsigned)flow->protocol;
+
+    for ( unsigned w = 0; w < words; ++w )
+    {
+        uint64_t proto = 0;
+
+        for ( unsigned bit = 0; bit < 8; ++bit )
+            if ( protos & (1u << bit) )
+                proto |= proto_bits[bit][w];
+
+        const uint64_t base = port[w] & vlan[w] & (in[w] | out[w]) & svc[w] & proto;
+        uint64_t m = base & policy[w];
+
+        while ( m )
+        {
+            unsigned b = __builtin_ctzll(m);
+            m &= m - 1;
+
+            if ( f(w * 64 + b) )
+                return;
+
+            // a policy binding without its own binder changes the policy
+            // for the rest of the search
+            if ( flow->policy_id != policy_id )
+            {
+                policy_id = flow->policy_id;
+                policy = get_policy(policy_id);
+                m = base & policy[w] & ~((((uint64_t)2) << b) - 1);
+            }
+        }
+    }
+}
+
 //-------------------------------------------------------------------------
 // helpers
 //-------------------------------------------------------------------------
@@ -406,6 +669,7 @@ private:
 
 private:
     vector<Binding*> bindings;
+    BindingTable table;
 };
 
 Binder::Binder(vector<Binding*>& v)
@@ -431,6 +695,7 @@ bool Binder::configure(SnortConfig* sc)
         if ( !pb->use.index )
             set_binding(sc, pb);
     }
+    table.compile(bindings);
     return true;
 }
 
@@ -513,27 +778,19 @@ void Binder::set_binding(SnortConfig*, Binding* pb)
         ParseError("can't bind %s", key);
 }
 
-// FIXIT-P this is a simple linear search until functionality is nailed
-// down.  performance should be the focus of the next iteration.
+// the table narrows the bindings to those matching the flow on all but
+// addresses; those are visited in order exactly as check_all() would
 void Binder::get_bindings(Flow* flow, Stuff& stuff)
 {
-    Binding* pb;
-    unsigned i, sz = bindings.size();
-
-    for ( i = 0; i < sz; i++ )
+    table.match(flow, [&](unsigned i)
     {
-        pb = bindings[i];
+        Binding* pb = bindings[i];
 
-        if ( !pb->check_all(flow) )
-            continue;
+        if ( !pb->check_addr(flow) )
+            return false;
 
         if ( !pb->use.index )
-        {
-            if ( stuff.update(pb) )
-                return;
-            else
-                continue;
-        }
+            return stuff.update(pb);
 
         set_policies(snort_conf, pb->use.index - 1);
         flow->policy_id = pb->use.index - 1;
@@ -543,9 +800,10 @@ void Binder::get_bindings(Flow* flow, Stuff& stuff)
         if ( sub )
         {
             sub->get_bindings(flow, stuff);
-            return;
+            return true;
         }
-    }
+        return false;
+    });
 }
 
 Inspector* Binder::find_gadget(Flow* flow)
@@ -23,6 +23,7 @@
 #include "config.h"
 #endif
 
+#include <assert.h>
 #include <string.h>
 
 #include "main/snort_config.h"
@@ -123,6 +124,7 @@ int Norm_Packet(NormalizerConfig* c, Packet* p)
 
     if ( changes > 0 )
     {
+        assert(!(p->packet_flags & PKT_CKSUM_CURRENT));
         p->packet_flags |= PKT_MODIFIED;
         return 1;
     }
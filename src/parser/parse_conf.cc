@@ -41,7 +41,6 @@
 
 #include <stack>
 #include <string>
-#include <fstream>
 #include <sstream>
 
 #include "parser.h"
@@ -128,28 +127,25 @@ void inc_parse_position()
     ++loc.line;
 }
 
-void parse_include(SnortConfig* sc, const char* arg)
+std::string get_include_path(const char* arg)
 {
     struct stat file_stat;  /* for include path testing */
-    char* fname = SnortStrdup(arg);
 
     /* Stat the file.  If that fails, make it relative to the directory
      * that the top level snort configuration file was in */
-    if ( stat(fname, &file_stat) == -1 && fname[0] != '/' )
-    {
-        const char* snort_conf_dir = get_snort_conf_dir();
+    if ( stat(arg, &file_stat) == -1 && arg[0] != '/' )
+        return std::string(get_snort_conf_dir()) + arg;
 
-        int path_len = strlen(snort_conf_dir) + strlen(arg) + 1;
-        free(fname);
+    return arg;
+}
 
-        fname = (char*)SnortAlloc(path_len);
-        snprintf(fname, path_len, "%s%s", snort_conf_dir, arg);
-    }
+void parse_include(SnortConfig* sc, const char* arg)
+{
+    std::string fname = get_include_path(arg);
 
-    push_parse_location(fname, 0);
-    ParseConfigFile(sc, fname);
+    push_parse_location(fname.c_str(), 0);
+    ParseConfigFile(sc, fname.c_str());
     pop_parse_location();
-    free((char*)fname);
 }
 
 void ParseIpVar(SnortConfig* sc, const char* var, const char* val)
@@ -291,15 +287,11 @@ void ParseConfigFile(SnortConfig* sc, const char* fname)
     if ( !fname )
         return;
 
-    std::ifstream fs(fname, std::ios_base::binary);
-
-    if ( !fs )
+    if ( !parse_stream(fname, sc) )
     {
         ParseError("unable to open rules file '%s': %s",
             fname, get_error(errno));
-        return;
     }
-    parse_stream(fs, sc);
 }
 
 void ParseConfigString(SnortConfig* sc, const char* s)
@@ -37,6 +37,8 @@
 #include <pwd.h>
 #include <fnmatch.h>
 
+#include <algorithm>
+
 #include "parser.h"
 #include "cmd_line.h"
 #include "config_file.h"
@@ -805,190 +807,52 @@ static void XferHeader(RuleTreeNode* test_node, RuleTreeNode* rtn)
 
 /****************************************************************************
  *
- * Function: AddRuleFuncToList(int (*func)(), RuleTreeNode *)
+ * Function: FlattenPorts(PortObject *, unsigned &)
  *
- * Purpose:  Adds RuleTreeNode associated detection functions to the
- *          current rule's function list
+ * Purpose: Copies the ranges of a port object into an array for the
+ *          header checks in CheckRuleHeader()
  *
- * Arguments: *func => function pointer to the detection function
- *            rtn   => pointer to the current rule
+ * Arguments: po => the rule's src or dst port object
+ *            n  => set to the number of ranges
  *
- * Returns: void function
+ * Returns: the ranges or NULL if none
  *
  ***************************************************************************/
-static void AddRuleFuncToList(
-    int (* rfunc) (Packet*, RuleTreeNode*, struct RuleFpList*, int),
-    RuleTreeNode* rtn)
+static PortRange* FlattenPorts(PortObject* po, unsigned& n)
 {
-    RuleFpList* idx;
-
-    DebugMessage(DEBUG_CONFIGRULES,"Adding new rule to list\n");
-
-    idx = rtn->rule_func;
-    if (idx == NULL)
-    {
-        rtn->rule_func = (RuleFpList*)SnortAlloc(sizeof(RuleFpList));
-
-        rtn->rule_func->RuleHeadFunc = rfunc;
-    }
-    else
-    {
-        while (idx->next != NULL)
-            idx = idx->next;
-
-        idx->next = (RuleFpList*)SnortAlloc(sizeof(RuleFpList));
-        idx = idx->next;
-        idx->RuleHeadFunc = rfunc;
-    }
-}
-
-/****************************************************************************
- *
- * Function: AddrToFunc(RuleTreeNode *, u_long, u_long, int, int)
- *
- * Purpose: Links the proper IP address testing function to the current RTN
- *          based on the address, netmask, and addr flags
- *
- * Arguments: rtn => the pointer to the current rules list entry to attach to
- *            mode => indicates whether this is a rule for the source
- *                    or destination IP for the rule
- *
- * Returns: void function
- *
- ***************************************************************************/
-static void AddrToFunc(RuleTreeNode* rtn, int mode)
-{
-    /*
-     * if IP and mask are both 0, this is a "any" IP and we don't need to
-     * check it
-     */
-    switch (mode)
-    {
-    case SRC:
-        if ((rtn->flags & ANY_SRC_IP) == 0)
-        {
-            DebugMessage(DEBUG_CONFIGRULES,"CheckSrcIP -> ");
-            AddRuleFuncToList(CheckSrcIP, rtn);
-        }
-
-        break;
-
-    case DST:
-        if ((rtn->flags & ANY_DST_IP) == 0)
-        {
-            DebugMessage(DEBUG_CONFIGRULES,"CheckDstIP -> ");
-            AddRuleFuncToList(CheckDstIP, rtn);
-        }
-
-        break;
-    }
-}
+    std::vector<PortRange> ranges;
+    PortObjectRanges(po, ranges);
 
-/****************************************************************************
- *
- * Function: PortToFunc(RuleTreeNode *, int, int, int)
- *
- * Purpose: Links in the port analysis function for the current rule
- *
- * Arguments: rtn => the pointer to the current rules list entry to attach to
- *            any_flag =>  accept any port if set
- *            except_flag => indicates negation (logical NOT) of the test
- *            mode => indicates whether this is a rule for the source
- *                    or destination port for the rule
- *
- * Returns: void function
- *
- ***************************************************************************/
-static void PortToFunc(RuleTreeNode* rtn, int any_flag, int except_flag, int mode)
-{
-    /*
-     * if the any flag is set we don't need to perform any test to match on
-     * this port
-     */
-    if (any_flag)
-        return;
+    n = ranges.size();
 
-    /* if the except_flag is up, test with the "NotEq" funcs */
-    if (except_flag)
-    {
-        switch (mode)
-        {
-        case SRC:
-            DebugMessage(DEBUG_CONFIGRULES,"CheckSrcPortNotEq -> ");
-            AddRuleFuncToList(CheckSrcPortNotEq, rtn);
-            break;
-
-        case DST:
-            DebugMessage(DEBUG_CONFIGRULES,"CheckDstPortNotEq -> ");
-            AddRuleFuncToList(CheckDstPortNotEq, rtn);
-            break;
-        }
+    if ( !n )
+        return NULL;
 
-        return;
-    }
-    /* default to setting the straight test function */
-    switch (mode)
-    {
-    case SRC:
-        DebugMessage(DEBUG_CONFIGRULES,"CheckSrcPortEqual -> ");
-        AddRuleFuncToList(CheckSrcPortEqual, rtn);
-        break;
+    PortRange* pr = (PortRange*)SnortAlloc(n * sizeof(PortRange));
+    std::copy(ranges.begin(), ranges.end(), pr);
 
-    case DST:
-        DebugMessage(DEBUG_CONFIGRULES,"CheckDstPortEqual -> ");
-        AddRuleFuncToList(CheckDstPortEqual, rtn);
-        break;
-    }
+    return pr;
 }
 
 /****************************************************************************
  *
- * Function: SetupRTNFuncList(RuleTreeNode *)
+ * Function: SetupRTNPorts(RuleTreeNode *)
  *
- * Purpose: Configures the function list for the rule header detection
- *          functions (addrs and ports)
+ * Purpose: Flattens the ports for the rule header checks, the address
+ *          checks use the ip vars directly and the flags select the checks
  *
- * Arguments: rtn => the pointer to the current rules list entry to attach to
+ * Arguments: rtn => the pointer to the current rules list entry
  *
  * Returns: void function
  *
  ***************************************************************************/
-static void SetupRTNFuncList(RuleTreeNode* rtn)
+static void SetupRTNPorts(RuleTreeNode* rtn)
 {
-    DebugMessage(DEBUG_CONFIGRULES,"Initializing RTN function list!\n");
-    DebugMessage(DEBUG_CONFIGRULES,"Functions: ");
-
-    if (rtn->flags & BIDIRECTIONAL)
-    {
-        DebugMessage(DEBUG_CONFIGRULES,"CheckBidirectional->\n");
-        AddRuleFuncToList(CheckBidirectional, rtn);
-    }
-    else
-    {
-        /* Attach the proper port checking function to the function list */
-        /*
-         * the in-line "if's" check to see if the "any" or "not" flags have
-         * been set so the PortToFunc call can determine which port testing
-         * function to attach to the list
-         */
-        PortToFunc(rtn, (rtn->flags & ANY_DST_PORT ? 1 : 0),
-            (rtn->flags & EXCEPT_DST_PORT ? 1 : 0), DST);
-
-        /* as above */
-        PortToFunc(rtn, (rtn->flags & ANY_SRC_PORT ? 1 : 0),
-            (rtn->flags & EXCEPT_SRC_PORT ? 1 : 0), SRC);
-
-        /* link in the proper IP address detection function */
-        AddrToFunc(rtn, SRC);
-
-        /* last verse, same as the first (but for dest IP) ;) */
-        AddrToFunc(rtn, DST);
-    }
-
-    DebugMessage(DEBUG_CONFIGRULES,"RuleListEnd\n");
+    if ( !(rtn->flags & ANY_SRC_PORT) )
+        rtn->src_ports = FlattenPorts(rtn->src_portobject, rtn->num_src_ports);
 
-    /* tack the end (success) function to the list */
-    AddRuleFuncToList(RuleListEnd, rtn);
+    if ( !(rtn->flags & ANY_DST_PORT) )
+        rtn->dst_ports = FlattenPorts(rtn->dst_portobject, rtn->num_dst_ports);
 }
 
 /****************************************************************************
@@ -1024,8 +888,8 @@ static RuleTreeNode* ProcessHeadNode(
         /* copy the prototype header info into the new header block */
         XferHeader(test_node, rtn);
 
-        /* initialize the function list for the new RTN */
-        SetupRTNFuncList(rtn);
+        /* flatten the ports for the new RTN */
+        SetupRTNPorts(rtn);
 
         /* add link to parent listhead */
         rtn->listhead = list;
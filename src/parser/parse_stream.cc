@@ -20,12 +20,21 @@
 #include "parse_stream.h"
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <condition_variable>
+#include <deque>
+#include <fstream>
 #include <istream>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 using namespace std;
 
 #include "parser.h"
@@ -58,6 +67,137 @@ static const char* const toks[TT_MAX] =
 };
 #endif
 
+// rule text is scanned into a list of fsm actions, on a worker thread when
+// prefetched, and then replayed on the main thread to build the rules in
+// order.  anything that depends on the parse location is deferred until the
+// replay so the output is the same as a serial parse.
+
+enum ScanWarning
+{
+    SW_STRING_BREAK,
+    SW_ESCAPE,
+    SW_COMMENT_BREAK,
+    SW_HEX,
+    SW_MAX
+};
+
+static const char* const scan_warnings[SW_MAX] =
+{
+    "line break in string on line %u\n",
+    "invalid escape on line %u\n",
+    "line break in commented string on line %u\n",
+    "\\x used with no following hex digits on line %u\n"
+};
+
+// most are reported on the line before the current char
+static const int scan_warning_line[SW_MAX] = { -1, 0, -1, -1 };
+
+enum ScanFlags
+{
+    SF_WARNING = 0x01,  // action is a ScanWarning
+    SF_SYNTAX  = 0x02,  // token has no fsm transition
+    SF_CARRY   = 0x04,  // include starts with the line break after its name
+    SF_ESCAPE  = 0x08,  // token depends on the escape used
+    SF_ESC_VAL = 0x30   // the escape used + 1
+};
+
+// the escape is -1, 0, or 1; see get_escape()
+static inline uint8_t escape_flags(int esc)
+{ return SF_ESCAPE | ((esc + 1) << 4); }
+
+static inline int escape_used(uint8_t flags)
+{ return ((flags & SF_ESC_VAL) >> 4) - 1; }
+
+struct ScanItem
+{
+    // line breaks since the previous item
+    uint32_t positions;
+    uint32_t lines;
+
+    // token in RuleScan::text
+    uint32_t offset;
+    uint32_t length;
+
+    uint8_t action;
+    uint8_t flags;
+};
+
+struct ScanCounts
+{
+    unsigned chars = 0, comments = 0, keys = 0;
+    unsigned lists = 0, strings = 0;
+
+    void operator+=(const ScanCounts& rhs)
+    {
+        chars += rhs.chars;
+        comments += rhs.comments;
+        keys += rhs.keys;
+        lists += rhs.lists;
+        strings += rhs.strings;
+    }
+};
+
+struct RuleScan : public ScanCounts
+{
+    std::vector<ScanItem> items;
+    string text;
+
+    // line breaks after the last item
+    uint32_t positions = 0;
+    uint32_t lines = 0;
+
+    int num = 0;    // final fsm state
+    int error = 0;  // errno when the file can't be opened
+};
+
+struct RuleParseState;
+struct ScanJob;
+struct ScanPool;
+
+// items are built right away when a rule parse state is given, otherwise
+// they are saved in the scan and handed off in chunks if there is a job.
+// when rescanning, the first skip items were already built.
+struct RuleScanner
+{
+    RuleScanner(istream& s, RuleScan* rs, RuleParseState* ps = nullptr, SnortConfig* c = nullptr) :
+        is(s), scan(rs), rps(ps), sc(c) { }
+
+    // warnings are held until the token is done so they get its flags
+    void add(uint8_t action, string& tok, uint8_t flags);
+    void flush(uint8_t flags);
+
+    void warn(ScanWarning w)
+    {
+        warnings.push_back({ positions, lines, 0, 0, (uint8_t)w, SF_WARNING });
+        positions = lines = 0;
+    }
+
+    bool building() const
+    { return rps && !skip; }
+
+    void put(ScanItem&, string& tok);
+
+    istream& is;
+    RuleScan* scan;
+
+    RuleParseState* rps;
+    SnortConfig* sc;
+
+    ScanPool* pool = nullptr;
+    ScanJob* job = nullptr;
+
+    std::vector<ScanItem> warnings;
+    size_t skip = 0;
+
+    int prev = EOF;
+    int pos = 0;
+
+    uint32_t positions = 0;
+    uint32_t lines = 0;
+
+    bool escaped = false;  // current token depends on the escape
+};
+
 static char unescape(char c)
 {
     switch ( c )
@@ -84,14 +224,16 @@ static uint8_t to_hex(char c)
 }
 
 static TokenType get_token(
-    istream& is, string& s, const char* punct, int esc)
+    RuleScanner& rs, string& s, const char* punct, int esc)
 {
-    static int prev = EOF;
+    istream& is = rs.is;
+    int& prev = rs.prev;
+    int& pos = rs.pos;
     int c, list = 0, state = 0;
     s.clear();
     bool inc = true;
-    static int pos = 0;
     uint8_t hex = 0;
+    rs.escaped = false;
 
     if ( prev != EOF )
     {
@@ -102,7 +244,7 @@ static TokenType get_token(
     else
     {
         c = is.get();
-        chars++;
+        rs.scan->chars++;
     }
 
     while ( c != EOF )
@@ -113,11 +255,11 @@ static TokenType get_token(
 
         if ( c == '\n' )
         {
-            lines++;
+            rs.lines++;
             pos = 0;
 
             if ( inc )
-                inc_parse_position();
+                rs.positions++;
             else
                 inc = true;
         }
@@ -135,7 +277,7 @@ static TokenType get_token(
             else if ( c == '#' )
             {
                 s = c;
-                comments++;
+                rs.scan->comments++;
                 state = 1;
             }
             else if ( c == '/' )
@@ -146,14 +288,14 @@ static TokenType get_token(
             else if ( c == '[' )
             {
                 s += c;
-                lists++;
+                rs.scan->lists++;
                 list = 1;
                 state = 2;
             }
             else if ( c == '"' )
             {
                 s += c;
-                strings++;
+                rs.scan->strings++;
                 state = 3;
             }
             else if ( c == '!' )
@@ -168,7 +310,7 @@ static TokenType get_token(
             else if ( !isspace(c) )
             {
                 s += c;
-                keys++;
+                rs.scan->keys++;
                 state = 6;
             }
             break;
@@ -195,6 +337,9 @@ static TokenType get_token(
                 return TT_LIST;
             break;
         case 3:  // string
+            if ( c == '"' || c == ';' || c == '\\' )
+                rs.escaped = true;
+
             if ( esc && c == '"' )
             {
                 s += c;
@@ -208,7 +353,7 @@ static TokenType get_token(
             else if ( c == '\\' )
                 state = (esc > 0) ? 4 : 16;
             else if ( c == '\n' )
-                ParseWarning(WARN_RULES, "line break in string on line %u\n", lines-1);
+                rs.warn(SW_STRING_BREAK);
             else
                 s += c;
             break;
@@ -223,10 +368,13 @@ static TokenType get_token(
             break;
         case 5:  // unquoted escape
             if ( c != '\n' && c != '\r' )
-                ParseWarning(WARN_RULES, "invalid escape on line %u\n", lines);
+                rs.warn(SW_ESCAPE);
             state = 0;
             break;
         case 6:  // token
+            if ( c == '\\' )
+                rs.escaped = true;
+
             if ( esc && c == '\\' )
             {
                 state = 9;
@@ -243,7 +391,7 @@ static TokenType get_token(
             if ( c == '"' )
             {
                 s += c;
-                strings++;
+                rs.scan->strings++;
                 state = 3;
             }
             else if ( isspace(c) || strchr(punct, c) )
@@ -280,8 +428,11 @@ static TokenType get_token(
                 state = 11;
                 break;
             }
-            keys++;
+            rs.scan->keys++;
             // now as if state == 6
+            if ( c == '\\' )
+                rs.escaped = true;
+
             if ( esc && c == '\\' )
             {
                 state = 9;
@@ -306,7 +457,7 @@ static TokenType get_token(
         case 12:  // end of comment?
             if ( c == '/' )
             {
-                comments++;
+                rs.scan->comments++;
                 state = 0;
             }
             break;
@@ -315,7 +466,7 @@ static TokenType get_token(
                 state = 11;
             else if ( c == '\n' )
             {
-                ParseWarning(WARN_RULES, "line break in commented string on line %u\n", lines-1);
+                rs.warn(SW_COMMENT_BREAK);
                 state = 11;
             }
             break;
@@ -327,8 +478,7 @@ static TokenType get_token(
             }
             else
             {
-                ParseWarning(WARN_RULES, "\\x used with no following hex digits on line %u\n",
-                        lines-1);
+                rs.warn(SW_HEX);
                 s += c;
                 state = 3;
             }
@@ -355,7 +505,7 @@ static TokenType get_token(
             break;
         }
         c = is.get();
-        chars++;
+        rs.scan->chars++;
     }
     return TT_NONE;
 }
@@ -466,7 +616,6 @@ static const State* get_state(int num, TokenType type, const string& tok)
             return s;
         }
     }
-    ParseError("syntax error");
     return fsm;
 }
 
@@ -624,69 +773,202 @@ static int get_escape(const string& s)
     return 1;      // escape, option goes to "
 }
 
-// parse_body() is called at the end of a stub rule to parse the detection
-// options in an so rule.  similar to parse_stream() except we start in a
-// different state.
-static void parse_body(const char* extra, RuleParseState& rps, struct SnortConfig* sc)
+// the key is tracked here when items aren't built.  an so rule body can
+// change the key used for the next rule header; the replay checks the
+// escape recorded with the tokens that depend on it and rescans if needed.
+static void scan_stream(RuleScanner& rs, int num, const char* punct, string key)
 {
-    stringstream is(extra);
-
     string tok;
     TokenType type;
     int esc = 1;
 
-    int num = 8;
-    const char* punct = "(:,;)";
-
-    while ( (type = get_token(is, tok, punct, esc)) )
+    while ( (type = get_token(rs, tok, punct, esc)) )
     {
-        ++tokens;
         const State* s = get_state(num, type, tok);
+        uint8_t flags = (s == fsm) ? SF_SYNTAX : 0;
+
+        if ( rs.escaped )
+            flags |= escape_flags(esc);
 
 #ifdef TRACER
         printf("%d: %s = '%s' -> %s\n",
             num, toks[type], tok.c_str(), acts[s->action]);
 #endif
-        exec(s->action, tok, rps, sc);
+
+        if ( s->action == FSM_INC )
+        {
+            // the char after the file name was read by the included file
+            if ( rs.prev == '\n' )
+                flags |= SF_CARRY;
+            rs.prev = EOF;
+        }
+        rs.add(s->action, tok, flags);
+
+        if ( s->action == FSM_ACT && tok == "END" )
+            break;
 
         num = s->next;
-        esc = get_escape(rps.key);
+
+        if ( s->action == FSM_KEY )
+            key = tok;
+
+        esc = get_escape(rs.building() ? rs.rps->key : key);
 
         if ( s->punct )
             punct = s->punct;
     }
+    rs.flush(rs.escaped ? escape_flags(esc) : 0);
+    rs.scan->positions = rs.positions;
+    rs.scan->lines = rs.lines;
+    rs.scan->num = num;
 }
 
-void parse_stream(istream& is, struct SnortConfig* sc)
+static void advance(uint32_t positions, uint32_t n)
 {
-    string tok;
-    TokenType type;
-    int esc = 1;
+    while ( positions-- )
+        inc_parse_position();
 
-    int num = 0;
-    const char* punct = fsm[0].punct;
-    RuleParseState rps;
+    lines += n;
+}
+
+// returns true at the end of input
+static bool build(
+    const ScanItem& si, string& tok, RuleParseState& rps, SnortConfig* sc)
+{
+    advance(si.positions, si.lines);
 
-    while ( (type = get_token(is, tok, punct, esc)) )
+    if ( si.flags & SF_WARNING )
     {
-        ++tokens;
-        const State* s = get_state(num, type, tok);
+        ParseWarning(WARN_RULES, scan_warnings[si.action],
+            lines + scan_warning_line[si.action]);
+        return false;
+    }
+    ++tokens;
 
-#ifdef TRACER
-        printf("%d: %s = '%s' -> %s\n",
-            num, toks[type], tok.c_str(), acts[s->action]);
-#endif
+    if ( si.flags & SF_SYNTAX )
+        ParseError("syntax error");
 
-        if ( exec(s->action, tok, rps, sc) )
-            break;
+    if ( si.flags & SF_CARRY )
+        ++lines;
 
-        num = s->next;
-        esc = get_escape(rps.key);
+    return exec((FsmAction)si.action, tok, rps, sc);
+}
 
-        if ( s->punct )
-            punct = s->punct;
+static void publish(ScanPool&, ScanJob&, RuleScan*, bool last);
+
+// items per chunk handed from a worker to the main thread
+static const unsigned scan_chunk = 4096;
+
+void RuleScanner::flush(uint8_t flags)
+{
+    string none;
+
+    for ( auto& si : warnings )
+    {
+        si.flags |= flags & (SF_ESCAPE | SF_ESC_VAL);
+        put(si, none);
+    }
+    warnings.clear();
+}
+
+void RuleScanner::add(uint8_t action, string& tok, uint8_t flags)
+{
+    flush(flags);
+
+    ScanItem si = { positions, lines, 0, (uint32_t)tok.size(), action, flags };
+    positions = lines = 0;
+    put(si, tok);
+}
+
+void RuleScanner::put(ScanItem& si, string& tok)
+{
+    if ( skip )
+    {
+        --skip;
+        return;
+    }
+    if ( rps )
+    {
+        build(si, tok, *rps, sc);
+        return;
     }
-    if ( num )
+    si.offset = scan->text.size();
+    scan->items.push_back(si);
+    scan->text += tok;
+
+    if ( job && scan->items.size() >= scan_chunk )
+    {
+        publish(*pool, *job, scan, false);
+        scan = new RuleScan;
+    }
+}
+
+static void count(const ScanCounts& c)
+{
+    chars += c.chars;
+    comments += c.comments;
+    keys += c.keys;
+    lists += c.lists;
+    strings += c.strings;
+}
+
+static void finish(const RuleScan& scan)
+{
+    advance(scan.positions, scan.lines);
+    count(scan);
+}
+
+enum ReplayResult
+{
+    RR_MORE,    // chunk done
+    RR_END,     // end of input
+    RR_RESCAN   // item n needs another escape
+};
+
+// esc is what a serial parse would use for the next token and n counts
+// the items built so far in this file
+static ReplayResult replay(
+    const RuleScan& scan, RuleParseState& rps, SnortConfig* sc, int& esc, size_t& n)
+{
+    string tok;
+    ReplayResult rr = RR_MORE;
+
+    for ( const auto& si : scan.items )
+    {
+        if ( (si.flags & SF_ESCAPE) && escape_used(si.flags) != esc )
+            return RR_RESCAN;
+
+        tok.assign(scan.text, si.offset, si.length);
+        ++n;
+
+        if ( build(si, tok, rps, sc) )
+        {
+            rr = RR_END;
+            break;
+        }
+        if ( !(si.flags & SF_WARNING) )
+            esc = get_escape(rps.key);
+    }
+    advance(scan.positions, scan.lines);
+    return rr;
+}
+
+// parse_body() is called at the end of a stub rule to parse the detection
+// options in an so rule.  similar to parse_stream() except we start in a
+// different state.
+static void parse_body(const char* extra, RuleParseState& rps, struct SnortConfig* sc)
+{
+    stringstream is(extra);
+    RuleScan scan;
+    RuleScanner rs(is, &scan, &rps, sc);
+
+    scan_stream(rs, 8, "(:,;)", rps.key);
+    finish(scan);
+}
+
+static void parse_end(const RuleScan& scan)
+{
+    if ( scan.num )
         ParseError("incomplete rule");
 
     //printf("chars = %d, tokens = %d\n", chars, tokens);
@@ -695,3 +977,256 @@ void parse_stream(istream& is, struct SnortConfig* sc)
     //printf("lists = %d, strings = %d\n", lists, strings);
 }
 
+void parse_stream(istream& is, struct SnortConfig* sc)
+{
+    RuleScan scan;
+    RuleParseState rps;
+    RuleScanner rs(is, &scan, &rps, sc);
+
+    scan_stream(rs, 0, fsm[0].punct, string());
+    finish(scan);
+    parse_end(scan);
+}
+
+//-------------------------------------------------------------------------
+// prefetch
+//-------------------------------------------------------------------------
+
+struct ScanJob
+{
+    enum { QUEUED, RUNNING, DONE, TAKEN } state = QUEUED;
+    deque<unique_ptr<RuleScan>> chunks;
+};
+
+// not destroyed on exit so a fatal error doesn't have to stop the workers
+struct ScanPool
+{
+    mutex lock;
+    condition_variable queued;
+    condition_variable done;
+
+    deque<string> queue;
+    unordered_map<string, ScanJob> jobs;
+    vector<thread> threads;
+    bool stopping = false;
+};
+
+static ScanPool* scan_pool = nullptr;
+
+static void prefetch(ScanPool& sp, const vector<string>& files)
+{
+    lock_guard<mutex> hold(sp.lock);
+
+    for ( const auto& f : files )
+    {
+        if ( sp.jobs.emplace(f, ScanJob()).second )
+            sp.queue.push_back(f);
+    }
+    sp.queued.notify_all();
+}
+
+static void prefetch_includes(ScanPool& sp, const RuleScan& scan)
+{
+    vector<string> files;
+
+    for ( const auto& si : scan.items )
+    {
+        if ( !(si.flags & SF_WARNING) && si.action == FSM_INC )
+            files.push_back(get_include_path(scan.text.substr(si.offset, si.length).c_str()));
+    }
+    if ( !files.empty() )
+        prefetch(sp, files);
+}
+
+static void publish(ScanPool& sp, ScanJob& job, RuleScan* chunk, bool last)
+{
+    prefetch_includes(sp, *chunk);
+
+    lock_guard<mutex> hold(sp.lock);
+    job.chunks.emplace_back(chunk);
+
+    if ( last )
+        job.state = ScanJob::DONE;
+
+    sp.done.notify_all();
+}
+
+// scan the whole file when there is no job
+static RuleScan* scan_file(const string& fname, ScanPool& sp, ScanJob* job)
+{
+    RuleScan* scan = new RuleScan;
+    ifstream fs(fname, ios_base::binary);
+
+    if ( !fs )
+    {
+        scan->error = errno;
+        return scan;
+    }
+    RuleScanner rs(fs, scan);
+    rs.pool = &sp;
+    rs.job = job;
+
+    scan_stream(rs, 0, fsm[0].punct, string());
+    return rs.scan;
+}
+
+// an so rule body changed the escape used for a token that depends on it so
+// the rest of the file is parsed serially
+static bool rescan_file(const char* fname, size_t n, RuleParseState& rps, SnortConfig* sc)
+{
+    ifstream fs(fname, ios_base::binary);
+
+    if ( !fs )
+        return false;
+
+    RuleScan scan;
+    RuleScanner rs(fs, &scan, &rps, sc);
+    rs.skip = n;
+
+    scan_stream(rs, 0, fsm[0].punct, string());
+    finish(scan);
+    parse_end(scan);
+    return true;
+}
+
+static void scan_worker(ScanPool* sp)
+{
+    unique_lock<mutex> hold(sp->lock);
+
+    while ( true )
+    {
+        sp->queued.wait(hold, [sp] { return sp->stopping || !sp->queue.empty(); });
+
+        if ( sp->stopping )
+            break;
+
+        string fname = sp->queue.front();
+        sp->queue.pop_front();
+
+        // jobs aren't erased until stop so this stays valid
+        ScanJob& job = sp->jobs[fname];
+
+        if ( job.state != ScanJob::QUEUED )
+            continue;
+
+        job.state = ScanJob::RUNNING;
+        hold.unlock();
+
+        publish(*sp, job, scan_file(fname, *sp, &job), true);
+
+        hold.lock();
+    }
+}
+
+void parse_stream_start(unsigned n)
+{
+    if ( !n || scan_pool )
+        return;
+
+    scan_pool = new ScanPool;
+
+    while ( n-- )
+        scan_pool->threads.push_back(thread(scan_worker, scan_pool));
+}
+
+void parse_stream_prefetch(const char* fname)
+{
+    if ( scan_pool )
+        prefetch(*scan_pool, vector<string>(1, fname));
+}
+
+void parse_stream_stop()
+{
+    if ( !scan_pool )
+        return;
+
+    {
+        lock_guard<mutex> hold(scan_pool->lock);
+        scan_pool->stopping = true;
+        scan_pool->queued.notify_all();
+    }
+    for ( auto& t : scan_pool->threads )
+        t.join();
+
+    delete scan_pool;
+    scan_pool = nullptr;
+}
+
+bool parse_stream(const char* fname, struct SnortConfig* sc)
+{
+    if ( !scan_pool )
+    {
+        ifstream fs(fname, ios_base::binary);
+
+        if ( !fs )
+            return false;
+
+        parse_stream(fs, sc);
+        return true;
+    }
+
+    ScanPool& sp = *scan_pool;
+    ScanJob local;
+    ScanJob* job = &local;
+    {
+        lock_guard<mutex> hold(sp.lock);
+        auto it = sp.jobs.find(fname);
+
+        if ( it != sp.jobs.end() && it->second.state != ScanJob::TAKEN &&
+            it->second.state != ScanJob::QUEUED )
+        {
+            job = &it->second;
+        }
+        // scanned here if not started yet or included again
+        else if ( it != sp.jobs.end() )
+            it->second.state = ScanJob::TAKEN;
+    }
+
+    if ( job == &local )
+        publish(sp, local, scan_file(fname, sp, nullptr), true);
+
+    RuleParseState rps;
+    unique_ptr<RuleScan> chunk;
+    ScanCounts counts;
+    ReplayResult rr = RR_MORE;
+    size_t n = 0;
+    int esc = 1;
+
+    while ( true )
+    {
+        unique_lock<mutex> hold(sp.lock);
+        sp.done.wait(hold, [job] { return !job->chunks.empty() || job->state == ScanJob::DONE; });
+
+        if ( job->chunks.empty() )
+        {
+            job->state = ScanJob::TAKEN;
+            break;
+        }
+        chunk = move(job->chunks.front());
+        job->chunks.pop_front();
+
+        // an error is the only chunk
+        if ( chunk->error )
+        {
+            job->state = ScanJob::TAKEN;
+            hold.unlock();
+            errno = chunk->error;
+            return false;
+        }
+        hold.unlock();
+
+        if ( rr == RR_MORE )
+        {
+            rr = replay(*chunk, rps, sc, esc, n);
+
+            if ( rr != RR_RESCAN )
+                counts += *chunk;
+        }
+    }
+    if ( rr == RR_RESCAN )
+        return rescan_file(fname, n, rps, sc);
+
+    count(counts);
+    parse_end(*chunk);
+    return true;
+}
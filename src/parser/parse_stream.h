@@ -24,5 +24,14 @@
 
 void parse_stream(std::istream&, struct SnortConfig*);
 
+// files are scanned by worker threads if prefetched and the rules are built
+// on the calling thread in the same order as a serial parse.  returns false
+// with errno set if the file can't be opened.
+bool parse_stream(const char* fname, struct SnortConfig*);
+
+void parse_stream_start(unsigned threads);
+void parse_stream_prefetch(const char* fname);
+void parse_stream_stop();
+
 #endif
 
@@ -37,8 +37,10 @@
 #include <pwd.h>
 #include <fnmatch.h>
 
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <thread>
 
 #include "cmd_line.h"
 #include "mstring.h"
@@ -51,6 +53,7 @@
 #include "utils/snort_bounds.h"
 #include "utils/util.h"
 #include "utils/sflsq.h"
+#include "utils/stats.h"
 #include "ports/port_object.h"
 #include "ports/port_table.h"
 #include "ports/port_utils.h"
@@ -251,6 +254,32 @@ static void PortTablesFinish(RulePortTables* port_tables, FastPatternConfig* fp)
     RuleListSortUniq(port_tables->udp.nfp->rule_list);
 }
 
+static void PortTablesPrint(RulePortTables* port_tables)
+{
+    const PortProto* pp[] =
+    { &port_tables->tcp, &port_tables->udp, &port_tables->icmp, &port_tables->ip };
+
+    unsigned src[4], dst[4], usecs[4];
+    unsigned total = 0;
+
+    for ( unsigned i = 0; i < 4; ++i )
+    {
+        src[i] = pp[i]->src->port_groups;
+        dst[i] = pp[i]->dst->port_groups;
+        usecs[i] = pp[i]->src->compile_usecs + pp[i]->dst->compile_usecs;
+        total += src[i] + dst[i];
+    }
+
+    if ( !total )
+        return;
+
+    LogLabel("port table compile");
+    LogMessage("%8s%8s%8s%8s%8s\n", " ", "tcp", "udp", "icmp", "ip");
+    LogMessage("%8s%8u%8u%8u%8u\n", "src grp", src[0], src[1], src[2], src[3]);
+    LogMessage("%8s%8u%8u%8u%8u\n", "dst grp", dst[0], dst[1], dst[2], dst[3]);
+    LogMessage("%8s%8u%8u%8u%8u\n", "usecs", usecs[0], usecs[1], usecs[2], usecs[3]);
+}
+
 static void OtnInit(SnortConfig* sc)
 {
     if (sc == NULL)
@@ -556,7 +585,6 @@ SnortConfig* ParseSnortConf(const SnortConfig* boot_conf, const char* fname)
 
 void FreeRuleTreeNode(RuleTreeNode* rtn)
 {
-    RuleFpList* idx, * tmp;
     if (!rtn)
         return;
 
@@ -570,13 +598,11 @@ void FreeRuleTreeNode(RuleTreeNode* rtn)
         sfvar_free(rtn->dip);
     }
 
-    idx = rtn->rule_func;
-    while (idx)
-    {
-        tmp = idx;
-        idx = idx->next;
-        free(tmp);
-    }
+    if (rtn->src_ports)
+        free(rtn->src_ports);
+
+    if (rtn->dst_ports)
+        free(rtn->dst_ports);
 }
 
 void DestroyRuleTreeNode(RuleTreeNode* rtn)
@@ -622,8 +648,23 @@ void SetRuleStates(SnortConfig* sc)
     }
 }
 
+// rule files are scanned ahead on other cpus while the rules are built here
+static unsigned get_scan_threads()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 1 ? std::min(n - 1, 4u) : 0;
+}
+
 void ParseRules(SnortConfig* sc)
 {
+    parse_stream_start(get_scan_threads());
+
+    for ( auto p : sc->policy_map->ips_policy )
+    {
+        if ( !p->include.empty() )
+            parse_stream_prefetch(p->include.c_str());
+    }
+
     for ( unsigned idx = 0; idx < sc->policy_map->ips_policy.size(); ++idx )
     {
         set_policies(sc, idx);
@@ -658,6 +699,8 @@ void ParseRules(SnortConfig* sc)
             pop_parse_location();
         }
     }
+    parse_stream_stop();
+
     IntegrityCheckRules(sc);
     /*FindMaxSegSize();*/
 
@@ -665,6 +708,7 @@ void ParseRules(SnortConfig* sc)
     PortTablesFinish(sc->port_tables, sc->fast_pattern_config);
 
     parse_rule_print();
+    PortTablesPrint(sc->port_tables);
 }
 
 /****************************************************************************
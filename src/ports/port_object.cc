@@ -24,6 +24,7 @@
 #include <sys/types.h>
 #include <ctype.h>
 
+#include <algorithm>
 #include <memory>
 
 #include "port_item.h"
@@ -479,6 +480,47 @@ int PortObjectHasPort(PortObject* po, int port)
     return 0;
 }
 
+void PortObjectRanges(PortObject* po, std::vector<PortRange>& ranges)
+{
+    std::vector<PortRange> items;
+    PortObjectItem* poi;
+    SF_LNODE* cursor;
+
+    ranges.clear();
+
+    if ( !po )
+        return;
+
+    for (poi=(PortObjectItem*)sflist_first(po->item_list, &cursor);
+        poi != 0;
+        poi=(PortObjectItem*)sflist_next(&cursor) )
+    {
+        if ( poi->any() )
+            break;
+
+        // any port not already matched matches a negated item
+        if ( poi->negate )
+        {
+            items.clear();
+            items.push_back({ 0, SFPO_MAX_PORTS - 1 });
+            break;
+        }
+        if ( poi->lport <= poi->hport )
+            items.push_back({ poi->lport, poi->hport });
+    }
+    std::sort(items.begin(), items.end(),
+        [](const PortRange& a, const PortRange& b)
+        { return a.lport < b.lport; });
+
+    for ( auto& r : items )
+    {
+        if ( !ranges.empty() and r.lport <= ranges.back().hport + 1 )
+            ranges.back().hport = std::max(ranges.back().hport, r.hport);
+        else
+            ranges.push_back(r);
+    }
+}
+
 void PortObjectToggle(PortObject* po)
 {
     PortObjectItem* poi;
@@ -22,6 +22,8 @@
 #ifndef PORT_OBJECT_H
 #define PORT_OBJECT_H
 
+#include <vector>
+
 #include "framework/bits.h"
 #include "utils/sflsq.h"
 
@@ -71,6 +73,40 @@ int PortObjectHasPort(PortObject*, int port);
 int PortObjectIsPureNot(PortObject*);
 int PortObjectHasAny(PortObject*);
 
+// PortObjectHasPort() flattened into sorted, disjoint ranges
+struct PortRange
+{
+    uint16_t lport;
+    uint16_t hport;
+};
+
+void PortObjectRanges(PortObject*, std::vector<PortRange>&);
+
+inline bool PortRangesHavePort(const PortRange* r, unsigned n, uint16_t port)
+{
+    if ( n <= 8 )
+    {
+        for ( unsigned i = 0; i < n and port >= r[i].lport; ++i )
+        {
+            if ( port <= r[i].hport )
+                return true;
+        }
+        return false;
+    }
+    unsigned lo = 0, hi = n;
+
+    while ( lo < hi )
+    {
+        unsigned mid = (lo + hi) / 2;
+
+        if ( port > r[mid].hport )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < n and port >= r[lo].lport;
+}
+
 int PortObjectRemovePorts(PortObject* a,  PortObject* b);
 PortObject* PortObjectAppend(PortObject* poa, PortObject* pob);
 
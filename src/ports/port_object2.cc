@@ -176,24 +176,19 @@ void PortObject2Free(void* pvoid)
 }
 
 /*
- * Dup the PortObjects Item List, Name, and RuleList->RuleHash
+ * Dup the PortObjects Item List and Name, sizing the RuleHash for nrules
  */
-PortObject2* PortObject2Dup(PortObject* po)
+PortObject2* PortObject2DupPorts(PortObject* po, int nrules)
 {
     PortObject2* ponew = NULL;
     PortObjectItem* poi = NULL;
     PortObjectItem* poinew = NULL;
     SF_LNODE* lpos = NULL;
-    int* prid = NULL;
-    int* prule = NULL;
 
     if ( !po )
         return NULL;
 
-    if ( !po->rule_list )
-        return NULL;
-
-    ponew = PortObject2New(po->rule_list->count + PO_EXTRA_RULE_CNT);
+    ponew = PortObject2New(nrules + PO_EXTRA_RULE_CNT);
     if ( !ponew )
         return NULL;
 
@@ -228,30 +223,59 @@ PortObject2* PortObject2Dup(PortObject* po)
         }
     }
 
+    return ponew;
+}
+
+/*
+ * Dup the PortObjects Item List, Name, and RuleList->RuleHash
+ */
+PortObject2* PortObject2Dup(PortObject* po)
+{
+    PortObject2* ponew = NULL;
+    SF_LNODE* lpos = NULL;
+    int* prid = NULL;
+
+    if ( !po )
+        return NULL;
+
+    if ( !po->rule_list )
+        return NULL;
+
+    ponew = PortObject2DupPorts(po, po->rule_list->count);
+    if ( !ponew )
+        return NULL;
+
     /* Dup the input rule list */
-    if ( po->rule_list )
+    for (prid  = (int*)sflist_first(po->rule_list,&lpos);
+        prid != 0;
+        prid  = (int*)sflist_next(&lpos) )
     {
-        for (prid  = (int*)sflist_first(po->rule_list,&lpos);
-            prid != 0;
-            prid  = (int*)sflist_next(&lpos) )
+        if ( PortObject2AddRule(ponew, *prid) )
         {
-            prule = (int*)calloc(1,sizeof(int));
-            if (!prule)
-            {
-                free(ponew);
-                return NULL;
-            }
-            *prule = *prid;
-            if ( sfghash_add(ponew->rule_hash, prule, prule) != SFGHASH_OK )
-            {
-                free(prule);
-            }
+            free(ponew);
+            return NULL;
         }
     }
 
     return ponew;
 }
 
+/* Add a rule number, returns nonzero only if out of memory */
+int PortObject2AddRule(PortObject2* po, int rule)
+{
+    int* prule = (int*)calloc(1,sizeof(int));
+
+    if ( !prule )
+        return -1;
+
+    *prule = rule;
+
+    if ( sfghash_add(po->rule_hash, prule, prule) != SFGHASH_OK )
+        free(prule);
+
+    return 0;
+}
+
 void PortObject2Iterate(PortObject2* po, PortObjectIterator f, void* pv)
 {
     PortObjectItem* poi;
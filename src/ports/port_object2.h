@@ -53,6 +53,8 @@ struct PortObject2
 PortObject2* PortObject2New(int nrules /*guess at this */);
 void PortObject2Free(void* p);
 PortObject2* PortObject2Dup(PortObject* po);
+PortObject2* PortObject2DupPorts(PortObject* po, int nrules);
+int PortObject2AddRule(PortObject2* po, int rule);
 
 typedef void (*PortObjectIterator)(int port, void*);
 void PortObject2Iterate(PortObject2*, PortObjectIterator, void*);
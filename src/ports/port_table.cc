@@ -28,7 +28,9 @@
 #include <sys/types.h>
 #include <ctype.h>
 
-#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 
 #include "port_item.h"
 #include "port_object.h"
@@ -43,6 +45,14 @@
 #include "utils/util.h"
 #include "utils/snort_bounds.h"
 #include "hash/sfhashfcn.h"
+#include "time/clock_defs.h"
+#include "time/stopwatch.h"
+
+#ifdef UNIT_TEST
+#include <map>
+#include <set>
+#include "catch/catch.hpp"
+#endif
 
 #define PTBL_LRC_DEFAULT 10
 #define PO_INIT_ID 1000000
@@ -220,6 +230,96 @@ static unsigned PortObject_hash(SFHASHFCN* p, unsigned char* d, int)
     return hash ^ p->hardener;
 }
 
+//-------------------------------------------------------------------------
+// PortTable - private - port sweep
+//-------------------------------------------------------------------------
+
+// an input port object starts or stops covering ports at this edge
+struct PortEdge
+{
+    int port;
+    unsigned index;
+    bool add;
+
+    bool operator<(const PortEdge& rhs) const
+    { return port < rhs.port; }
+};
+
+static void PortObjectEdges(PortObject* po, unsigned index, std::vector<PortEdge>& edges)
+{
+    std::vector<PortRange> ranges;
+    PortObjectRanges(po, ranges);
+
+    for ( auto& r : ranges )
+    {
+        edges.push_back({ r.lport, index, true });
+
+        if ( r.hport + 1 < SFPO_MAX_PORTS )
+            edges.push_back({ r.hport + 1, index, false });
+    }
+}
+
+//-------------------------------------------------------------------------
+// PortTable - private - rule bits
+//-------------------------------------------------------------------------
+
+// rule sets are merged as bitsets over rule index while compiling and only
+// the rules new to a PortObject2 are added to its rule hash
+typedef std::vector<uint64_t> RuleBits;
+
+struct PortMerge
+{
+    SFGHASH* mhash;
+    SFGHASH* mhashx;
+    SF_LIST* plx_list;
+
+    unsigned words;
+    std::unordered_map<PortObject2*, RuleBits> rules;
+};
+
+static void RuleBitsAdd(RuleBits& bits, PortObject* po)
+{
+    SF_LNODE* lpos;
+
+    for ( int* prid = (int*)sflist_first(po->rule_list, &lpos);
+        prid;
+        prid = (int*)sflist_next(&lpos) )
+    {
+        bits[*prid / 64] |= 1ULL << (*prid % 64);
+    }
+}
+
+static unsigned RuleBitsCount(const RuleBits& bits)
+{
+    unsigned n = 0;
+
+    for ( auto w : bits )
+        n += __builtin_popcountll(w);
+
+    return n;
+}
+
+/* add the rules in bits not yet in po2 */
+static void PortMergeAddRules(PortMerge& pm, PortObject2* po2, const RuleBits& bits)
+{
+    RuleBits& have = pm.rules[po2];
+
+    if ( have.empty() )
+        have.resize(pm.words, 0);
+
+    for ( unsigned w = 0; w < pm.words; w++ )
+    {
+        uint64_t m = bits[w] & ~have[w];
+        have[w] |= m;
+
+        for ( ; m; m &= m - 1 )
+        {
+            if ( PortObject2AddRule(po2, w * 64 + __builtin_ctzll(m)) )
+                FatalError("Memory error in PortTableCompile\n");
+        }
+    }
+}
+
 /*
  * Merge multiple PortObjects into a final PortObject2,
  * this merges ports and rules.
@@ -232,19 +332,21 @@ static unsigned PortObject_hash(SFHASHFCN* p, unsigned char* d, int)
  *  This is quick and does not require assembling/merging the port
  *  objects intoa PortObject2 1st.
  *  2) if found were done, otherwise
- *  3) make a merged PortObject2
- *  4) Try adding the PortObject2 to it's table - mhash
- *     a) if it adds go on, else
- *     b) if it's already in the table
+ *  3) make a merged PortObject2 with the merged ports, merging
+ *     the rules into a bitset
+ *  4) Try finding the PortObject2 in it's table - mhash
+ *     a) if it's already in the table
  *        1) get the one in the table
- *        2) add any ports in the just created one
+ *        2) add any rules it doesn't have from the bitset
  *        3) free the one just created
+ *     b) else add the rules from the bitset and add it to the table
  *  5) Create a plx object
  *  6) Add the plx object to the plx Table
  *      1) if it's already in the object - fail this contradicts 1)
  *  7) return the create PortObject2, or the one retrived from the
  *     PortObject table.
  *
+ * pm     - merge state, hash tables and rule bitsets
  * pol    - list of input PortObject pointers
  * pol_cnt- count in 'pol'
  * mhash  - stores the merged ports, using the merged port objects port list as a key.
@@ -258,10 +360,10 @@ static unsigned PortObject_hash(SFHASHFCN* p, unsigned char* d, int)
  *
  */
 static PortObject2* _merge_N_pol(
-    SFGHASH* mhash, SFGHASH* mhashx,
-    SF_LIST* plx_list, void** pol,
-    int pol_cnt, plx_t* plx)
+    PortMerge& pm, void** pol, int pol_cnt, plx_t* plx)
 {
+    SFGHASH* mhash = pm.mhash;
+    SFGHASH* mhashx = pm.mhashx;
     PortObject2* ponew;
     PortObject2* pox;
     plx_t* plx_tmp;
@@ -284,68 +386,53 @@ static PortObject2* _merge_N_pol(
         "n=%d posnew not found in mhashx\n",pol_cnt);
 
     /*
-    *  Merge the port objects together - ports and rules
+    *  Merge the port object rules together
     */
+    RuleBits rules(pm.words, 0);
 
-    /* Dup the 1st port objects rules and ports */
-    ponew = PortObject2Dup( (PortObject*)pol[0]);
+    for (i=0; i<pol_cnt; i++)
+        RuleBitsAdd(rules, (PortObject*)pol[i]);
+
+    /* Dup the 1st port objects ports */
+    ponew = PortObject2DupPorts( (PortObject*)pol[0], RuleBitsCount(rules));
     if ( !ponew )
     {
         FatalError("Could not Dup2\n");
     }
 
-    /* Merge in all the other port object rules and ports */
+    /* Merge in all the other port object ports */
     if ( pol_cnt > 1 )
     {
         for (i=1; i<pol_cnt; i++)
-        {
-            DebugFormat(DEBUG_PORTLISTS,"*** %d rules in object %d\n",
-                ((PortObject*)pol[i])->rule_list->count,i);
-            PortObjectAppendEx2(ponew, (PortObject*)pol[i]);
-            DebugFormat(DEBUG_PORTLISTS,
-                "*** merged port-object[%d], %d rules\n",
-                i,ponew->rule_hash->count);
-        }
+            PortObjectAppend( (PortObject*)ponew, (PortObject*)pol[i]);
+
         PortObjectNormalize( (PortObject*)ponew);
     }
 
-    DebugFormat(DEBUG_PORTLISTS,
-        "*** merged %d port objects, %d rules\n",
-        pol_cnt,ponew->rule_hash->count);
-    DebugMessage(DEBUG_PORTLISTS,"*** merged ponew - follows: \n");
-    // PortObjectPrint2(ponew);
-
     /*
-    * Add the Merged PortObject2 to the PortObject2 hash table
-    * keyed by ports.
+    * Find the Merged PortObject2 in the PortObject2 hash table
+    * keyed by ports, or add it.
     */
-    DebugFormat(DEBUG_PORTLISTS,"n=%d sfghash_add-mhash\n",pol_cnt);
-    stat =sfghash_add(mhash, &ponew, ponew);
-    if ( stat != SFGHASH_OK )
+    DebugFormat(DEBUG_PORTLISTS,"n=%d sfghash_find-mhash ponew\n",pol_cnt);
+    pox = (PortObject2*)sfghash_find(mhash, &ponew);
+
+    if ( pox )
     {
         /* This is possible since PLX hash on a different key */
-        if ( stat == SFGHASH_INTABLE )
-        {
-            DebugFormat(DEBUG_PORTLISTS,"n=%d sfghash_add-mhash ponew in table\n",
-                pol_cnt);
-            DebugFormat(DEBUG_PORTLISTS,"n=%d sfghash_find-mhash ponew\n",pol_cnt);
-            pox = (PortObject2*)sfghash_find(mhash,&ponew);
-            if ( pox )
-            {
-                PortObject2AppendPortObject2(pox,ponew);
-                DebugFormat(DEBUG_PORTLISTS,
-                    "sfportobject.c: merge_N_pol() line=%d  SFGHASH_INTABLE\n",__LINE__);
-                PortObject2Free(ponew);
-                ponew = pox;
-                DebugFormat(DEBUG_PORTLISTS,
-                    "n=%d sfghash_find-mhash ponew found, new rules merged\n",pol_cnt);
-            }
-            else
-            {
-                FatalError("mhash add/find error n=%d\n", pol_cnt);
-            }
-        }
-        else
+        PortMergeAddRules(pm, pox, rules);
+        PortObject2Free(ponew);
+        ponew = pox;
+        DebugFormat(DEBUG_PORTLISTS,
+            "n=%d sfghash_find-mhash ponew found, new rules merged\n",pol_cnt);
+    }
+    else
+    {
+        PortMergeAddRules(pm, ponew, rules);
+
+        DebugFormat(DEBUG_PORTLISTS,"n=%d sfghash_add-mhash\n",pol_cnt);
+        stat = sfghash_add(mhash, &ponew, ponew);
+
+        if ( stat != SFGHASH_OK )
         {
             FatalError("Could not add ponew to hash table- error\n");
         }
@@ -363,7 +450,7 @@ static PortObject2* _merge_N_pol(
     {
         FatalError("plx_new: memory alloc error\n");
     }
-    sflist_add_head(plx_list, (void*)plx_tmp);
+    sflist_add_head(pm.plx_list, (void*)plx_tmp);
 
     /*
      * Add the plx node to the PLX hash table
@@ -403,16 +490,15 @@ static PortObject2* _merge_N_pol(
  * We use plx_t types to manage tracking and testing for merged large
  * rule groups, and merged small port groups.
  *
- * mhash   - table of merged port objects ( built and used here )
- * mhashx  - table of plx_t objects ( built and used here )
+ * pm      - tables of merged port objects and plx_t objects and the
+ *           merged rule bitsets ( built and used here )
  * pol     - list of input port objects touching the current port
  * pol_cnt - number of port objects in port list
  * lcnt    - large rule count
  *
  */
 static PortObject2* PortTableCompileMergePortObjectList2(
-    SFGHASH* mhash, SFGHASH* mhashx, SF_LIST* plx_list,
-    PortObject* pol[], int pol_cnt, unsigned int lcnt)
+    PortMerge& pm, PortObject* pol[], int pol_cnt, unsigned int lcnt)
 {
     PortObject2* ponew = NULL;
     PortObject2* posnew = NULL;
@@ -423,11 +509,8 @@ static PortObject2* PortTableCompileMergePortObjectList2(
     unsigned largest;
     int i;
 
-    std::unique_ptr<void*[]> upA(new void*[SFPO_MAX_LPORTS]);
-    std::unique_ptr<void*[]> upB(new void*[SFPO_MAX_LPORTS]);
-
-    void** polarge = upA.get();
-    void** posmall = upB.get();
+    void* polarge[SFPO_MAX_LPORTS];
+    void* posmall[SFPO_MAX_LPORTS];
 
     /*
     * Find the largest rule count of all of the port objects
@@ -505,7 +588,7 @@ static PortObject2* PortTableCompileMergePortObjectList2(
     if ( nlarge )
     {
         DebugFormat(DEBUG_PORTLISTS,"***nlarge=%d \n",nlarge);
-        ponew =  _merge_N_pol(mhash, mhashx, plx_list, polarge, nlarge, &plx_large);
+        ponew =  _merge_N_pol(pm, polarge, nlarge, &plx_large);
     }
 
     /*
@@ -514,7 +597,7 @@ static PortObject2* PortTableCompileMergePortObjectList2(
     if ( nsmall )
     {
         DebugFormat(DEBUG_PORTLISTS,"***nsmall=%d \n",nsmall);
-        posnew =  _merge_N_pol(mhash, mhashx, plx_list, posmall, nsmall, &plx_small);
+        posnew =  _merge_N_pol(pm, posmall, nsmall, &plx_small);
     }
     /*
     * Merge Large and Small (rule groups) PortObject2's together
@@ -528,7 +611,7 @@ static PortObject2* PortTableCompileMergePortObjectList2(
         if (ponew != posnew)
         {
             /* Append small port object, just the rules */
-            PortObject2AppendPortObject2(ponew, posnew);
+            PortMergeAddRules(pm, ponew, pm.rules[posnew]);
 
             /* Remove Ports in ponew from posnew */
             PortObjectRemovePorts( (PortObject*)posnew, (PortObject*)ponew);
@@ -593,9 +676,6 @@ static int PortTableCompileMergePortObjects(PortTable* p)
 
     DebugMessage(DEBUG_PORTLISTS,"***\n***Merging PortObjects->PortObjects2\n***\n");
 
-    std::unique_ptr<PortObject*[]> upA(new PortObject*[SFPO_MAX_LPORTS]);
-    PortObject** pol = upA.get();
-
     /* Create a Merged Port Object Table  - hash by ports */
     mhash = sfghash_new(PO_HASH_TBL_ROWS, sizeof(PortObject*), 0 /*userkeys-no*/,
         0 /*free data-don't*/);
@@ -629,53 +709,95 @@ static int PortTableCompileMergePortObjects(PortTable* p)
     p->pt_plx_list = plx_list;
 
     /*
-     *  For each port, merge rules from all port objects that touch the port
-     *  into an optimal object, that may be shared with other ports.
+     *  Sweep the ports keeping a bitset of the input port objects touching
+     *  the current port.  The set only changes at the edges of the objects'
+     *  port runs so each run of ports with the same set is merged once into
+     *  an optimal object, that may be shared with other ports.
      */
+    std::vector<PortObject*> polist;
+    std::vector<PortEdge> edges;
+    PortObject* po;
+    SF_LNODE* lpos;
+    int max_rule = -1;
+
+    for (po=(PortObject*)sflist_first(p->pt_polist,&lpos);
+        po;
+        po=(PortObject*)sflist_next(&lpos) )
+    {
+        PortObjectEdges(po, polist.size(), edges);
+        polist.push_back(po);
+
+        SF_LNODE* rpos;
+
+        for ( int* prid = (int*)sflist_first(po->rule_list, &rpos);
+            prid;
+            prid = (int*)sflist_next(&rpos) )
+        {
+            max_rule = std::max(max_rule, *prid);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    PortMerge pm;
+    pm.mhash = mhash;
+    pm.mhashx = mhashx;
+    pm.plx_list = plx_list;
+    pm.words = (max_rule + 64) / 64;
+
+    std::vector<uint64_t> members((polist.size() + 63) / 64, 0);
+    PortObject* pol[SFPO_MAX_LPORTS];
     int id = PO_INIT_ID;
+    unsigned e = 0;
 
-    for ( int i = 0; i < SFPO_MAX_PORTS; i++ )
+    memset(p->pt_port_object, 0, sizeof(p->pt_port_object));
+
+    while ( e < edges.size() )
     {
-        /* Build a list of port objects touching port 'i' */
+        int lport = edges[e].port;
+
+        for ( ; e < edges.size() and edges[e].port == lport; e++ )
+        {
+            uint64_t bit = 1ULL << (edges[e].index % 64);
+
+            if ( edges[e].add )
+                members[edges[e].index / 64] |= bit;
+            else
+                members[edges[e].index / 64] &= ~bit;
+        }
+        int hport = (e < edges.size()) ? edges[e].port - 1 : SFPO_MAX_PORTS - 1;
+
+        /* Build a list of port objects touching these ports */
         int pol_cnt = 0;
-        PortObject* po;
-        SF_LNODE* lpos;
 
-        for (po=(PortObject*)sflist_first(p->pt_polist,&lpos);
-            po;
-            po=(PortObject*)sflist_next(&lpos) )
+        for ( unsigned w = 0; w < members.size() and pol_cnt < SFPO_MAX_LPORTS; w++ )
         {
-            if ( PortObjectHasPort (po, i) )
-            {
-                if ( pol_cnt < SFPO_MAX_LPORTS )
-                {
-                    pol[ pol_cnt++ ] = po;
-                }
-            }
+            for ( uint64_t m = members[w]; m and pol_cnt < SFPO_MAX_LPORTS; m &= m - 1 )
+                pol[ pol_cnt++ ] = polist[w * 64 + __builtin_ctzll(m)];
         }
-        p->pt_port_object[i] = 0;
 
         if ( !pol_cnt )
         {
-            //port not contained in any PortObject
+            //ports not contained in any PortObject
             continue;
         }
 
-        DEBUG_WRAP(DebugFormat(DEBUG_PORTLISTS,"*** merging list for port[%d] \n",i); fflush(
-            stdout); );
+        DebugFormat(DEBUG_PORTLISTS,"*** merging list for ports[%d-%d] \n", lport, hport);
 
         /* merge the rules into an optimal port object */
-        p->pt_port_object[i] =
-            PortTableCompileMergePortObjectList2(mhash, mhashx, plx_list, pol, pol_cnt, p->pt_lrc);
-        if ( !p->pt_port_object[i] )
+        PortObject2* po2 =
+            PortTableCompileMergePortObjectList2(pm, pol, pol_cnt, p->pt_lrc);
+
+        if ( !po2 )
         {
-            FatalError(" Could not merge PorObjectList on port %d\n",i);
+            FatalError(" Could not merge PorObjectList on port %d\n", lport);
         }
 
-        /* give the new compiled port object an id of its own */
-        p->pt_port_object[i]->id = id++;
+        for ( int i = lport; i <= hport; i++ )
+            p->pt_port_object[i] = po2;
 
-        DEBUG_WRAP(DebugMessage(DEBUG_PORTLISTS,"\n"); fflush(stdout); );
+        /* give the new compiled port object the id of the last port it is on */
+        id += hport - lport;
+        po2->id = id++;
     }
 
     /*
@@ -738,21 +860,12 @@ static int PortTableCompileMergePortObjects(PortTable* p)
             continue;
         }
 
-        PortBitSet parray;
-
-        /* Convert the port_list bits to a char array */
-        for ( int i = 0; i < SFPO_MAX_PORTS; i++ )
-            parray[ i ] = po->port_list->test(i);
+        /* Build a PortObjectItem list from the port_list bits */
+        SF_LIST* plist = PortObjectItemListFromBits(*po->port_list, SFPO_MAX_PORTS);
 
         /* Release bit buffer for each port object */
-        if ( po->port_list )
-        {
-            delete po->port_list;
-            po->port_list = nullptr;
-        }
-
-        /* Build a PortObjectItem list from the char array */
-        SF_LIST* plist = PortObjectItemListFromBits(parray, SFPO_MAX_PORTS);
+        delete po->port_list;
+        po->port_list = nullptr;
 
         if ( !plist )
         {
@@ -765,6 +878,8 @@ static int PortTableCompileMergePortObjects(PortTable* p)
         /* set the new list - this is a list of port items for this port object */
         po->item_list = plist;
 
+        p->port_groups++;
+
         DebugFormat(DEBUG_PORTLISTS,"port-object id = %d, port cnt = %d\n",po->id,
             po->port_cnt);
     }
@@ -786,10 +901,9 @@ static int PortTableConsistencyCheck(PortTable* p)
     PortObject* ipo;
     PortObject2* lastpo = NULL;
     PortObjectItem* poi;
+    std::vector<PortRange> ranges;
 
-    std::unique_ptr<char[]> upA(new char[SFPO_MAX_PORTS]);
-    char* parray = upA.get();
-    memset(parray,0,SFPO_MAX_PORTS);
+    PortBitSet* parray = new PortBitSet;
 
     /*  Make sure each port is only in one composite port object */
     for (node=sfghash_findfirst(p->pt_mpo_hash);
@@ -807,20 +921,23 @@ static int PortTableConsistencyCheck(PortTable* p)
         if ( !po->port_cnt ) /* port object is not used ignore it */
             continue;
 
-        for (i=0; i<SFPO_MAX_PORTS; i++)
+        PortObjectRanges((PortObject*)po, ranges);
+
+        for ( auto& r : ranges )
         {
-            if ( PortObjectHasPort( (PortObject*)po, i) )
+            for ( i = r.lport; i <= r.hport; i++ )
             {
-                if ( parray[i] )
+                if ( parray->test(i) )
                 {
                     FatalError(
                         "PortTableCompile: failed consistency check, multiple objects reference port %d\n",
                         i);
                 }
-                parray[i]=1;
+                parray->set(i);
             }
         }
     }
+    delete parray;
 
     DebugMessage(DEBUG_PORTLISTS,
         "***\n***Port Table Compiler Consistency Check Phase-I Passed !\n");
@@ -1012,6 +1129,9 @@ int PortTableCompile(PortTable* p)
 
     DebugMessage(DEBUG_PORTLISTS,"#PortTableCompile: Compiling Port Array Lists\n");
 
+    Stopwatch<hr_clock> sw;
+    sw.start();
+
     if ( PortTableCompileMergePortObjects(p) )
     {
         FatalError("Could not create PortArryayLists\n");
@@ -1021,6 +1141,9 @@ int PortTableCompile(PortTable* p)
 
     PortTableConsistencyCheck(p);
 
+    p->compile_usecs =
+        std::chrono::duration_cast<std::chrono::microseconds>(sw.get()).count();
+
     return 0;
 }
 
@@ -1217,3 +1340,280 @@ void PortTableSortUniqRules(PortTable* p)
     }
 }
 
+
+//-------------------------------------------------------------------------
+// unit tests
+//-------------------------------------------------------------------------
+
+#ifdef UNIT_TEST
+
+typedef std::set<int> RuleSet;
+
+static void add_rules(RuleSet& rs, PortObject* po)
+{
+    SF_LNODE* pos;
+
+    for ( int* prid = (int*)sflist_first(po->rule_list, &pos);
+        prid;
+        prid = (int*)sflist_next(&pos) )
+    {
+        rs.insert(*prid);
+    }
+}
+
+static RuleSet get_rules(PortObject2* po2)
+{
+    RuleSet rs;
+
+    for ( SFGHASH_NODE* node = sfghash_findfirst(po2->rule_hash);
+        node;
+        node = sfghash_findnext(po2->rule_hash) )
+    {
+        rs.insert(*(int*)node->data);
+    }
+    return rs;
+}
+
+static PortObject* add_object(PortTable* pt, int first_rule, int num_rules)
+{
+    PortObject* po = PortObjectNew();
+
+    for ( int i = 0; i < num_rules; i++ )
+        PortObjectAddRule(po, first_rule + i);
+
+    PortTableAddObject(pt, po);
+    return po;
+}
+
+// each port's group must have the rules of every input object that has
+// the port, and only those of the objects on one of the group's ports.
+// large groups are shared by ports with and without small objects so
+// that is as exact as it gets.
+static void check_table(PortTable* pt)
+{
+    std::vector<PortObject*> pol;
+    SF_LNODE* pos;
+
+    for ( PortObject* po = (PortObject*)sflist_first(pt->pt_polist, &pos);
+        po;
+        po = (PortObject*)sflist_next(&pos) )
+    {
+        pol.push_back(po);
+    }
+
+    std::map<PortObject2*, RuleSet> want;
+    std::map<PortObject2*, std::vector<int>> ports;
+    std::vector<PortObject*> has, last;
+    PortObject2* last_po2 = nullptr;
+    unsigned missing = 0, extra = 0;
+
+    for ( int port = 0; port < SFPO_MAX_PORTS; port++ )
+    {
+        last.swap(has);
+        has.clear();
+
+        for ( auto po : pol )
+        {
+            if ( PortObjectHasPort(po, port) )
+                has.push_back(po);
+        }
+        PortObject2* po2 = pt->pt_port_object[port];
+
+        if ( has.empty() )
+        {
+            if ( po2 )
+                ++extra;
+            continue;
+        }
+        if ( !po2 )
+        {
+            ++missing;
+            continue;
+        }
+        // the rules only change at the edges
+        if ( has != last or po2 != last_po2 )
+        {
+            for ( auto po : has )
+                add_rules(want[po2], po);
+        }
+        ports[po2].push_back(port);
+        last_po2 = po2;
+    }
+    CHECK(missing == 0);
+    CHECK(extra == 0);
+
+    std::set<int> ids;
+
+    for ( auto& g : ports )
+    {
+        PortObject2* po2 = g.first;
+        CHECK(get_rules(po2) == want[po2]);
+        CHECK((unsigned)po2->port_cnt == g.second.size());
+
+        // the item list is exactly the ports that use the group
+        std::vector<int> items;
+        PortObjectItem* poi;
+
+        for ( poi = (PortObjectItem*)sflist_first(po2->item_list, &pos);
+            poi;
+            poi = (PortObjectItem*)sflist_next(&pos) )
+        {
+            CHECK(!poi->negate);
+
+            for ( int i = poi->lport; i <= poi->hport; i++ )
+                items.push_back(i);
+        }
+        std::sort(items.begin(), items.end());
+        CHECK(items == g.second);
+
+        ids.insert(po2->id);
+    }
+    CHECK(ids.size() == ports.size());
+    CHECK(pt->port_groups == ports.size());
+}
+
+TEST_CASE("port table compile", "[ports]")
+{
+    PortTable* pt = PortTableNew();
+    REQUIRE(pt);
+
+    // small list
+    PortObject* a = add_object(pt, 0, 2);
+    PortObjectAddPort(a, 80, 0);
+    PortObjectAddPort(a, 443, 0);
+    PortObjectAddPort(a, 8080, 0);
+
+    // large range
+    PortObject* b = add_object(pt, 10, PTBL_LRC_DEFAULT + 2);
+    PortObjectAddRange(b, 1, 1024, 0);
+
+    // any is not compiled into the table
+    PortObject* d = add_object(pt, 3, 1);
+    PortObjectAddPortAny(d);
+
+    // overlapping ranges
+    PortObject* f = add_object(pt, 4, 1);
+    PortObjectAddRange(f, 5000, 5010, 0);
+
+    PortObject* g = add_object(pt, 5, 1);
+    PortObjectAddPort(g, 5005, 0);
+    PortObjectAddRange(g, 5008, 5020, 0);
+
+    SECTION("lists and ranges")
+    {
+        REQUIRE(!PortTableCompile(pt));
+        check_table(pt);
+
+        PortObject2* const* map = pt->pt_port_object;
+
+        CHECK(map[0] == nullptr);
+        CHECK(map[1025] == nullptr);
+        CHECK(map[5021] == nullptr);
+        CHECK(map[65535] == nullptr);
+
+        // small rules go into the large group on the same ports
+        RuleSet big = { 0, 1 };
+        for ( int i = 0; i < PTBL_LRC_DEFAULT + 2; i++ )
+            big.insert(10 + i);
+
+        CHECK(get_rules(map[80]) == big);
+        CHECK(map[443] == map[80]);
+        CHECK(map[1] == map[80]);
+        CHECK(map[1024] == map[80]);
+
+        CHECK(get_rules(map[8080]) == RuleSet({ 0, 1 }));
+        CHECK(get_rules(map[5000]) == RuleSet({ 4 }));
+        CHECK(get_rules(map[5005]) == RuleSet({ 4, 5 }));
+        CHECK(get_rules(map[5010]) == RuleSet({ 4, 5 }));
+        CHECK(get_rules(map[5011]) == RuleSet({ 5 }));
+
+        CHECK(map[5006] == map[5000]);
+        CHECK(map[5009] == map[5005]);
+        CHECK(map[5005]->port_cnt == 4);
+    }
+
+    SECTION("negated")
+    {
+        // a negated item has every port as far as PortObjectHasPort goes
+        PortObject* c = add_object(pt, 6, 1);
+        PortObjectAddPort(c, 80, 1);
+
+        PortObject* e = add_object(pt, 7, 2);
+        PortObjectAddRange(e, 1000, 2000, 0);
+        PortObjectAddPort(e, 1500, 1);
+
+        REQUIRE(!PortTableCompile(pt));
+        check_table(pt);
+
+        unsigned missing = 0;
+
+        for ( int port = 0; port < SFPO_MAX_PORTS; port++ )
+        {
+            if ( !pt->pt_port_object[port] )
+                ++missing;
+        }
+        CHECK(missing == 0);
+
+        CHECK(get_rules(pt->pt_port_object[0]) == RuleSet({ 6, 7, 8 }));
+        CHECK(get_rules(pt->pt_port_object[5005]) == RuleSet({ 4, 5, 6, 7, 8 }));
+    }
+    PortTableFree(pt);
+}
+
+TEST_CASE("port table compile random", "[ports]")
+{
+    unsigned seed = 12345;
+
+    auto rnd = [&seed]()
+    {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 8;
+    };
+
+    for ( int t = 0; t < 3; t++ )
+    {
+        PortTable* pt = PortTableNew();
+        REQUIRE(pt);
+
+        const int num_objects = 60;
+        int num_rules = 0;
+
+        for ( int i = 0; i < num_objects; i++ )
+        {
+            // a few large objects so large and small groups are merged
+            int n = (i % 10) ? 1 + rnd() % 4 : PTBL_LRC_DEFAULT + rnd() % 20;
+            PortObject* po = add_object(pt, num_rules, n);
+            num_rules += n;
+
+            switch ( rnd() % 12 )
+            {
+            case 0:
+                // the parser doesn't mix any with other ports
+                PortObjectAddPortAny(po);
+                continue;
+            case 1:
+                PortObjectAddPort(po, rnd() % 2000, 1);
+                break;
+            case 2:
+                PortObjectAddRange(po, 1024, 65535, 0);
+                break;
+            }
+
+            for ( int j = 1 + rnd() % 5; j > 0; j-- )
+            {
+                if ( rnd() % 3 )
+                    PortObjectAddPort(po, rnd() % 1100, 0);
+                else
+                {
+                    int lport = rnd() % 65000;
+                    PortObjectAddRange(po, lport, lport + rnd() % 500, 0);
+                }
+            }
+        }
+        REQUIRE(!PortTableCompile(pt));
+        check_table(pt);
+        PortTableFree(pt);
+    }
+}
+
+#endif
@@ -77,6 +77,8 @@ struct PortTable
     int large_single_merges; /* 1 large + some small objects */
     int large_multi_merges; /* >1 large object merged + some small objects */
     int non_opt_merges;
+    unsigned port_groups;    /* compiled port objects in use */
+    unsigned compile_usecs;  /* time spent in PortTableCompile */
 };
 
 PortTable* PortTableNew(void);
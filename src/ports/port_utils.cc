@@ -42,6 +42,29 @@
 // bitset conversions
 //-------------------------------------------------------------------------
 
+// set or clear lport through hport a word at a time
+static void PortBitsRange(PortBitSet& parray, int lport, int hport, bool on)
+{
+    if ( lport > hport )
+        return;
+
+    if ( lport == hport )
+    {
+        parray[lport] = on;
+        return;
+    }
+
+    PortBitSet range;
+    range.set();
+    range >>= SFPO_MAX_PORTS - 1 - (hport - lport);
+    range <<= lport;
+
+    if ( on )
+        parray |= range;
+    else
+        parray &= ~range;
+}
+
 /*
  *  Build a PortMap Char Array
  *  returns:  0 if an  ANY port.
@@ -52,7 +75,7 @@ int PortObjectBits(PortBitSet& parray, PortObject* po)
     if ( !po || PortObjectHasAny (po) )
         return 0;  /* ANY =64K */
 
-    int cnt = 0;
+    int cnt = parray.count();
     unsigned not_cnt = 0;
     PortObjectItem* poi;
     SF_LNODE* pos;
@@ -71,14 +94,13 @@ int PortObjectBits(PortBitSet& parray, PortObject* po)
         if ( poi->any() )
             continue;
 
-        for ( int i = poi->lport; i <= poi->hport; i++ )
-        {
-            if ( !parray[i] )
-                cnt++;
-            parray[i] = 1;
-        }
+        PortBitsRange(parray, poi->lport, poi->hport, true);
     }
 
+    /* A pure Not list - enable all of the ports */
+    if ( po->item_list->count == not_cnt )
+        parray.set();
+
     /* Remove any NOT'd ports that may have been added above */
     for (poi=(PortObjectItem*)sflist_first(po->item_list,&pos);
         poi != 0;
@@ -90,47 +112,10 @@ int PortObjectBits(PortBitSet& parray, PortObject* po)
         if ( poi->any() )
             continue;
 
-        for ( int i = poi->lport; i <= poi->hport; i++ )
-        {
-            if ( parray[i] )
-                cnt--;
-            parray[i] = 0;
-        }
-    }
-
-    /* A pure Not list */
-    if ( po->item_list->count == not_cnt )
-    {
-        int i;
-
-        /* enable all of the ports */
-        for (i=0; i<SFPO_MAX_PORTS; i++)
-        {
-            parray[i] = 1;
-            cnt++;
-        }
-
-        /* disable the NOT'd ports */
-        for (poi=(PortObjectItem*)sflist_first(po->item_list,&pos);
-            poi != 0;
-            poi=(PortObjectItem*)sflist_next(&pos) )
-        {
-            if ( !poi->negate  )
-                continue; /* should not happen */
-
-            if ( poi->any() )
-                continue;
-
-            for ( int k = poi->lport; k <= poi->hport; k++ )
-            {
-                if ( parray[k] )
-                    cnt--;
-                parray[k] = 0;
-            }
-        }
+        PortBitsRange(parray, poi->lport, poi->hport, false);
     }
 
-    return cnt;
+    return parray.count() - cnt;
 }
 
 /*
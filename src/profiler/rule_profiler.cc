@@ -55,6 +55,8 @@ static inline OtnState& operator+=(OtnState& lhs, const OtnState& rhs)
     lhs.checks += rhs.checks;
     lhs.matches += rhs.matches;
     lhs.alerts += rhs.alerts;
+    lhs.elapsed_script += rhs.elapsed_script;
+    lhs.script_checks += rhs.script_checks;
     return lhs;
 }
 
@@ -76,6 +78,7 @@ static const StatsTable::Field fields[] =
     { "avg/non-match", 14, '\0', 1, std::ios_base::fmtflags() },
     { "timeouts", 9, '\0', 0, std::ios_base::fmtflags() },
     { "suspends", 9, '\0', 0, std::ios_base::fmtflags() },
+    { "script/call", 12, '\0', 1, std::ios_base::fmtflags() },
     { nullptr, 0, '\0', 0, std::ios_base::fmtflags() }
 };
 
@@ -111,6 +114,12 @@ struct View
     uint64_t suspends() const
     { return state.latency_suspends; }
 
+    hr_duration elapsed_script() const
+    { return state.elapsed_script; }
+
+    uint64_t script_checks() const
+    { return state.script_checks; }
+
     hr_duration time_per(hr_duration d, uint64_t v) const
     {
         if ( v  == 0 )
@@ -128,6 +137,9 @@ struct View
     hr_duration avg_check() const
     { return time_per(elapsed(), checks()); }
 
+    hr_duration avg_script() const
+    { return time_per(elapsed_script(), script_checks()); }
+
     View(const OtnState& otn_state, const SigInfo* si = nullptr) :
         state(otn_state)
     {
@@ -242,6 +254,7 @@ static void print_single_entry(const View& v, unsigned n)
 
         table << v.timeouts();
         table << v.suspends();
+        table << duration_cast<microseconds>(v.avg_script()).count(); // script/call
     }
 
     LogMessage("%s", ss.str().c_str());
@@ -404,6 +417,8 @@ TEST_CASE( "otn state", "[profiler][rule_profiler]" )
         state_b.matches = 6;
         state_b.noalerts = 7;
         state_b.alerts = 8;
+        state_b.elapsed_script = 3_ticks;
+        state_b.script_checks = 2;
 
         state_a += state_b;
 
@@ -412,6 +427,8 @@ TEST_CASE( "otn state", "[profiler][rule_profiler]" )
         CHECK( state_a.checks == 6 );
         CHECK( state_a.matches == 8 );
         CHECK( state_a.alerts == 12 );
+        CHECK( state_a.elapsed_script == 3_ticks );
+        CHECK( state_a.script_checks == 2 );
     }
 
     SECTION( "reset" )
@@ -448,6 +465,8 @@ TEST_CASE( "rule entry", "[profiler][rule_profiler]" )
     entry.state.alerts = 77;
     entry.state.latency_timeouts = 5;
     entry.state.latency_suspends = 2;
+    entry.state.elapsed_script = 4_ticks;
+    entry.state.script_checks = 2;
 
     SECTION( "copy assignment" )
     {
@@ -533,6 +552,13 @@ TEST_CASE( "rule entry", "[profiler][rule_profiler]" )
         INFO( ticks.count() << " == " << (1_ticks).count() );
         CHECK( ticks == 1_ticks );
     }
+
+    SECTION( "avg_script" )
+    {
+        auto ticks = entry.avg_script();
+        INFO( ticks.count() << " == " << (2_ticks).count() );
+        CHECK( ticks == 2_ticks );
+    }
 }
 
 TEST_CASE( "rule profiler sorting", "[profiler][rule_profiler]" )
@@ -80,7 +80,10 @@ extern "C" {
 
 #define PKT_FILE_EVENT_SET   0x00400000
 #define PKT_IGNORE           0x00800000  /* this packet should be ignored, based on port */
-#define PKT_UNUSED_FLAGS     0xfe000000
+// set by rewrites that fix checksums as they go so encode_update() can be
+// skipped; normalizers run before rewrites and assert it is not yet set
+#define PKT_CKSUM_CURRENT    0x02000000  /* modified with checksums updated in place */
+#define PKT_UNUSED_FLAGS     0xfc000000
 
 // 0x40000000 are available
 #define PKT_PDU_FULL (PKT_PDU_HEAD | PKT_PDU_TAIL)
@@ -99,6 +99,23 @@ static inline void push_layer(Packet* p,
 //    lyr.invalid_bits = p->byte_skip;  -- currently unused
 }
 
+// eth, vlan, ip4, ip6, tcp and udp make up nearly all traffic.  decode()
+// walks these with a trimmed loop that still calls each codec's decode().
+static inline bool fast_layer(uint16_t prot_id)
+{
+    switch ( prot_id )
+    {
+    case PROTO_ETHERNET_802_3:
+    case ETHERTYPE_8021Q:
+    case ETHERTYPE_IPV4:
+    case ETHERTYPE_IPV6:
+    case IPPROTO_ID_TCP:
+    case IPPROTO_ID_UDP:
+        return true;
+    }
+    return false;
+}
+
 void PacketManager::pop_teredo(Packet* p, RawData& raw)
 {
     p->proto_bits &= ~PROTO_BIT__TEREDO;
@@ -198,18 +215,68 @@ void PacketManager::decode(
     if ( cooked )
         codec_data.codec_flags |= CODEC_STREAM_REBUILT;
 
-    // initialize all Packet information
+    // initialize all Packet information (reset() also resets ptrs)
     p->reset();
     p->pkth = pkthdr;
     p->pkt = pkt;
-    p->ptrs.reset();
     layer::set_packet_pointer(p);
 
     s_stats[total_processed]++;
 
+    // fast path for the common layers.  a layer that needs encapsulation
+    // or fragment handling, or hits the layer limit, is finished by the
+    // generic loop below which then carries on from there.
+    bool decoded = false;  // current layer decoded but not yet recorded
+    bool done = false;
+
+    while ( fast_layer(prev_prot_id) )
+    {
+        if ( !CodecManager::s_protocols[mapped_prot]->decode(raw, codec_data, p->ptrs) )
+        {
+            done = true;
+            break;
+        }
+
+        if ( (codec_data.codec_flags & (CODEC_SAVE_LAYER | CODEC_UNSURE_ENCAP)) or
+            p->is_fragment() or (p->num_layers == CodecManager::max_layers) )
+        {
+            decoded = true;
+            break;
+        }
+
+        if ( codec_data.proto_bits & (PROTO_BIT__IP | PROTO_BIT__IP6_EXT) )
+            p->ip_proto_next = (uint8_t)codec_data.next_prot_id;
+
+        push_layer(p, prev_prot_id, raw.data, codec_data.lyr_len);
+
+        s_stats[mapped_prot + stat_offset]++;
+        mapped_prot = CodecManager::s_proto_map[codec_data.next_prot_id];
+        prev_prot_id = codec_data.next_prot_id;
+
+        const uint16_t curr_lyr_len = codec_data.lyr_len + codec_data.invalid_bytes;
+        assert(curr_lyr_len <= raw.len);
+        raw.len -= curr_lyr_len;
+        raw.data += curr_lyr_len;
+        p->proto_bits |= codec_data.proto_bits;
+        codec_data.next_prot_id = FINISHED_DECODE;
+        codec_data.lyr_len = 0;
+        codec_data.invalid_bytes = 0;
+        codec_data.proto_bits = 0;
+
+        // the default codec always fails so don't bother calling it
+        if ( prev_prot_id == FINISHED_DECODE )
+        {
+            done = true;
+            break;
+        }
+    }
+
     // loop until the protocol id is no longer valid
-    while (CodecManager::s_protocols[mapped_prot]->decode(raw, codec_data, p->ptrs))
+    while ( !done and (decoded or
+        CodecManager::s_protocols[mapped_prot]->decode(raw, codec_data, p->ptrs)) )
     {
+        decoded = false;
+
         DebugFormat(DEBUG_DECODE, "Codec %s (protocol_id: %u:"
             "ip header starts at: %p, length is %lu\n",
             CodecManager::s_protocols[mapped_prot]->get_name(),
@@ -19,8 +19,42 @@
 
 #include "nhttp_cutter.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef UNIT_TEST
+#include <string>
+#include "catch/catch.hpp"
+#endif
+
 using namespace NHttpEnums;
 
+// Return the index of the first CR or LF in buffer[k] through buffer[length-1], or length if there
+// are none. Most octets in start lines and headers are neither so the cutters use this to skip
+// ahead instead of running their state machines on every octet.
+static inline uint32_t find_cr_lf(const uint8_t* buffer, uint32_t k, uint32_t length)
+{
+#ifdef __SSE2__
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    for (; k + 16 <= length; k += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(buffer + k));
+        const int hits = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr),
+            _mm_cmpeq_epi8(v, lf)));
+        if (hits != 0)
+            return k + __builtin_ctz(hits);
+    }
+#endif
+    for (; k < length; k++)
+    {
+        if ((buffer[k] == '\r') || (buffer[k] == '\n'))
+            return k;
+    }
+    return length;
+}
+
 ScanResult NHttpStartCutter::cut(const uint8_t* buffer, uint32_t length,
     NHttpInfractions& infractions, NHttpEventGen& events, uint32_t, uint32_t)
 {
@@ -94,6 +128,12 @@ ScanResult NHttpStartCutter::cut(const uint8_t* buffer, uint32_t length,
         {
             num_crlf = 1;
         }
+        else if (validated)
+        {
+            // Nothing else to do until the end of the start line. The loop increment moves onto
+            // the CR or LF.
+            k = find_cr_lf(buffer, k+1, length) - 1;
+        }
     }
     octets_seen += length;
     return SCAN_NOTFOUND;
@@ -177,6 +217,7 @@ ScanResult NHttpHeaderCutter::cut(const uint8_t* buffer, uint32_t length,
         {
             num_crlf = 0;
             first_lf = 0;
+            k = find_cr_lf(buffer, k+1, length) - 1;
         }
     }
     octets_seen += length;
@@ -340,6 +381,11 @@ ScanResult NHttpBodyChunkCutter::cut(const uint8_t* buffer, uint32_t length,
                 curr_state = CHUNK_BAD;
                 break;
             }
+            else
+            {
+                // chunk extensions are not examined
+                k = find_cr_lf(buffer, k+1, length) - 1;
+            }
             break;
         case CHUNK_HCRLF:
             if (buffer[k] != '\n')
@@ -444,3 +490,183 @@ ScanResult NHttpBodyChunkCutter::cut(const uint8_t* buffer, uint32_t length,
     return SCAN_NOTFOUND;
 }
 
+
+#ifdef UNIT_TEST
+// Line endings are placed at every position within a 16-byte block and at both buffer ends so
+// the vector and scalar parts of find_cr_lf() are each exercised.
+class TestEventGen : public NHttpEventGen
+{
+public:
+    void create_event(EventSid) override { count++; }
+    unsigned count = 0;
+};
+
+static uint32_t find_cr_lf_scalar(const uint8_t* buffer, uint32_t k, uint32_t length)
+{
+    for (; k < length; k++)
+    {
+        if ((buffer[k] == '\r') || (buffer[k] == '\n'))
+            return k;
+    }
+    return length;
+}
+
+TEST_CASE("find_cr_lf", "[nhttp_cutter]")
+{
+    uint8_t buf[48];
+
+    for (uint32_t len = 0; len <= sizeof(buf); len++)
+    {
+        for (uint32_t start = 0; start <= len; start++)
+        {
+            // near misses with the high bit set must not match
+            for (uint32_t j = 0; j < len; j++)
+                buf[j] = (j % 3) ? 'a' + j % 26 : (0x80 | ((j % 2) ? '\r' : '\n'));
+            CHECK(find_cr_lf(buf, start, len) == len);
+
+            for (uint32_t pos = start; pos < len; pos++)
+            {
+                for (uint8_t c : { '\r', '\n' })
+                {
+                    const uint8_t save = buf[pos];
+                    buf[pos] = c;
+                    CHECK(find_cr_lf(buf, start, len) == pos);
+                    if (pos + 1 < len)
+                    {
+                        buf[len-1] = '\n';
+                        CHECK(find_cr_lf(buf, start, len) == find_cr_lf_scalar(buf, start, len));
+                        buf[len-1] = 'z';
+                    }
+                    buf[pos] = save;
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("start cutter line ends", "[nhttp_cutter]")
+{
+    for (unsigned pad = 0; pad < 40; pad++)
+    {
+        const std::string line = "GET /" + std::string(pad, 'u') + " HTTP/1.1\r\n";
+        const uint8_t* data = (const uint8_t*)line.c_str();
+        const uint32_t len = line.size();
+
+        for (uint32_t split = 1; split <= len; split++)
+        {
+            NHttpRequestCutter cutter;
+            NHttpInfractions infractions;
+            TestEventGen events;
+            uint32_t flush;
+
+            if (split < len)
+            {
+                CHECK(cutter.cut(data, split, infractions, events, 0, 0) == SCAN_NOTFOUND);
+                CHECK(cutter.cut(data + split, len - split, infractions, events, 0, 0) ==
+                    SCAN_FOUND);
+                flush = cutter.get_num_flush() + split;
+            }
+            else
+            {
+                CHECK(cutter.cut(data, len, infractions, events, 0, 0) == SCAN_FOUND);
+                flush = cutter.get_num_flush();
+            }
+            CHECK(flush == len);
+            CHECK(cutter.get_num_excess() == 2);
+            CHECK(events.count == 0);
+        }
+    }
+
+    // CR not followed by LF anywhere in the line
+    for (unsigned pad = 0; pad < 40; pad++)
+    {
+        const std::string line = "GET /" + std::string(pad, 'u') + "\rx HTTP/1.1\r\n";
+        NHttpRequestCutter cutter;
+        NHttpInfractions infractions;
+        TestEventGen events;
+        CHECK(cutter.cut((const uint8_t*)line.c_str(), line.size(), infractions, events, 0, 0) ==
+            SCAN_ABORT);
+    }
+}
+
+TEST_CASE("header cutter line ends", "[nhttp_cutter]")
+{
+    for (unsigned pad = 0; pad < 40; pad++)
+    {
+        const std::string head = "Host: " + std::string(pad, 'h') + "\r\nAccept: " +
+            std::string(pad % 17, 'a') + "\r\n\r\n";
+        const uint8_t* data = (const uint8_t*)head.c_str();
+        const uint32_t len = head.size();
+
+        for (uint32_t split = 1; split <= len; split++)
+        {
+            NHttpHeaderCutter cutter;
+            NHttpInfractions infractions;
+            TestEventGen events;
+            uint32_t flush;
+
+            if (split < len)
+            {
+                CHECK(cutter.cut(data, split, infractions, events, 0, 0) == SCAN_NOTFOUND);
+                CHECK(cutter.cut(data + split, len - split, infractions, events, 0, 0) ==
+                    SCAN_FOUND);
+                flush = cutter.get_num_flush() + split;
+            }
+            else
+            {
+                CHECK(cutter.cut(data, len, infractions, events, 0, 0) == SCAN_FOUND);
+                flush = cutter.get_num_flush();
+            }
+            CHECK(flush == len);
+            CHECK(cutter.get_num_excess() == 4);
+            CHECK(cutter.get_num_head_lines() == 2);
+            CHECK(events.count == 0);
+        }
+
+        // bare LF separator
+        const std::string bare = "Host: " + std::string(pad, 'h') + "\n\n";
+        NHttpHeaderCutter cutter;
+        NHttpInfractions infractions;
+        TestEventGen events;
+        CHECK(cutter.cut((const uint8_t*)bare.c_str(), bare.size(), infractions, events, 0, 0) ==
+            SCAN_FOUND);
+        CHECK(cutter.get_num_flush() == bare.size());
+        CHECK(cutter.get_num_excess() == 2);
+        CHECK(events.count == 1);
+    }
+}
+
+TEST_CASE("chunk extension line ends", "[nhttp_cutter]")
+{
+    for (unsigned pad = 0; pad < 40; pad++)
+    {
+        const std::string chunk = "5;" + std::string(pad, 'e') + "\r\n";
+        const uint8_t* data = (const uint8_t*)chunk.c_str();
+        const uint32_t len = chunk.size();
+
+        for (uint32_t split = 1; split <= len; split++)
+        {
+            NHttpBodyChunkCutter cutter;
+            NHttpInfractions infractions;
+            TestEventGen events;
+            cutter.cut(data, split, infractions, events, 16384, 0);
+            if (split < len)
+                cutter.cut(data + split, len - split, infractions, events, 16384, 0);
+            CHECK(!cutter.get_is_broken_chunk());
+            CHECK(events.count == 1);  // chunk options
+        }
+
+        // a bare LF anywhere in the extension breaks the chunk
+        for (unsigned pos = 0; pos < pad; pos++)
+        {
+            std::string bad = chunk;
+            bad[2 + pos] = '\n';
+            NHttpBodyChunkCutter cutter;
+            NHttpInfractions infractions;
+            TestEventGen events;
+            cutter.cut((const uint8_t*)bad.c_str(), bad.size(), infractions, events, 16384, 0);
+            CHECK(cutter.get_is_broken_chunk());
+        }
+    }
+}
+#endif
@@ -138,19 +138,21 @@ uint32_t NHttpMsgHeadShared::find_header_end(const uint8_t* buffer, int32_t leng
     // k=1 because the splitter would not give us a header consisting solely of LF.
     for (int32_t k=1; k < length; k++)
     {
-        if (buffer[k] == '\n')
+        const uint8_t* lf = (const uint8_t*)memchr(buffer + k, '\n', length - k);
+        if (lf == nullptr)
+            break;
+        k = lf - buffer;
+
+        // Check for wrapping
+        if ((k+1 == length) || !is_sp_tab[buffer[k+1]])
         {
-            // Check for wrapping
-            if ((k+1 == length) || !is_sp_tab[buffer[k+1]])
+            num_seps = (buffer[k-1] == '\r') ? 2 : 1;
+            if (num_seps == 1)
             {
-                num_seps = (buffer[k-1] == '\r') ? 2 : 1;
-                if (num_seps == 1)
-                {
-                    infractions += INF_LF_WITHOUT_CR;
-                    events.create_event(EVENT_IIS_DELIMITER);
-                }
-                return k + 1 - num_seps;
+                infractions += INF_LF_WITHOUT_CR;
+                events.create_event(EVENT_IIS_DELIMITER);
             }
+            return k + 1 - num_seps;
         }
     }
     num_seps = 0;
@@ -164,16 +166,13 @@ void NHttpMsgHeadShared::parse_header_lines()
     header_value = new Field[num_headers];
     header_name_id = new HeaderId[num_headers];
 
-    int colon;
     for (int k=0; k < num_headers; k++)
     {
-        for (colon=0; colon < header_line[k].length; colon++)
-        {
-            if (header_line[k].start[colon] == ':')
-                break;
-        }
-        if (colon < header_line[k].length)
+        const uint8_t* colon_ptr = (header_line[k].length > 0) ?
+            (const uint8_t*)memchr(header_line[k].start, ':', header_line[k].length) : nullptr;
+        if (colon_ptr != nullptr)
         {
+            const int32_t colon = colon_ptr - header_line[k].start;
             header_name[k].start = header_line[k].start;
             header_name[k].length = colon;
             header_value[k].start = header_line[k].start + colon + 1;
@@ -200,6 +199,15 @@ void NHttpMsgHeadShared::derive_header_name_id(int index)
         return;
     }
 
+    // Usual case of no LWS in the name is matched in place without making a lower case copy
+    int32_t k;
+    for (k=0; (k < length) && !is_sp_tab[buffer[k]]; k++);
+    if (k == length)
+    {
+        header_name_id[index] = (HeaderId)header_map.find_nocase(buffer, length);
+        return;
+    }
+
     // Normalize header field name to lower case and remove LWS for matching purposes
     int32_t lower_length = 0;
     uint8_t* lower_name = new uint8_t[length];
@@ -216,7 +224,7 @@ void NHttpMsgHeadShared::derive_header_name_id(int index)
             events.create_event(EVENT_HEAD_NAME_WHITESPACE);
         }
     }
-    header_name_id[index] = (HeaderId)str_to_code(lower_name, lower_length, header_list);
+    header_name_id[index] = (HeaderId)str_to_code(lower_name, lower_length, header_map);
     delete[] lower_name;
 }
 
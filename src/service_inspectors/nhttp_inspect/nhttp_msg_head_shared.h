@@ -52,6 +52,9 @@ public:
     static const StrCode header_list[];
     static const StrCode trans_code_list[];
     static const StrCode content_code_list[];
+    static const StrCodeMap header_map;
+    static const StrCodeMap trans_code_map;
+    static const StrCodeMap content_code_map;
 
 protected:
     NHttpMsgHeadShared(const uint8_t* buffer, const uint16_t buf_size,
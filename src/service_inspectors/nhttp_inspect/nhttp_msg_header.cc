@@ -83,7 +83,7 @@ void NHttpMsgHeader::update_flow()
     if (get_header_value_norm(HEAD_TRANSFER_ENCODING).length > 0)
     {
         if (norm_last_token_code(get_header_value_norm(HEAD_TRANSFER_ENCODING),
-            NHttpMsgHeadShared::trans_code_list) == TRANSCODE_CHUNKED)
+            NHttpMsgHeadShared::trans_code_map) == TRANSCODE_CHUNKED)
         {
             // FIXIT-M inspect for Content-Length header which should not be present
             // Chunked body
@@ -194,7 +194,7 @@ void NHttpMsgHeader::setup_decompression()
         return;
 
     const Contentcoding compress_code = (Contentcoding)norm_last_token_code(
-        norm_content_encoding, NHttpMsgHeadShared::content_code_list);
+        norm_content_encoding, NHttpMsgHeadShared::content_code_map);
 
     CompressId& compression = session_data->compression[source_id];
 
@@ -74,7 +74,7 @@ void NHttpMsgRequest::parse_start_line()
 
     method.start = start_line.start;
     method.length = first_space;
-    method_id = (MethodId)str_to_code(method.start, method.length, method_list);
+    method_id = (MethodId)str_to_code(method.start, method.length, method_map);
 
     version.start = start_line.start + (start_line.length - 8);
     version.length = 8;
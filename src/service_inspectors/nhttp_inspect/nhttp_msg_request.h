@@ -48,9 +48,10 @@ public:
     void print_section(FILE* output) override;
 #endif
 
-private:
     static const StrCode method_list[];
+    static const StrCodeMap method_map;
 
+private:
     void parse_start_line() override;
     bool handle_zero_nine();
 
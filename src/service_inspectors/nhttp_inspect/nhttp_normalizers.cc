@@ -78,7 +78,7 @@ int64_t norm_decimal_integer(const Field& input)
 }
 
 // Find the last token in a comma-separated field and convert it to an enum
-int32_t norm_last_token_code(const Field& input, const StrCode table[])
+int32_t norm_last_token_code(const Field& input, const StrCodeMap& map)
 {
     assert(input.length > 0);
     const uint8_t* last_start;
@@ -86,6 +86,6 @@ int32_t norm_last_token_code(const Field& input, const StrCode table[])
         (*last_start != ','); last_start--);
     last_start++;
     const int32_t last_length = input.length - (last_start - input.start);
-    return str_to_code(last_start, last_length, table);
+    return str_to_code(last_start, last_length, map);
 }
 
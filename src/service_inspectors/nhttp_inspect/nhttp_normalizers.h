@@ -37,7 +37,7 @@ NormFunc norm_remove_lws;
 
 // Other normalization-related utilities
 int64_t norm_decimal_integer(const Field& input);
-int32_t norm_last_token_code(const Field& input, const StrCode table[]);
+int32_t norm_last_token_code(const Field& input, const StrCodeMap& map);
 
 #endif
 
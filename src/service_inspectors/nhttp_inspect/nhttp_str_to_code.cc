@@ -20,11 +20,12 @@
 #include <string.h>
 
 #include "main/snort_types.h"
+#include "log/messages.h"
 
 #include "nhttp_enum.h"
 #include "nhttp_str_to_code.h"
 
-// Need to replace this simple algorithm for better performance FIXIT-P
+// Linear search retained for small or one-time lookups
 SO_PUBLIC int32_t str_to_code(const uint8_t* text, const int32_t text_len, const StrCode table[])
 {
     for (int32_t k=0; table[k].name != nullptr; k++)
@@ -38,3 +39,121 @@ SO_PUBLIC int32_t str_to_code(const uint8_t* text, const int32_t text_len, const
     return NHttpEnums::STAT_OTHER;
 }
 
+SO_PUBLIC int32_t str_to_code(const uint8_t* text, const int32_t text_len, const StrCodeMap& map)
+{
+    return map.find(text, text_len);
+}
+
+static inline uint8_t fold(uint8_t c)
+{
+    return ((c < 'A') || (c > 'Z')) ? c : c + ('a' - 'A');
+}
+
+// FNV-1a over the case-folded text
+static inline uint32_t fold_hash(const uint8_t* text, int32_t text_len, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    for (int32_t k=0; k < text_len; k++)
+        h = (h ^ fold(text[k])) * 16777619u;
+    return h;
+}
+
+static bool same_folded(const char* a, const char* b, int32_t len)
+{
+    for (int32_t k=0; k < len; k++)
+    {
+        if (fold(a[k]) != fold(b[k]))
+            return false;
+    }
+    return true;
+}
+
+// Search for a seed that places every name in its own slot. The tables are a few dozen entries
+// so a table four times the entry count nearly always works within a handful of seeds. Names
+// that differ only in case hash alike under every seed and could never be separated.
+StrCodeMap::StrCodeMap(const StrCode table_[]) : table(table_)
+{
+    int32_t num = 0;
+    for (; table[num].name != nullptr; num++)
+    {
+        lengths.push_back(strlen(table[num].name));
+        if (lengths[num] > max_length)
+            max_length = lengths[num];
+
+        for (int32_t k=0; k < num; k++)
+        {
+            if ((lengths[k] == lengths[num]) &&
+                same_folded(table[k].name, table[num].name, lengths[num]))
+            {
+                FatalError("nhttp code table: %s and %s differ only in case\n", table[k].name,
+                    table[num].name);
+            }
+        }
+    }
+
+    if (num > INT16_MAX)
+        FatalError("nhttp code table: %d entries is too many\n", num);
+
+    const uint32_t max_size = 1 << 20;
+    uint32_t size = 4;
+    while (size < 4 * (uint32_t)num)
+        size *= 2;
+
+    for (; size <= max_size; size *= 2)
+    {
+        for (seed = 0; seed < 1024; seed++)
+        {
+            slots.assign(size, -1);
+            int32_t k;
+            for (k=0; k < num; k++)
+            {
+                const uint32_t h = fold_hash((const uint8_t*)table[k].name, lengths[k], seed) &
+                    (size - 1);
+                if (slots[h] >= 0)
+                    break;
+                slots[h] = k;
+            }
+            if (k == num)
+            {
+                mask = size - 1;
+                return;
+            }
+        }
+    }
+    FatalError("nhttp code table: no perfect hash for %d entries\n", num);
+}
+
+int32_t StrCodeMap::lookup(const uint8_t* text, int32_t text_len) const
+{
+    if ((text_len <= 0) || (text_len > max_length))
+        return -1;
+
+    const int32_t k = slots[fold_hash(text, text_len, seed) & mask];
+    if ((k < 0) || (lengths[k] != text_len))
+        return -1;
+    return k;
+}
+
+int32_t StrCodeMap::find(const uint8_t* text, int32_t text_len) const
+{
+    const int32_t k = lookup(text, text_len);
+    if ((k < 0) || (memcmp(text, table[k].name, text_len) != 0))
+        return NHttpEnums::STAT_OTHER;
+    return table[k].code;
+}
+
+int32_t StrCodeMap::find_nocase(const uint8_t* text, int32_t text_len) const
+{
+    const int32_t k = lookup(text, text_len);
+    if (k < 0)
+        return NHttpEnums::STAT_OTHER;
+
+    const uint8_t* name = (const uint8_t*)table[k].name;
+    for (int32_t j=0; j < text_len; j++)
+    {
+        if (fold(text[j]) != name[j])
+            return NHttpEnums::STAT_OTHER;
+    }
+    return table[k].code;
+}
+
@@ -20,13 +20,38 @@
 #ifndef NHTTP_STR_TO_CODE_H
 #define NHTTP_STR_TO_CODE_H
 
+#include <stdint.h>
+#include <vector>
+
 struct StrCode
 {
     int32_t code;
     const char* name;
 };
 
+// Perfect hash over a StrCode table. Built once at startup and read-only afterward so it may be
+// shared by all packet threads. Hashing folds case so the same map supports exact matching and
+// case-insensitive matching against a table of lower case names.
+class StrCodeMap
+{
+public:
+    StrCodeMap(const StrCode table[]);
+    int32_t find(const uint8_t* text, int32_t text_len) const;
+    int32_t find_nocase(const uint8_t* text, int32_t text_len) const;
+
+private:
+    int32_t lookup(const uint8_t* text, int32_t text_len) const;
+
+    const StrCode* const table;
+    std::vector<int16_t> slots;
+    std::vector<int32_t> lengths;
+    uint32_t seed = 0;
+    uint32_t mask = 0;
+    int32_t max_length = 0;
+};
+
 int32_t str_to_code(const uint8_t* text, const int32_t text_len, const StrCode table[]);
+int32_t str_to_code(const uint8_t* text, const int32_t text_len, const StrCodeMap& map);
 
 #endif
 
@@ -36,6 +36,11 @@
 #include "nhttp_uri_norm.h"
 #include "nhttp_cutter.h"
 
+#ifdef UNIT_TEST
+#include <string>
+#include "catch/catch.hpp"
+#endif
+
 using namespace NHttpEnums;
 
 const StrCode NHttpMsgRequest::method_list[] =
@@ -91,6 +96,8 @@ const StrCode NHttpMsgRequest::method_list[] =
     { 0,                       nullptr }
 };
 
+const StrCodeMap NHttpMsgRequest::method_map(method_list);
+
 SO_PUBLIC const StrCode NHttpMsgHeadShared::header_list[] =
 {
     { HEAD_CACHE_CONTROL,        "cache-control" },
@@ -172,6 +179,10 @@ const StrCode NHttpMsgHeadShared::content_code_list[] =
     { 0,                         nullptr }
 };
 
+const StrCodeMap NHttpMsgHeadShared::header_map(header_list);
+const StrCodeMap NHttpMsgHeadShared::trans_code_map(trans_code_list);
+const StrCodeMap NHttpMsgHeadShared::content_code_map(content_code_list);
+
 const HeaderNormalizer NHttpMsgHeadShared::NORMALIZER_BASIC
     { false, nullptr, nullptr, nullptr };
 
@@ -411,3 +422,96 @@ const bool NHttpEnums::is_sp_tab[256] =
     false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false
 };
 
+
+#ifdef UNIT_TEST
+// The maps must agree with the linear table search for every name and near miss.
+// find_nocase() is only used with tables of lower case names.
+static int32_t linear_nocase(const std::string& text, const StrCode table[])
+{
+    for (int32_t k=0; table[k].name != nullptr; k++)
+    {
+        if ((text.size() == strlen(table[k].name)) &&
+            (strncasecmp(text.c_str(), table[k].name, text.size()) == 0))
+            return table[k].code;
+    }
+    return STAT_OTHER;
+}
+
+static void check_text(const std::string& text, const StrCode table[], const StrCodeMap& map,
+    bool nocase = true)
+{
+    const uint8_t* p = (const uint8_t*)text.c_str();
+    CHECK(map.find(p, text.size()) == str_to_code(p, text.size(), table));
+    if ( nocase )
+        CHECK(map.find_nocase(p, text.size()) == linear_nocase(text, table));
+}
+
+static void check_table(const StrCode table[], const StrCodeMap& map, bool nocase = true)
+{
+    for (int32_t k=0; table[k].name != nullptr; k++)
+    {
+        const std::string name = table[k].name;
+        const uint8_t* p = (const uint8_t*)name.c_str();
+        CHECK(map.find(p, name.size()) == table[k].code);
+        if ( nocase )
+            CHECK(map.find_nocase(p, name.size()) == table[k].code);
+
+        std::string upper = name, lower = name, mixed = name;
+        for (size_t j=0; j < name.size(); j++)
+        {
+            upper[j] = toupper(name[j]);
+            lower[j] = tolower(name[j]);
+            mixed[j] = (j % 2) ? toupper(name[j]) : tolower(name[j]);
+        }
+        check_text(upper, table, map, nocase);
+        check_text(lower, table, map, nocase);
+        check_text(mixed, table, map, nocase);
+
+        std::string changed = name;
+        changed.back() ^= 0x01;
+        check_text(changed, table, map, nocase);
+        check_text(name.substr(0, name.size()-1), table, map, nocase);
+        check_text(name + "s", table, map, nocase);
+        check_text(" " + name, table, map, nocase);
+    }
+    check_text("", table, map, nocase);
+    check_text(std::string(256, 'x'), table, map, nocase);
+}
+
+TEST_CASE("nhttp methods", "[nhttp_str_to_code]")
+{
+    check_table(NHttpMsgRequest::method_list, NHttpMsgRequest::method_map, false);
+}
+
+TEST_CASE("nhttp headers", "[nhttp_str_to_code]")
+{
+    check_table(NHttpMsgHeadShared::header_list, NHttpMsgHeadShared::header_map);
+}
+
+TEST_CASE("nhttp transfer codings", "[nhttp_str_to_code]")
+{
+    check_table(NHttpMsgHeadShared::trans_code_list, NHttpMsgHeadShared::trans_code_map);
+}
+
+TEST_CASE("nhttp content codings", "[nhttp_str_to_code]")
+{
+    check_table(NHttpMsgHeadShared::content_code_list, NHttpMsgHeadShared::content_code_map);
+}
+
+TEST_CASE("nhttp large table", "[nhttp_str_to_code]")
+{
+    std::vector<std::string> names;
+    for (int k=0; k < 2000; k++)
+        names.push_back("name-" + std::to_string(k));
+
+    std::vector<StrCode> table;
+    for (int k=0; k < 2000; k++)
+        table.push_back({ k + 1, names[k].c_str() });
+    table.push_back({ 0, nullptr });
+
+    const StrCodeMap map(table.data());
+    for (int k=0; k < 2000; k += 97)
+        check_text(names[k], table.data(), map);
+    check_text("name-2000", table.data(), map);
+}
+#endif
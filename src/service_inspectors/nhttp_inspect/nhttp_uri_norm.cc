@@ -23,11 +23,74 @@
 #include <sstream>
 #include <string>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef UNIT_TEST
+#include "catch/catch.hpp"
+#endif
+
 #include "nhttp_enum.h"
 #include "nhttp_uri_norm.h"
 
 using namespace NHttpEnums;
 
+// Return the index of the first octet at or after k that might not be CHAR_NORMAL, or length if
+// there is none. Configuration can only turn the percent, substitute, and path characters into
+// normal characters, so anything outside this set plus eight bit octets is always CHAR_NORMAL.
+// Callers still consult uri_char for the octet found.
+static inline int32_t skip_normal(const uint8_t* buf, int32_t k, int32_t length)
+{
+#ifdef __SSE2__
+    const __m128i percent = _mm_set1_epi8('%');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i plus = _mm_set1_epi8('+');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i period = _mm_set1_epi8('.');
+    for (; k + 16 <= length; k += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(buf + k));
+        const __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, percent), _mm_cmpeq_epi8(v, backslash)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, plus),
+            _mm_or_si128(_mm_cmpeq_epi8(v, slash), _mm_cmpeq_epi8(v, period))));
+        // the sign bit of each octet flags eight bit characters
+        const int hits = _mm_movemask_epi8(_mm_or_si128(special, v));
+        if (hits != 0)
+            return k + __builtin_ctz(hits);
+    }
+#endif
+    for (; k < length; k++)
+    {
+        switch (buf[k])
+        {
+        case '%': case '\\': case '+': case '/': case '.':
+            return k;
+        default:
+            if (buf[k] & 0x80)
+                return k;
+        }
+    }
+    return length;
+}
+
+// Return the index of the first octet at or after k with the high bit set, or length if there is
+// none. Only these can begin a UTF-8 sequence.
+static inline int32_t skip_ascii(const uint8_t* buf, int32_t k, int32_t length)
+{
+#ifdef __SSE2__
+    for (; k + 16 <= length; k += 16)
+    {
+        const int hits = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(buf + k)));
+        if (hits != 0)
+            return k + __builtin_ctz(hits);
+    }
+#endif
+    for (; (k < length) && !(buf[k] & 0x80); k++);
+    return k;
+}
+
 void UriNormalizer::normalize(const Field& input, Field& result, bool do_path, uint8_t* buffer,
     const NHttpParaList::UriParam& uri_param, NHttpInfractions& infractions, NHttpEventGen& events)
 {
@@ -70,7 +133,7 @@ bool UriNormalizer::need_norm_no_path(const Field& uri_component,
 {
     const int32_t& length = uri_component.length;
     const uint8_t* const & buf = uri_component.start;
-    for (int32_t k = 0; k < length; k++)
+    for (int32_t k = skip_normal(buf, 0, length); k < length; k = skip_normal(buf, k+1, length))
     {
         if ((uri_param.uri_char[buf[k]] == CHAR_PERCENT) ||
             (uri_param.uri_char[buf[k]] == CHAR_SUBSTIT))
@@ -84,7 +147,7 @@ bool UriNormalizer::need_norm_path(const Field& uri_component,
 {
     const int32_t& length = uri_component.length;
     const uint8_t* const & buf = uri_component.start;
-    for (int32_t k = 0; k < length; k++)
+    for (int32_t k = skip_normal(buf, 0, length); k < length; k = skip_normal(buf, k+1, length))
     {
         switch (uri_param.uri_char[buf[k]])
         {
@@ -137,6 +200,16 @@ int32_t UriNormalizer::norm_percent_processing(const Field& input, uint8_t* out_
     int32_t length = 0;
     for (int32_t k = 0; k < input.length; k++)
     {
+        // Copy runs of normal characters in bulk
+        const int32_t next = skip_normal(input.start, k, input.length);
+        if (next > k)
+        {
+            memcpy(out_buf + length, input.start + k, next - k);
+            length += next - k;
+            if ((k = next) == input.length)
+                break;
+        }
+
         switch (uri_param.uri_char[input.start[k]])
         {
         case CHAR_EIGHTBIT:
@@ -218,6 +291,16 @@ int32_t UriNormalizer::norm_utf8_processing(const Field& input, uint8_t* out_buf
     int32_t length = 0;
     for (int32_t k=0; k < input.length; k++)
     {
+        // Move runs of ASCII in bulk. Output may overlap input.
+        const int32_t next = skip_ascii(input.start, k, input.length);
+        if (next > k)
+        {
+            memmove(out_buf + length, input.start + k, next - k);
+            length += next - k;
+            if ((k = next) == input.length)
+                break;
+        }
+
         if (percent_encoded[k] || uri_param.utf8_bare_byte)
         {
             // two-byte UTF-8: 110xxxxx 10xxxxxx
@@ -307,24 +390,20 @@ void UriNormalizer::norm_substitute(uint8_t* buf, int32_t length,
 {
     if (uri_param.backslash_to_slash)
     {
-        for (int32_t k = 0; k < length; k++)
+        uint8_t* const end = buf + length;
+        for (uint8_t* p = buf; (p = (uint8_t*)memchr(p, '\\', end - p)) != nullptr; p++)
         {
-            if (buf[k] == '\\')
-            {
-                buf[k] = '/';
-                infractions += INF_URI_BACKSLASH;
-                events.create_event(EVENT_IIS_BACKSLASH);
-            }
+            *p = '/';
+            infractions += INF_URI_BACKSLASH;
+            events.create_event(EVENT_IIS_BACKSLASH);
         }
     }
     if (uri_param.plus_to_space)
     {
-        for (int32_t k = 0; k < length; k++)
+        uint8_t* const end = buf + length;
+        for (uint8_t* p = buf; (p = (uint8_t*)memchr(p, '+', end - p)) != nullptr; p++)
         {
-            if (buf[k] == '+')
-            {
-                buf[k] = ' ';
-            }
+            *p = ' ';
         }
     }
 }
@@ -493,3 +572,146 @@ void UriNormalizer::load_default_unicode_map(uint8_t map[65536])
     }
 }
 
+
+#ifdef UNIT_TEST
+// Special octets are placed at every position within a 16-byte block and at both buffer ends so
+// the vector and scalar parts of the skip helpers are each exercised.
+class TestEventGen : public NHttpEventGen
+{
+public:
+    void create_event(EventSid) override { count++; }
+    unsigned count = 0;
+};
+
+static int32_t skip_normal_scalar(const uint8_t* buf, int32_t k, int32_t length)
+{
+    for (; k < length; k++)
+    {
+        if (memchr("%\\+/.", buf[k], 5) or (buf[k] & 0x80))
+            return k;
+    }
+    return length;
+}
+
+TEST_CASE("uri skip helpers", "[nhttp_uri_norm]")
+{
+    // near misses are the neighbors of the special octets
+    const uint8_t filler[] = "$&*,-0[]abcXYZ~";
+    const uint8_t specials[] = { '%', '\\', '+', '/', '.', 0x80, 0xA5, 0xC3, 0xFF };
+    uint8_t buf[48];
+
+    for (int32_t len = 0; len <= (int32_t)sizeof(buf); len++)
+    {
+        for (int32_t j = 0; j < len; j++)
+            buf[j] = filler[j % (sizeof(filler) - 1)];
+
+        for (int32_t start = 0; start <= len; start++)
+        {
+            CHECK(skip_normal(buf, start, len) == len);
+            CHECK(skip_ascii(buf, start, len) == len);
+
+            for (int32_t pos = start; pos < len; pos++)
+            {
+                for (uint8_t c : specials)
+                {
+                    const uint8_t save = buf[pos];
+                    buf[pos] = c;
+                    CHECK(skip_normal(buf, start, len) == pos);
+                    CHECK(skip_ascii(buf, start, len) == ((c & 0x80) ? pos : len));
+                    buf[len-1] ^= 0x80;
+                    CHECK(skip_normal(buf, start, len) == skip_normal_scalar(buf, start, len));
+                    buf[len-1] ^= 0x80;
+                    buf[pos] = save;
+                }
+            }
+        }
+    }
+}
+
+static void set_uri_param(NHttpParaList::UriParam& param)
+{
+    param.percent_u = true;
+    param.utf8 = true;
+    param.utf8_bare_byte = true;
+    param.iis_unicode = false;
+    param.backslash_to_slash = true;
+    param.plus_to_space = true;
+    param.simplify_path = true;
+    param.uri_char[(uint8_t)'\\'] = CHAR_SUBSTIT;
+}
+
+static std::string normalize(const std::string& uri, const NHttpParaList::UriParam& param,
+    unsigned& events_seen)
+{
+    uint8_t buffer[256];
+    NHttpInfractions infractions;
+    TestEventGen events;
+    Field result;
+    UriNormalizer::normalize(Field(uri.size(), (const uint8_t*)uri.c_str()), result, false,
+        buffer, param, infractions, events);
+    events_seen = events.count;
+    return std::string((const char*)result.start, result.length);
+}
+
+TEST_CASE("uri normalization at every offset", "[nhttp_uri_norm]")
+{
+    NHttpParaList::UriParam param;
+    set_uri_param(param);
+    const char* tokens[] = { "%41", "%%", "%u0041", "%zz", "%", "\\", "+", "%C3%A9", "\xC3\xA9",
+        "\xE9", "%e2%82%ac" };
+
+    for (const char* token : tokens)
+    {
+        unsigned token_events;
+        const std::string token_norm = normalize(token, param, token_events);
+        Field token_field(strlen(token), (const uint8_t*)token);
+        NHttpInfractions token_infractions;
+        TestEventGen token_gen;
+        const bool token_need = UriNormalizer::need_norm(token_field, false, param,
+            token_infractions, token_gen);
+
+        for (unsigned pad = 0; pad < 40; pad++)
+        {
+            const std::string prefix(pad, 'p');
+            const std::string suffix((pad * 7) % 23, 's');
+            const std::string uri = prefix + token + suffix;
+            unsigned uri_events;
+            CHECK(normalize(uri, param, uri_events) == prefix + token_norm + suffix);
+            CHECK(uri_events == token_events);
+
+            Field field(uri.size(), (const uint8_t*)uri.c_str());
+            NHttpInfractions infractions;
+            TestEventGen events;
+            CHECK(UriNormalizer::need_norm(field, false, param, infractions, events) ==
+                token_need);
+
+            const std::string clean = prefix + "x" + suffix;
+            Field clean_field(clean.size(), (const uint8_t*)clean.c_str());
+            CHECK(!UriNormalizer::need_norm(clean_field, false, param, infractions, events));
+        }
+    }
+}
+
+TEST_CASE("uri path need_norm at every offset", "[nhttp_uri_norm]")
+{
+    NHttpParaList::UriParam param;
+    set_uri_param(param);
+
+    for (unsigned pad = 0; pad < 40; pad++)
+    {
+        for (const char* token : { "/./", "/../", "//" })
+        {
+            const std::string uri = "/" + std::string(pad, 'p') + token + "x";
+            Field field(uri.size(), (const uint8_t*)uri.c_str());
+            NHttpInfractions infractions;
+            TestEventGen events;
+            CHECK(UriNormalizer::need_norm(field, true, param, infractions, events));
+        }
+        const std::string clean = "/" + std::string(pad + 1, 'p') + "/x.y";
+        Field clean_field(clean.size(), (const uint8_t*)clean.c_str());
+        NHttpInfractions infractions;
+        TestEventGen events;
+        CHECK(!UriNormalizer::need_norm(clean_field, true, param, infractions, events));
+    }
+}
+#endif
@@ -25,8 +25,6 @@
 
 using namespace std;
 
-#define WILD 0x100
-
 bool HexBook::translate(const char* in, HexVector& out)
 {
     bool hex = false;
@@ -45,9 +43,9 @@ bool HexBook::translate(const char* in, HexVector& out)
         else if ( !hex )
         {
             if ( in[i] == '?' )
-                out.push_back(WILD);
+                out.push_back(MAGIC_WILD);
             else
-                out.push_back(in[i]);
+                out.push_back((uint8_t)in[i]);
         }
         else if ( in[i] != ' ' )
         {
@@ -72,26 +70,6 @@ bool HexBook::translate(const char* in, HexVector& out)
 
 //-------------------------------------------------------------------------
 
-void HexBook::add_spell(
-    const char* key, const char* val, HexVector& hv, unsigned i, MagicPage* p)
-{
-    while ( i < hv.size() )
-    {
-        MagicPage* t = new MagicPage(*this);
-        int c = hv[i];
-
-        if ( c == WILD )
-            p->any = t;
-        else
-            p->next[c] = t;
-
-        p = t;
-        ++i;
-    }
-    p->key = key;
-    p->value = val;
-}
-
 bool HexBook::add_spell(const char* key, const char* val)
 {
     HexVector hv;
@@ -99,31 +77,13 @@ bool HexBook::add_spell(const char* key, const char* val)
     if ( !translate(key, hv) )
         return false;
 
-    unsigned i = 0;
-    MagicPage* p = root;
-
-    while ( i < hv.size() )
-    {
-        int c = hv[i];
-
-        if ( c == WILD && p->any )
-            p = p->any;
-
-        else if ( p->next[c] )
-            p = p->next[c];
-
-        else
-            break;
-
-        ++i;
-    }
-    if ( p->key == key )
-        return false;
-
-    add_spell(key, val, hv, i, p);
-    return true;
+    return MagicBook::add_spell(key, val, hv);
 }
 
+//-------------------------------------------------------------------------
+// trie search, only used if the dfa is too big
+//-------------------------------------------------------------------------
+
 const MagicPage* HexBook::find_spell(
     const uint8_t* s, unsigned n, const MagicPage* p, unsigned i) const
 {
@@ -165,4 +125,3 @@ const char* HexBook::find_spell(
 
     return nullptr;
 }
-
@@ -19,6 +19,24 @@
 
 #include "magic.h"
 
+#include <ctype.h>
+
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <queue>
+
+#ifdef UNIT_TEST
+#include <string.h>
+#include "catch/catch.hpp"
+#endif
+
+using namespace std;
+
+//-------------------------------------------------------------------------
+// books
+//-------------------------------------------------------------------------
+
 MagicPage::MagicPage(const MagicBook& b) : book(b)
 {
     for ( int i = 0; i < 256; ++i )
@@ -36,9 +54,534 @@ MagicPage::~MagicPage()
     delete any;
 }
 
-MagicBook::MagicBook()
-{ root = new MagicPage(*this); }
-
 MagicBook::~MagicBook()
 { delete root; }
 
+// wild and glob elements both take the any page; a later spell with the
+// same pattern as an earlier one replaces it, as it did when the trie was
+// built by add_spell()
+void MagicBook::add_pages()
+{
+    if ( root )
+        return;
+
+    root = new MagicPage(*this);
+
+    if ( text )
+    {
+        // allows skipping leading whitespace only
+        root->next[(int)' '] = root;
+        root->next[(int)'\t'] = root;
+        root->next[(int)'\r'] = root;
+        root->next[(int)'\n'] = root;
+    }
+
+    for ( const auto& sp : spells )
+    {
+        unsigned i = 0;
+        MagicPage* p = root;
+
+        while ( i < sp.hv.size() )
+        {
+            uint16_t c = sp.hv[i];
+
+            if ( c > 0xFF and p->any )
+                p = p->any;
+
+            else if ( c <= 0xFF and p->next[c] )
+                p = p->next[c];
+
+            else
+                break;
+
+            ++i;
+        }
+        while ( i < sp.hv.size() )
+        {
+            MagicPage* t = new MagicPage(*this);
+            uint16_t c = sp.hv[i];
+
+            if ( c > 0xFF )
+                p->any = t;
+            else
+                p->next[c] = t;
+
+            p = t;
+            ++i;
+        }
+        p->key = sp.key;
+        p->value = sp.value;
+    }
+}
+
+bool MagicBook::add_spell(const char* key, const char* val, HexVector& hv)
+{
+    if ( hv.empty() )
+        return false;
+
+    for ( const auto& sp : spells )
+    {
+        if ( sp.key == key )
+            return false;
+    }
+
+    spells.push_back({ key, val, hv });
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// compiler - subset construction over positions in the spells.  a
+// position is (spell << 16) | offset; globs loop on every byte and may
+// also be skipped.  positions that consumed bytes with a glob are flagged
+// so states know if an anchored match in progress can still get deeper.
+//-------------------------------------------------------------------------
+
+#define GLOBBED  0x8000
+#define MAX_OFF  0x7FFF
+
+namespace
+{
+typedef vector<uint32_t> Positions;
+typedef vector<uint16_t> Hits;
+typedef pair<Positions, Hits> StateKey;
+
+struct Spell
+{
+    const HexVector* hv;
+    bool text;
+};
+
+class MagicCompiler
+{
+public:
+    MagicCompiler(const vector<Spell>& s) : spells(s) { }
+
+    StateKey start() const;
+    StateKey step(const Positions&, uint8_t) const;
+
+private:
+    StateKey close(Positions&) const;
+
+private:
+    const vector<Spell>& spells;
+};
+}
+
+static inline bool leading_space(uint8_t b)
+{ return b == ' ' or b == '\t' or b == '\r' or b == '\n'; }
+
+StateKey MagicCompiler::close(Positions& pos) const
+{
+    StateKey key;
+
+    for ( unsigned i = 0; i < pos.size(); ++i )
+    {
+        uint32_t p = pos[i];
+        const HexVector& hv = *spells[p >> 16].hv;
+        unsigned off = p & MAX_OFF;
+
+        if ( off == hv.size() )
+            key.second.push_back(p >> 16);
+
+        else
+        {
+            key.first.push_back(p);
+
+            if ( hv[off] == MAGIC_GLOB )
+                pos.push_back(p + 1);
+        }
+    }
+    sort(key.first.begin(), key.first.end());
+    key.first.erase(unique(key.first.begin(), key.first.end()), key.first.end());
+
+    sort(key.second.begin(), key.second.end());
+    key.second.erase(unique(key.second.begin(), key.second.end()), key.second.end());
+
+    return key;
+}
+
+StateKey MagicCompiler::start() const
+{
+    Positions pos;
+
+    for ( unsigned i = 0; i < spells.size(); ++i )
+        pos.push_back(i << 16);
+
+    return close(pos);
+}
+
+StateKey MagicCompiler::step(const Positions& live, uint8_t b) const
+{
+    Positions pos;
+
+    for ( auto p : live )
+    {
+        const Spell& sp = spells[p >> 16];
+        unsigned off = p & MAX_OFF;
+        uint16_t e = (*sp.hv)[off];
+
+        if ( e == MAGIC_GLOB )
+            pos.push_back(p | GLOBBED);
+
+        else if ( e == MAGIC_WILD or e == (sp.text ? toupper(b) : b) )
+            pos.push_back(p + 1);
+
+        if ( sp.text and !off and leading_space(b) )
+            pos.push_back(p);
+    }
+    return close(pos);
+}
+
+//-------------------------------------------------------------------------
+// dfa
+//-------------------------------------------------------------------------
+
+MagicDfa::MagicDfa()
+{ clear(); }
+
+// no spells: the start state goes dead on any byte
+void MagicDfa::clear()
+{
+    for ( int i = 0; i < 256; ++i )
+        byte_class[i] = 0;
+
+    num_classes = 1;
+    num_states = 2;
+    literal_depth = 0;
+    first_hit = 2;
+
+    trans.assign(num_states * num_classes, 0);
+    extend.assign(num_states, 0);
+    hit_index.clear();
+    hit_rank.clear();
+    hits.clear();
+    values.clear();
+}
+
+// bytes that no literal can tell apart share a class; each literal (or
+// the set of leading spaces) splits the classes it straddles
+void MagicDfa::compile_byte_classes(const MagicBook* const* books, unsigned num_books)
+{
+    vector<bitset<256>> sets;
+    bool text = false;
+
+    for ( unsigned n = 0; n < num_books; ++n )
+    {
+        text = text or books[n]->is_text();
+
+        for ( const auto& sp : books[n]->get_spells() )
+        {
+            for ( auto e : sp.hv )
+            {
+                if ( e > 0xFF )
+                    continue;
+
+                bitset<256> bs;
+
+                for ( int b = 0; b < 256; ++b )
+                {
+                    if ( e == (books[n]->is_text() ? toupper(b) : b) )
+                        bs.set(b);
+                }
+                sets.push_back(bs);
+            }
+        }
+    }
+    if ( text )
+    {
+        bitset<256> bs;
+
+        for ( int b = 0; b < 256; ++b )
+            bs[b] = leading_space(b);
+
+        sets.push_back(bs);
+    }
+
+    unsigned cls[256] = { };
+
+    for ( const auto& bs : sets )
+    {
+        map<pair<unsigned, bool>, unsigned> split;
+
+        for ( int b = 0; b < 256; ++b )
+        {
+            auto r = split.insert({ { cls[b], bs[b] }, (unsigned)split.size() });
+            cls[b] = r.first->second;
+        }
+    }
+
+    num_classes = 0;
+
+    for ( int b = 0; b < 256; ++b )
+    {
+        byte_class[b] = cls[b];
+
+        if ( cls[b] >= num_classes )
+            num_classes = cls[b] + 1;
+    }
+}
+
+bool MagicDfa::compile(const MagicBook* const* books, unsigned num_books, unsigned max_states)
+{
+    vector<Spell> spells;
+    vector<uint8_t> spell_rank;
+    clear();
+
+    for ( unsigned n = 0; n < num_books; ++n )
+    {
+        for ( const auto& sp : books[n]->get_spells() )
+        {
+            spells.push_back({ &sp.hv, books[n]->is_text() });
+            spell_rank.push_back(n);
+            values.push_back(sp.value);
+
+            unsigned len = count_if(sp.hv.begin(), sp.hv.end(),
+                [](uint16_t e) { return e != MAGIC_GLOB; });
+
+            if ( len > literal_depth )
+                literal_depth = len;
+
+            if ( sp.hv.size() > MAX_OFF )
+                return false;
+        }
+    }
+    if ( max_states > 0x10000 )
+        max_states = 0x10000;
+
+    if ( spells.size() > 0x10000 or num_books > 0x100 )
+        return false;
+
+    if ( spells.empty() )
+        return true;
+
+    compile_byte_classes(books, num_books);
+
+    uint8_t rep[256];
+
+    for ( int b = 255; b >= 0; --b )
+        rep[byte_class[b]] = b;
+
+    MagicCompiler mc(spells);
+    map<StateKey, unsigned> ids;
+    vector<const StateKey*> keys;
+    vector<unsigned> tmp;
+
+    auto add = [&](const StateKey& k) -> unsigned
+    {
+        auto r = ids.insert({ k, (unsigned)keys.size() });
+
+        if ( r.second )
+            keys.push_back(&r.first->first);
+
+        return r.first->second;
+    };
+
+    add(StateKey());     // dead
+    add(mc.start());
+
+    for ( unsigned s = 1; s < keys.size(); ++s )
+    {
+        if ( keys.size() > max_states )
+            return false;
+
+        tmp.resize((s + 1) * num_classes, 0);
+
+        for ( unsigned c = 0; c < num_classes; ++c )
+        {
+            StateKey k = mc.step(keys[s]->first, rep[c]);
+
+            if ( k.first.empty() and k.second.empty() )
+                continue;
+
+            tmp[s * num_classes + c] = add(k);
+        }
+    }
+
+    // renumber so the hit states come last
+    num_states = keys.size();
+    vector<unsigned> map_to(num_states);
+    unsigned n = 0;
+
+    for ( unsigned s = 0; s < num_states; ++s )
+    {
+        if ( keys[s]->second.empty() )
+            map_to[s] = n++;
+    }
+    first_hit = n;
+    hit_index.clear();
+    hit_rank.clear();
+    hits.clear();
+
+    for ( unsigned s = 0; s < num_states; ++s )
+    {
+        if ( keys[s]->second.empty() )
+            continue;
+
+        map_to[s] = n++;
+        hit_index.push_back(hits.size());
+        hit_rank.push_back(spell_rank[keys[s]->second.front()]);
+        hits.insert(hits.end(), keys[s]->second.begin(), keys[s]->second.end());
+    }
+    hit_index.push_back(hits.size());
+
+    extend.assign(num_states, 0);
+
+    for ( unsigned s = 0; s < num_states; ++s )
+    {
+        for ( auto p : keys[s]->first )
+        {
+            if ( !(p & GLOBBED) and (p & MAX_OFF) )
+                extend[map_to[s]] = 1;
+        }
+    }
+
+    trans.assign(num_states * num_classes, 0);
+
+    for ( unsigned s = 0; s < num_states; ++s )
+    {
+        for ( unsigned c = 0; c < num_classes; ++c )
+            trans[map_to[s] * num_classes + c] = map_to[tmp[s * num_classes + c]];
+    }
+    return true;
+}
+
+const char* MagicDfa::get_service(uint16_t state) const
+{
+    if ( !is_hit(state) )
+        return nullptr;
+
+    return values[hits[hit_index[state - first_hit]]].c_str();
+}
+
+#ifdef UNIT_TEST
+static const char* cast(const MagicDfa& dfa, const char* s, unsigned len = 0)
+{
+    uint16_t state = MagicDfa::start(), hit = 0;
+    dfa.find(state, hit, (const uint8_t*)s, len ? len : strlen(s));
+    return hit ? dfa.get_service(hit) : nullptr;
+}
+
+static const char* cast(const MagicBook& book, const char* s)
+{
+    const MagicPage* p = book.page1();
+    return book.find_spell((const uint8_t*)s, strlen(s), p);
+}
+
+TEST_CASE("magic dfa globs", "[magic]")
+{
+    SpellBook spells;
+    REQUIRE(spells.add_spell("*SSH", "ssh"));
+    REQUIRE(spells.add_spell("GET * HTTP", "http"));
+
+    const MagicBook* books[] = { &spells };
+    MagicDfa dfa;
+    REQUIRE(dfa.compile(books, 1));
+
+    CHECK(!strcmp(cast(dfa, "SSH-2.0"), "ssh"));
+    CHECK(!strcmp(cast(dfa, "xx SSH-2.0"), "ssh"));
+    CHECK(!strcmp(cast(dfa, "GET /index.html HTTP/1.1"), "http"));
+    CHECK(!strcmp(cast(dfa, "  GET / HTTP/1.1"), "http"));
+    CHECK(!cast(dfa, "GET /index.html"));
+    CHECK(!cast(dfa, "POST / HTTP/1.1"));
+}
+
+TEST_CASE("magic dfa hexes beat spells", "[magic]")
+{
+    HexBook hexes;
+    SpellBook spells;
+
+    REQUIRE(hexes.add_spell("GE", "hex"));
+    REQUIRE(hexes.add_spell("|01|", "one"));
+    REQUIRE(hexes.add_spell("|01 02|", "two"));
+    REQUIRE(spells.add_spell("GET", "spell"));
+    REQUIRE(spells.add_spell("PUT", "put"));
+
+    const MagicBook* books[] = { &hexes, &spells };
+    MagicDfa dfa;
+    REQUIRE(dfa.compile(books, 2));
+
+    // a deeper spell does not replace a hex hit
+    CHECK(!strcmp(cast(dfa, "GET /"), "hex"));
+    CHECK(!strcmp(cast(dfa, "PUT /"), "put"));
+
+    // but a deeper hex does
+    CHECK(!strcmp(cast(dfa, "\x01\x03"), "one"));
+    CHECK(!strcmp(cast(dfa, "\x01\x02"), "two"));
+}
+
+TEST_CASE("magic dfa depth", "[magic]")
+{
+    HexBook hexes;
+    SpellBook spells;
+
+    REQUIRE(hexes.add_spell("??|00 01|?", "hex"));
+    REQUIRE(spells.add_spell("*XYZ", "xyz"));
+    REQUIRE(spells.add_spell("AB*CD", "abcd"));
+
+    const MagicBook* books[] = { &hexes, &spells };
+    MagicDfa dfa;
+    REQUIRE(dfa.compile(books, 2));
+
+    // globs don't count
+    CHECK(dfa.get_literal_depth() == 5);
+
+    const char* data = "0123456789012345678XYZ";
+    CHECK(!strcmp(cast(dfa, data), "xyz"));
+    CHECK(!cast(dfa, data, 16));
+
+    // a glob never goes dead but a mismatched literal does
+    uint16_t state = MagicDfa::start(), hit = 0;
+    CHECK(dfa.find(state, hit, (const uint8_t*)data, 16) == 16);
+    CHECK(state);
+
+    state = MagicDfa::start();
+    HexBook none;
+    const MagicBook* empty[] = { &none };
+    MagicDfa dead;
+    REQUIRE(dead.compile(empty, 1));
+    CHECK(dead.find(state, hit, (const uint8_t*)data, 16) == 1);
+    CHECK(!state);
+}
+
+TEST_CASE("magic dfa case", "[magic]")
+{
+    HexBook hexes;
+    SpellBook spells;
+
+    REQUIRE(hexes.add_spell("RFB", "vnc"));
+    REQUIRE(spells.add_spell("get", "http"));
+
+    const MagicBook* books[] = { &hexes, &spells };
+    MagicDfa dfa;
+    REQUIRE(dfa.compile(books, 2));
+
+    CHECK(!strcmp(cast(dfa, "GeT /"), "http"));
+    CHECK(!strcmp(cast(dfa, "get /"), "http"));
+    CHECK(!strcmp(cast(dfa, "RFB 003"), "vnc"));
+    CHECK(!cast(dfa, "rfb 003"));
+}
+
+TEST_CASE("magic dfa too big", "[magic]")
+{
+    HexBook hexes;
+    SpellBook spells;
+
+    REQUIRE(hexes.add_spell("|05|?|01|", "socks"));
+    REQUIRE(spells.add_spell("*SSH", "ssh"));
+    REQUIRE(spells.add_spell("HELO", "smtp"));
+
+    const MagicBook* books[] = { &hexes, &spells };
+    MagicDfa dfa;
+    CHECK(!dfa.compile(books, 2, 3));
+
+    // the tries give the same answers
+    hexes.add_pages();
+    spells.add_pages();
+
+    CHECK(!strcmp(cast(hexes, "\x05\x07\x01"), "socks"));
+    CHECK(!cast(hexes, "\x05\x07\x02"));
+    CHECK(!strcmp(cast(spells, "ssh-2.0"), "ssh"));
+    CHECK(!strcmp(cast(spells, " helo"), "smtp"));
+    CHECK(!cast(spells, "ehlo"));
+}
+#endif
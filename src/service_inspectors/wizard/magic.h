@@ -17,12 +17,27 @@
 //--------------------------------------------------------------------------
 // magic.h author Russ Combs <rucombs@cisco.com>
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 
 #ifndef MAGIC_H
 #define MAGIC_H
 
+typedef std::vector<uint16_t> HexVector;
+
+// pattern elements other than literal bytes
+#define MAGIC_WILD 0x100  // any one byte
+#define MAGIC_GLOB 0x200  // any number of bytes
+
+struct MagicSpell
+{
+    std::string key;
+    std::string value;
+    HexVector hv;
+};
+
 class MagicBook;
 
 struct MagicPage
@@ -39,9 +54,9 @@ struct MagicPage
     ~MagicPage();
 };
 
-typedef std::vector<uint16_t> HexVector;
-
-// MagicBook is a set of MagicPages implementing a trie
+// MagicBook is the set of patterns for one direction and syntax; books
+// are compiled into a MagicDfa for searching.  if the dfa would be too
+// big the book is searched with a trie of MagicPages instead.
 
 class MagicBook
 {
@@ -49,14 +64,31 @@ public:
     virtual ~MagicBook();
 
     virtual bool add_spell(const char* key, const char* val) = 0;
+
+    const std::vector<MagicSpell>& get_spells() const
+    { return spells; }
+
+    // text books are case insensitive and skip leading whitespace
+    bool is_text() const
+    { return text; }
+
+    // build the trie for find_spell()
+    void add_pages();
+
     virtual const char* find_spell(const uint8_t*, unsigned len, const MagicPage*&) const = 0;
 
-    const MagicPage* page1()
+    const MagicPage* page1() const
     { return root; }
 
 protected:
-    MagicBook();
-    MagicPage* root;
+    MagicBook(bool t) : text(t) { }
+    bool add_spell(const char* key, const char* val, HexVector&);
+
+    MagicPage* root = nullptr;
+
+private:
+    std::vector<MagicSpell> spells;
+    bool text;
 };
 
 //-------------------------------------------------------------------------
@@ -67,15 +99,14 @@ protected:
 class SpellBook : public MagicBook
 {
 public:
-    SpellBook();
+    SpellBook() : MagicBook(true) { }
     ~SpellBook() { }
 
-    bool add_spell(const char*, const char*);
-    const char* find_spell(const uint8_t*, unsigned len, const MagicPage*&) const;
+    bool add_spell(const char*, const char*) override;
+    const char* find_spell(const uint8_t*, unsigned len, const MagicPage*&) const override;
 
 private:
     bool translate(const char*, HexVector&);
-    void add_spell(const char*, const char*, HexVector&, unsigned, MagicPage*);
     const MagicPage* find_spell(const uint8_t*, unsigned, const MagicPage*, unsigned) const;
 };
 
@@ -87,17 +118,88 @@ private:
 class HexBook : public MagicBook
 {
 public:
-    HexBook() { }
+    HexBook() : MagicBook(false) { }
     ~HexBook() { }
 
-    bool add_spell(const char*, const char*);
-    const char* find_spell(const uint8_t*, unsigned len, const MagicPage*&) const;
+    bool add_spell(const char*, const char*) override;
+    const char* find_spell(const uint8_t*, unsigned len, const MagicPage*&) const override;
 
 private:
     bool translate(const char*, HexVector&);
-    void add_spell(const char*, const char*, HexVector&, unsigned, MagicPage*);
     const MagicPage* find_spell(const uint8_t*, unsigned, const MagicPage*, unsigned) const;
 };
 
+//-------------------------------------------------------------------------
+// MagicDfa - all the books for one direction compiled into a single dfa
+// over byte equivalence classes.  state 0 is dead (no possible match),
+// state 1 is the start, and states >= first_hit have at least one match.
+//-------------------------------------------------------------------------
+
+class MagicDfa
+{
+public:
+    MagicDfa();
+
+    // books are given in priority order; returns false if more than
+    // max_states are needed
+    bool compile(const MagicBook* const*, unsigned num_books, unsigned max_states = 0x10000);
+
+    static uint16_t start()
+    { return 1; }
+
+    bool is_hit(uint16_t state) const
+    { return state >= first_hit; }
+
+    // advance state over data until the end, a dead state, or a hit that
+    // can't get deeper; hit is updated with each hit state from the same
+    // or a higher priority book so the deepest match of the best book
+    // wins.  returns bytes used.
+    unsigned find(uint16_t& state, uint16_t& hit, const uint8_t* data, unsigned len) const
+    {
+        unsigned i = 0;
+
+        while ( i < len and state and !settled(state, hit) )
+        {
+            state = trans[state * num_classes + byte_class[data[i++]]];
+
+            if ( state >= first_hit and (!hit or rank(state) <= rank(hit)) )
+                hit = state;
+        }
+        return i;
+    }
+
+    // true if hit can't be improved by scanning past state
+    bool settled(uint16_t state, uint16_t hit) const
+    { return hit and !extend[state]; }
+
+    // highest priority service matched in state
+    const char* get_service(uint16_t state) const;
+
+    // length of the longest pattern not counting globs
+    unsigned get_literal_depth() const
+    { return literal_depth; }
+
+private:
+    void clear();
+    void compile_byte_classes(const MagicBook* const*, unsigned);
+
+    unsigned rank(uint16_t state) const
+    { return hit_rank[state - first_hit]; }
+
+private:
+    uint8_t byte_class[256];
+    unsigned num_classes;
+    unsigned num_states;
+    unsigned literal_depth;
+    uint16_t first_hit;
+
+    std::vector<uint16_t> trans;        // num_states x num_classes
+    std::vector<uint32_t> hit_index;    // per hit state + 1, into hits
+    std::vector<uint8_t> hit_rank;      // per hit state, book of best hit
+    std::vector<uint8_t> extend;        // per state, anchored match in progress
+    std::vector<uint16_t> hits;         // indices into values
+    std::vector<std::string> values;    // service of each spell
+};
+
 #endif
 
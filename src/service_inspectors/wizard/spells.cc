@@ -24,17 +24,6 @@
 
 using namespace std;
 
-#define WILD 0x100
-
-SpellBook::SpellBook()
-{
-    // allows skipping leading whitespace only
-    root->next[(int)' '] = root;
-    root->next[(int)'\t'] = root;
-    root->next[(int)'\r'] = root;
-    root->next[(int)'\n'] = root;
-}
-
 bool SpellBook::translate(const char* in, HexVector& out)
 {
     bool wild = false;
@@ -45,9 +34,9 @@ bool SpellBook::translate(const char* in, HexVector& out)
         if ( wild )
         {
             if ( in[i] != '*' )
-                out.push_back(WILD);
+                out.push_back(MAGIC_GLOB);
 
-            out.push_back(in[i]);
+            out.push_back(toupper((uint8_t)in[i]));
             wild = false;
         }
         else
@@ -55,32 +44,13 @@ bool SpellBook::translate(const char* in, HexVector& out)
             if ( in[i] == '*' )
                 wild = true;
             else
-                out.push_back(in[i]);
+                out.push_back(toupper((uint8_t)in[i]));
         }
         ++i;
     }
     return true;
 }
 
-void SpellBook::add_spell(
-    const char* key, const char* val, HexVector& hv, unsigned i, MagicPage* p)
-{
-    while ( i < hv.size() )
-    {
-        MagicPage* t = new MagicPage(*this);
-
-        if ( hv[i] == WILD )
-            p->any = t;
-        else
-            p->next[toupper(hv[i])] = t;
-
-        p = t;
-        ++i;
-    }
-    p->key = key;
-    p->value = val;
-}
-
 bool SpellBook::add_spell(const char* key, const char* val)
 {
     HexVector hv;
@@ -88,31 +58,13 @@ bool SpellBook::add_spell(const char* key, const char* val)
     if ( !translate(key, hv) )
         return false;
 
-    unsigned i = 0;
-    MagicPage* p = root;
-
-    while ( i < hv.size() )
-    {
-        int c = toupper(hv[i]);
-
-        if ( c == WILD && p->any )
-            p = p->any;
-
-        else if ( p->next[c] )
-            p = p->next[c];
-
-        else
-            break;
-
-        ++i;
-    }
-    if ( p->key == key )
-        return false;
-
-    add_spell(key, val, hv, i, p);
-    return true;
+    return MagicBook::add_spell(key, val, hv);
 }
 
+//-------------------------------------------------------------------------
+// trie search, only used if the dfa is too big
+//-------------------------------------------------------------------------
+
 const MagicPage* SpellBook::find_spell(
     const uint8_t* s, unsigned n, const MagicPage* p, unsigned i) const
 {
@@ -164,4 +116,3 @@ const char* SpellBook::find_spell(
 
     return nullptr;
 }
-
@@ -96,6 +96,9 @@ static const Parameter s_params[] =
     { "spells", Parameter::PT_LIST, wizard_spells_params, nullptr,
       "criteria for text service identification" },
 
+    { "max_search_depth", Parameter::PT_INT, "1:65535", "16",
+      "maximum bytes scanned per flow direction; patterns without wild cards (*) are always scanned in full" },
+
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
@@ -105,6 +108,7 @@ WizardModule::WizardModule() : Module(WIZ_NAME, WIZ_HELP, s_params)
     s2c_hexes = nullptr;
     c2s_spells = nullptr;
     s2c_spells = nullptr;
+    max_search_depth = 16;
 }
 
 WizardModule::~WizardModule()
@@ -137,6 +141,9 @@ bool WizardModule::set(const char*, Value& v, SnortConfig*)
     else if ( v.is("spell") )
         spells.push_back(v.get_string());
 
+    else if ( v.is("max_search_depth") )
+        max_search_depth = v.get_long();
+
     else
         return false;
 
@@ -54,12 +54,16 @@ public:
 
     MagicBook* get_book(bool c2s, bool hex);
 
+    unsigned get_max_search_depth() const
+    { return max_search_depth; }
+
 private:
     void add_spells(MagicBook*, std::string&);
 
 private:
     bool hex;
     bool c2s;
+    unsigned max_search_depth;
 
     std::string service;
     std::vector<std::string> spells;
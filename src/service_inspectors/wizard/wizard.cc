@@ -17,6 +17,7 @@
 //--------------------------------------------------------------------------
 // wizard.cc author Russ Combs <rucombs@cisco.com>
 
+#include <algorithm>
 #include <vector>
 using namespace std;
 
@@ -29,6 +30,7 @@ using namespace std;
 #include "utils/stats.h"
 #include "log/messages.h"
 #include "host_tracker/host_cache.h"
+#include "memory/memory_cap.h"
 
 #include "magic.h"
 #include "wiz_module.h"
@@ -43,6 +45,8 @@ struct WizStats
     PegCount udp_hits;
     PegCount user_scans;
     PegCount user_hits;
+    PegCount hit_bytes;
+    PegCount trie_scans;
 };
 
 const PegInfo wiz_pegs[] =
@@ -53,6 +57,8 @@ const PegInfo wiz_pegs[] =
     { "udp hits", "udp identifications" },
     { "user scans", "user payload scans" },
     { "user hits", "user identifications" },
+    { "hit bytes", "total bytes scanned by identifications (divide by hits for mean depth)" },
+    { "trie scans", "scans done with the slower trie because the dfa was too big" },
     { nullptr, nullptr }
 };
 
@@ -64,10 +70,30 @@ THREAD_LOCAL WizStats tstats;
 
 struct Wand
 {
+    const MagicDfa* dfa;  // null if the books are searched as tries
+    uint16_t state;
+    uint16_t hit;
+    unsigned bytes;
+    unsigned depth;
+
     const MagicPage* hex;
     const MagicPage* spell;
 };
 
+// the compiled dfa for one direction, or the books if it was too big
+struct Magic
+{
+    MagicDfa dfa;
+    MagicBook* hexes = nullptr;
+    MagicBook* spells = nullptr;
+
+    ~Magic()
+    {
+        delete hexes;
+        delete spells;
+    }
+};
+
 class Wizard;
 
 class MagicSplitter : public StreamSplitter
@@ -100,15 +126,16 @@ public:
     StreamSplitter* get_splitter(bool) override;
 
     void reset(Wand&, bool tcp, bool c2s);
-    bool cast_spell(Wand&, Flow*, const uint8_t*, unsigned);
+    bool cast_spell(Wand&, Flow*, const uint8_t*, unsigned, bool last);
+
+private:
     bool spellbind(const MagicPage*&, Flow*, const uint8_t*, unsigned);
+    void bind(Flow*, const char* service);
 
 public:
-    MagicBook* c2s_hexes;
-    MagicBook* s2c_hexes;
-
-    MagicBook* c2s_spells;
-    MagicBook* s2c_spells;
+    Magic c2s_magic;
+    Magic s2c_magic;
+    unsigned max_depth;
 };
 
 //-------------------------------------------------------------------------
@@ -130,14 +157,13 @@ MagicSplitter::~MagicSplitter()
     wizard->rem_ref();
 }
 
-// FIXIT-M stop search on hit and failure (no possible match)
 StreamSplitter::Status MagicSplitter::scan(
     Flow* f, const uint8_t* data, uint32_t len,
     uint32_t, uint32_t*)
 {
     ++tstats.tcp_scans;
 
-    if ( wizard->cast_spell(wand, f, data, len) )
+    if ( wizard->cast_spell(wand, f, data, len, false) )
         ++tstats.tcp_hits;
 
     return SEARCH;
@@ -147,36 +173,52 @@ StreamSplitter::Status MagicSplitter::scan(
 // class stuff
 //-------------------------------------------------------------------------
 
-Wizard::Wizard(WizardModule* m)
+// hexes are searched ahead of spells so they win ties.  if the dfa
+// would be too big the books are kept and searched as tries instead.
+static void compile(Magic& m, MagicBook* hexes, MagicBook* spells, const char* dir)
 {
-    c2s_hexes = m->get_book(true, true);
-    s2c_hexes = m->get_book(false, true);
+    const MagicBook* books[] = { hexes, spells };
+
+    if ( m.dfa.compile(books, 2) )
+    {
+        delete hexes;
+        delete spells;
+        return;
+    }
+    ParseWarning(WARN_CONF, "wizard %s hexes and spells are too complex for a dfa; "
+        "using the slower trie search", dir);
 
-    c2s_spells = m->get_book(true, false);
-    s2c_spells = m->get_book(false, false);
+    hexes->add_pages();
+    spells->add_pages();
+
+    m.hexes = hexes;
+    m.spells = spells;
 }
 
-Wizard::~Wizard()
+Wizard::Wizard(WizardModule* m)
 {
-    delete c2s_hexes;
-    delete s2c_hexes;
-
-    delete c2s_spells;
-    delete s2c_spells;
+    max_depth = m->get_max_search_depth();
+    compile(c2s_magic, m->get_book(true, true), m->get_book(true, false), "to_server");
+    compile(s2c_magic, m->get_book(false, true), m->get_book(false, false), "to_client");
 }
 
+Wizard::~Wizard()
+{ }
+
 void Wizard::reset(Wand& w, bool /*tcp*/, bool c2s)
 {
-    if ( c2s )
-    {
-        w.hex = c2s_hexes->page1();
-        w.spell = c2s_spells->page1();
-    }
-    else
-    {
-        w.hex = s2c_hexes->page1();
-        w.spell = s2c_spells->page1();
-    }
+    const Magic& m = c2s ? c2s_magic : s2c_magic;
+
+    w.dfa = m.hexes ? nullptr : &m.dfa;
+    w.state = MagicDfa::start();
+    w.hit = 0;
+    w.bytes = 0;
+
+    // the bound is for globs and leading space so literals always fit
+    w.depth = max(max_depth, m.dfa.get_literal_depth());
+
+    w.hex = m.hexes ? m.hexes->page1() : nullptr;
+    w.spell = m.spells ? m.spells->page1() : nullptr;
 }
 
 void Wizard::eval(Packet* p)
@@ -190,7 +232,7 @@ void Wizard::eval(Packet* p)
     Wand wand;
     reset(wand, false, p->packet_flags & PKT_FROM_CLIENT);
 
-    if ( cast_spell(wand, p->flow, p->data, p->dsize) )
+    if ( cast_spell(wand, p->flow, p->data, p->dsize, true) )
         ++tstats.udp_hits;
 
     ++tstats.udp_scans;
@@ -201,32 +243,67 @@ StreamSplitter* Wizard::get_splitter(bool c2s)
     return new MagicSplitter(c2s, this);
 }
 
-bool Wizard::spellbind(
-    const MagicPage*& m, Flow* f, const uint8_t* data, unsigned len)
+// the search ends when the best hit can't get deeper, when the data ends
+// on a hit, when no match is possible, at the depth bound, or with the
+// last data
+bool Wizard::cast_spell(
+    Wand& w, Flow* f, const uint8_t* data, unsigned len, bool last)
 {
-    f->service = m->book.find_spell(data, len, m);
-
-    if (f->service != nullptr)
+    if ( !w.dfa )
     {
-        // FIXIT-H: Need to make sure Flow's ipproto and service
-        //          correspond to HostApplicationEntry's ipproto and service
-        host_cache_add_service(f->server_ip, f->ip_proto, f->server_port, f->service);
-        return true;
+        ++tstats.trie_scans;
+
+        if ( w.hex && spellbind(w.hex, f, data, len) )
+            return true;
+
+        if ( w.spell && spellbind(w.spell, f, data, len) )
+            return true;
+
+        return false;
     }
 
-    return false;
+    if ( !w.state )
+        return false;
+
+    if ( len > w.depth - w.bytes )
+        len = w.depth - w.bytes;
+
+    w.bytes += w.dfa->find(w.state, w.hit, data, len);
+
+    if ( !last and w.state and w.bytes < w.depth and !w.dfa->is_hit(w.state) and
+        !w.dfa->settled(w.state, w.hit) )
+        return false;
+
+    w.state = 0;
+
+    if ( !w.hit )
+        return false;
+
+    tstats.hit_bytes += w.bytes;
+    bind(f, w.dfa->get_service(w.hit));
+    return true;
 }
 
-bool Wizard::cast_spell(
-    Wand& w, Flow* f, const uint8_t* data, unsigned len)
+bool Wizard::spellbind(
+    const MagicPage*& m, Flow* f, const uint8_t* data, unsigned len)
 {
-    if ( w.hex && spellbind(w.hex, f, data, len) )
-        return true;
+    const char* service = m->book.find_spell(data, len, m);
+
+    if ( !service )
+        return false;
 
-    if ( w.spell && spellbind(w.spell, f, data, len) )
-        return true;
+    bind(f, service);
+    return true;
+}
+
+void Wizard::bind(Flow* f, const char* service)
+{
+    f->service = service;
 
-    return false;
+    // FIXIT-H: Need to make sure Flow's ipproto and service
+    //          correspond to HostApplicationEntry's ipproto and service
+    memory::BudgetContext budget(memory::BUDGET_CACHE);
+    host_cache_add_service(f->server_ip, f->ip_proto, f->server_port, f->service);
 }
 
 //-------------------------------------------------------------------------
@@ -76,6 +76,8 @@ SideChannel* SideChannelManager::get_side_channel(SCPort port)
 SideChannel::SideChannel()
 {
     DebugMessage(DEBUG_SIDE_CHANNEL,"SideChannel::SideChannel()\n");
+    connector_receive = nullptr;
+    connector_transmit = nullptr;
     sequence = 0;
     default_port = 0;
 }
@@ -113,6 +115,10 @@ void SideChannelManager::instantiate(const SCConnectors* connectors, const PortB
 void SideChannelManager::pre_config_init()
 {
     DebugMessage(DEBUG_SIDE_CHANNEL,"SideChannelManager::pre_config_init()\n");
+
+    for ( auto* scm : s_maps )
+        delete scm;
+
     s_maps.clear();
 }
 
@@ -173,7 +179,15 @@ void SideChannelManager::thread_term()
     // First shutdown the connectors
     ConnectorManager::thread_term();
 
+    if ( !tls_maps )
+        return;
+
+    // the side channels themselves belong to their users
+    for ( auto* map : *tls_maps )
+        delete map;
+
     delete tls_maps;
+    tls_maps = nullptr;
 }
 
 // receive at most max_messages.  Zero indicates unlimited.
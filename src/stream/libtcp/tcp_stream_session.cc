@@ -465,6 +465,7 @@ void TcpStreamSession::start_proxy(void)
 
 void TcpStreamSession::set_memcap(Memcap& mc)
 {
+    mc.set_budget(memory::BUDGET_STREAM);
     tcp_memcap = &mc;
 }
 
@@ -21,6 +21,8 @@
 
 #include "segment_overlap_editor.h"
 
+#include <assert.h>
+
 #include "log/messages.h"
 #include "main/snort_debug.h"
 #include "protocols/packet.h"
@@ -162,6 +164,7 @@ int SegmentOverlapEditor::left_overlap_keep_first(void)
                 unsigned offset = tsd->get_seg_seq() - left->seq;
                 memcpy( ( uint8_t* )tsd->get_pkt()->data, left->payload + offset,
                     tsd->get_seg_len() );
+                assert(!(tsd->get_pkt()->packet_flags & PKT_CKSUM_CURRENT));
                 tsd->get_pkt()->packet_flags |= PKT_MODIFIED;
             }
             tcp_norm_stats[PC_TCP_IPS_DATA][tcp_ips_data]++;
@@ -173,6 +176,7 @@ int SegmentOverlapEditor::left_overlap_keep_first(void)
                 unsigned offset = tsd->get_seg_seq() - left->seq;
                 unsigned length = left->seq + left->payload_size - tsd->get_seg_seq();
                 memcpy( ( uint8_t* )tsd->get_pkt()->data, left->payload + offset, length);
+                assert(!(tsd->get_pkt()->packet_flags & PKT_CKSUM_CURRENT));
                 tsd->get_pkt()->packet_flags |= PKT_MODIFIED;
             }
 
@@ -288,6 +292,7 @@ void SegmentOverlapEditor::right_overlap_truncate_new(void)
         unsigned offset = right->seq - tsd->get_seg_seq();
         unsigned length = tsd->get_seg_seq() + tsd->get_seg_len() - right->seq;
         memcpy( ( uint8_t* )tsd->get_pkt()->data + offset, right->payload, length);
+        assert(!(tsd->get_pkt()->packet_flags & PKT_CKSUM_CURRENT));
         tsd->get_pkt()->packet_flags |= PKT_MODIFIED;
     }
 
@@ -305,6 +310,7 @@ int SegmentOverlapEditor::full_right_overlap_truncate_new(void)
     {
         unsigned offset = right->seq - tsd->get_seg_seq();
         memcpy( ( uint8_t* )tsd->get_pkt()->data + offset, right->payload, right->payload_size);
+        assert(!(tsd->get_pkt()->packet_flags & PKT_CKSUM_CURRENT));
         tsd->get_pkt()->packet_flags |= PKT_MODIFIED;
     }
 
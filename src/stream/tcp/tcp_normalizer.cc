@@ -19,6 +19,8 @@
 // tcp_normalization.cc author davis mcpherson <davmcphe@@cisco.com>
 // Created on: Jul 31, 2015
 
+#include <assert.h>
+
 #include "packet_io/active.h"
 
 #include "tcp_normalizer.h"
@@ -81,6 +83,7 @@ void TcpNormalizer::trim_payload(
     {
         uint16_t fat = tsd.get_seg_len() - max;
         tsd.set_seg_len(max);
+        assert(!(tsd.get_pkt()->packet_flags & PKT_CKSUM_CURRENT));
         tsd.get_pkt()->packet_flags |= (PKT_MODIFIED | PKT_RESIZED);
         tsd.set_end_seq(tsd.get_end_seq() - fat);
     }
@@ -97,6 +100,7 @@ bool TcpNormalizer::strip_tcp_timestamp(
     {
         // set raw option bytes to nops
         memset((void*)opt, (uint32_t)tcp::TcpOptCode::NOP, tcp::TCPOLEN_TIMESTAMP);
+        assert(!(tsd.get_pkt()->packet_flags & PKT_CKSUM_CURRENT));
         tsd.get_pkt()->packet_flags |= PKT_MODIFIED;
         return true;
     }
@@ -161,6 +165,7 @@ void TcpNormalizer::ecn_stripper(Packet* p)
         if (strip_ecn == NORM_MODE_ON)
         {
             ((tcp::TCPHdr*)p->ptrs.tcph)->th_flags &= ~(TH_ECE | TH_CWR);
+            assert(!(p->packet_flags & PKT_CKSUM_CURRENT));
             p->packet_flags |= PKT_MODIFIED;
         }
 
@@ -208,6 +208,8 @@ const PegInfo pc_names[] =
     { "log limit", "events queued but not logged" },
     { "event limit", "events filtered" },
     { "alert limit", "events previously triggered on same PDU" },
+    { "filter expires", "filter tracking entries reused after aging out" },
+    { "filter prunes", "filter tracking entries evicted due to memcap" },
     { nullptr, nullptr }
 };
 
@@ -59,6 +59,8 @@ struct PacketCount
     PegCount log_limit;
     PegCount event_limit;
     PegCount alert_limit;
+    PegCount filter_expires;
+    PegCount filter_prunes;
 };
 
 struct ProcessCount